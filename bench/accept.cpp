@@ -0,0 +1,435 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#if defined(USE_SOCKET_TEMPLATE)
+  #include "net/async/event/dispatchers.cpp"
+#endif
+#include "net/async/event/socket.h"
+#include "net/sync/tcp/socket.h"
+#include "bench/bench.h"
+
+// Connections accepted per second: each client connects, waits for the
+// server to close the connection and connects again. The server closes the
+// connections as soon as they have been accepted (the TIME_WAIT state is
+// kept on the server side, so the clients don't run out of ports).
+// With "--batch <count>", the acceptor uses the batched accept (up to
+// <count> connections per call); otherwise, it accepts one connection per
+// call. The length of the accept queue is sampled every 10 ms.
+
+static const int timeout = 30 * 1000; // Milliseconds.
+
+static const size_t max_batch = 1024;
+
+static const unsigned sample_interval = 10; // Milliseconds.
+
+// In the template build all the sockets handled by a dispatcher have the
+// same type, so the same class is used for the acceptor and the
+// connections.
+class accept_socket : public net::async::event::socket {
+  public:
+    // Constructor.
+    accept_socket()
+      : _M_acceptor(nullptr),
+        _M_next(nullptr),
+        _M_free_sockets(nullptr),
+        _M_batch(nullptr),
+        _M_batch_size(0),
+        _M_accepted(0),
+        _M_wakeups(0)
+    {
+    }
+
+    accept_socket(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher),
+        _M_acceptor(nullptr),
+        _M_next(nullptr),
+        _M_free_sockets(nullptr),
+        _M_batch(nullptr),
+        _M_batch_size(0),
+        _M_accepted(0),
+        _M_wakeups(0)
+    {
+    }
+
+    // Destructor.
+    ~accept_socket()
+    {
+      accept_socket* sock = _M_free_sockets;
+
+      while (sock) {
+        accept_socket* next = sock->_M_next;
+
+        delete sock;
+        sock = next;
+      }
+
+      delete [] _M_batch;
+    }
+
+    // Use the batched accept (up to 'n' connections per call).
+    bool set_batch(size_t n)
+    {
+      if ((_M_batch = new (std::nothrow) accept_socket*[n]) != nullptr) {
+        _M_batch_size = n;
+        return true;
+      }
+
+      return false;
+    }
+
+    // Clear.
+    void clear()
+    {
+      // Connection?
+      if (_M_acceptor) {
+        // Add socket to the free list.
+        _M_next = _M_acceptor->_M_free_sockets;
+        _M_acceptor->_M_free_sockets = this;
+      }
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      return false;
+    }
+
+    // Run.
+    bool run()
+    {
+      // Close the connections as soon as they are reported.
+      return _M_acceptor ? false : run_acceptor();
+    }
+
+    // Get number of accepted connections.
+    uint64_t accepted() const
+    {
+      return _M_accepted;
+    }
+
+    // Get number of times the acceptor has been run.
+    uint64_t wakeups() const
+    {
+      return _M_wakeups;
+    }
+
+  private:
+    accept_socket* _M_acceptor;
+    accept_socket* _M_next;
+
+    accept_socket* _M_free_sockets;
+
+    // Sockets of the batch (batched accept).
+    accept_socket** _M_batch;
+    size_t _M_batch_size;
+
+    uint64_t _M_accepted;
+    uint64_t _M_wakeups;
+
+    // Get a free socket.
+    accept_socket* get_socket()
+    {
+      accept_socket* sock;
+      if (_M_free_sockets) {
+        sock = _M_free_sockets;
+        _M_free_sockets = sock->_M_next;
+      } else if ((sock = new (std::nothrow) accept_socket()) == nullptr) {
+        return nullptr;
+      }
+
+      sock->_M_acceptor = this;
+
+      return sock;
+    }
+
+    // Put socket in the free list.
+    void put_socket(accept_socket* sock)
+    {
+      sock->_M_next = _M_free_sockets;
+      _M_free_sockets = sock;
+    }
+
+    // Run acceptor.
+    bool run_acceptor()
+    {
+      _M_wakeups++;
+
+      if (_M_batch_size > 0) {
+        return run_batch();
+      }
+
+      do {
+        accept_socket* sock;
+        if ((sock = get_socket()) == nullptr) {
+          return false;
+        }
+
+        if (!accept(*sock)) {
+          put_socket(sock);
+          return !error();
+        }
+
+        _M_accepted++;
+      } while (true);
+    }
+
+    // Run acceptor (batched accept).
+    bool run_batch()
+    {
+      // If the batch is full, readable() returns false and the acceptor is
+      // run again in the next loop iteration.
+      while (readable()) {
+        size_t n;
+        for (n = 0; n < _M_batch_size; n++) {
+          if ((_M_batch[n] = get_socket()) == nullptr) {
+            break;
+          }
+        }
+
+        if (n == 0) {
+          return false;
+        }
+
+        size_t accepted = accept(_M_batch, n);
+
+        _M_accepted += accepted;
+
+        // Put back the sockets which haven't been used.
+        for (size_t i = accepted; i < n; i++) {
+          put_socket(_M_batch[i]);
+        }
+
+        if (error()) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+};
+
+struct client {
+  pthread_t thread;
+
+  const net::socket::address* addr;
+  uint64_t deadline;
+
+  bench::histogram connection_time; // Nanoseconds.
+  bool failed;
+};
+
+static void* run_client(void* arg);
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  const char* address = "127.0.0.1:8888";
+  size_t nconnections = 4;
+  size_t ndispatchers = 1;
+  size_t batch = 0;
+  unsigned duration = 5;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--address") == 0) {
+      address = argv[++i];
+    } else if (strcasecmp(argv[i], "--connections") == 0) {
+      nconnections = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--dispatchers") == 0) {
+      ndispatchers = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--batch") == 0) {
+      batch = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if ((nconnections == 0) ||
+      (ndispatchers == 0) ||
+      (batch > max_batch) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Build socket address.
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  // Start dispatchers.
+  net::async::event::dispatchers dispatchers;
+#if defined(USE_SOCKET_TEMPLATE)
+  if (!dispatchers.start<accept_socket>(ndispatchers)) {
+#else
+  if (!dispatchers.start(ndispatchers)) {
+#endif
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  // Create one acceptor per dispatcher (listening on the same port).
+  accept_socket** acceptors;
+  if ((acceptors = new (std::nothrow) accept_socket*[ndispatchers]) ==
+      nullptr) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    if (((acceptors[i] = new (std::nothrow)
+                         accept_socket(dispatchers.get(i))) == nullptr) ||
+        ((batch > 0) && (!acceptors[i]->set_batch(batch))) ||
+        (!acceptors[i]->listen(addr))) {
+      fprintf(stderr, "Error listening on '%s'.\n", address);
+      return -1;
+    }
+  }
+
+  client* clients;
+  if ((clients = new (std::nothrow) client[nconnections]) == nullptr) {
+    return -1;
+  }
+
+  uint64_t start = bench::now();
+
+  size_t nclients;
+  for (nclients = 0; nclients < nconnections; nclients++) {
+    client* c = &clients[nclients];
+
+    c->addr = &addr;
+    c->deadline = start + (duration * 1000000000ull);
+    c->failed = false;
+
+    if (pthread_create(&c->thread, nullptr, run_client, c) != 0) {
+      break;
+    }
+  }
+
+  // Sample the length of the accept queues.
+  uint64_t deadline = start + (duration * 1000000000ull);
+  uint64_t nsamples = 0;
+  uint64_t queued = 0;
+  size_t max_queued = 0;
+  size_t backlog = 0;
+
+  while (bench::now() < deadline) {
+    usleep(sample_interval * 1000);
+
+    for (size_t i = 0; i < ndispatchers; i++) {
+      size_t length;
+      if (acceptors[i]->get_accept_queue(length, backlog)) {
+        queued += length;
+        nsamples++;
+
+        if (length > max_queued) {
+          max_queued = length;
+        }
+      }
+    }
+  }
+
+  bench::histogram connection_time;
+  bool failed = (nclients != nconnections);
+
+  for (size_t i = 0; i < nclients; i++) {
+    pthread_join(clients[i].thread, nullptr);
+
+    connection_time.add(clients[i].connection_time);
+    failed |= clients[i].failed;
+  }
+
+  double seconds = (bench::now() - start) / 1000000000.0;
+
+  dispatchers.stop();
+
+  uint64_t accepted = 0;
+  uint64_t wakeups = 0;
+  for (size_t i = 0; i < ndispatchers; i++) {
+    accepted += acceptors[i]->accepted();
+    wakeups += acceptors[i]->wakeups();
+    delete acceptors[i];
+  }
+
+  delete [] acceptors;
+  delete [] clients;
+
+  if (failed) {
+    fprintf(stderr, "Error running clients.\n");
+    return -1;
+  }
+
+  bench::begin_result("accept");
+
+  printf(" connections=%zu dispatchers=%zu batch=%zu accepted=%llu "
+         "seconds=%.3f accepts_per_sec=%.0f accepts_per_wakeup=%.2f "
+         "queue_avg=%.2f queue_max=%zu backlog=%zu conn_p50_us=%.2f "
+         "conn_p99_us=%.2f conn_max_us=%.2f",
+         nconnections,
+         ndispatchers,
+         batch,
+         static_cast<unsigned long long>(accepted),
+         seconds,
+         accepted / seconds,
+         (wakeups > 0) ? static_cast<double>(accepted) / wakeups : 0.0,
+         (nsamples > 0) ? static_cast<double>(queued) / nsamples : 0.0,
+         max_queued,
+         backlog,
+         connection_time.percentile(50.0) / 1000.0,
+         connection_time.percentile(99.0) / 1000.0,
+         connection_time.max() / 1000.0);
+
+  bench::end_result();
+
+  return 0;
+}
+
+void* run_client(void* arg)
+{
+  client* c = static_cast<client*>(arg);
+
+  do {
+    uint64_t start = bench::now();
+
+    net::sync::tcp::socket sock;
+    if (!sock.connect(*c->addr, timeout)) {
+      c->failed = true;
+      break;
+    }
+
+    // Wait for the server to close the connection.
+    uint8_t buf[64];
+    if (sock.recv(buf, sizeof(buf), timeout) != 0) {
+      c->failed = true;
+      break;
+    }
+
+    sock.close();
+
+    c->connection_time.record(bench::now() - start);
+  } while (bench::now() < c->deadline);
+
+  return nullptr;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--address <address>] [--connections <count>] "
+          "[--dispatchers <count>] [--batch <count>] "
+          "[--duration <seconds>]\n",
+          program);
+}
@@ -0,0 +1,389 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+  #include <sys/syscall.h>
+  #include <linux/perf_event.h>
+#endif
+#include "net/async/event/dispatchers.h"
+
+// Helpers shared by the benchmarks.
+// Results are printed as a single line of space-separated key=value pairs,
+// starting with "benchmark=<name> build=<virtual|template>", so that they
+// can be collected and compared across runs.
+
+namespace bench {
+#if defined(USE_SOCKET_TEMPLATE)
+  static const char* const build = "template";
+#else
+  static const char* const build = "virtual";
+#endif
+
+  // Get monotonic time (nanoseconds).
+  static inline uint64_t now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000000000ull) + ts.tv_nsec;
+  }
+
+  // Print the beginning of a result line.
+  static inline void begin_result(const char* benchmark)
+  {
+    printf("benchmark=%s build=%s", benchmark, build);
+  }
+
+  // Print the end of a result line.
+  static inline void end_result()
+  {
+    printf("\n");
+    fflush(stdout);
+  }
+
+  // Parse a list of CPUs ("0,2,4-7").
+  // Returns the number of CPUs or 0 if the list is not valid.
+  static inline size_t parse_cpus(const char* s, int* cpus, size_t max)
+  {
+    size_t n = 0;
+
+    do {
+      char* end;
+      long first = strtol(s, &end, 10);
+      if ((end == s) || (first < 0)) {
+        return 0;
+      }
+
+      long last = first;
+      if (*end == '-') {
+        s = end + 1;
+        last = strtol(s, &end, 10);
+        if ((end == s) || (last < first)) {
+          return 0;
+        }
+      }
+
+      for (long cpu = first; cpu <= last; cpu++) {
+        if (n == max) {
+          return 0;
+        }
+
+        cpus[n++] = static_cast<int>(cpu);
+      }
+
+      if (*end == 0) {
+        return n;
+      } else if (*end != ',') {
+        return 0;
+      }
+
+      s = end + 1;
+    } while (true);
+  }
+
+  // Print the metrics of the dispatchers (one result line per dispatcher).
+  static inline void print_metrics(const char* benchmark,
+                                   net::async::event::dispatchers& dispatchers,
+                                   size_t ndispatchers)
+  {
+    typedef net::async::event::metrics metrics;
+
+    for (size_t i = 0; i < ndispatchers; i++) {
+      metrics m;
+      dispatchers.get(i)->get_metrics(m);
+
+      uint64_t total = m.wait_time + m.busy_time;
+
+      begin_result(benchmark);
+
+      printf(" dispatcher=%zu iterations=%llu events=%llu "
+             "events_per_wait=%.2f max_events=%llu full_waits=%llu "
+             "event_capacity=%llu callbacks=%llu requeued=%llu "
+             "shared=%llu modified=%llu accepted=%llu timeouts=%llu "
+             "timers=%llu errors=%llu handoffs=%llu migrated=%llu "
+             "sockets=%llu "
+             "busy_pct=%.2f",
+             i,
+             static_cast<unsigned long long>(m.iterations),
+             static_cast<unsigned long long>(m.events),
+             (m.iterations > 0) ? static_cast<double>(m.events) /
+                                  m.iterations :
+                                  0.0,
+             static_cast<unsigned long long>(m.max_events),
+             static_cast<unsigned long long>(m.full_waits),
+             static_cast<unsigned long long>(m.event_capacity),
+             static_cast<unsigned long long>(m.callbacks),
+             static_cast<unsigned long long>(m.requeued),
+             static_cast<unsigned long long>(m.shared),
+             static_cast<unsigned long long>(m.modified),
+             static_cast<unsigned long long>(m.accepted),
+             static_cast<unsigned long long>(m.timeouts),
+             static_cast<unsigned long long>(m.timers),
+             static_cast<unsigned long long>(m.errors),
+             static_cast<unsigned long long>(m.handoffs),
+             static_cast<unsigned long long>(m.migrated),
+             static_cast<unsigned long long>(m.sockets),
+             (total > 0) ? (100.0 * m.busy_time) / total : 0.0);
+
+      // Callback latency histogram (if enabled).
+      for (unsigned j = 0; j < metrics::latency_buckets; j++) {
+        if (m.callback_latency[j] > 0) {
+          printf(" run_lt_%lluns=%llu",
+                 1ull << (metrics::min_shift + j),
+                 static_cast<unsigned long long>(m.callback_latency[j]));
+        }
+      }
+
+      end_result();
+    }
+  }
+
+  // Hardware cache misses of the process in user space (Linux,
+  // perf_event_open()), including the threads created after open() (e.g.
+  // the dispatchers'), so that the misses of the event loop are not
+  // drowned by the ones of the kernel. Not available in most virtual
+  // machines and containers.
+  class cache_misses {
+    public:
+      // Constructor.
+      cache_misses();
+
+      // Destructor.
+      ~cache_misses();
+
+      // Open counter.
+      bool open();
+
+      // Read counter.
+      bool read(uint64_t& misses) const;
+
+    private:
+      int _M_fd;
+  };
+
+  inline cache_misses::cache_misses()
+    : _M_fd(-1)
+  {
+  }
+
+  inline cache_misses::~cache_misses()
+  {
+    if (_M_fd != -1) {
+      close(_M_fd);
+    }
+  }
+
+  inline bool cache_misses::open()
+  {
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(struct perf_event_attr));
+
+    attr.size = sizeof(struct perf_event_attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+
+    _M_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+    return (_M_fd != -1);
+#else
+    return false;
+#endif
+  }
+
+  inline bool cache_misses::read(uint64_t& misses) const
+  {
+    return ((_M_fd != -1) &&
+            (::read(_M_fd, &misses, sizeof(uint64_t)) ==
+             static_cast<ssize_t>(sizeof(uint64_t))));
+  }
+
+  // Histogram of values (HdrHistogram-like, log-linear buckets).
+  // Values are recorded with a relative error below 1/64 (~1.6%) and
+  // recording doesn't allocate memory.
+  class histogram {
+    public:
+      // Constructor.
+      histogram();
+
+      // Clear.
+      void clear();
+
+      // Record value.
+      void record(uint64_t value);
+
+      // Add the values of another histogram.
+      void add(const histogram& other);
+
+      // Get number of values.
+      uint64_t count() const;
+
+      // Get minimum value.
+      uint64_t min() const;
+
+      // Get maximum value.
+      uint64_t max() const;
+
+      // Get mean.
+      double mean() const;
+
+      // Get percentile (0.0 - 100.0).
+      uint64_t percentile(double p) const;
+
+    private:
+      // Values below 'linear' are recorded exactly, the others are
+      // recorded in 'sub_buckets' buckets per power of two.
+      static const unsigned sub_bucket_bits = 6;
+      static const unsigned sub_buckets = 1u << sub_bucket_bits;
+      static const unsigned linear = 2 * sub_buckets;
+      static const unsigned size = linear + (64 - sub_bucket_bits - 1) *
+                                            sub_buckets;
+
+      uint64_t _M_counts[size];
+
+      uint64_t _M_count;
+      uint64_t _M_min;
+      uint64_t _M_max;
+      double _M_sum;
+
+      // Get index of the bucket of a value.
+      static unsigned index(uint64_t value);
+
+      // Get highest value of a bucket.
+      static uint64_t highest(unsigned idx);
+  };
+
+  inline histogram::histogram()
+  {
+    clear();
+  }
+
+  inline void histogram::clear()
+  {
+    memset(_M_counts, 0, sizeof(_M_counts));
+
+    _M_count = 0;
+    _M_min = UINT64_MAX;
+    _M_max = 0;
+    _M_sum = 0.0;
+  }
+
+  inline void histogram::record(uint64_t value)
+  {
+    _M_counts[index(value)]++;
+
+    _M_count++;
+
+    if (value < _M_min) {
+      _M_min = value;
+    }
+
+    if (value > _M_max) {
+      _M_max = value;
+    }
+
+    _M_sum += value;
+  }
+
+  inline void histogram::add(const histogram& other)
+  {
+    for (unsigned i = 0; i < size; i++) {
+      _M_counts[i] += other._M_counts[i];
+    }
+
+    _M_count += other._M_count;
+
+    if (other._M_min < _M_min) {
+      _M_min = other._M_min;
+    }
+
+    if (other._M_max > _M_max) {
+      _M_max = other._M_max;
+    }
+
+    _M_sum += other._M_sum;
+  }
+
+  inline uint64_t histogram::count() const
+  {
+    return _M_count;
+  }
+
+  inline uint64_t histogram::min() const
+  {
+    return (_M_count > 0) ? _M_min : 0;
+  }
+
+  inline uint64_t histogram::max() const
+  {
+    return _M_max;
+  }
+
+  inline double histogram::mean() const
+  {
+    return (_M_count > 0) ? _M_sum / _M_count : 0.0;
+  }
+
+  inline uint64_t histogram::percentile(double p) const
+  {
+    if (_M_count == 0) {
+      return 0;
+    }
+
+    // Number of values at or below the percentile.
+    uint64_t n = static_cast<uint64_t>((p / 100.0) * _M_count + 0.5);
+    if (n == 0) {
+      n = 1;
+    } else if (n > _M_count) {
+      n = _M_count;
+    }
+
+    uint64_t total = 0;
+    for (unsigned i = 0; i < size; i++) {
+      if ((total += _M_counts[i]) >= n) {
+        uint64_t value = highest(i);
+        return (value < _M_max) ? value : _M_max;
+      }
+    }
+
+    return _M_max;
+  }
+
+  inline unsigned histogram::index(uint64_t value)
+  {
+    if (value < linear) {
+      return static_cast<unsigned>(value);
+    }
+
+    // Position of the most significant bit (>= sub_bucket_bits + 1).
+    unsigned msb = 63 - __builtin_clzll(value);
+    unsigned shift = msb - sub_bucket_bits;
+
+    return linear +
+           ((shift - 1) * sub_buckets) +
+           static_cast<unsigned>((value >> shift) - sub_buckets);
+  }
+
+  inline uint64_t histogram::highest(unsigned idx)
+  {
+    if (idx < linear) {
+      return idx;
+    }
+
+    unsigned shift = ((idx - linear) / sub_buckets) + 1;
+    uint64_t sub = ((idx - linear) % sub_buckets) + sub_buckets;
+
+    return ((sub + 1) << shift) - 1;
+  }
+}
+
+#endif // BENCH_BENCH_H
@@ -0,0 +1,326 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#include "net/async/event/socket.h"
+#include "net/sync/tcp/socket.h"
+#include "bench/bench.h"
+
+// Small-message throughput with and without write coalescing.
+// The server answers each pipelined request "PING\r\n" with a separate
+// send() of "+PONG\r\n" (as a naive Redis-like server would do).
+
+static const char request[] = "PING\r\n";
+static const size_t requestlen = sizeof(request) - 1;
+
+static const char reply[] = "+PONG\r\n";
+static const size_t replylen = sizeof(reply) - 1;
+
+static const int timeout = 30 * 1000; // Milliseconds.
+
+namespace server {
+  class socket : public net::async::event::socket {
+    public:
+      // Constructor.
+      socket()
+        : _M_off(0),
+          _M_replies(0),
+          _M_replyoff(0)
+      {
+      }
+
+      // Clear.
+      void clear()
+      {
+        delete this;
+      }
+
+      // Run.
+      bool run()
+      {
+        do {
+          // Send pending replies.
+          while (_M_replies > 0) {
+            size_t left = replylen - _M_replyoff;
+
+            ssize_t ret;
+            if ((ret = send(reply + _M_replyoff, left)) ==
+                static_cast<ssize_t>(left)) {
+              _M_replyoff = 0;
+              _M_replies--;
+            } else if (ret > 0) {
+              _M_replyoff += ret;
+              return true;
+            } else {
+              return !error();
+            }
+          }
+
+          if (!readable()) {
+            return true;
+          }
+
+          // Receive requests.
+          ssize_t ret;
+          if ((ret = recv(_M_buf + _M_off, sizeof(_M_buf) - _M_off)) > 0) {
+            _M_off += ret;
+
+            size_t nrequests = _M_off / requestlen;
+
+            _M_replies += nrequests;
+
+            _M_off -= (nrequests * requestlen);
+            memmove(_M_buf, _M_buf + (nrequests * requestlen), _M_off);
+          } else if (ret == 0) {
+            // Connection closed by peer.
+            return false;
+          } else {
+            return !error();
+          }
+        } while (true);
+      }
+
+    private:
+      uint8_t _M_buf[4 * 1024];
+      size_t _M_off;
+
+      size_t _M_replies;
+      size_t _M_replyoff;
+  };
+
+  class acceptor : public net::async::event::socket {
+    public:
+      // Constructor.
+      acceptor(net::async::event::dispatcher* dispatcher, bool coalesce)
+        : net::async::event::socket(dispatcher),
+          _M_coalesce(coalesce)
+      {
+      }
+
+      // Run.
+      bool run()
+      {
+        do {
+          server::socket* sock;
+          if ((sock = new (std::nothrow) server::socket()) == nullptr) {
+            return false;
+          }
+
+          if (!accept(*sock)) {
+            delete sock;
+            return !error();
+          }
+
+          if (_M_coalesce) {
+            sock->enable_write_coalescing();
+          } else {
+            net::internal::socket::set_tcp_no_delay(sock->handle(), true);
+          }
+        } while (true);
+      }
+
+    private:
+      bool _M_coalesce;
+  };
+}
+
+struct client {
+  pthread_t thread;
+
+  const net::socket::address* addr;
+  size_t pipeline;
+  uint64_t deadline;
+
+  uint64_t messages;
+  bool failed;
+};
+
+static void* run_client(void* arg);
+static bool run(const net::socket::address& addr,
+                bool coalesce,
+                size_t nconnections,
+                size_t pipeline,
+                unsigned duration);
+
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  const char* address = "127.0.0.1:8888";
+  size_t nconnections = 4;
+  size_t pipeline = 32;
+  unsigned duration = 5;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--address") == 0) {
+      address = argv[++i];
+    } else if (strcasecmp(argv[i], "--connections") == 0) {
+      nconnections = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--pipeline") == 0) {
+      pipeline = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  static const size_t bufsize =
+    net::async::event::socket::default_write_buffer_size;
+
+  if ((nconnections == 0) ||
+      (pipeline == 0) ||
+      (pipeline * replylen > bufsize) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Build socket address.
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  return ((run(addr, false, nconnections, pipeline, duration)) &&
+          (run(addr, true, nconnections, pipeline, duration))) ? 0 : -1;
+}
+
+void* run_client(void* arg)
+{
+  client* c = static_cast<client*>(arg);
+
+  uint8_t requests[net::async::event::socket::default_write_buffer_size];
+  uint8_t replies[net::async::event::socket::default_write_buffer_size];
+
+  for (size_t i = 0; i < c->pipeline; i++) {
+    memcpy(requests + (i * requestlen), request, requestlen);
+  }
+
+  net::sync::tcp::socket sock;
+  if (sock.connect(*c->addr, timeout)) {
+    net::internal::socket::set_tcp_no_delay(sock.handle(), true);
+
+    do {
+      // Send requests.
+      if (!sock.send(requests, c->pipeline * requestlen, timeout)) {
+        c->failed = true;
+        return nullptr;
+      }
+
+      // Receive replies.
+      size_t left = c->pipeline * replylen;
+      while (left > 0) {
+        ssize_t ret;
+        if ((ret = sock.recv(replies, left, timeout)) <= 0) {
+          c->failed = true;
+          return nullptr;
+        }
+
+        left -= ret;
+      }
+
+      c->messages += c->pipeline;
+    } while (bench::now() < c->deadline);
+  } else {
+    c->failed = true;
+  }
+
+  return nullptr;
+}
+
+bool run(const net::socket::address& addr,
+         bool coalesce,
+         size_t nconnections,
+         size_t pipeline,
+         unsigned duration)
+{
+  // Start dispatcher.
+  net::async::event::dispatchers dispatchers;
+  if (!dispatchers.start(1)) {
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return false;
+  }
+
+  server::acceptor acceptor(dispatchers.get(0), coalesce);
+  if (!acceptor.listen(addr)) {
+    fprintf(stderr, "Error listening.\n");
+    return false;
+  }
+
+  client* clients;
+  if ((clients = new (std::nothrow) client[nconnections]) == nullptr) {
+    return false;
+  }
+
+  uint64_t start = bench::now();
+
+  size_t nclients;
+  for (nclients = 0; nclients < nconnections; nclients++) {
+    client* c = &clients[nclients];
+
+    c->addr = &addr;
+    c->pipeline = pipeline;
+    c->deadline = start + (duration * 1000000000ull);
+    c->messages = 0;
+    c->failed = false;
+
+    if (pthread_create(&c->thread, nullptr, run_client, c) != 0) {
+      break;
+    }
+  }
+
+  uint64_t messages = 0;
+  bool failed = (nclients != nconnections);
+
+  for (size_t i = 0; i < nclients; i++) {
+    pthread_join(clients[i].thread, nullptr);
+
+    messages += clients[i].messages;
+    failed |= clients[i].failed;
+  }
+
+  double seconds = (bench::now() - start) / 1000000000.0;
+
+  delete [] clients;
+
+  dispatchers.stop();
+
+  if (failed) {
+    fprintf(stderr, "Error running clients.\n");
+    return false;
+  }
+
+  bench::begin_result("coalesce");
+
+  printf(" coalescing=%s connections=%zu pipeline=%zu messages=%llu "
+         "seconds=%.3f msgs_per_sec=%.0f",
+         coalesce ? "on" : "off",
+         nconnections,
+         pipeline,
+         static_cast<unsigned long long>(messages),
+         seconds,
+         messages / seconds);
+
+  bench::end_result();
+
+  return true;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--address <address>] [--connections <count>] "
+          "[--pipeline <count>] [--duration <seconds>]\n",
+          program);
+}
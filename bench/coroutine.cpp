@@ -0,0 +1,303 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#if defined(USE_SOCKET_TEMPLATE)
+  #include "net/async/event/dispatchers.cpp"
+#endif
+#include "net/async/event/coroutine.h"
+#include "net/sync/tcp/socket.h"
+#include "bench/bench.h"
+
+// Echo round-trip latency with a server written with coroutines: same
+// clients as the echo benchmark, but each connection of the server is
+// handled by a coroutine awaiting recv() and send() instead of a state
+// machine in run(). Comparing both results shows the overhead of the
+// coroutines.
+
+typedef net::async::event::coroutine_socket coroutine_socket;
+typedef net::async::event::task task;
+
+static const int timeout = 30 * 1000; // Milliseconds.
+
+static const size_t max_payload = 64 * 1024;
+
+// Echo the data received.
+static task serve(coroutine_socket& sock)
+{
+  uint8_t buf[max_payload];
+
+  ssize_t ret;
+  while ((ret = co_await sock.recv(buf, sizeof(buf))) > 0) {
+    if (co_await sock.send(buf, ret) < 0) {
+      break;
+    }
+  }
+}
+
+// Accept connections and spawn a coroutine for each of them.
+static task accept_connections(coroutine_socket& acceptor)
+{
+  do {
+    coroutine_socket* sock;
+    if ((sock = new (std::nothrow) coroutine_socket()) == nullptr) {
+      co_return;
+    }
+
+    if (!co_await acceptor.accept(*sock)) {
+      delete sock;
+      co_return;
+    }
+
+    net::internal::socket::set_tcp_no_delay(sock->handle(), true);
+
+    // The socket is deleted when the connection is closed.
+    if (!sock->spawn(serve(*sock), true)) {
+      co_return;
+    }
+  } while (true);
+}
+
+struct client {
+  pthread_t thread;
+
+  const net::socket::address* addr;
+  size_t payload;
+  uint64_t deadline;
+
+  bench::histogram rtt; // Nanoseconds.
+  bool failed;
+};
+
+static void* run_client(void* arg);
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  const char* address = "127.0.0.1:8888";
+  size_t nconnections = 1;
+  size_t ndispatchers = 1;
+  size_t payload = 64;
+  unsigned duration = 5;
+  bool print_metrics = false;
+  net::async::event::dispatchers::config config;
+  config.name = "coroutine";
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--address") == 0) {
+      address = argv[++i];
+    } else if (strcasecmp(argv[i], "--connections") == 0) {
+      nconnections = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--dispatchers") == 0) {
+      ndispatchers = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--payload") == 0) {
+      payload = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--metrics") == 0) {
+      print_metrics = (strcasecmp(argv[++i], "on") == 0);
+    } else if (strcasecmp(argv[i], "--read-budget") == 0) {
+      config.read_budget = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if ((nconnections == 0) ||
+      (ndispatchers == 0) ||
+      (payload == 0) ||
+      (payload > max_payload) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Build socket address.
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  // Start dispatchers.
+  net::async::event::dispatchers dispatchers;
+#if defined(USE_SOCKET_TEMPLATE)
+  if (!dispatchers.start<coroutine_socket>(ndispatchers, config)) {
+#else
+  if (!dispatchers.start(ndispatchers, config)) {
+#endif
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  if (print_metrics) {
+    for (size_t i = 0; i < ndispatchers; i++) {
+      dispatchers.get(i)->enable_callback_latency(true);
+    }
+  }
+
+  // Create one acceptor per dispatcher (listening on the same port). The
+  // coroutine is spawned before listening, so that it is started when the
+  // first connection arrives.
+  coroutine_socket** acceptors;
+  if ((acceptors = new (std::nothrow) coroutine_socket*[ndispatchers]) ==
+      nullptr) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    if (((acceptors[i] = new (std::nothrow)
+                         coroutine_socket(dispatchers.get(i))) == nullptr) ||
+        (!acceptors[i]->spawn(accept_connections(*acceptors[i]))) ||
+        (!acceptors[i]->listen(addr))) {
+      fprintf(stderr, "Error listening on '%s'.\n", address);
+      return -1;
+    }
+  }
+
+  client* clients;
+  if ((clients = new (std::nothrow) client[nconnections]) == nullptr) {
+    return -1;
+  }
+
+  uint64_t start = bench::now();
+
+  size_t nclients;
+  for (nclients = 0; nclients < nconnections; nclients++) {
+    client* c = &clients[nclients];
+
+    c->addr = &addr;
+    c->payload = payload;
+    c->deadline = start + (duration * 1000000000ull);
+    c->failed = false;
+
+    if (pthread_create(&c->thread, nullptr, run_client, c) != 0) {
+      break;
+    }
+  }
+
+  bench::histogram rtt;
+  bool failed = (nclients != nconnections);
+
+  for (size_t i = 0; i < nclients; i++) {
+    pthread_join(clients[i].thread, nullptr);
+
+    rtt.add(clients[i].rtt);
+    failed |= clients[i].failed;
+  }
+
+  double seconds = (bench::now() - start) / 1000000000.0;
+
+  dispatchers.stop();
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    delete acceptors[i];
+  }
+
+  delete [] acceptors;
+  delete [] clients;
+
+  if (failed) {
+    fprintf(stderr, "Error running clients.\n");
+    return -1;
+  }
+
+  bench::begin_result("coroutine");
+
+  printf(" connections=%zu dispatchers=%zu payload=%zu messages=%llu "
+         "seconds=%.3f msgs_per_sec=%.0f rtt_min_us=%.2f "
+         "rtt_mean_us=%.2f rtt_p50_us=%.2f rtt_p90_us=%.2f "
+         "rtt_p99_us=%.2f rtt_p999_us=%.2f rtt_max_us=%.2f",
+         nconnections,
+         ndispatchers,
+         payload,
+         static_cast<unsigned long long>(rtt.count()),
+         seconds,
+         rtt.count() / seconds,
+         rtt.min() / 1000.0,
+         rtt.mean() / 1000.0,
+         rtt.percentile(50.0) / 1000.0,
+         rtt.percentile(90.0) / 1000.0,
+         rtt.percentile(99.0) / 1000.0,
+         rtt.percentile(99.9) / 1000.0,
+         rtt.max() / 1000.0);
+
+  bench::end_result();
+
+  if (print_metrics) {
+    bench::print_metrics("coroutine_dispatcher", dispatchers, ndispatchers);
+  }
+
+  return 0;
+}
+
+void* run_client(void* arg)
+{
+  client* c = static_cast<client*>(arg);
+
+  uint8_t* buf;
+  if ((buf = static_cast<uint8_t*>(malloc(c->payload))) == nullptr) {
+    c->failed = true;
+    return nullptr;
+  }
+
+  memset(buf, 'x', c->payload);
+
+  net::sync::tcp::socket sock;
+  if (sock.connect(*c->addr, timeout)) {
+    net::internal::socket::set_tcp_no_delay(sock.handle(), true);
+
+    do {
+      uint64_t start = bench::now();
+
+      // Send message.
+      if (!sock.send(buf, c->payload, timeout)) {
+        c->failed = true;
+        break;
+      }
+
+      // Receive echo.
+      size_t left = c->payload;
+      while (left > 0) {
+        ssize_t ret;
+        if ((ret = sock.recv(buf, left, timeout)) <= 0) {
+          c->failed = true;
+          break;
+        }
+
+        left -= ret;
+      }
+
+      if (c->failed) {
+        break;
+      }
+
+      c->rtt.record(bench::now() - start);
+    } while (bench::now() < c->deadline);
+  } else {
+    c->failed = true;
+  }
+
+  free(buf);
+
+  return nullptr;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--address <address>] [--connections <count>] "
+          "[--dispatchers <count>] [--payload <bytes>] "
+          "[--duration <seconds>] [--metrics on|off] "
+          "[--read-budget <bytes>]\n",
+          program);
+}
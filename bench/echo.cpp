@@ -0,0 +1,608 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#if defined(USE_SOCKET_TEMPLATE)
+  #include "net/async/event/dispatchers.cpp"
+#endif
+#include "net/async/event/socket.h"
+#include "net/sync/tcp/socket.h"
+#include "bench/bench.h"
+
+// Echo round-trip latency: each client connection sends a message and waits
+// for the echo before sending the next one. The round-trip times are
+// recorded in a histogram.
+
+static const int timeout = 30 * 1000; // Milliseconds.
+
+static const size_t max_payload = 64 * 1024;
+
+// Keep the write events of the connections enabled (otherwise they are
+// only enabled while there is data pending to be sent).
+static bool write_events = true;
+
+// In the template build all the sockets handled by a dispatcher have the
+// same type, so the same class is used for the acceptor and the
+// connections.
+class echo_socket : public net::async::event::socket {
+  public:
+    // Constructor.
+    echo_socket()
+      : _M_acceptor(nullptr),
+        _M_prev(nullptr),
+        _M_next(nullptr),
+        _M_used_sockets(nullptr),
+        _M_free_sockets(nullptr)
+    {
+    }
+
+    echo_socket(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher),
+        _M_acceptor(nullptr),
+        _M_prev(nullptr),
+        _M_next(nullptr),
+        _M_used_sockets(nullptr),
+        _M_free_sockets(nullptr)
+    {
+    }
+
+    // Destructor.
+    ~echo_socket()
+    {
+      delete_sockets(_M_used_sockets);
+      delete_sockets(_M_free_sockets);
+    }
+
+    // Clear.
+    void clear()
+    {
+      _M_begin = 0;
+      _M_end = 0;
+
+      // Connection?
+      if (_M_acceptor) {
+        unlink_node(_M_acceptor->_M_used_sockets, this);
+        link_node(_M_acceptor->_M_free_sockets, this);
+      }
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      return false;
+    }
+
+    // Run.
+    bool run()
+    {
+      return _M_acceptor ? run_connection() : run_acceptor();
+    }
+
+  private:
+    uint8_t _M_buf[max_payload];
+    size_t _M_begin;
+    size_t _M_end;
+
+    echo_socket* _M_acceptor;
+
+    echo_socket* _M_prev;
+    echo_socket* _M_next;
+
+    echo_socket* _M_used_sockets;
+    echo_socket* _M_free_sockets;
+
+    // Run acceptor.
+    bool run_acceptor()
+    {
+      do {
+        echo_socket* sock;
+        if (_M_free_sockets) {
+          sock = _M_free_sockets;
+          unlink_node(_M_free_sockets, sock);
+        } else if ((sock = new (std::nothrow) echo_socket()) == nullptr) {
+          return false;
+        }
+
+        sock->_M_acceptor = this;
+        sock->_M_begin = 0;
+        sock->_M_end = 0;
+
+        if (!accept(*sock)) {
+          link_node(_M_free_sockets, sock);
+          return !error();
+        }
+
+        link_node(_M_used_sockets, sock);
+
+        net::internal::socket::set_tcp_no_delay(sock->handle(), true);
+      } while (true);
+    }
+
+    // Run connection.
+    bool run_connection()
+    {
+      bool ret = process_connection();
+
+      if (!write_events) {
+        if (_M_begin < _M_end) {
+          enable_write_events();
+        } else {
+          disable_write_events();
+        }
+      }
+
+      return ret;
+    }
+
+    // Process connection.
+    bool process_connection()
+    {
+      do {
+        // Send pending data.
+        if (_M_begin < _M_end) {
+          ssize_t ret;
+          if ((ret = send(_M_buf + _M_begin, _M_end - _M_begin)) > 0) {
+            if ((_M_begin += ret) < _M_end) {
+              return true;
+            }
+
+            _M_begin = 0;
+            _M_end = 0;
+          } else {
+            return !error();
+          }
+        }
+
+        if (!readable()) {
+          return true;
+        }
+
+        // Receive.
+        ssize_t ret;
+        if ((ret = recv(_M_buf, sizeof(_M_buf))) > 0) {
+          _M_end = ret;
+        } else if (ret == 0) {
+          // Connection closed by peer.
+          return false;
+        } else {
+          return !error();
+        }
+      } while (true);
+    }
+
+    static void delete_sockets(echo_socket* sock)
+    {
+      while (sock) {
+        echo_socket* next = sock->_M_next;
+
+        delete sock;
+        sock = next;
+      }
+    }
+
+    static void unlink_node(echo_socket*& list, echo_socket* sock)
+    {
+      if (sock->_M_prev) {
+        sock->_M_prev->_M_next = sock->_M_next;
+      } else {
+        list = list->_M_next;
+      }
+
+      if (sock->_M_next) {
+        sock->_M_next->_M_prev = sock->_M_prev;
+        sock->_M_next = nullptr;
+      }
+
+      sock->_M_prev = nullptr;
+    }
+
+    static void link_node(echo_socket*& list, echo_socket* sock)
+    {
+      if (list) {
+        list->_M_prev = sock;
+      }
+
+      sock->_M_prev = nullptr;
+      sock->_M_next = list;
+
+      list = sock;
+    }
+};
+
+struct client {
+  pthread_t thread;
+
+  const net::socket::address* addr;
+  size_t payload;
+  uint64_t deadline;
+
+  bench::histogram rtt; // Nanoseconds.
+  bool failed;
+};
+
+// Thread monitoring the dispatchers' watchdogs.
+struct monitor {
+  pthread_t thread;
+
+  net::async::event::dispatchers* dispatchers;
+  size_t ndispatchers;
+  uint64_t threshold; // Nanoseconds.
+  volatile bool running;
+
+  struct stats {
+    uint64_t cursor;
+    uint64_t slow_callbacks;
+    uint64_t lost;
+    uint64_t max_duration;
+    uint64_t stalls;
+  };
+
+  stats* dispatcher_stats;
+};
+
+static void* run_client(void* arg);
+static void* run_monitor(void* arg);
+static void read_slow_callbacks(monitor* m);
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  const char* address = "127.0.0.1:8888";
+  size_t nconnections = 1;
+  size_t ndispatchers = 1;
+  size_t payload = 64;
+  unsigned duration = 5;
+  bool print_metrics = false;
+  uint64_t slow_callback = 0; // Microseconds.
+  int cpus[1024];
+  net::async::event::dispatchers::config config;
+  config.name = "echo";
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--address") == 0) {
+      address = argv[++i];
+    } else if (strcasecmp(argv[i], "--connections") == 0) {
+      nconnections = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--dispatchers") == 0) {
+      ndispatchers = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--payload") == 0) {
+      payload = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--metrics") == 0) {
+      print_metrics = (strcasecmp(argv[++i], "on") == 0);
+    } else if (strcasecmp(argv[i], "--slow-callback") == 0) {
+      slow_callback = strtoull(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--cpus") == 0) {
+      if ((config.ncpus = bench::parse_cpus(argv[++i],
+                                            cpus,
+                                            sizeof(cpus) / sizeof(int))) ==
+          0) {
+        usage(argv[0]);
+        return -1;
+      }
+
+      config.cpus = cpus;
+    } else if (strcasecmp(argv[i], "--cpus-per-dispatcher") == 0) {
+      config.cpus_per_dispatcher = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--incoming-cpu") == 0) {
+      config.incoming_cpu = (strcasecmp(argv[++i], "on") == 0);
+    } else if (strcasecmp(argv[i], "--read-budget") == 0) {
+      config.read_budget = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--write-events") == 0) {
+      write_events = (strcasecmp(argv[++i], "on") == 0);
+    } else if (strcasecmp(argv[i], "--trigger") == 0) {
+      if (strcasecmp(argv[++i], "edge") == 0) {
+        config.trigger = net::event::trigger::edge;
+      } else if (strcasecmp(argv[i], "level") == 0) {
+        config.trigger = net::event::trigger::level;
+      } else if (strcasecmp(argv[i], "oneshot") == 0) {
+        config.trigger = net::event::trigger::oneshot;
+      } else {
+        usage(argv[0]);
+        return -1;
+      }
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if ((nconnections == 0) ||
+      (ndispatchers == 0) ||
+      (payload == 0) ||
+      (payload > max_payload) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Build socket address.
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  // Start dispatchers.
+  net::async::event::dispatchers dispatchers;
+#if defined(USE_SOCKET_TEMPLATE)
+  if (!dispatchers.start<echo_socket>(ndispatchers, config)) {
+#else
+  if (!dispatchers.start(ndispatchers, config)) {
+#endif
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  if (print_metrics) {
+    for (size_t i = 0; i < ndispatchers; i++) {
+      dispatchers.get(i)->enable_callback_latency(true);
+    }
+  }
+
+  // Start monitor.
+  monitor mon;
+  mon.dispatcher_stats = nullptr;
+
+  if (slow_callback > 0) {
+    mon.dispatchers = &dispatchers;
+    mon.ndispatchers = ndispatchers;
+    mon.threshold = slow_callback * 1000;
+    mon.running = true;
+
+    if ((mon.dispatcher_stats = new (std::nothrow)
+                                monitor::stats[ndispatchers]) == nullptr) {
+      return -1;
+    }
+
+    memset(mon.dispatcher_stats, 0, ndispatchers * sizeof(monitor::stats));
+
+    for (size_t i = 0; i < ndispatchers; i++) {
+      dispatchers.get(i)->enable_watchdog(mon.threshold);
+    }
+
+    if (pthread_create(&mon.thread, nullptr, run_monitor, &mon) != 0) {
+      fprintf(stderr, "Error starting monitor.\n");
+      return -1;
+    }
+  }
+
+  // Create one acceptor per dispatcher (listening on the same port).
+  echo_socket** acceptors;
+  if ((acceptors = new (std::nothrow) echo_socket*[ndispatchers]) == nullptr) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    if (((acceptors[i] = new (std::nothrow)
+                         echo_socket(dispatchers.get(i))) == nullptr) ||
+        (!acceptors[i]->listen(addr))) {
+      fprintf(stderr, "Error listening on '%s'.\n", address);
+      return -1;
+    }
+  }
+
+  client* clients;
+  if ((clients = new (std::nothrow) client[nconnections]) == nullptr) {
+    return -1;
+  }
+
+  uint64_t start = bench::now();
+
+  size_t nclients;
+  for (nclients = 0; nclients < nconnections; nclients++) {
+    client* c = &clients[nclients];
+
+    c->addr = &addr;
+    c->payload = payload;
+    c->deadline = start + (duration * 1000000000ull);
+    c->failed = false;
+
+    if (pthread_create(&c->thread, nullptr, run_client, c) != 0) {
+      break;
+    }
+  }
+
+  bench::histogram rtt;
+  bool failed = (nclients != nconnections);
+
+  for (size_t i = 0; i < nclients; i++) {
+    pthread_join(clients[i].thread, nullptr);
+
+    rtt.add(clients[i].rtt);
+    failed |= clients[i].failed;
+  }
+
+  double seconds = (bench::now() - start) / 1000000000.0;
+
+  dispatchers.stop();
+
+  // Stop monitor.
+  if (mon.dispatcher_stats) {
+    mon.running = false;
+    pthread_join(mon.thread, nullptr);
+
+    read_slow_callbacks(&mon);
+  }
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    delete acceptors[i];
+  }
+
+  delete [] acceptors;
+  delete [] clients;
+
+  if (failed) {
+    fprintf(stderr, "Error running clients.\n");
+    return -1;
+  }
+
+  bench::begin_result("echo");
+
+  printf(" connections=%zu dispatchers=%zu cpus=%zu payload=%zu "
+         "messages=%llu seconds=%.3f msgs_per_sec=%.0f rtt_min_us=%.2f "
+         "rtt_mean_us=%.2f rtt_p50_us=%.2f rtt_p90_us=%.2f "
+         "rtt_p99_us=%.2f rtt_p999_us=%.2f rtt_max_us=%.2f",
+         nconnections,
+         ndispatchers,
+         config.ncpus,
+         payload,
+         static_cast<unsigned long long>(rtt.count()),
+         seconds,
+         rtt.count() / seconds,
+         rtt.min() / 1000.0,
+         rtt.mean() / 1000.0,
+         rtt.percentile(50.0) / 1000.0,
+         rtt.percentile(90.0) / 1000.0,
+         rtt.percentile(99.0) / 1000.0,
+         rtt.percentile(99.9) / 1000.0,
+         rtt.max() / 1000.0);
+
+  bench::end_result();
+
+  if (print_metrics) {
+    bench::print_metrics("echo_dispatcher", dispatchers, ndispatchers);
+  }
+
+  if (mon.dispatcher_stats) {
+    for (size_t i = 0; i < ndispatchers; i++) {
+      const monitor::stats* st = &mon.dispatcher_stats[i];
+
+      bench::begin_result("echo_watchdog");
+
+      printf(" dispatcher=%zu threshold_us=%llu slow_callbacks=%llu "
+             "lost=%llu max_us=%.2f stalls=%llu",
+             i,
+             static_cast<unsigned long long>(slow_callback),
+             static_cast<unsigned long long>(st->slow_callbacks),
+             static_cast<unsigned long long>(st->lost),
+             st->max_duration / 1000.0,
+             static_cast<unsigned long long>(st->stalls));
+
+      bench::end_result();
+    }
+
+    delete [] mon.dispatcher_stats;
+  }
+
+  return 0;
+}
+
+void* run_client(void* arg)
+{
+  client* c = static_cast<client*>(arg);
+
+  uint8_t* buf;
+  if ((buf = static_cast<uint8_t*>(malloc(c->payload))) == nullptr) {
+    c->failed = true;
+    return nullptr;
+  }
+
+  memset(buf, 'x', c->payload);
+
+  net::sync::tcp::socket sock;
+  if (sock.connect(*c->addr, timeout)) {
+    net::internal::socket::set_tcp_no_delay(sock.handle(), true);
+
+    do {
+      uint64_t start = bench::now();
+
+      // Send message.
+      if (!sock.send(buf, c->payload, timeout)) {
+        c->failed = true;
+        break;
+      }
+
+      // Receive echo.
+      size_t left = c->payload;
+      while (left > 0) {
+        ssize_t ret;
+        if ((ret = sock.recv(buf, left, timeout)) <= 0) {
+          c->failed = true;
+          break;
+        }
+
+        left -= ret;
+      }
+
+      if (c->failed) {
+        break;
+      }
+
+      c->rtt.record(bench::now() - start);
+    } while (bench::now() < c->deadline);
+  } else {
+    c->failed = true;
+  }
+
+  free(buf);
+
+  return nullptr;
+}
+
+void* run_monitor(void* arg)
+{
+  monitor* m = static_cast<monitor*>(arg);
+
+  while (m->running) {
+    // Check whether some dispatcher is stuck in a callback.
+    for (size_t i = 0; i < m->ndispatchers; i++) {
+      int fd;
+      uint64_t duration;
+      if (m->dispatchers->get(i)->stalled(m->threshold, fd, duration)) {
+        m->dispatcher_stats[i].stalls++;
+      }
+    }
+
+    read_slow_callbacks(m);
+
+    usleep(1000);
+  }
+
+  return nullptr;
+}
+
+void read_slow_callbacks(monitor* m)
+{
+  for (size_t i = 0; i < m->ndispatchers; i++) {
+    monitor::stats* st = &m->dispatcher_stats[i];
+
+    net::async::event::slow_callback entries[64];
+    size_t n;
+    while ((n = m->dispatchers->get(i)->read_slow_callbacks(st->cursor,
+                                                           entries,
+                                                           64,
+                                                           st->lost)) > 0) {
+      for (size_t j = 0; j < n; j++) {
+        if (entries[j].duration > st->max_duration) {
+          st->max_duration = entries[j].duration;
+        }
+      }
+
+      st->slow_callbacks += n;
+    }
+  }
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--address <address>] [--connections <count>] "
+          "[--dispatchers <count>] [--payload <bytes>] "
+          "[--duration <seconds>] [--metrics on|off] "
+          "[--slow-callback <microseconds>] [--cpus <list>] "
+          "[--cpus-per-dispatcher <count>] [--incoming-cpu on|off] "
+          "[--read-budget <bytes>] [--trigger edge|level|oneshot] "
+          "[--write-events on|off]\n",
+          program);
+}
@@ -0,0 +1,317 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#if defined(USE_SOCKET_TEMPLATE)
+  #include "net/async/event/dispatchers.cpp"
+#endif
+#include "net/async/event/socket.h"
+#include "net/sync/udp/socket.h"
+#include "bench/bench.h"
+
+// Events per second with many ready sockets: each UDP socket sends a
+// datagram to itself every time it receives one, so that all the sockets
+// are ready in every wait. The sockets are bound to consecutive ports of
+// consecutive loopback addresses (127.0.0.1, 127.0.0.2, ...), so more than
+// 64K sockets can be used (raise the limit of open files for 1M sockets).
+// Comparing runs with different --max-events / --max-events-limit shows
+// the effect of the size of the event batch. The cache misses per event
+// (user space) show the cost of touching the sockets (see the layout of
+// net::async::event::socket); they are reported as "n/a" when the hardware
+// counters are not available.
+
+static const int timeout = 30 * 1000; // Milliseconds.
+
+static const unsigned ports_per_address = 40000;
+
+class ready_socket : public net::async::event::socket {
+  public:
+    // Constructor.
+    ready_socket(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher)
+    {
+    }
+
+    // Clear.
+    void clear()
+    {
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      return false;
+    }
+
+    // Run.
+    bool run()
+    {
+      bool received = false;
+
+      while (readable()) {
+        uint8_t buf[64];
+        if (recvfrom(buf, sizeof(buf)) >= 0) {
+          received = true;
+        } else if (error()) {
+          return false;
+        }
+      }
+
+      // Make the socket ready again for the next wait.
+      return ((!received) || (sendto("x", 1, _M_addr) == 1) || (!error()));
+    }
+
+    // Bind.
+    bool bind(size_t i, in_port_t first_port)
+    {
+      struct sockaddr_in addr;
+      memset(&addr, 0, sizeof(struct sockaddr_in));
+
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK +
+                                   (i / ports_per_address));
+      addr.sin_port = htons(first_port + (i % ports_per_address));
+
+      _M_addr = addr;
+
+      return net::async::event::socket::bind(_M_addr);
+    }
+
+    // Get address.
+    const net::socket::address::ipv4& address() const
+    {
+      return _M_addr;
+    }
+
+  private:
+    net::socket::address::ipv4 _M_addr;
+};
+
+static void get_totals(net::async::event::dispatchers& dispatchers,
+                       size_t ndispatchers,
+                       uint64_t& events,
+                       uint64_t& waits,
+                       uint64_t& capacity);
+
+static void raise_file_limit();
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  size_t nsockets = 10000;
+  size_t ndispatchers = 1;
+  size_t max_events = net::async::event::dispatcher::default_max_events;
+  size_t max_events_limit =
+    net::async::event::dispatcher::default_max_events_limit;
+
+  unsigned first_port = 20000;
+  unsigned duration = 5;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--sockets") == 0) {
+      nsockets = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--dispatchers") == 0) {
+      ndispatchers = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--max-events") == 0) {
+      max_events = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--max-events-limit") == 0) {
+      max_events_limit = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--port") == 0) {
+      first_port = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if ((nsockets == 0) ||
+      (ndispatchers == 0) ||
+      (max_events == 0) ||
+      (first_port == 0) ||
+      (first_port + ports_per_address > 65536) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  raise_file_limit();
+
+  // Count the cache misses of the dispatchers' threads.
+  bench::cache_misses misses;
+  bool counting = misses.open();
+
+  // Start dispatchers.
+  net::async::event::dispatchers::config config;
+  config.name = "events";
+  config.max_events = max_events;
+  config.max_events_limit = max_events_limit;
+
+  net::async::event::dispatchers dispatchers;
+#if defined(USE_SOCKET_TEMPLATE)
+  if (!dispatchers.start<ready_socket>(ndispatchers, config)) {
+#else
+  if (!dispatchers.start(ndispatchers, config)) {
+#endif
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  // Create sockets (round-robin among the dispatchers).
+  ready_socket** sockets;
+  if ((sockets = new (std::nothrow) ready_socket*[nsockets]) == nullptr) {
+    fprintf(stderr, "Error allocating sockets.\n");
+    return -1;
+  }
+
+  size_t nbound;
+  for (nbound = 0; nbound < nsockets; nbound++) {
+    if ((sockets[nbound] = new (std::nothrow)
+                           ready_socket(dispatchers.get(nbound %
+                                                        ndispatchers))) ==
+        nullptr) {
+      break;
+    }
+
+    if (!sockets[nbound]->bind(nbound, first_port)) {
+      delete sockets[nbound];
+      break;
+    }
+  }
+
+  // Send the first datagram to each socket.
+  net::sync::udp::socket sender;
+  bool ret = false;
+
+  if ((nbound == nsockets) && (sender.create(net::socket::domain::ipv4))) {
+    size_t i;
+    for (i = 0; i < nsockets; i++) {
+      if (!sender.sendto("x", 1, sockets[i]->address(), timeout)) {
+        break;
+      }
+    }
+
+    if (i == nsockets) {
+      // Let the dispatchers warm up (and grow the event batch).
+      usleep(500 * 1000);
+
+      uint64_t events, waits, capacity, nmisses;
+      get_totals(dispatchers, ndispatchers, events, waits, capacity);
+      counting = counting && misses.read(nmisses);
+
+      uint64_t start = bench::now();
+
+      sleep(duration);
+
+      uint64_t end_events, end_waits, end_misses;
+      get_totals(dispatchers, ndispatchers, end_events, end_waits, capacity);
+      counting = counting && misses.read(end_misses);
+
+      double seconds = (bench::now() - start) / 1000000000.0;
+
+      events = end_events - events;
+      waits = end_waits - waits;
+
+      char misses_per_event[32];
+      if ((counting) && (events > 0)) {
+        snprintf(misses_per_event,
+                 sizeof(misses_per_event),
+                 "%.2f",
+                 static_cast<double>(end_misses - nmisses) / events);
+      } else {
+        strcpy(misses_per_event, "n/a");
+      }
+
+      bench::begin_result("events");
+
+      printf(" sockets=%zu dispatchers=%zu max_events=%zu "
+             "max_events_limit=%zu event_capacity=%llu events=%llu "
+             "waits=%llu seconds=%.3f events_per_sec=%.0f "
+             "events_per_wait=%.2f cache_misses_per_event=%s",
+             nsockets,
+             ndispatchers,
+             max_events,
+             max_events_limit,
+             static_cast<unsigned long long>(capacity),
+             static_cast<unsigned long long>(events),
+             static_cast<unsigned long long>(waits),
+             seconds,
+             events / seconds,
+             (waits > 0) ? static_cast<double>(events) / waits : 0.0,
+             misses_per_event);
+
+      bench::end_result();
+
+      ret = true;
+    } else {
+      fprintf(stderr, "Error sending datagram.\n");
+    }
+  } else {
+    fprintf(stderr,
+            "Error binding socket %zu (check the limit of open files).\n",
+            nbound);
+  }
+
+  dispatchers.stop();
+
+  for (size_t i = 0; i < nbound; i++) {
+    delete sockets[i];
+  }
+
+  delete [] sockets;
+
+  return ret ? 0 : -1;
+}
+
+void get_totals(net::async::event::dispatchers& dispatchers,
+                size_t ndispatchers,
+                uint64_t& events,
+                uint64_t& waits,
+                uint64_t& capacity)
+{
+  events = 0;
+  waits = 0;
+  capacity = 0;
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    net::async::event::metrics m;
+    dispatchers.get(i)->get_metrics(m);
+
+    events += m.events;
+    waits += m.iterations;
+
+    if (m.event_capacity > capacity) {
+      capacity = m.event_capacity;
+    }
+  }
+}
+
+void raise_file_limit()
+{
+  struct rlimit rlim;
+  if ((getrlimit(RLIMIT_NOFILE, &rlim) == 0) &&
+      (rlim.rlim_cur < rlim.rlim_max)) {
+    rlim.rlim_cur = rlim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rlim);
+  }
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--sockets <count>] [--dispatchers <count>] "
+          "[--max-events <count>] [--max-events-limit <count>] "
+          "[--port <first-port>] [--duration <seconds>]\n",
+          program);
+}
@@ -0,0 +1,514 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#if defined(USE_SOCKET_TEMPLATE)
+  #include "net/async/event/dispatchers.cpp"
+#endif
+#include "net/async/event/socket.h"
+#include "bench/bench.h"
+
+// Short-lived requests: each client opens a connection, sends a request,
+// waits for the response and closes the connection. The server closes the
+// connection as soon as the response has been sent.
+// "--fast-open on" sends the request in the SYN (TCP Fast Open; on Linux,
+// the server side has to be enabled in net.ipv4.tcp_fastopen) and
+// "--defer-accept on" only wakes the acceptor up once the request has
+// arrived. The system calls made per request are counted on both sides (on
+// the server side: waits, accepts, receives, sends, closes and changes of
+// the watched events).
+
+static const int timeout = 30 * 1000; // Milliseconds.
+
+static const size_t max_payload = 16 * 1024;
+
+static const unsigned fast_open_queue = 1024;
+static const unsigned defer_accept_timeout = 5; // Seconds.
+
+// Size of the requests and the responses.
+static size_t payload = 64;
+
+// In the template build all the sockets handled by a dispatcher have the
+// same type, so the same class is used for the acceptor and the
+// connections.
+class rpc_socket : public net::async::event::socket {
+  public:
+    // Constructor.
+    rpc_socket()
+      : _M_acceptor(nullptr),
+        _M_next(nullptr),
+        _M_free_sockets(nullptr),
+        _M_received(0),
+        _M_sent(0),
+        _M_requests(0),
+        _M_syscalls(0)
+    {
+    }
+
+    rpc_socket(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher),
+        _M_acceptor(nullptr),
+        _M_next(nullptr),
+        _M_free_sockets(nullptr),
+        _M_received(0),
+        _M_sent(0),
+        _M_requests(0),
+        _M_syscalls(0)
+    {
+    }
+
+    // Destructor.
+    ~rpc_socket()
+    {
+      rpc_socket* sock = _M_free_sockets;
+
+      while (sock) {
+        rpc_socket* next = sock->_M_next;
+
+        delete sock;
+        sock = next;
+      }
+    }
+
+    // Clear.
+    void clear()
+    {
+      // Connection?
+      if (_M_acceptor) {
+        // close().
+        _M_acceptor->_M_syscalls++;
+
+        // Add socket to the free list.
+        _M_next = _M_acceptor->_M_free_sockets;
+        _M_acceptor->_M_free_sockets = this;
+      }
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      return false;
+    }
+
+    // Run.
+    bool run()
+    {
+      return _M_acceptor ? run_connection() : run_acceptor();
+    }
+
+    // Get number of requests served.
+    uint64_t requests() const
+    {
+      return _M_requests;
+    }
+
+    // Get number of system calls made by the sockets (excluding the ones
+    // made by the dispatcher).
+    uint64_t syscalls() const
+    {
+      return _M_syscalls;
+    }
+
+  private:
+    uint8_t _M_buf[max_payload];
+
+    rpc_socket* _M_acceptor;
+    rpc_socket* _M_next;
+
+    rpc_socket* _M_free_sockets;
+
+    size_t _M_received;
+    size_t _M_sent;
+
+    uint64_t _M_requests;
+    uint64_t _M_syscalls;
+
+    // Run acceptor.
+    bool run_acceptor()
+    {
+      do {
+        rpc_socket* sock;
+        if (_M_free_sockets) {
+          sock = _M_free_sockets;
+          _M_free_sockets = sock->_M_next;
+        } else if ((sock = new (std::nothrow) rpc_socket()) == nullptr) {
+          return false;
+        }
+
+        sock->_M_acceptor = this;
+        sock->_M_received = 0;
+        sock->_M_sent = 0;
+
+        _M_syscalls++;
+
+        if (!accept(*sock)) {
+          sock->_M_next = _M_free_sockets;
+          _M_free_sockets = sock;
+
+          return !error();
+        }
+      } while (true);
+    }
+
+    // Run connection.
+    bool run_connection()
+    {
+      // Receive the request.
+      while (_M_received < payload) {
+        if (!readable()) {
+          return true;
+        }
+
+        _M_acceptor->_M_syscalls++;
+
+        ssize_t ret;
+        if ((ret = recv(_M_buf + _M_received, payload - _M_received)) > 0) {
+          _M_received += ret;
+        } else if (ret == 0) {
+          // Connection closed by peer.
+          return false;
+        } else {
+          return !error();
+        }
+      }
+
+      // Send the response.
+      while (_M_sent < payload) {
+        _M_acceptor->_M_syscalls++;
+
+        ssize_t ret;
+        if ((ret = send(_M_buf + _M_sent, payload - _M_sent)) > 0) {
+          _M_sent += ret;
+        } else {
+          return !error();
+        }
+      }
+
+      _M_acceptor->_M_requests++;
+
+      // Close the connection.
+      return false;
+    }
+};
+
+struct client {
+  pthread_t thread;
+
+  const net::socket::address* addr;
+  bool fast_open;
+  uint64_t deadline;
+
+  bench::histogram request_time; // Nanoseconds.
+  uint64_t requests;
+  uint64_t syn_data; // Requests sent in the SYN.
+  uint64_t syscalls;
+  bool failed;
+};
+
+static void* run_client(void* arg);
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  const char* address = "127.0.0.1:8888";
+  size_t nconnections = 4;
+  size_t ndispatchers = 1;
+  bool fast_open = false;
+  bool defer_accept = false;
+  unsigned duration = 5;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--address") == 0) {
+      address = argv[++i];
+    } else if (strcasecmp(argv[i], "--connections") == 0) {
+      nconnections = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--dispatchers") == 0) {
+      ndispatchers = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--payload") == 0) {
+      payload = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--fast-open") == 0) {
+      fast_open = (strcasecmp(argv[++i], "on") == 0);
+    } else if (strcasecmp(argv[i], "--defer-accept") == 0) {
+      defer_accept = (strcasecmp(argv[++i], "on") == 0);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if ((nconnections == 0) ||
+      (ndispatchers == 0) ||
+      (payload == 0) ||
+      (payload > max_payload) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Build socket address.
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  // Start dispatchers.
+  net::async::event::dispatchers dispatchers;
+#if defined(USE_SOCKET_TEMPLATE)
+  if (!dispatchers.start<rpc_socket>(ndispatchers)) {
+#else
+  if (!dispatchers.start(ndispatchers)) {
+#endif
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  // Create one acceptor per dispatcher (listening on the same port).
+  rpc_socket** acceptors;
+  if ((acceptors = new (std::nothrow) rpc_socket*[ndispatchers]) ==
+      nullptr) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    if (((acceptors[i] = new (std::nothrow)
+                         rpc_socket(dispatchers.get(i))) == nullptr) ||
+        (!acceptors[i]->listen(addr))) {
+      fprintf(stderr, "Error listening on '%s'.\n", address);
+      return -1;
+    }
+
+    if ((fast_open) && (!acceptors[i]->set_fast_open(fast_open_queue))) {
+      fprintf(stderr, "Error enabling TCP Fast Open.\n");
+      return -1;
+    }
+
+    if ((defer_accept) &&
+        (!acceptors[i]->set_defer_accept(defer_accept_timeout))) {
+      fprintf(stderr, "Error enabling deferred accept.\n");
+      return -1;
+    }
+  }
+
+  client* clients;
+  if ((clients = new (std::nothrow) client[nconnections]) == nullptr) {
+    return -1;
+  }
+
+  uint64_t start = bench::now();
+
+  size_t nclients;
+  for (nclients = 0; nclients < nconnections; nclients++) {
+    client* c = &clients[nclients];
+
+    c->addr = &addr;
+    c->fast_open = fast_open;
+    c->deadline = start + (duration * 1000000000ull);
+    c->requests = 0;
+    c->syn_data = 0;
+    c->syscalls = 0;
+    c->failed = false;
+
+    if (pthread_create(&c->thread, nullptr, run_client, c) != 0) {
+      break;
+    }
+  }
+
+  bench::histogram request_time;
+  uint64_t requests = 0;
+  uint64_t syn_data = 0;
+  uint64_t client_syscalls = 0;
+  bool failed = (nclients != nconnections);
+
+  for (size_t i = 0; i < nclients; i++) {
+    pthread_join(clients[i].thread, nullptr);
+
+    request_time.add(clients[i].request_time);
+    requests += clients[i].requests;
+    syn_data += clients[i].syn_data;
+    client_syscalls += clients[i].syscalls;
+    failed |= clients[i].failed;
+  }
+
+  double seconds = (bench::now() - start) / 1000000000.0;
+
+  // Let the dispatchers close the last connections.
+  usleep(100 * 1000);
+
+  // System calls made by the dispatchers: one wait per loop iteration, one
+  // registration per accepted connection and one call per change of the
+  // watched events.
+  uint64_t served = 0;
+  uint64_t server_syscalls = 0;
+  uint64_t iterations = 0;
+  uint64_t callbacks = 0;
+  for (size_t i = 0; i < ndispatchers; i++) {
+    net::async::event::metrics m;
+    dispatchers.get(i)->get_metrics(m);
+
+    served += acceptors[i]->requests();
+    server_syscalls += acceptors[i]->syscalls() +
+                       m.iterations +
+                       m.accepted +
+                       m.modified;
+
+    iterations += m.iterations;
+    callbacks += m.callbacks;
+  }
+
+  dispatchers.stop();
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    delete acceptors[i];
+  }
+
+  delete [] acceptors;
+  delete [] clients;
+
+  if (failed) {
+    fprintf(stderr, "Error running clients.\n");
+    return -1;
+  }
+
+  bench::begin_result("fastopen");
+
+  printf(" connections=%zu dispatchers=%zu payload=%zu fast_open=%s "
+         "defer_accept=%s requests=%llu seconds=%.3f requests_per_sec=%.0f "
+         "syn_data_pct=%.2f client_syscalls_per_req=%.2f "
+         "server_syscalls_per_req=%.2f wakeups_per_req=%.2f "
+         "callbacks_per_req=%.2f req_p50_us=%.2f req_p99_us=%.2f "
+         "req_max_us=%.2f",
+         nconnections,
+         ndispatchers,
+         payload,
+         fast_open ? "on" : "off",
+         defer_accept ? "on" : "off",
+         static_cast<unsigned long long>(requests),
+         seconds,
+         requests / seconds,
+         (requests > 0) ? (100.0 * syn_data) / requests : 0.0,
+         (requests > 0) ? static_cast<double>(client_syscalls) / requests :
+                          0.0,
+         (served > 0) ? static_cast<double>(server_syscalls) / served : 0.0,
+         (served > 0) ? static_cast<double>(iterations) / served : 0.0,
+         (served > 0) ? static_cast<double>(callbacks) / served : 0.0,
+         request_time.percentile(50.0) / 1000.0,
+         request_time.percentile(99.0) / 1000.0,
+         request_time.max() / 1000.0);
+
+  bench::end_result();
+
+  return 0;
+}
+
+void* run_client(void* arg)
+{
+  client* c = static_cast<client*>(arg);
+
+  uint8_t buf[max_payload];
+  memset(buf, 'x', payload);
+
+  do {
+    uint64_t start = bench::now();
+
+    net::socket sock;
+    if (!sock.create(static_cast<net::socket::domain>(c->addr->family()),
+                     net::socket::type::stream)) {
+      c->failed = true;
+      break;
+    }
+
+    // socket(), connect() or sendto() and close().
+    c->syscalls += 3;
+
+    // Connect (sending the request in the SYN, if possible).
+    ssize_t sent;
+    if (c->fast_open) {
+      if ((sent = sock.connect(*c->addr, buf, payload)) < 0) {
+        c->failed = true;
+        break;
+      }
+
+      if (sent > 0) {
+        c->syn_data++;
+      }
+    } else if (sock.connect(*c->addr)) {
+      sent = 0;
+    } else {
+      c->failed = true;
+      break;
+    }
+
+    // Send the rest of the request.
+    while (static_cast<size_t>(sent) < payload) {
+      c->syscalls++;
+
+      ssize_t ret;
+      if ((ret = sock.send(buf + sent, payload - sent)) > 0) {
+        sent += ret;
+      } else if ((ret < 0) && (errno == EAGAIN)) {
+        c->syscalls++;
+
+        if (!net::internal::socket::wait_writable(sock.handle(), timeout)) {
+          c->failed = true;
+          break;
+        }
+      } else {
+        c->failed = true;
+        break;
+      }
+    }
+
+    // Receive the response.
+    size_t received = 0;
+    while ((!c->failed) && (received < payload)) {
+      c->syscalls++;
+
+      ssize_t ret;
+      if ((ret = sock.recv(buf + received, payload - received)) > 0) {
+        received += ret;
+      } else if ((ret < 0) && (errno == EAGAIN)) {
+        c->syscalls++;
+
+        if (!net::internal::socket::wait_readable(sock.handle(), timeout)) {
+          c->failed = true;
+        }
+      } else {
+        c->failed = true;
+      }
+    }
+
+    if (c->failed) {
+      break;
+    }
+
+    sock.close();
+
+    c->request_time.record(bench::now() - start);
+    c->requests++;
+  } while (bench::now() < c->deadline);
+
+  return nullptr;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--address <address>] [--connections <count>] "
+          "[--dispatchers <count>] [--payload <bytes>] "
+          "[--fast-open on|off] [--defer-accept on|off] "
+          "[--duration <seconds>]\n",
+          program);
+}
@@ -0,0 +1,332 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#include "net/http/server.h"
+#include "net/sync/tcp/socket.h"
+
+// wrk-style loopback benchmark of the HTTP server: each client connection
+// sends batches of pipelined keep-alive requests and waits for the
+// responses.
+
+static const int timeout = 30 * 1000; // Milliseconds.
+
+static const char request[] = "GET /plaintext HTTP/1.1\r\n"
+                              "Host: 127.0.0.1\r\n"
+                              "User-Agent: bench_http\r\n"
+                              "Accept: */*\r\n"
+                              "\r\n";
+
+static const size_t requestlen = sizeof(request) - 1;
+
+class hello_server : public net::http::server {
+  public:
+    // Constructor.
+    hello_server(net::async::event::dispatcher* dispatcher)
+      : net::http::server(dispatcher)
+    {
+    }
+
+    // Process request.
+    bool process(const net::http::request& req, net::http::connection& conn)
+    {
+      return conn.respond(200, "text/plain", "Hello, World!", 13);
+    }
+};
+
+struct client {
+  pthread_t thread;
+
+  const net::socket::address* addr;
+  size_t pipeline;
+  uint64_t deadline;
+
+  uint64_t requests;
+  uint64_t latency; // Sum of latencies (nanoseconds).
+  uint64_t max_latency;
+  bool failed;
+};
+
+static uint64_t now();
+static void* run_client(void* arg);
+static size_t parse_responses(const char* buf, size_t len, size_t& nresponses);
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  const char* address = "127.0.0.1:8080";
+  size_t nconnections = 4;
+  size_t ndispatchers = 1;
+  size_t pipeline = 16;
+  unsigned duration = 5;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--address") == 0) {
+      address = argv[++i];
+    } else if (strcasecmp(argv[i], "--connections") == 0) {
+      nconnections = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--dispatchers") == 0) {
+      ndispatchers = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--pipeline") == 0) {
+      pipeline = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if ((nconnections == 0) ||
+      (ndispatchers == 0) ||
+      (pipeline == 0) ||
+      (pipeline * requestlen > net::http::connection::buffer_size) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Build socket address.
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  // Start dispatchers.
+  net::async::event::dispatchers dispatchers;
+  if (!dispatchers.start(ndispatchers)) {
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  // Create one server per dispatcher (listening on the same port).
+  hello_server** servers;
+  if ((servers = new (std::nothrow) hello_server*[ndispatchers]) == nullptr) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    if (((servers[i] = new (std::nothrow)
+                       hello_server(dispatchers.get(i))) == nullptr) ||
+        (!servers[i]->listen(addr))) {
+      fprintf(stderr, "Error listening on '%s'.\n", address);
+      return -1;
+    }
+  }
+
+  client* clients;
+  if ((clients = new (std::nothrow) client[nconnections]) == nullptr) {
+    return -1;
+  }
+
+  printf("Running %us test @ http://%s/plaintext\n", duration, address);
+  printf("  %zu connections, %zu dispatchers, pipeline %zu\n",
+         nconnections,
+         ndispatchers,
+         pipeline);
+
+  uint64_t start = now();
+
+  size_t nclients;
+  for (nclients = 0; nclients < nconnections; nclients++) {
+    client* c = &clients[nclients];
+
+    c->addr = &addr;
+    c->pipeline = pipeline;
+    c->deadline = start + (duration * 1000000000ull);
+    c->requests = 0;
+    c->latency = 0;
+    c->max_latency = 0;
+    c->failed = false;
+
+    if (pthread_create(&c->thread, nullptr, run_client, c) != 0) {
+      break;
+    }
+  }
+
+  uint64_t requests = 0;
+  uint64_t latency = 0;
+  uint64_t max_latency = 0;
+  bool failed = (nclients != nconnections);
+
+  for (size_t i = 0; i < nclients; i++) {
+    pthread_join(clients[i].thread, nullptr);
+
+    requests += clients[i].requests;
+    latency += clients[i].latency;
+
+    if (clients[i].max_latency > max_latency) {
+      max_latency = clients[i].max_latency;
+    }
+
+    failed |= clients[i].failed;
+  }
+
+  double seconds = (now() - start) / 1000000000.0;
+
+  dispatchers.stop();
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    delete servers[i];
+  }
+
+  delete [] servers;
+  delete [] clients;
+
+  if (failed) {
+    fprintf(stderr, "Error running clients.\n");
+    return -1;
+  }
+
+  printf("  Latency (batch of %zu requests): avg %.2fus, max %.2fus\n",
+         pipeline,
+         (requests > 0) ? (latency / 1000.0) / (requests / pipeline) : 0.0,
+         max_latency / 1000.0);
+
+  printf("  %llu requests in %.2fs\n",
+         static_cast<unsigned long long>(requests),
+         seconds);
+
+  printf("Requests/sec: %.2f\n", requests / seconds);
+
+  return 0;
+}
+
+uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (static_cast<uint64_t>(ts.tv_sec) * 1000000000ull) + ts.tv_nsec;
+}
+
+void* run_client(void* arg)
+{
+  client* c = static_cast<client*>(arg);
+
+  char requests[net::http::connection::buffer_size];
+  char responses[64 * 1024];
+
+  for (size_t i = 0; i < c->pipeline; i++) {
+    memcpy(requests + (i * requestlen), request, requestlen);
+  }
+
+  net::sync::tcp::socket sock;
+  if (!sock.connect(*c->addr, timeout)) {
+    c->failed = true;
+    return nullptr;
+  }
+
+  net::internal::socket::set_tcp_no_delay(sock.handle(), true);
+
+  do {
+    uint64_t start = now();
+
+    // Send requests.
+    if (!sock.send(requests, c->pipeline * requestlen, timeout)) {
+      c->failed = true;
+      return nullptr;
+    }
+
+    // Receive responses.
+    size_t left = c->pipeline;
+    size_t len = 0;
+
+    do {
+      ssize_t ret;
+      if ((ret = sock.recv(responses + len,
+                           sizeof(responses) - len,
+                           timeout)) <= 0) {
+        c->failed = true;
+        return nullptr;
+      }
+
+      len += ret;
+
+      size_t nresponses;
+      size_t consumed = parse_responses(responses, len, nresponses);
+
+      if (nresponses > left) {
+        c->failed = true;
+        return nullptr;
+      }
+
+      left -= nresponses;
+
+      memmove(responses, responses + consumed, len - consumed);
+      len -= consumed;
+    } while (left > 0);
+
+    uint64_t latency = now() - start;
+
+    c->requests += c->pipeline;
+    c->latency += latency;
+
+    if (latency > c->max_latency) {
+      c->max_latency = latency;
+    }
+  } while (now() < c->deadline);
+
+  return nullptr;
+}
+
+size_t parse_responses(const char* buf, size_t len, size_t& nresponses)
+{
+  static const char content_length[] = "\r\nContent-Length: ";
+  static const size_t content_length_len = sizeof(content_length) - 1;
+
+  const char* p = buf;
+  const char* end = buf + len;
+
+  nresponses = 0;
+
+  do {
+    const char* hdrend;
+    if ((hdrend = static_cast<const char*>(memmem(p,
+                                                  end - p,
+                                                  "\r\n\r\n",
+                                                  4))) == nullptr) {
+      break;
+    }
+
+    const char* cl;
+    if ((cl = static_cast<const char*>(memmem(p,
+                                              hdrend - p,
+                                              content_length,
+                                              content_length_len))) ==
+        nullptr) {
+      break;
+    }
+
+    size_t bodylen = strtoul(cl + content_length_len, nullptr, 10);
+
+    if (static_cast<size_t>(end - (hdrend + 4)) < bodylen) {
+      break;
+    }
+
+    p = hdrend + 4 + bodylen;
+
+    nresponses++;
+  } while (true);
+
+  return p - buf;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--address <address>] [--connections <count>] "
+          "[--dispatchers <count>] [--pipeline <count>] "
+          "[--duration <seconds>]\n",
+          program);
+}
@@ -0,0 +1,242 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <new>
+#include "net/sync/tcp/socket.h"
+#include "bench/bench.h"
+
+// Ping-pong: a client sends a message to a synchronous echo server and
+// waits for it to come back before sending the next one, so the latency is
+// dominated by the system calls of both sides. With "--mode poll" the
+// sockets are non-blocking (each operation which can't complete immediately
+// waits with poll() and is retried); with "--mode blocking" they are in
+// blocking mode (one system call per operation). By default both modes are
+// run, one after the other (one result line per mode).
+
+static const int timeout = 30 * 1000; // Milliseconds.
+
+static const size_t max_payload = 64 * 1024;
+
+struct server {
+  pthread_t thread;
+
+  net::sync::tcp::socket listener;
+  bool blocking;
+  size_t payload;
+
+  bool failed;
+};
+
+static bool run(const net::socket::address& addr,
+                bool blocking,
+                size_t payload,
+                unsigned duration);
+
+static void* run_server(void* arg);
+static bool recv_message(net::sync::tcp::socket& sock, void* buf, size_t len);
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  const char* address = "127.0.0.1:8888";
+  const char* mode = "both";
+  size_t payload = 64;
+  unsigned duration = 5;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--address") == 0) {
+      address = argv[++i];
+    } else if (strcasecmp(argv[i], "--mode") == 0) {
+      mode = argv[++i];
+    } else if (strcasecmp(argv[i], "--payload") == 0) {
+      payload = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if (((strcasecmp(mode, "poll") != 0) &&
+       (strcasecmp(mode, "blocking") != 0) &&
+       (strcasecmp(mode, "both") != 0)) ||
+      (payload == 0) ||
+      (payload > max_payload) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Build socket address.
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  if (strcasecmp(mode, "blocking") != 0) {
+    if (!run(addr, false, payload, duration)) {
+      return -1;
+    }
+  }
+
+  if (strcasecmp(mode, "poll") != 0) {
+    if (!run(addr, true, payload, duration)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+bool run(const net::socket::address& addr,
+         bool blocking,
+         size_t payload,
+         unsigned duration)
+{
+  server s;
+  s.blocking = blocking;
+  s.payload = payload;
+  s.failed = false;
+
+  if (!s.listener.listen(addr)) {
+    fprintf(stderr, "Error listening.\n");
+    return false;
+  }
+
+  if (pthread_create(&s.thread, nullptr, run_server, &s) != 0) {
+    return false;
+  }
+
+  static uint8_t buf[max_payload];
+  memset(buf, 'x', payload);
+
+  bench::histogram rtt; // Nanoseconds.
+  uint64_t round_trips = 0;
+  bool failed = false;
+
+  net::sync::tcp::socket sock;
+  if ((sock.connect(addr, timeout)) &&
+      (sock.set_tcp_no_delay(true)) &&
+      (sock.set_blocking(blocking))) {
+    uint64_t start = bench::now();
+    uint64_t deadline = start + (duration * 1000000000ull);
+    uint64_t now = start;
+
+    do {
+      if ((!sock.send(buf, payload, timeout)) ||
+          (!recv_message(sock, buf, payload))) {
+        failed = true;
+        break;
+      }
+
+      uint64_t t = bench::now();
+      rtt.record(t - now);
+      now = t;
+
+      round_trips++;
+    } while (now < deadline);
+
+    double seconds = (now - start) / 1000000000.0;
+
+    sock.close();
+
+    pthread_join(s.thread, nullptr);
+
+    if ((!failed) && (!s.failed)) {
+      bench::begin_result("pingpong");
+
+      printf(" mode=%s payload=%zu round_trips=%llu seconds=%.3f "
+             "round_trips_per_sec=%.0f rtt_p50_us=%.2f rtt_p99_us=%.2f "
+             "rtt_max_us=%.2f",
+             blocking ? "blocking" : "poll",
+             payload,
+             static_cast<unsigned long long>(round_trips),
+             seconds,
+             round_trips / seconds,
+             rtt.percentile(50.0) / 1000.0,
+             rtt.percentile(99.0) / 1000.0,
+             rtt.max() / 1000.0);
+
+      bench::end_result();
+
+      return true;
+    }
+  } else {
+    sock.close();
+
+    pthread_join(s.thread, nullptr);
+  }
+
+  fprintf(stderr, "Error running client.\n");
+  return false;
+}
+
+void* run_server(void* arg)
+{
+  server* s = static_cast<server*>(arg);
+
+  static uint8_t buf[max_payload];
+
+  net::sync::tcp::socket sock;
+  if ((s->listener.set_blocking(s->blocking)) &&
+      (s->listener.accept(sock, timeout)) &&
+      (sock.set_tcp_no_delay(true)) &&
+      (sock.set_blocking(s->blocking))) {
+    s->listener.close();
+
+    // Echo the messages until the client closes the connection.
+    do {
+      ssize_t ret;
+      if ((ret = sock.recv(buf, s->payload, timeout)) <= 0) {
+        s->failed = (ret < 0);
+        break;
+      }
+
+      if (((static_cast<size_t>(ret) < s->payload) &&
+           (!recv_message(sock, buf + ret, s->payload - ret))) ||
+          (!sock.send(buf, s->payload, timeout))) {
+        s->failed = true;
+        break;
+      }
+    } while (true);
+  } else {
+    s->listener.close();
+    s->failed = true;
+  }
+
+  return nullptr;
+}
+
+bool recv_message(net::sync::tcp::socket& sock, void* buf, size_t len)
+{
+  uint8_t* b = static_cast<uint8_t*>(buf);
+
+  do {
+    ssize_t ret;
+    if ((ret = sock.recv(b, len, timeout)) <= 0) {
+      return false;
+    }
+
+    b += ret;
+    len -= ret;
+  } while (len > 0);
+
+  return true;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--address <address>] [--mode blocking|poll|both] "
+          "[--payload <bytes>] [--duration <seconds>]\n",
+          program);
+}
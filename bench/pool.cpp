@@ -0,0 +1,426 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#include "net/async/event/connection_pool.h"
+#include "bench/bench.h"
+
+#if defined(USE_SOCKET_TEMPLATE)
+  #error "bench/pool.cpp requires the virtual socket interface."
+#endif
+
+// Request round-trip latency of outbound connections: each request
+// connection sends a message to an echo server and waits for the echo.
+// With the connection pool on, the connection is released to the pool after
+// each response and the next request reuses it; with the pool off, a new
+// connection is opened for each request. The echo server runs on the first
+// dispatcher and the request connections on the second one.
+
+static const int connection_timeout = 30 * 1000; // Milliseconds.
+
+static const size_t max_payload = 64 * 1024;
+
+// Echo connection.
+class echo_connection : public net::async::event::socket {
+  public:
+    // Constructor.
+    echo_connection()
+      : _M_begin(0),
+        _M_end(0)
+    {
+    }
+
+    // Clear.
+    void clear()
+    {
+      delete this;
+    }
+
+    // Run.
+    bool run()
+    {
+      do {
+        // Send pending data.
+        if (_M_begin < _M_end) {
+          ssize_t ret;
+          if ((ret = send(_M_buf + _M_begin, _M_end - _M_begin)) > 0) {
+            if ((_M_begin += ret) < _M_end) {
+              return true;
+            }
+
+            _M_begin = 0;
+            _M_end = 0;
+          } else {
+            return !error();
+          }
+        }
+
+        if (!readable()) {
+          return true;
+        }
+
+        // Receive.
+        ssize_t ret;
+        if ((ret = recv(_M_buf, sizeof(_M_buf))) > 0) {
+          _M_end = ret;
+        } else if (ret == 0) {
+          // Connection closed by peer.
+          return false;
+        } else {
+          return !error();
+        }
+      } while (true);
+    }
+
+  private:
+    uint8_t _M_buf[max_payload];
+    size_t _M_begin;
+    size_t _M_end;
+};
+
+// Echo server.
+class acceptor : public net::async::event::socket {
+  public:
+    // Constructor.
+    acceptor(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher)
+    {
+    }
+
+    // Run.
+    bool run()
+    {
+      do {
+        echo_connection* sock;
+        if ((sock = new (std::nothrow) echo_connection()) == nullptr) {
+          return false;
+        }
+
+        if (!accept(*sock, connection_timeout)) {
+          delete sock;
+          return !error();
+        }
+
+        net::internal::socket::set_tcp_no_delay(sock->handle(), true);
+      } while (true);
+    }
+};
+
+// State shared by the request connections (only used from the thread of
+// the second dispatcher).
+struct requests {
+  net::async::event::dispatcher* dispatcher;
+  net::async::event::connection_pool pool;
+  bool use_pool;
+
+  const net::socket::address* addr;
+  uint8_t* payload;
+  size_t len;
+  uint64_t deadline;
+
+  bench::histogram rtt; // Nanoseconds.
+  uint64_t failed;
+};
+
+// Request connection.
+class request : public net::async::event::pooled_socket {
+  public:
+    // Constructor.
+    request(net::async::event::dispatcher* dispatcher, requests* requests)
+      : net::async::event::pooled_socket(dispatcher),
+        _M_requests(requests),
+        _M_sent(0),
+        _M_received(0),
+        _M_start(bench::now()),
+        _M_done(false)
+    {
+    }
+
+    // Clear.
+    void clear()
+    {
+      if (!_M_done) {
+        _M_requests->failed++;
+      }
+
+      _M_requests->pool.remove(this);
+
+      delete this;
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      // Close idle connections.
+      return false;
+    }
+
+    // Run.
+    bool run()
+    {
+      // Idle connections are checked by the pool before being reused.
+      if (idle()) {
+        return true;
+      }
+
+      // First run of a connection opened from the main thread?
+      if ((!pooled()) &&
+          (_M_requests->use_pool) &&
+          (!_M_requests->pool.add(this, *_M_requests->addr))) {
+        return false;
+      }
+
+      // Send request.
+      while (_M_sent < _M_requests->len) {
+        if (!writable()) {
+          return true;
+        }
+
+        ssize_t ret;
+        if ((ret = send(_M_requests->payload + _M_sent,
+                        _M_requests->len - _M_sent)) > 0) {
+          _M_sent += ret;
+        } else {
+          return !error();
+        }
+      }
+
+      // Receive response.
+      while (_M_received < _M_requests->len) {
+        if (!readable()) {
+          return true;
+        }
+
+        uint8_t buf[max_payload];
+
+        ssize_t ret;
+        if ((ret = recv(buf, _M_requests->len - _M_received)) > 0) {
+          _M_received += ret;
+        } else {
+          return (ret < 0) && (!error());
+        }
+      }
+
+      uint64_t now = bench::now();
+
+      _M_requests->rtt.record(now - _M_start);
+
+      _M_done = true;
+
+      bool keep = (_M_requests->use_pool) && (_M_requests->pool.release(this));
+
+      if (now < _M_requests->deadline) {
+        next(now);
+      }
+
+      return keep;
+    }
+
+  private:
+    requests* _M_requests;
+
+    size_t _M_sent;
+    size_t _M_received;
+    uint64_t _M_start;
+
+    bool _M_done;
+
+    // Start request.
+    void start(uint64_t now)
+    {
+      _M_sent = 0;
+      _M_received = 0;
+      _M_start = now;
+      _M_done = false;
+    }
+
+    // Send the next request (reusing an idle connection or opening a new
+    // one).
+    void next(uint64_t now)
+    {
+      net::async::event::connection_pool& pool = _M_requests->pool;
+
+      if (_M_requests->use_pool) {
+        request* sock;
+        if ((sock = static_cast<request*>(
+                      pool.acquire(*_M_requests->addr)
+                    )) != nullptr) {
+          sock->start(now);
+          sock->schedule_run();
+
+          return;
+        }
+      }
+
+      request* sock;
+      if ((sock = new (std::nothrow) request(_M_requests->dispatcher,
+                                             _M_requests)) != nullptr) {
+        if (_M_requests->use_pool ?
+              pool.connect(sock, *_M_requests->addr, connection_timeout) :
+              sock->connect(*_M_requests->addr, connection_timeout)) {
+          net::internal::socket::set_tcp_no_delay(sock->handle(), true);
+        } else {
+          delete sock;
+          _M_requests->failed++;
+        }
+      } else {
+        _M_requests->failed++;
+      }
+    }
+};
+
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  const char* address = "127.0.0.1:8888";
+  size_t nconnections = 1;
+  size_t payload = 64;
+  unsigned duration = 5;
+  bool use_pool = true;
+  net::async::event::dispatchers::config config;
+  config.name = "pool";
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--address") == 0) {
+      address = argv[++i];
+    } else if (strcasecmp(argv[i], "--connections") == 0) {
+      nconnections = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--payload") == 0) {
+      payload = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--pool") == 0) {
+      use_pool = (strcasecmp(argv[++i], "on") == 0);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if ((nconnections == 0) ||
+      (payload == 0) ||
+      (payload > max_payload) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Build socket address.
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  requests* reqs;
+  if ((reqs = new (std::nothrow) requests) == nullptr) {
+    return -1;
+  }
+
+  net::async::event::connection_pool::config pool_config;
+  pool_config.max_idle = nconnections;
+
+  if (!reqs->pool.create(pool_config)) {
+    return -1;
+  }
+
+  if ((reqs->payload = static_cast<uint8_t*>(malloc(payload))) == nullptr) {
+    return -1;
+  }
+
+  memset(reqs->payload, 'x', payload);
+
+  reqs->use_pool = use_pool;
+  reqs->addr = &addr;
+  reqs->len = payload;
+  reqs->failed = 0;
+
+  // Start dispatchers.
+  net::async::event::dispatchers dispatchers;
+  if (!dispatchers.start(2, config)) {
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  reqs->dispatcher = dispatchers.get(1);
+
+  acceptor* server;
+  if (((server = new (std::nothrow) acceptor(dispatchers.get(0))) ==
+       nullptr) ||
+      (!server->listen(addr))) {
+    fprintf(stderr, "Error listening on '%s'.\n", address);
+    return -1;
+  }
+
+  reqs->deadline = bench::now() + (duration * 1000000000ull);
+
+  // Open the request connections (they are added to the pool when they are
+  // run for the first time).
+  for (size_t i = 0; i < nconnections; i++) {
+    request* sock;
+    if (((sock = new (std::nothrow) request(reqs->dispatcher, reqs)) ==
+         nullptr) ||
+        (!sock->connect(addr, connection_timeout))) {
+      fprintf(stderr, "Error connecting to '%s'.\n", address);
+      return -1;
+    }
+
+    net::internal::socket::set_tcp_no_delay(sock->handle(), true);
+  }
+
+  // Wait until the last requests have been answered.
+  sleep(duration + 1);
+
+  dispatchers.stop();
+
+  // Sockets registered through the pipe of the requests' dispatcher.
+  net::async::event::metrics m;
+  reqs->dispatcher->get_metrics(m);
+
+  const net::async::event::connection_pool::stats&
+    stats = reqs->pool.get_stats();
+
+  bench::begin_result("pool");
+
+  printf(" pool=%s connections=%zu payload=%zu requests=%llu "
+         "requests_per_sec=%.0f opened=%llu reused=%llu stale=%llu "
+         "failed=%llu handoffs=%llu rtt_min_us=%.2f rtt_mean_us=%.2f "
+         "rtt_p50_us=%.2f rtt_p90_us=%.2f rtt_p99_us=%.2f rtt_max_us=%.2f",
+         use_pool ? "on" : "off",
+         nconnections,
+         payload,
+         static_cast<unsigned long long>(reqs->rtt.count()),
+         static_cast<double>(reqs->rtt.count()) / duration,
+         static_cast<unsigned long long>(stats.opened),
+         static_cast<unsigned long long>(stats.reused),
+         static_cast<unsigned long long>(stats.stale),
+         static_cast<unsigned long long>(reqs->failed),
+         static_cast<unsigned long long>(m.handoffs),
+         reqs->rtt.min() / 1000.0,
+         reqs->rtt.mean() / 1000.0,
+         reqs->rtt.percentile(50.0) / 1000.0,
+         reqs->rtt.percentile(90.0) / 1000.0,
+         reqs->rtt.percentile(99.0) / 1000.0,
+         reqs->rtt.max() / 1000.0);
+
+  bench::end_result();
+
+  return 0;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--address <address>] [--connections <count>] "
+          "[--payload <bytes>] [--duration <seconds>] [--pool on|off]\n",
+          program);
+}
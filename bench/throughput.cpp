@@ -0,0 +1,333 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#if defined(USE_SOCKET_TEMPLATE)
+  #include "net/async/event/dispatchers.cpp"
+#endif
+#include "net/async/event/socket.h"
+#include "net/sync/tcp/socket.h"
+#include "bench/bench.h"
+
+// Bulk TCP throughput: each client connection sends data as fast as it can
+// and the server discards it. The throughput is computed from the number of
+// bytes received by the server.
+
+static const int timeout = 30 * 1000; // Milliseconds.
+
+static const size_t max_payload = 1024 * 1024;
+
+// In the template build all the sockets handled by a dispatcher have the
+// same type, so the same class is used for the acceptor and the
+// connections.
+class sink_socket : public net::async::event::socket {
+  public:
+    // Constructor.
+    sink_socket()
+      : _M_acceptor(nullptr),
+        _M_next(nullptr),
+        _M_free_sockets(nullptr),
+        _M_received(0)
+    {
+    }
+
+    sink_socket(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher),
+        _M_acceptor(nullptr),
+        _M_next(nullptr),
+        _M_free_sockets(nullptr),
+        _M_received(0)
+    {
+    }
+
+    // Destructor.
+    ~sink_socket()
+    {
+      sink_socket* sock = _M_free_sockets;
+
+      while (sock) {
+        sink_socket* next = sock->_M_next;
+
+        delete sock;
+        sock = next;
+      }
+    }
+
+    // Clear.
+    void clear()
+    {
+      // Connection?
+      if (_M_acceptor) {
+        // Add socket to the free list.
+        _M_next = _M_acceptor->_M_free_sockets;
+        _M_acceptor->_M_free_sockets = this;
+      }
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      return false;
+    }
+
+    // Run.
+    bool run()
+    {
+      return _M_acceptor ? run_connection() : run_acceptor();
+    }
+
+    // Get number of bytes received by all the connections.
+    uint64_t received() const
+    {
+      return _M_received;
+    }
+
+  private:
+    sink_socket* _M_acceptor;
+    sink_socket* _M_next;
+
+    sink_socket* _M_free_sockets;
+
+    // Bytes received (acceptor).
+    uint64_t _M_received;
+
+    // Receive buffer (shared by the connections of the same dispatcher).
+    static __thread uint8_t _M_buf[256 * 1024];
+
+    // Run acceptor.
+    bool run_acceptor()
+    {
+      do {
+        sink_socket* sock;
+        if (_M_free_sockets) {
+          sock = _M_free_sockets;
+          _M_free_sockets = sock->_M_next;
+        } else if ((sock = new (std::nothrow) sink_socket()) == nullptr) {
+          return false;
+        }
+
+        sock->_M_acceptor = this;
+
+        if (!accept(*sock)) {
+          sock->_M_next = _M_free_sockets;
+          _M_free_sockets = sock;
+
+          return !error();
+        }
+      } while (true);
+    }
+
+    // Run connection.
+    bool run_connection()
+    {
+      while (readable()) {
+        ssize_t ret;
+        if ((ret = recv(_M_buf, sizeof(_M_buf))) > 0) {
+          _M_acceptor->_M_received += ret;
+        } else if (ret == 0) {
+          // Connection closed by peer.
+          return false;
+        } else {
+          return !error();
+        }
+      }
+
+      return true;
+    }
+};
+
+__thread uint8_t sink_socket::_M_buf[256 * 1024];
+
+struct client {
+  pthread_t thread;
+
+  const net::socket::address* addr;
+  size_t payload;
+  uint64_t deadline;
+
+  bool failed;
+};
+
+static void* run_client(void* arg);
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  const char* address = "127.0.0.1:8888";
+  size_t nconnections = 1;
+  size_t ndispatchers = 1;
+  size_t payload = 64 * 1024;
+  unsigned duration = 5;
+  net::async::event::dispatchers::config config;
+  config.name = "throughput";
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--address") == 0) {
+      address = argv[++i];
+    } else if (strcasecmp(argv[i], "--connections") == 0) {
+      nconnections = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--dispatchers") == 0) {
+      ndispatchers = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--payload") == 0) {
+      payload = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--read-budget") == 0) {
+      config.read_budget = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if ((nconnections == 0) ||
+      (ndispatchers == 0) ||
+      (payload == 0) ||
+      (payload > max_payload) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Build socket address.
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  // Start dispatchers.
+  net::async::event::dispatchers dispatchers;
+#if defined(USE_SOCKET_TEMPLATE)
+  if (!dispatchers.start<sink_socket>(ndispatchers, config)) {
+#else
+  if (!dispatchers.start(ndispatchers, config)) {
+#endif
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  // Create one acceptor per dispatcher (listening on the same port).
+  sink_socket** acceptors;
+  if ((acceptors = new (std::nothrow) sink_socket*[ndispatchers]) == nullptr) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    if (((acceptors[i] = new (std::nothrow)
+                         sink_socket(dispatchers.get(i))) == nullptr) ||
+        (!acceptors[i]->listen(addr))) {
+      fprintf(stderr, "Error listening on '%s'.\n", address);
+      return -1;
+    }
+  }
+
+  client* clients;
+  if ((clients = new (std::nothrow) client[nconnections]) == nullptr) {
+    return -1;
+  }
+
+  uint64_t start = bench::now();
+
+  size_t nclients;
+  for (nclients = 0; nclients < nconnections; nclients++) {
+    client* c = &clients[nclients];
+
+    c->addr = &addr;
+    c->payload = payload;
+    c->deadline = start + (duration * 1000000000ull);
+    c->failed = false;
+
+    if (pthread_create(&c->thread, nullptr, run_client, c) != 0) {
+      break;
+    }
+  }
+
+  bool failed = (nclients != nconnections);
+
+  for (size_t i = 0; i < nclients; i++) {
+    pthread_join(clients[i].thread, nullptr);
+    failed |= clients[i].failed;
+  }
+
+  double seconds = (bench::now() - start) / 1000000000.0;
+
+  dispatchers.stop();
+
+  uint64_t received = 0;
+  for (size_t i = 0; i < ndispatchers; i++) {
+    received += acceptors[i]->received();
+    delete acceptors[i];
+  }
+
+  delete [] acceptors;
+  delete [] clients;
+
+  if (failed) {
+    fprintf(stderr, "Error running clients.\n");
+    return -1;
+  }
+
+  bench::begin_result("throughput");
+
+  printf(" connections=%zu dispatchers=%zu payload=%zu read_budget=%zu "
+         "bytes=%llu seconds=%.3f mbytes_per_sec=%.2f gbits_per_sec=%.3f",
+         nconnections,
+         ndispatchers,
+         payload,
+         config.read_budget,
+         static_cast<unsigned long long>(received),
+         seconds,
+         (received / seconds) / (1024.0 * 1024.0),
+         (received * 8.0 / seconds) / 1000000000.0);
+
+  bench::end_result();
+
+  return 0;
+}
+
+void* run_client(void* arg)
+{
+  client* c = static_cast<client*>(arg);
+
+  uint8_t* buf;
+  if ((buf = static_cast<uint8_t*>(malloc(c->payload))) == nullptr) {
+    c->failed = true;
+    return nullptr;
+  }
+
+  memset(buf, 'x', c->payload);
+
+  net::sync::tcp::socket sock;
+  if (sock.connect(*c->addr, timeout)) {
+    do {
+      if (!sock.send(buf, c->payload, timeout)) {
+        c->failed = true;
+        break;
+      }
+    } while (bench::now() < c->deadline);
+  } else {
+    c->failed = true;
+  }
+
+  free(buf);
+
+  return nullptr;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--address <address>] [--connections <count>] "
+          "[--dispatchers <count>] [--payload <bytes>] "
+          "[--duration <seconds>] [--read-budget <bytes>]\n",
+          program);
+}
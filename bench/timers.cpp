@@ -0,0 +1,288 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <new>
+#include "net/async/event/dispatcher.h"
+#if defined(USE_SOCKET_TEMPLATE)
+  #include "net/async/event/dispatcher.cpp"
+#endif
+#include "net/async/event/socket.h"
+#include "bench/bench.h"
+
+// Timers: each dispatcher schedules its share of one-shot timers (expiring
+// at random times during the benchmark) before it is started, cancels a
+// percentage of them and runs a few periodic timers. The cost of scheduling
+// and cancelling a timer and how late the timers expire are measured.
+// The one-shot timers start expiring after 'startup' nanoseconds, so that
+// the time spent scheduling them is not counted as lateness.
+
+static const uint64_t startup = 1000000000ull;
+
+#if defined(USE_SOCKET_TEMPLATE)
+// In the template build the dispatcher needs a socket type (no sockets are
+// registered).
+class idle_socket : public net::async::event::socket {
+  public:
+    // Clear.
+    void clear()
+    {
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      return false;
+    }
+
+    // Run.
+    bool run()
+    {
+      return false;
+    }
+};
+#endif // defined(USE_SOCKET_TEMPLATE)
+
+// Timers of a dispatcher.
+struct shard {
+  net::async::event::dispatcher dispatcher;
+
+  net::async::event::timer* timers;
+  size_t ntimers;
+
+  net::async::event::timer* periodic;
+  size_t nperiodic;
+
+  uint64_t fired;
+  bench::histogram lateness; // Nanoseconds.
+
+  uint64_t periodic_fired;
+  bench::histogram periodic_lateness; // Nanoseconds.
+};
+
+static void expired(net::async::event::timer& t, void* arg);
+static void expired_periodic(net::async::event::timer& t, void* arg);
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  size_t ntimers = 1000000;
+  size_t ndispatchers = 1;
+  size_t nperiodic = 16;
+  unsigned period = 250; // Microseconds.
+  unsigned cancel = 50; // Percentage.
+  unsigned duration = 5;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--timers") == 0) {
+      ntimers = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--dispatchers") == 0) {
+      ndispatchers = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--periodic") == 0) {
+      nperiodic = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--period") == 0) {
+      period = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--cancel") == 0) {
+      cancel = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if ((ndispatchers == 0) ||
+      (period == 0) ||
+      (cancel > 100) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  shard** shards;
+  if ((shards = new (std::nothrow) shard*[ndispatchers]) == nullptr) {
+    return -1;
+  }
+
+  uint64_t schedule_time = 0;
+  uint64_t cancel_time = 0;
+  size_t ncancelled = 0;
+
+  uint64_t seed = 0x9e3779b97f4a7c15ull;
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    shard* s;
+    if (((s = shards[i] = new (std::nothrow) shard()) == nullptr) ||
+        (!s->dispatcher.create())) {
+      fprintf(stderr, "Error creating dispatcher.\n");
+      return -1;
+    }
+
+    s->ntimers = (ntimers / ndispatchers) +
+                 (i < ntimers % ndispatchers);
+
+    s->nperiodic = nperiodic;
+    s->fired = 0;
+    s->periodic_fired = 0;
+
+    if (((s->timers = new (std::nothrow)
+                      net::async::event::timer[s->ntimers + 1]) ==
+         nullptr) ||
+        ((s->periodic = new (std::nothrow)
+                        net::async::event::timer[s->nperiodic + 1]) ==
+         nullptr)) {
+      return -1;
+    }
+
+    // Schedule the one-shot timers (before the dispatcher is started).
+    uint64_t start = bench::now();
+
+    for (size_t j = 0; j < s->ntimers; j++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+
+      s->timers[j].set_callback(expired, s);
+      s->dispatcher.schedule(s->timers[j],
+                             startup +
+                             (seed % (duration * 1000000000ull)));
+    }
+
+    uint64_t end = bench::now();
+    schedule_time += end - start;
+
+    // Cancel a percentage of them.
+    size_t n = (s->ntimers * cancel) / 100;
+
+    for (size_t j = 0; j < n; j++) {
+      s->dispatcher.cancel(s->timers[j * s->ntimers / n]);
+    }
+
+    cancel_time += bench::now() - end;
+    ncancelled += n;
+
+    for (size_t j = 0; j < s->nperiodic; j++) {
+      s->periodic[j].set_callback(expired_periodic, s);
+      s->dispatcher.schedule(s->periodic[j],
+                             period * 1000ull,
+                             period * 1000ull);
+    }
+  }
+
+  // Start dispatchers.
+  for (size_t i = 0; i < ndispatchers; i++) {
+#if defined(USE_SOCKET_TEMPLATE)
+    if (!shards[i]->dispatcher.start<idle_socket>()) {
+#else
+    if (!shards[i]->dispatcher.start()) {
+#endif
+      fprintf(stderr, "Error starting dispatchers.\n");
+      return -1;
+    }
+  }
+
+  // Wait for the timers to expire.
+  usleep(((startup / 1000) + (duration * 1000000)) + 100000);
+
+  bench::histogram lateness;
+  bench::histogram periodic_lateness;
+  uint64_t fired = 0;
+  uint64_t periodic_fired = 0;
+  uint64_t iterations = 0;
+
+  for (size_t i = 0; i < ndispatchers; i++) {
+    shard* s = shards[i];
+
+    s->dispatcher.stop();
+
+    net::async::event::metrics m;
+    s->dispatcher.get_metrics(m);
+
+    iterations += m.iterations;
+
+    lateness.add(s->lateness);
+    periodic_lateness.add(s->periodic_lateness);
+    fired += s->fired;
+    periodic_fired += s->periodic_fired;
+
+    delete [] s->timers;
+    delete [] s->periodic;
+    delete s;
+  }
+
+  delete [] shards;
+
+  if (fired != ntimers - ncancelled) {
+    fprintf(stderr,
+            "%llu timers expired, %llu expected.\n",
+            static_cast<unsigned long long>(fired),
+            static_cast<unsigned long long>(ntimers - ncancelled));
+
+    return -1;
+  }
+
+  bench::begin_result("timers");
+
+  printf(" timers=%zu dispatchers=%zu cancelled=%zu periodic=%zu "
+         "period_us=%u seconds=%u schedule_ns=%.1f cancel_ns=%.1f "
+         "fired=%llu late_p50_us=%.2f late_p99_us=%.2f late_max_us=%.2f "
+         "periodic_fired=%llu periodic_late_p50_us=%.2f "
+         "periodic_late_p99_us=%.2f iterations=%llu",
+         ntimers,
+         ndispatchers,
+         ncancelled,
+         nperiodic * ndispatchers,
+         period,
+         duration,
+         (ntimers > 0) ? static_cast<double>(schedule_time) / ntimers : 0.0,
+         (ncancelled > 0) ? static_cast<double>(cancel_time) / ncancelled :
+                            0.0,
+         static_cast<unsigned long long>(fired),
+         lateness.percentile(50.0) / 1000.0,
+         lateness.percentile(99.0) / 1000.0,
+         lateness.max() / 1000.0,
+         static_cast<unsigned long long>(periodic_fired),
+         periodic_lateness.percentile(50.0) / 1000.0,
+         periodic_lateness.percentile(99.0) / 1000.0,
+         static_cast<unsigned long long>(iterations));
+
+  bench::end_result();
+
+  return 0;
+}
+
+void expired(net::async::event::timer& t, void* arg)
+{
+  shard* s = static_cast<shard*>(arg);
+
+  s->lateness.record(bench::now() - t.expiration());
+  s->fired++;
+}
+
+void expired_periodic(net::async::event::timer& t, void* arg)
+{
+  shard* s = static_cast<shard*>(arg);
+
+  // The timer has already been rearmed for the next period.
+  uint64_t now = bench::now();
+  uint64_t expiration = t.expiration() - t.period();
+
+  s->periodic_lateness.record((now > expiration) ? now - expiration : 0);
+  s->periodic_fired++;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--timers <count>] [--dispatchers <count>] "
+          "[--periodic <count>] [--period <microseconds>] "
+          "[--cancel <percentage>] [--duration <seconds>]\n",
+          program);
+}
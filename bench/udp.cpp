@@ -0,0 +1,370 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#if defined(USE_SOCKET_TEMPLATE)
+  #include "net/async/event/dispatchers.cpp"
+#endif
+#include "net/async/event/socket.h"
+#include "net/sync/udp/socket.h"
+#include "bench/bench.h"
+
+// UDP packets per second: the senders send datagrams as fast as they can,
+// one per sendto() call or in batches with sendmmsg(), and one socket per
+// dispatcher receives them. Datagrams dropped by the kernel are counted as
+// sent but not as received.
+
+static const int timeout = 30 * 1000; // Milliseconds.
+
+static const size_t max_payload = 64 * 1024 - 64;
+static const unsigned max_batch = 1024;
+
+class receiver : public net::async::event::socket {
+  public:
+    // Constructor.
+    receiver(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher),
+        _M_received(0)
+    {
+    }
+
+    // Clear.
+    void clear()
+    {
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      return false;
+    }
+
+    // Run.
+    bool run()
+    {
+      while (readable()) {
+        if (recvfrom(_M_buf, sizeof(_M_buf)) >= 0) {
+          _M_received++;
+        } else {
+          return !error();
+        }
+      }
+
+      return true;
+    }
+
+    // Get number of datagrams received.
+    uint64_t received() const
+    {
+      return _M_received;
+    }
+
+  private:
+    uint8_t _M_buf[64 * 1024];
+
+    uint64_t _M_received;
+};
+
+enum class mode {
+  sendto,
+  sendmmsg
+};
+
+struct sender {
+  pthread_t thread;
+
+  const net::socket::address* addr;
+  mode m;
+  size_t payload;
+  unsigned batch;
+  uint64_t deadline;
+
+  uint64_t sent;
+  bool failed;
+};
+
+static void* run_sender(void* arg);
+static bool run(const net::socket::address& addr,
+                mode m,
+                size_t nsenders,
+                size_t ndispatchers,
+                size_t payload,
+                unsigned batch,
+                unsigned duration);
+
+static void usage(const char* program);
+
+int main(int argc, const char** argv)
+{
+  const char* address = "127.0.0.1:8888";
+  const char* modes = "both";
+  size_t nsenders = 1;
+  size_t ndispatchers = 1;
+  size_t payload = 64;
+  unsigned batch = 64;
+  unsigned duration = 5;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    if (strcasecmp(argv[i], "--address") == 0) {
+      address = argv[++i];
+    } else if (strcasecmp(argv[i], "--mode") == 0) {
+      modes = argv[++i];
+    } else if (strcasecmp(argv[i], "--senders") == 0) {
+      nsenders = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--dispatchers") == 0) {
+      ndispatchers = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--payload") == 0) {
+      payload = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--batch") == 0) {
+      batch = strtoul(argv[++i], nullptr, 10);
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      duration = strtoul(argv[++i], nullptr, 10);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  bool use_sendto, use_sendmmsg;
+  if (strcasecmp(modes, "both") == 0) {
+    use_sendto = true;
+    use_sendmmsg = true;
+  } else if (strcasecmp(modes, "sendto") == 0) {
+    use_sendto = true;
+    use_sendmmsg = false;
+  } else if (strcasecmp(modes, "sendmmsg") == 0) {
+    use_sendto = false;
+    use_sendmmsg = true;
+  } else {
+    usage(argv[0]);
+    return -1;
+  }
+
+  if ((nsenders == 0) ||
+      (ndispatchers == 0) ||
+      (payload > max_payload) ||
+      (batch == 0) ||
+      (batch > max_batch) ||
+      (duration == 0)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Build socket address.
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  return (((!use_sendto) ||
+           (run(addr,
+                mode::sendto,
+                nsenders,
+                ndispatchers,
+                payload,
+                1,
+                duration))) &&
+          ((!use_sendmmsg) ||
+           (run(addr,
+                mode::sendmmsg,
+                nsenders,
+                ndispatchers,
+                payload,
+                batch,
+                duration)))) ? 0 : -1;
+}
+
+void* run_sender(void* arg)
+{
+  sender* s = static_cast<sender*>(arg);
+
+  uint8_t buf[max_payload];
+  memset(buf, 'x', s->payload);
+
+  net::sync::udp::socket sock;
+  if (!sock.create(static_cast<net::socket::domain>(s->addr->family()))) {
+    s->failed = true;
+    return nullptr;
+  }
+
+  if (s->m == mode::sendto) {
+    do {
+      if (!sock.sendto(buf, s->payload, *s->addr, timeout)) {
+        s->failed = true;
+        break;
+      }
+
+      s->sent++;
+    } while (bench::now() < s->deadline);
+  } else {
+    struct iovec vec;
+    vec.iov_base = buf;
+    vec.iov_len = s->payload;
+
+    struct mmsghdr msgs[max_batch];
+    for (unsigned i = 0; i < s->batch; i++) {
+      struct msghdr* msg = &msgs[i].msg_hdr;
+
+      msg->msg_name = const_cast<struct sockaddr*>(
+                        static_cast<const struct sockaddr*>(*s->addr)
+                      );
+
+      msg->msg_namelen = s->addr->size();
+      msg->msg_iov = &vec;
+      msg->msg_iovlen = 1;
+      msg->msg_control = nullptr;
+      msg->msg_controllen = 0;
+      msg->msg_flags = 0;
+    }
+
+    do {
+      if (!sock.sendmmsg(msgs, s->batch, timeout)) {
+        s->failed = true;
+        break;
+      }
+
+      s->sent += s->batch;
+    } while (bench::now() < s->deadline);
+  }
+
+  return nullptr;
+}
+
+bool run(const net::socket::address& addr,
+         mode m,
+         size_t nsenders,
+         size_t ndispatchers,
+         size_t payload,
+         unsigned batch,
+         unsigned duration)
+{
+  // Start dispatchers.
+  net::async::event::dispatchers dispatchers;
+#if defined(USE_SOCKET_TEMPLATE)
+  if (!dispatchers.start<receiver>(ndispatchers)) {
+#else
+  if (!dispatchers.start(ndispatchers)) {
+#endif
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return false;
+  }
+
+  // Create one receiver per dispatcher (bound to the same port).
+  receiver** receivers;
+  if ((receivers = new (std::nothrow) receiver*[ndispatchers]) == nullptr) {
+    return false;
+  }
+
+  size_t nreceivers;
+  for (nreceivers = 0; nreceivers < ndispatchers; nreceivers++) {
+    if ((receivers[nreceivers] = new (std::nothrow)
+                                 receiver(dispatchers.get(nreceivers))) ==
+        nullptr) {
+      break;
+    }
+
+    if (!receivers[nreceivers]->bind(addr)) {
+      delete receivers[nreceivers];
+      break;
+    }
+  }
+
+  sender* senders = nullptr;
+  bool ret = false;
+
+  if ((nreceivers == ndispatchers) &&
+      ((senders = new (std::nothrow) sender[nsenders]) != nullptr)) {
+    uint64_t start = bench::now();
+
+    size_t nstarted;
+    for (nstarted = 0; nstarted < nsenders; nstarted++) {
+      sender* s = &senders[nstarted];
+
+      s->addr = &addr;
+      s->m = m;
+      s->payload = payload;
+      s->batch = batch;
+      s->deadline = start + (duration * 1000000000ull);
+      s->sent = 0;
+      s->failed = false;
+
+      if (pthread_create(&s->thread, nullptr, run_sender, s) != 0) {
+        break;
+      }
+    }
+
+    uint64_t sent = 0;
+    bool failed = (nstarted != nsenders);
+
+    for (size_t i = 0; i < nstarted; i++) {
+      pthread_join(senders[i].thread, nullptr);
+
+      sent += senders[i].sent;
+      failed |= senders[i].failed;
+    }
+
+    double seconds = (bench::now() - start) / 1000000000.0;
+
+    dispatchers.stop();
+
+    uint64_t received = 0;
+    for (size_t i = 0; i < nreceivers; i++) {
+      received += receivers[i]->received();
+    }
+
+    if (!failed) {
+      bench::begin_result("udp");
+
+      printf(" mode=%s senders=%zu dispatchers=%zu payload=%zu batch=%u "
+             "sent=%llu received=%llu seconds=%.3f sent_pps=%.0f "
+             "received_pps=%.0f",
+             (m == mode::sendto) ? "sendto" : "sendmmsg",
+             nsenders,
+             ndispatchers,
+             payload,
+             batch,
+             static_cast<unsigned long long>(sent),
+             static_cast<unsigned long long>(received),
+             seconds,
+             sent / seconds,
+             received / seconds);
+
+      bench::end_result();
+
+      ret = true;
+    } else {
+      fprintf(stderr, "Error running senders.\n");
+    }
+  } else {
+    fprintf(stderr, "Error binding to the address.\n");
+  }
+
+  dispatchers.stop();
+
+  for (size_t i = 0; i < nreceivers; i++) {
+    delete receivers[i];
+  }
+
+  delete [] receivers;
+  delete [] senders;
+
+  return ret;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--address <address>] [--mode sendto|sendmmsg|both] "
+          "[--senders <count>] [--dispatchers <count>] "
+          "[--payload <bytes>] [--batch <count>] [--duration <seconds>]\n",
+          program);
+}
@@ -0,0 +1,574 @@
+#ifndef NET_ASYNC_EVENT_CONNECTION_POOL_H
+#define NET_ASYNC_EVENT_CONNECTION_POOL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <new>
+#include "net/async/event/socket.h"
+
+namespace net {
+  namespace async {
+    namespace event {
+      class pooled_socket;
+
+      // Pool of outbound connections, keyed by destination address.
+      // Connections opened through the pool (connect()) are counted per
+      // destination and, once released (release()), they are kept idle
+      // with their own idle timeout until they are reused (acquire()). An
+      // idle connection is checked before it is reused: if the peer has
+      // closed it or has sent unexpected data, it is failed and the next one
+      // is tried.
+      // The pool is used from the thread of a single dispatcher (one pool
+      // per dispatcher). While a connection is idle, the dispatcher keeps
+      // calling its handlers: timeout() is called when the idle timeout
+      // expires (return false to close the connection) and clear() has to
+      // call remove(). The pool has to outlive its connections.
+      class connection_pool {
+        friend class pooled_socket;
+
+        public:
+          static const size_t default_max_connections = 0;
+          static const size_t default_max_idle = 16;
+          static const unsigned default_idle_timeout = 30 * 1000;
+          static const size_t default_buckets = 64;
+
+          struct config {
+            // Maximum number of connections per destination (in use and
+            // idle, 0: no limit).
+            size_t max_connections;
+
+            // Maximum number of idle connections per destination.
+            size_t max_idle;
+
+            // Idle timeout (milliseconds).
+            unsigned idle_timeout;
+
+            // Initial number of buckets of the hash table of destinations
+            // (power of two).
+            size_t buckets;
+
+            // Constructor.
+            config();
+          };
+
+          struct stats {
+            // Idle connections reused.
+            uint64_t reused;
+
+            // Connections opened.
+            uint64_t opened;
+
+            // Idle connections failed by the health check.
+            uint64_t stale;
+
+            // Connections rejected by the limit of connections.
+            uint64_t rejected;
+          };
+
+          // Constructor.
+          connection_pool();
+
+          // Destructor.
+          ~connection_pool();
+
+          // Create.
+          bool create();
+          bool create(const config& config);
+
+          // Open connection to 'addr'.
+          // Fails with EAGAIN if the destination has already the maximum
+          // number of connections.
+          bool connect(pooled_socket* sock, const net::socket::address& addr);
+          bool connect(pooled_socket* sock,
+                       const net::socket::address& addr,
+                       unsigned timeout);
+
+          // Add a connection to 'addr' opened outside the pool.
+          bool add(pooled_socket* sock, const net::socket::address& addr);
+
+          // Get an idle connection to 'addr' (the connection released last
+          // is reused first) and restore its timeout.
+          // Returns nullptr if there is none.
+          pooled_socket* acquire(const net::socket::address& addr);
+
+          // Release connection (it is kept idle).
+          // Returns false if the connection can't be kept (the destination
+          // has already the maximum number of idle connections or the
+          // connection has failed or has data pending to be sent); the
+          // caller should then close it.
+          bool release(pooled_socket* sock);
+
+          // Remove connection from the pool (called from clear()).
+          void remove(pooled_socket* sock);
+
+          // Get number of connections to 'addr' (in use and idle).
+          size_t connections(const net::socket::address& addr) const;
+
+          // Get number of idle connections to 'addr'.
+          size_t idle(const net::socket::address& addr) const;
+
+          // Get statistics.
+          const stats& get_stats() const;
+
+        private:
+          // Destination.
+          struct destination {
+            net::socket::address addr;
+            size_t hash;
+
+            // Next destination in the bucket.
+            destination* next;
+
+            // Idle connections (the connection released last first).
+            pooled_socket* idle;
+
+            size_t nidle;
+            size_t nconnections;
+          };
+
+          config _M_config;
+
+          destination** _M_buckets;
+          size_t _M_nbuckets;
+          size_t _M_ndestinations;
+
+          stats _M_stats;
+
+          // Find destination.
+          destination* find(const net::socket::address& addr) const;
+
+          // Find or insert destination.
+          destination* get(const net::socket::address& addr);
+
+          // Double the number of buckets.
+          bool grow();
+
+          // Add connection to the destination.
+          bool add(pooled_socket* sock, destination* dest);
+
+          // Link / unlink idle connection.
+          static void link_idle(destination* dest, pooled_socket* sock);
+          static void unlink_idle(destination* dest, pooled_socket* sock);
+
+          // Check idle connection before reusing it.
+          static bool healthy(pooled_socket* sock);
+
+          // Disable copy constructor and assignment operator.
+          connection_pool(const connection_pool&) = delete;
+          connection_pool& operator=(const connection_pool&) = delete;
+      };
+
+      // Socket which can be kept in a connection pool.
+      class pooled_socket : public socket {
+        friend class connection_pool;
+
+        public:
+          // Constructor.
+          pooled_socket(dispatcher* dispatcher);
+          pooled_socket();
+
+          // Is the connection in a pool?
+          bool pooled() const;
+
+          // Is the connection idle in its pool?
+          bool idle() const;
+
+        private:
+          connection_pool::destination* _M_destination;
+
+          // Previous and next idle connections to the same destination.
+          pooled_socket* _M_prev_idle;
+          pooled_socket* _M_next_idle;
+
+          bool _M_idle;
+
+          // Timeout to restore when the connection is reused.
+          int _M_saved_timeout;
+      };
+
+      inline connection_pool::config::config()
+        : max_connections(default_max_connections),
+          max_idle(default_max_idle),
+          idle_timeout(default_idle_timeout),
+          buckets(default_buckets)
+      {
+      }
+
+      inline connection_pool::connection_pool()
+        : _M_buckets(nullptr),
+          _M_nbuckets(0),
+          _M_ndestinations(0)
+      {
+        _M_stats.reused = 0;
+        _M_stats.opened = 0;
+        _M_stats.stale = 0;
+        _M_stats.rejected = 0;
+      }
+
+      inline connection_pool::~connection_pool()
+      {
+        for (size_t i = 0; i < _M_nbuckets; i++) {
+          destination* dest = _M_buckets[i];
+
+          while (dest) {
+            destination* next = dest->next;
+
+            delete dest;
+            dest = next;
+          }
+        }
+
+        free(_M_buckets);
+      }
+
+      inline bool connection_pool::create()
+      {
+        return create(config());
+      }
+
+      inline bool connection_pool::create(const config& config)
+      {
+        // If the number of buckets is not a power of two...
+        if ((config.buckets == 0) ||
+            ((config.buckets & (config.buckets - 1)) != 0) ||
+            (_M_buckets)) {
+          errno = EINVAL;
+          return false;
+        }
+
+        if ((_M_buckets = static_cast<destination**>(
+                            calloc(config.buckets, sizeof(destination*))
+                          )) == nullptr) {
+          return false;
+        }
+
+        _M_config = config;
+        _M_nbuckets = config.buckets;
+
+        return true;
+      }
+
+      inline bool connection_pool::connect(pooled_socket* sock,
+                                           const net::socket::address& addr)
+      {
+        destination* dest;
+        if ((dest = get(addr)) != nullptr) {
+          if ((_M_config.max_connections == 0) ||
+              (dest->nconnections < _M_config.max_connections)) {
+            if (sock->connect(addr)) {
+              _M_stats.opened++;
+              return add(sock, dest);
+            }
+          } else {
+            _M_stats.rejected++;
+            errno = EAGAIN;
+          }
+        }
+
+        return false;
+      }
+
+      inline bool connection_pool::connect(pooled_socket* sock,
+                                           const net::socket::address& addr,
+                                           unsigned timeout)
+      {
+        destination* dest;
+        if ((dest = get(addr)) != nullptr) {
+          if ((_M_config.max_connections == 0) ||
+              (dest->nconnections < _M_config.max_connections)) {
+            if (sock->connect(addr, timeout)) {
+              _M_stats.opened++;
+              return add(sock, dest);
+            }
+          } else {
+            _M_stats.rejected++;
+            errno = EAGAIN;
+          }
+        }
+
+        return false;
+      }
+
+      inline bool connection_pool::add(pooled_socket* sock,
+                                       const net::socket::address& addr)
+      {
+        destination* dest;
+        return (((dest = get(addr)) != nullptr) && (add(sock, dest)));
+      }
+
+      inline pooled_socket*
+      connection_pool::acquire(const net::socket::address& addr)
+      {
+        destination* dest;
+        if ((dest = find(addr)) != nullptr) {
+          while (dest->idle) {
+            pooled_socket* sock = dest->idle;
+
+            unlink_idle(dest, sock);
+
+            if (healthy(sock)) {
+              // Restore the timeout of the connection.
+              sock->set_timeout(sock->_M_saved_timeout);
+
+              _M_stats.reused++;
+
+              return sock;
+            }
+
+            // The connection is removed from the pool when it is cleared.
+            sock->fail();
+
+            _M_stats.stale++;
+          }
+        }
+
+        return nullptr;
+      }
+
+      inline bool connection_pool::release(pooled_socket* sock)
+      {
+        destination* dest = sock->_M_destination;
+
+        if ((!dest) ||
+            (sock->_M_idle) ||
+            (dest->nidle >= _M_config.max_idle) ||
+            (sock->error()) ||
+            (sock->pending() > 0)) {
+          return false;
+        }
+
+        // Save the timeout of the connection and set the idle timeout.
+        sock->_M_saved_timeout = sock->_M_timeout;
+        sock->set_timeout(_M_config.idle_timeout);
+
+        link_idle(dest, sock);
+
+        return true;
+      }
+
+      inline void connection_pool::remove(pooled_socket* sock)
+      {
+        destination* dest;
+        if ((dest = sock->_M_destination) != nullptr) {
+          if (sock->_M_idle) {
+            unlink_idle(dest, sock);
+          }
+
+          dest->nconnections--;
+
+          sock->_M_destination = nullptr;
+        }
+      }
+
+      inline
+      size_t connection_pool::connections(const net::socket::address& addr)
+      const
+      {
+        const destination* dest = find(addr);
+        return dest ? dest->nconnections : 0;
+      }
+
+      inline size_t connection_pool::idle(const net::socket::address& addr)
+      const
+      {
+        const destination* dest = find(addr);
+        return dest ? dest->nidle : 0;
+      }
+
+      inline const connection_pool::stats& connection_pool::get_stats() const
+      {
+        return _M_stats;
+      }
+
+      inline connection_pool::destination*
+      connection_pool::find(const net::socket::address& addr) const
+      {
+        if (_M_nbuckets > 0) {
+          size_t hash = addr.hash();
+
+          for (destination* dest = _M_buckets[hash & (_M_nbuckets - 1)];
+               dest;
+               dest = dest->next) {
+            if ((dest->hash == hash) && (dest->addr.equal(addr))) {
+              return dest;
+            }
+          }
+        }
+
+        return nullptr;
+      }
+
+      inline connection_pool::destination*
+      connection_pool::get(const net::socket::address& addr)
+      {
+        destination* dest;
+        if ((dest = find(addr)) != nullptr) {
+          return dest;
+        }
+
+        // If the pool has not been created...
+        if (_M_nbuckets == 0) {
+          errno = EINVAL;
+          return nullptr;
+        }
+
+        // Keep the load factor at or below 1.
+        if ((_M_ndestinations == _M_nbuckets) && (!grow())) {
+          return nullptr;
+        }
+
+        if ((dest = new (std::nothrow) destination) == nullptr) {
+          errno = ENOMEM;
+          return nullptr;
+        }
+
+        dest->addr = addr;
+        dest->hash = addr.hash();
+        dest->idle = nullptr;
+        dest->nidle = 0;
+        dest->nconnections = 0;
+
+        destination** bucket = &_M_buckets[dest->hash & (_M_nbuckets - 1)];
+
+        dest->next = *bucket;
+        *bucket = dest;
+
+        _M_ndestinations++;
+
+        return dest;
+      }
+
+      inline bool connection_pool::grow()
+      {
+        size_t nbuckets = _M_nbuckets * 2;
+
+        destination** buckets;
+        if ((buckets = static_cast<destination**>(
+                         calloc(nbuckets, sizeof(destination*))
+                       )) == nullptr) {
+          return false;
+        }
+
+        for (size_t i = 0; i < _M_nbuckets; i++) {
+          destination* dest = _M_buckets[i];
+
+          while (dest) {
+            destination* next = dest->next;
+
+            destination** bucket = &buckets[dest->hash & (nbuckets - 1)];
+
+            dest->next = *bucket;
+            *bucket = dest;
+
+            dest = next;
+          }
+        }
+
+        free(_M_buckets);
+
+        _M_buckets = buckets;
+        _M_nbuckets = nbuckets;
+
+        return true;
+      }
+
+      inline bool connection_pool::add(pooled_socket* sock, destination* dest)
+      {
+        if (sock->_M_destination) {
+          errno = EINVAL;
+          return false;
+        }
+
+        sock->_M_destination = dest;
+        sock->_M_idle = false;
+
+        dest->nconnections++;
+
+        return true;
+      }
+
+      inline void connection_pool::link_idle(destination* dest,
+                                             pooled_socket* sock)
+      {
+        sock->_M_prev_idle = nullptr;
+        sock->_M_next_idle = dest->idle;
+
+        if (dest->idle) {
+          dest->idle->_M_prev_idle = sock;
+        }
+
+        dest->idle = sock;
+        dest->nidle++;
+
+        sock->_M_idle = true;
+      }
+
+      inline void connection_pool::unlink_idle(destination* dest,
+                                               pooled_socket* sock)
+      {
+        if (sock->_M_prev_idle) {
+          sock->_M_prev_idle->_M_next_idle = sock->_M_next_idle;
+        } else {
+          dest->idle = sock->_M_next_idle;
+        }
+
+        if (sock->_M_next_idle) {
+          sock->_M_next_idle->_M_prev_idle = sock->_M_prev_idle;
+        }
+
+        sock->_M_prev_idle = nullptr;
+        sock->_M_next_idle = nullptr;
+
+        dest->nidle--;
+
+        sock->_M_idle = false;
+      }
+
+      inline bool connection_pool::healthy(pooled_socket* sock)
+      {
+        if (sock->error()) {
+          return false;
+        }
+
+        // The connection is healthy if there is nothing to read (if the peer
+        // has closed the connection, recv() returns 0).
+        uint8_t b;
+        return ((::recv(sock->handle(), &b, 1, MSG_PEEK | MSG_DONTWAIT) < 0) &&
+                (errno == EAGAIN));
+      }
+
+      inline pooled_socket::pooled_socket(dispatcher* dispatcher)
+        : socket(dispatcher),
+          _M_destination(nullptr),
+          _M_prev_idle(nullptr),
+          _M_next_idle(nullptr),
+          _M_idle(false),
+          _M_saved_timeout(-1)
+      {
+      }
+
+      inline pooled_socket::pooled_socket()
+        : _M_destination(nullptr),
+          _M_prev_idle(nullptr),
+          _M_next_idle(nullptr),
+          _M_idle(false),
+          _M_saved_timeout(-1)
+      {
+      }
+
+      inline bool pooled_socket::pooled() const
+      {
+        return (_M_destination != nullptr);
+      }
+
+      inline bool pooled_socket::idle() const
+      {
+        return _M_idle;
+      }
+    }
+  }
+}
+
+#endif // NET_ASYNC_EVENT_CONNECTION_POOL_H
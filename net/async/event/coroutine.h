@@ -0,0 +1,933 @@
+#ifndef NET_ASYNC_EVENT_COROUTINE_H
+#define NET_ASYNC_EVENT_COROUTINE_H
+
+#if !defined(__cpp_impl_coroutine)
+  #error "net/async/event/coroutine.h requires C++20 coroutines."
+#endif
+
+#include <stdlib.h>
+#include <errno.h>
+#include <exception>
+#include <coroutine>
+#include "net/async/event/socket.h"
+
+namespace net {
+  namespace async {
+    namespace event {
+      // Allocator of coroutine frames.
+      // The frames are taken from per-thread free lists (one per power of
+      // two between 'min_size' and 'max_size' bytes), so that once the lists
+      // have been populated spawning a coroutine doesn't call malloc().
+      // Frames bigger than 'max_size' bytes are allocated with malloc(). A
+      // frame can be freed from any thread (it is added to the free list of
+      // that thread).
+      class frame_allocator {
+        public:
+          static const unsigned min_shift = 6;
+          static const unsigned max_shift = 18;
+
+          static const size_t min_size = static_cast<size_t>(1) << min_shift;
+          static const size_t max_size = static_cast<size_t>(1) << max_shift;
+
+          // Allocate frame.
+          // Returns nullptr if there is no memory.
+          static void* allocate(size_t size);
+
+          // Free frame.
+          static void deallocate(void* p, size_t size);
+
+        private:
+          static const size_t nclasses = max_shift - min_shift + 1;
+
+          struct block {
+            block* next;
+          };
+
+          // Free lists of the thread (released when the thread exits).
+          struct cache {
+            block* lists[nclasses];
+
+            // Constructor.
+            cache();
+
+            // Destructor.
+            ~cache();
+          };
+
+          // Get free lists of the current thread.
+          static cache& local();
+
+          // Get size class.
+          static size_t size_class(size_t size);
+      };
+
+      // Coroutine spawned on a coroutine socket (see
+      // coroutine_socket::spawn()).
+      // The coroutine starts suspended and is resumed by the dispatcher of
+      // the socket. Exceptions are not supported (std::terminate() is
+      // called).
+      class task {
+        public:
+          struct promise_type {
+            // Get task.
+            task get_return_object();
+
+            // Get task if the frame couldn't be allocated.
+            static task get_return_object_on_allocation_failure();
+
+            // Initial suspend.
+            std::suspend_always initial_suspend() const noexcept;
+
+            // Final suspend (the frame is destroyed by the socket).
+            std::suspend_always final_suspend() const noexcept;
+
+            // Return.
+            void return_void() const;
+
+            // Unhandled exception.
+            void unhandled_exception() const;
+
+            // Allocate frame.
+            static void* operator new(size_t size) noexcept;
+
+            // Free frame.
+            static void operator delete(void* p, size_t size);
+          };
+
+          typedef std::coroutine_handle<promise_type> handle_type;
+
+          // Constructors.
+          task();
+          task(task&& other);
+
+          // Destructor.
+          ~task();
+
+          // Move assignment operator.
+          task& operator=(task&& other);
+
+          // Valid (the frame could be allocated)?
+          bool valid() const;
+
+          // Release handle.
+          handle_type release();
+
+        private:
+          handle_type _M_handle;
+
+          // Constructor.
+          task(handle_type handle);
+
+          // Disable copy constructor and assignment operator.
+          task(const task&) = delete;
+          task& operator=(const task&) = delete;
+      };
+
+      // Socket driven by a coroutine.
+      // Instead of implementing run() as a state machine, a coroutine is
+      // spawned on the socket and awaits its operations:
+      //
+      //   task serve(coroutine_socket& sock)
+      //   {
+      //     uint8_t buf[1024];
+      //     ssize_t ret;
+      //     while ((ret = co_await sock.recv(buf, sizeof(buf))) > 0) {
+      //       if (co_await sock.send(buf, ret) < 0) {
+      //         break;
+      //       }
+      //     }
+      //   }
+      //
+      // An operation which can complete immediately doesn't suspend the
+      // coroutine. Otherwise the coroutine is resumed by the dispatcher when
+      // the socket becomes readable / writable (the operation is retried
+      // from run()) or, if the socket has a timeout, when it expires (the
+      // operation fails with ETIMEDOUT). When the coroutine returns, the
+      // socket is closed.
+      // The operations of a socket can only be awaited by the coroutine
+      // spawned on it. No memory is allocated per operation (the awaitables
+      // live in the coroutine frame).
+      class coroutine_socket : public socket {
+        private:
+          struct operation;
+
+        public:
+          // Awaitable operations.
+          class recv_awaitable;
+          class send_awaitable;
+          class accept_awaitable;
+          class connect_awaitable;
+          class sleep_awaitable;
+
+          // Constructor.
+          coroutine_socket(dispatcher* dispatcher);
+          coroutine_socket();
+
+          // Destructor.
+          ~coroutine_socket();
+
+          // Spawn coroutine.
+          // If called from the dispatcher's thread, the coroutine is started
+          // in the current loop iteration; otherwise it is started the first
+          // time the socket is run (e.g. when a connection arrives at a
+          // listening socket), so it has to be spawned before the socket is
+          // registered from the other thread. If 'destroy' is true, the
+          // socket is deleted when it is cleared.
+          // Returns false if the coroutine couldn't be allocated or the
+          // socket already has a coroutine.
+          bool spawn(task t, bool destroy = false);
+
+          // Receive.
+          // The result of the awaitable is the number of bytes received (0
+          // if the peer closed the connection) or -1 on error.
+          recv_awaitable recv(void* buf, size_t len);
+
+          // Send.
+          // All the data is sent (write events are enabled while waiting).
+          // The result of the awaitable is 'len' or -1 on error.
+          send_awaitable send(const void* buf, size_t len);
+
+          // Accept.
+          // The accepted socket is registered in the dispatcher of this
+          // socket (with an idle timeout of 'timeout' milliseconds, if
+          // given); a coroutine can then be spawned on it. The result of the
+          // awaitable is true if a connection has been accepted.
+          accept_awaitable accept(coroutine_socket& sock);
+          accept_awaitable accept(coroutine_socket& sock, unsigned timeout);
+
+          // Connect.
+          // The result of the awaitable is true if the connection has been
+          // established.
+          connect_awaitable connect(const net::socket::address& addr);
+
+          // Sleep.
+          // The coroutine is resumed after 'ms' milliseconds (shared sockets
+          // don't have timers). Afterwards the socket's timeout is restored.
+          // The other deadlines (read, write and lifetime) keep running; if
+          // one of them expires first, the socket is closed (see
+          // timeout()).
+          sleep_awaitable sleep(unsigned ms);
+
+          // Clear.
+          // The coroutine is destroyed.
+          void clear();
+
+          // Timeout.
+          // The pending operation fails with ETIMEDOUT (or the sleep
+          // finishes) and the coroutine is resumed. If a deadline other
+          // than the idle timeout expires while sleeping (see
+          // socket::expired()), the socket is closed.
+          bool timeout();
+
+          // Run.
+          // The pending operation is retried and, if it completes, the
+          // coroutine is resumed.
+          bool run();
+
+        private:
+          // Event the coroutine is waiting for.
+          enum class wait {
+            none, // Not started yet.
+            read,
+            write,
+            timer
+          };
+
+          // Pending operation (base of the awaitables).
+          struct operation {
+            coroutine_socket* sock;
+
+            // Result and error (errno) of the operation.
+            ssize_t result;
+            int error;
+
+            // Retry operation.
+            // Returns true if the operation has completed.
+            bool (*retry)(operation* op);
+
+            // Constructor.
+            operation(coroutine_socket* s, bool (*fn)(operation*));
+
+            // Complete operation with error.
+            bool fail(int err);
+          };
+
+          std::coroutine_handle<> _M_task;
+          bool _M_destroy;
+
+          wait _M_wait;
+          operation* _M_operation;
+
+          // Timeout to restore after sleeping.
+          int _M_saved_timeout;
+
+          // Suspend coroutine until the operation can be retried.
+          void suspend(operation* op, wait w);
+
+          // Resume coroutine.
+          // Returns false if the coroutine has finished.
+          bool resume();
+
+          // Destroy coroutine.
+          void destroy();
+
+        public:
+          class recv_awaitable : private operation {
+            friend class coroutine_socket;
+
+            public:
+              bool await_ready();
+              void await_suspend(std::coroutine_handle<>);
+              ssize_t await_resume() const;
+
+            private:
+              void* _M_buf;
+              size_t _M_len;
+
+              recv_awaitable(coroutine_socket* sock, void* buf, size_t len);
+
+              static bool try_recv(operation* op);
+          };
+
+          class send_awaitable : private operation {
+            friend class coroutine_socket;
+
+            public:
+              bool await_ready();
+              void await_suspend(std::coroutine_handle<>);
+              ssize_t await_resume() const;
+
+            private:
+              const uint8_t* _M_buf;
+              size_t _M_len;
+              size_t _M_sent;
+
+              send_awaitable(coroutine_socket* sock,
+                             const void* buf,
+                             size_t len);
+
+              static bool try_send(operation* op);
+          };
+
+          class accept_awaitable : private operation {
+            friend class coroutine_socket;
+
+            public:
+              bool await_ready();
+              void await_suspend(std::coroutine_handle<>);
+              bool await_resume() const;
+
+            private:
+              coroutine_socket* _M_peer;
+              int _M_timeout;
+
+              accept_awaitable(coroutine_socket* sock,
+                               coroutine_socket* peer,
+                               int timeout);
+
+              static bool try_accept(operation* op);
+          };
+
+          class connect_awaitable : private operation {
+            friend class coroutine_socket;
+
+            public:
+              bool await_ready();
+              void await_suspend(std::coroutine_handle<>);
+              bool await_resume() const;
+
+            private:
+              const net::socket::address& _M_addr;
+
+              connect_awaitable(coroutine_socket* sock,
+                                const net::socket::address& addr);
+
+              static bool try_connect(operation* op);
+          };
+
+          class sleep_awaitable : private operation {
+            friend class coroutine_socket;
+
+            public:
+              bool await_ready() const;
+              void await_suspend(std::coroutine_handle<>);
+              void await_resume() const;
+
+            private:
+              unsigned _M_ms;
+
+              sleep_awaitable(coroutine_socket* sock, unsigned ms);
+          };
+      };
+
+      inline void* frame_allocator::allocate(size_t size)
+      {
+        if (size <= max_size) {
+          size_t cls = size_class(size);
+
+          cache& c = local();
+          block* b = c.lists[cls];
+          if (b) {
+            c.lists[cls] = b->next;
+            return b;
+          }
+
+          return malloc(min_size << cls);
+        }
+
+        return malloc(size);
+      }
+
+      inline void frame_allocator::deallocate(void* p, size_t size)
+      {
+        if (size <= max_size) {
+          size_t cls = size_class(size);
+
+          cache& c = local();
+
+          block* b = static_cast<block*>(p);
+          b->next = c.lists[cls];
+          c.lists[cls] = b;
+        } else {
+          free(p);
+        }
+      }
+
+      inline frame_allocator::cache::cache()
+      {
+        for (size_t i = 0; i < nclasses; i++) {
+          lists[i] = nullptr;
+        }
+      }
+
+      inline frame_allocator::cache::~cache()
+      {
+        for (size_t i = 0; i < nclasses; i++) {
+          while (lists[i]) {
+            block* next = lists[i]->next;
+            free(lists[i]);
+            lists[i] = next;
+          }
+        }
+      }
+
+      inline frame_allocator::cache& frame_allocator::local()
+      {
+        static thread_local cache c;
+        return c;
+      }
+
+      inline size_t frame_allocator::size_class(size_t size)
+      {
+        if (size <= min_size) {
+          return 0;
+        }
+
+        return (64 - __builtin_clzll(size - 1)) - min_shift;
+      }
+
+      inline task task::promise_type::get_return_object()
+      {
+        return task(handle_type::from_promise(*this));
+      }
+
+      inline task task::promise_type::get_return_object_on_allocation_failure()
+      {
+        return task();
+      }
+
+      inline std::suspend_always
+      task::promise_type::initial_suspend() const noexcept
+      {
+        return std::suspend_always();
+      }
+
+      inline std::suspend_always
+      task::promise_type::final_suspend() const noexcept
+      {
+        return std::suspend_always();
+      }
+
+      inline void task::promise_type::return_void() const
+      {
+      }
+
+      inline void task::promise_type::unhandled_exception() const
+      {
+        std::terminate();
+      }
+
+      inline void* task::promise_type::operator new(size_t size) noexcept
+      {
+        return frame_allocator::allocate(size);
+      }
+
+      inline void task::promise_type::operator delete(void* p, size_t size)
+      {
+        frame_allocator::deallocate(p, size);
+      }
+
+      inline task::task()
+      {
+      }
+
+      inline task::task(task&& other)
+        : _M_handle(other._M_handle)
+      {
+        other._M_handle = nullptr;
+      }
+
+      inline task::task(handle_type handle)
+        : _M_handle(handle)
+      {
+      }
+
+      inline task::~task()
+      {
+        if (_M_handle) {
+          _M_handle.destroy();
+        }
+      }
+
+      inline task& task::operator=(task&& other)
+      {
+        if (this != &other) {
+          if (_M_handle) {
+            _M_handle.destroy();
+          }
+
+          _M_handle = other._M_handle;
+          other._M_handle = nullptr;
+        }
+
+        return *this;
+      }
+
+      inline bool task::valid() const
+      {
+        return static_cast<bool>(_M_handle);
+      }
+
+      inline task::handle_type task::release()
+      {
+        handle_type handle = _M_handle;
+        _M_handle = nullptr;
+
+        return handle;
+      }
+
+      inline coroutine_socket::coroutine_socket(dispatcher* dispatcher)
+        : socket(dispatcher),
+          _M_destroy(false),
+          _M_wait(wait::none),
+          _M_operation(nullptr),
+          _M_saved_timeout(-1)
+      {
+      }
+
+      inline coroutine_socket::coroutine_socket()
+        : _M_destroy(false),
+          _M_wait(wait::none),
+          _M_operation(nullptr),
+          _M_saved_timeout(-1)
+      {
+      }
+
+      inline coroutine_socket::~coroutine_socket()
+      {
+        destroy();
+      }
+
+      inline bool coroutine_socket::spawn(task t, bool destroy)
+      {
+        if ((!t.valid()) || (_M_task)) {
+          return false;
+        }
+
+        _M_task = t.release();
+        _M_destroy = destroy;
+        _M_wait = wait::none;
+
+        // If running in the dispatcher's thread, start the coroutine in the
+        // current loop iteration.
+        if (dispatcher::current() == _M_dispatcher) {
+          schedule_run();
+        }
+
+        return true;
+      }
+
+      inline coroutine_socket::recv_awaitable
+      coroutine_socket::recv(void* buf, size_t len)
+      {
+        return recv_awaitable(this, buf, len);
+      }
+
+      inline coroutine_socket::send_awaitable
+      coroutine_socket::send(const void* buf, size_t len)
+      {
+        return send_awaitable(this, buf, len);
+      }
+
+      inline coroutine_socket::accept_awaitable
+      coroutine_socket::accept(coroutine_socket& sock)
+      {
+        return accept_awaitable(this, &sock, -1);
+      }
+
+      inline coroutine_socket::accept_awaitable
+      coroutine_socket::accept(coroutine_socket& sock, unsigned timeout)
+      {
+        return accept_awaitable(this, &sock, timeout);
+      }
+
+      inline coroutine_socket::connect_awaitable
+      coroutine_socket::connect(const net::socket::address& addr)
+      {
+        return connect_awaitable(this, addr);
+      }
+
+      inline coroutine_socket::sleep_awaitable
+      coroutine_socket::sleep(unsigned ms)
+      {
+        return sleep_awaitable(this, ms);
+      }
+
+      inline void coroutine_socket::clear()
+      {
+        destroy();
+
+        // Delete socket (if wished).
+        if (_M_destroy) {
+          delete this;
+        }
+      }
+
+      inline bool coroutine_socket::timeout()
+      {
+        switch (_M_wait) {
+          case wait::read:
+          case wait::write:
+            // Fail the pending operation.
+            _M_operation->fail(ETIMEDOUT);
+            break;
+          case wait::timer:
+            // Only the idle deadline armed by sleep() finishes the sleep;
+            // another deadline (e.g. the lifetime) closes the socket.
+            if (_M_expired != deadline::idle) {
+              return false;
+            }
+
+            // Restore timeout.
+            _M_timeout = _M_saved_timeout;
+            _M_timestamp = _M_dispatcher->time();
+
+            break;
+          default:
+            // Close socket.
+            return false;
+        }
+
+        return resume();
+      }
+
+      inline bool coroutine_socket::run()
+      {
+        switch (_M_wait) {
+          case wait::none:
+            // If the socket doesn't have a coroutine...
+            if (!_M_task) {
+              return true;
+            }
+
+            // Start coroutine.
+            break;
+          case wait::read:
+            if ((!readable()) || (!_M_operation->retry(_M_operation))) {
+              return true;
+            }
+
+            break;
+          case wait::write:
+            if ((!writable()) || (!_M_operation->retry(_M_operation))) {
+              return true;
+            }
+
+            break;
+          case wait::timer:
+            return true;
+        }
+
+        return resume();
+      }
+
+      inline void coroutine_socket::suspend(operation* op, wait w)
+      {
+        _M_operation = op;
+        _M_wait = w;
+      }
+
+      inline bool coroutine_socket::resume()
+      {
+        _M_operation = nullptr;
+        _M_wait = wait::none;
+
+        _M_task.resume();
+
+        return !_M_task.done();
+      }
+
+      inline void coroutine_socket::destroy()
+      {
+        if (_M_task) {
+          _M_task.destroy();
+          _M_task = nullptr;
+        }
+
+        _M_operation = nullptr;
+        _M_wait = wait::none;
+      }
+
+      inline coroutine_socket::operation::operation(coroutine_socket* s,
+                                                    bool (*fn)(operation*))
+        : sock(s),
+          result(-1),
+          error(0),
+          retry(fn)
+      {
+      }
+
+      inline bool coroutine_socket::operation::fail(int err)
+      {
+        result = -1;
+        error = err;
+
+        return true;
+      }
+
+      inline
+      coroutine_socket::recv_awaitable::recv_awaitable(coroutine_socket* sock,
+                                                       void* buf,
+                                                       size_t len)
+        : operation(sock, try_recv),
+          _M_buf(buf),
+          _M_len(len)
+      {
+      }
+
+      inline bool coroutine_socket::recv_awaitable::await_ready()
+      {
+        return ((sock->readable()) && (try_recv(this)));
+      }
+
+      inline void
+      coroutine_socket::recv_awaitable::await_suspend(std::coroutine_handle<>)
+      {
+        sock->suspend(this, wait::read);
+      }
+
+      inline ssize_t coroutine_socket::recv_awaitable::await_resume() const
+      {
+        if (result < 0) {
+          errno = error;
+        }
+
+        return result;
+      }
+
+      inline bool coroutine_socket::recv_awaitable::try_recv(operation* op)
+      {
+        recv_awaitable* a = static_cast<recv_awaitable*>(op);
+
+        if ((a->result = a->sock->socket::recv(a->_M_buf, a->_M_len)) >= 0) {
+          return true;
+        }
+
+        return (errno != EAGAIN) ? a->fail(errno) : false;
+      }
+
+      inline
+      coroutine_socket::send_awaitable::send_awaitable(coroutine_socket* sock,
+                                                       const void* buf,
+                                                       size_t len)
+        : operation(sock, try_send),
+          _M_buf(static_cast<const uint8_t*>(buf)),
+          _M_len(len),
+          _M_sent(0)
+      {
+      }
+
+      inline bool coroutine_socket::send_awaitable::await_ready()
+      {
+        return try_send(this);
+      }
+
+      inline void
+      coroutine_socket::send_awaitable::await_suspend(std::coroutine_handle<>)
+      {
+        sock->enable_write_events();
+        sock->suspend(this, wait::write);
+      }
+
+      inline ssize_t coroutine_socket::send_awaitable::await_resume() const
+      {
+        if (result < 0) {
+          errno = error;
+        }
+
+        return result;
+      }
+
+      inline bool coroutine_socket::send_awaitable::try_send(operation* op)
+      {
+        send_awaitable* a = static_cast<send_awaitable*>(op);
+
+        while (a->_M_sent < a->_M_len) {
+          ssize_t ret;
+          if ((ret = a->sock->socket::send(a->_M_buf + a->_M_sent,
+                                           a->_M_len - a->_M_sent)) > 0) {
+            a->_M_sent += ret;
+          } else if ((ret == 0) || (errno == EAGAIN)) {
+            return false;
+          } else {
+            return a->fail(errno);
+          }
+        }
+
+        a->result = a->_M_len;
+
+        return true;
+      }
+
+      inline coroutine_socket::accept_awaitable::accept_awaitable(
+        coroutine_socket* sock,
+        coroutine_socket* peer,
+        int timeout
+      )
+        : operation(sock, try_accept),
+          _M_peer(peer),
+          _M_timeout(timeout)
+      {
+      }
+
+      inline bool coroutine_socket::accept_awaitable::await_ready()
+      {
+        return ((sock->readable()) && (try_accept(this)));
+      }
+
+      inline void
+      coroutine_socket::accept_awaitable::await_suspend(std::coroutine_handle<>)
+      {
+        sock->suspend(this, wait::read);
+      }
+
+      inline bool coroutine_socket::accept_awaitable::await_resume() const
+      {
+        if (result < 0) {
+          errno = error;
+          return false;
+        }
+
+        return true;
+      }
+
+      inline bool coroutine_socket::accept_awaitable::try_accept(operation* op)
+      {
+        accept_awaitable* a = static_cast<accept_awaitable*>(op);
+
+        if ((a->_M_timeout < 0) ?
+              a->sock->socket::accept(*a->_M_peer) :
+              a->sock->socket::accept(*a->_M_peer, a->_M_timeout)) {
+          a->result = 0;
+          return true;
+        }
+
+        return (errno != EAGAIN) ? a->fail(errno) : false;
+      }
+
+      inline coroutine_socket::connect_awaitable::connect_awaitable(
+        coroutine_socket* sock,
+        const net::socket::address& addr
+      )
+        : operation(sock, try_connect),
+          _M_addr(addr)
+      {
+      }
+
+      inline bool coroutine_socket::connect_awaitable::await_ready()
+      {
+        // Start connecting (the connection is established when the socket
+        // becomes writable).
+        return (!sock->socket::connect(_M_addr)) ? fail(errno) : false;
+      }
+
+      inline void
+      coroutine_socket::connect_awaitable::await_suspend(
+        std::coroutine_handle<>
+      )
+      {
+        sock->enable_write_events();
+        sock->suspend(this, wait::write);
+      }
+
+      inline bool coroutine_socket::connect_awaitable::await_resume() const
+      {
+        if (result < 0) {
+          errno = error;
+          return false;
+        }
+
+        return true;
+      }
+
+      inline bool
+      coroutine_socket::connect_awaitable::try_connect(operation* op)
+      {
+        connect_awaitable* a = static_cast<connect_awaitable*>(op);
+
+        int error;
+        if (!a->sock->get_socket_error(error)) {
+          return a->fail(errno);
+        } else if (error != 0) {
+          return a->fail(error);
+        }
+
+        a->result = 0;
+
+        return true;
+      }
+
+      inline
+      coroutine_socket::sleep_awaitable::sleep_awaitable(coroutine_socket* sock,
+                                                         unsigned ms)
+        : operation(sock, nullptr),
+          _M_ms(ms)
+      {
+      }
+
+      inline bool coroutine_socket::sleep_awaitable::await_ready() const
+      {
+        return false;
+      }
+
+      inline void
+      coroutine_socket::sleep_awaitable::await_suspend(std::coroutine_handle<>)
+      {
+        // The dispatcher rearms the socket's timer when the callback
+        // returns.
+        sock->_M_saved_timeout = sock->_M_timeout;
+
+        sock->_M_timeout = _M_ms;
+        sock->_M_timestamp = sock->_M_dispatcher->time();
+
+        sock->suspend(this, wait::timer);
+      }
+
+      inline void coroutine_socket::sleep_awaitable::await_resume() const
+      {
+      }
+    }
+  }
+}
+
+#endif // NET_ASYNC_EVENT_COROUTINE_H
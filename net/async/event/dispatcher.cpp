@@ -9,7 +9,23 @@
   bool net::async::event::dispatcher::register_socket(T* sock,
                                                       net::event::watch ev)
   {
-    return _M_selector.add(sock->handle(), ev, sock);
+    // If running in the dispatcher's thread...
+    if (current() == this) {
+      if (add_socket(sock, ev)) {
+        sock->start_deadlines(_M_time);
+        update_node(sock);
+
+        return true;
+      }
+
+      return false;
+    }
+
+    // Hand the socket off to the dispatcher's thread.
+    sock->_M_event = ev;
+    sock->_M_timeout = -1;
+
+    return register_socket(sock);
   }
 #endif // !defined(USE_SOCKET_TEMPLATE)
 
@@ -18,64 +34,135 @@
 #endif
 void net::async::event::dispatcher::run()
 {
+  current_dispatcher() = this;
+
   // Get current time.
   gettimeofday(&_M_start, nullptr);
   _M_time = 0;
 
+  uint64_t start = counters::now();
+
   do {
     // Wait for events.
 #if defined(USE_SOCKET_TEMPLATE)
-    int ret = _M_selector.wait(compute_timeout<T>());
+    int ret = wait(_M_ready ? 0 : compute_timeout<T>());
 #else
-    int ret = _M_selector.wait(compute_timeout());
+    int ret = wait(_M_ready ? 0 : compute_timeout());
 #endif
 
+    uint64_t now = counters::now();
+    counters::add(_M_counters.wait_time, now - start);
+
+    if (ret > 0) {
+      counters::add(_M_counters.events, ret);
+      counters::max(_M_counters.max_events, ret);
+
+      if (static_cast<size_t>(ret) == _M_selector.max_events()) {
+        counters::add(_M_counters.full_waits);
+      }
+    }
+
     // Update time.
     update_time();
 
-    T* errors[net::internal::selector::max_events];
-    size_t nerrors = 0;
+    // Run the sockets which exhausted their read budget.
+    if (_M_ready) {
+#if defined(USE_SOCKET_TEMPLATE)
+      run_ready<T>();
+#else
+      run_ready();
+#endif
+    }
 
     // Process events.
     for (int i = 0; i < ret; i++) {
+      // Prefetch the first two cache lines of the next socket (see
+      // socket.h), so that they are loaded while this one is processed
+      // (the data of the pipe and of the shared selector is a descriptor,
+      // but a prefetch never faults).
+      if (i + 1 < ret) {
+        const char* next = static_cast<const char*>(_M_selector.data(i + 1));
+        __builtin_prefetch(next);
+        __builtin_prefetch(next + 64);
+      }
+
       net::event::result ev;
       T* sock;
       _M_selector.get(i, ev, reinterpret_cast<void*&>(sock));
 
-      // If the event is not for the pipe...
-      if (reinterpret_cast<uintptr_t>(sock) !=
-          static_cast<uintptr_t>(_M_pipe[0])) {
+      uintptr_t data = reinterpret_cast<uintptr_t>(sock);
+
+      // If the event is for a socket...
+      if ((data != static_cast<uintptr_t>(_M_pipe[0])) &&
+          (data != static_cast<uintptr_t>(_M_shared.handle()))) {
         if (!ev.error) {
           if (!sock->_M_error) {
+            int fd = sock->handle();
+            uint64_t start = begin_callback(fd);
+
             // Process socket.
-            if (!process_socket(sock, ev)) {
+            bool ok = process_socket(sock, ev);
+
+            end_callback(fd,
+                         (ev.readable ? slow_callback::readable : 0) |
+                         (ev.writable ? slow_callback::writable : 0),
+                         start);
+
+            if (!ok) {
               // Socket failed.
-              sock->_M_error = true;
-              errors[nerrors++] = sock;
+              fail_socket(sock);
             }
           }
         } else if (!sock->_M_error) {
           // Socket failed.
-          sock->_M_error = true;
-          errors[nerrors++] = sock;
+          fail_socket(sock);
+        }
+      } else if (data == static_cast<uintptr_t>(_M_pipe[0])) {
+        if (ev.readable) {
+          // Process pipe.
+#if defined(USE_SOCKET_TEMPLATE)
+          process_pipe<T>();
+#else
+          process_pipe();
+#endif
         }
-      } else if (ev.readable) {
-        // Process pipe.
+      } else {
+        // Process the events of the shared selector.
 #if defined(USE_SOCKET_TEMPLATE)
-        process_pipe<T>();
+        process_shared<T>();
 #else
-        process_pipe();
+        process_shared();
 #endif
       }
     }
 
-    // Clear failed sockets.
-    for (size_t i = 0; i < nerrors; i++) {
-      // Unlink node.
-      unlink_node(errors[i]);
+    // If the events didn't fit in a single wait, make room for more.
+    if ((static_cast<size_t>(ret) == _M_selector.max_events()) &&
+        (_M_selector.max_events() < _M_max_events_limit)) {
+      size_t max_events = _M_selector.max_events() * 2;
+      if (max_events > _M_max_events_limit) {
+        max_events = _M_max_events_limit;
+      }
 
-      // Clear socket.
-      clear_socket(errors[i]);
+      if (_M_selector.resize(max_events)) {
+        counters::set(_M_counters.event_capacity, max_events);
+      }
+    }
+
+    // Flush coalesced writes.
+#if defined(USE_SOCKET_TEMPLATE)
+    flush<T>();
+#else
+    flush();
+#endif
+
+    // Clear failed sockets.
+    if (_M_errors.next != &_M_errors) {
+#if defined(USE_SOCKET_TEMPLATE)
+      clear_failed_sockets<T>();
+#else
+      clear_failed_sockets();
+#endif
     }
 
     // Check expired sockets.
@@ -84,7 +171,46 @@ void net::async::event::dispatcher::run()
 #else
     check_expired();
 #endif
-  } while (_M_running);
+
+    // Run expired timers.
+    if (!_M_timers.empty()) {
+      run_timers();
+    }
+
+    // Flush writes made from the timeout handlers and the timers.
+    if (_M_flush) {
+#if defined(USE_SOCKET_TEMPLATE)
+      flush<T>();
+#else
+      flush();
+#endif
+    }
+
+    // Migrate sockets (if requested).
+    if (_M_migrate.load(std::memory_order_acquire)) {
+#if defined(USE_SOCKET_TEMPLATE)
+      migrate_sockets<T>();
+#else
+      migrate_sockets();
+#endif
+    }
+
+    // Drain sockets (if requested).
+    if (_M_drain.load(std::memory_order_acquire)) {
+#if defined(USE_SOCKET_TEMPLATE)
+      process_drain<T>();
+#else
+      process_drain();
+#endif
+    }
+
+    start = counters::now();
+
+    counters::add(_M_counters.busy_time, start - now);
+    counters::add(_M_counters.iterations);
+  } while (_M_running.load(std::memory_order_acquire));
+
+  current_dispatcher() = nullptr;
 }
 
 #if defined(USE_SOCKET_TEMPLATE)
@@ -96,24 +222,48 @@ bool net::async::event::dispatcher::process_socket(T* sock,
   sock->_M_readable |= ev.readable;
   sock->_M_writable |= ev.writable;
 
-  uint64_t oldtimestamp = sock->_M_timestamp;
-  int oldtimeout = sock->_M_timeout;
+  // The connection has been established.
+  if ((ev.writable) && (sock->_M_connecting)) {
+    sock->_M_connecting = false;
+  }
+
+  // If there are coalesced writes pending and the socket is writable, flush
+  // them first to make room in the write buffer.
+  if ((ev.writable) && (sock->_M_wend > sock->_M_wbegin)) {
+    if (!sock->flush()) {
+      return false;
+    }
+  }
 
-  if (sock->run()) {
-    if (sock->_M_timeout >= 0) {
-      if ((oldtimestamp != sock->_M_timestamp) ||
-          (oldtimeout != sock->_M_timeout)) {
-        // Unlink node.
-        unlink_node(sock);
+  counters::add(_M_counters.callbacks);
 
-        sock->_M_expire = sock->_M_timestamp + sock->_M_timeout;
+  // Set the read budget of the callback.
+  _M_budget = (_M_read_budget > 0) ? _M_read_budget : SIZE_MAX;
+  _M_in_run = true;
 
-        add_node(sock);
-      }
-    } else {
-      // Unlink node.
-      unlink_node(sock);
-    }
+  bool ret = sock->run();
+
+  _M_in_run = false;
+
+  // If the socket is still readable after exhausting its read budget, run
+  // it again in the next loop iteration (level-triggered and one-shot
+  // sockets are reported again by the selector).
+  if ((_M_budget == 0) &&
+      (ret) &&
+      (sock->_M_readable) &&
+      (net::event::trigger_of(sock->_M_event) ==
+       net::event::trigger::edge)) {
+    defer_run(sock);
+    counters::add(_M_counters.requeued);
+  }
+
+  _M_budget = SIZE_MAX;
+
+  // The socket might have failed in run() (e.g. fail() has been called):
+  // it is handled as a failure of the callback.
+  if ((ret) && (!sock->_M_error) && (update_socket(_M_selector, sock))) {
+    // Rearm the timeout (only if the earliest deadline has changed).
+    update_node(sock);
 
     return true;
   } else {
@@ -122,6 +272,45 @@ bool net::async::event::dispatcher::process_socket(T* sock,
   }
 }
 
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+void net::async::event::dispatcher::run_ready()
+{
+  // Count the sockets currently in the list (the sockets which exhaust
+  // their budget again are added to the end of the list and are run in the
+  // next loop iteration).
+  size_t count = 0;
+  for (const T* s = static_cast<T*>(_M_ready);
+       s;
+       s = static_cast<const T*>(s->_M_next_ready)) {
+    count++;
+  }
+
+  // The sockets are removed from the list one by one, so that they can be
+  // cleared while the list is being processed.
+  while ((_M_ready) && (count-- > 0)) {
+    T* sock = static_cast<T*>(_M_ready);
+
+    cancel_run(sock);
+
+    if (!sock->_M_error) {
+      int fd = sock->handle();
+      uint64_t start = begin_callback(fd);
+
+      // Process socket.
+      bool ok = process_socket(sock, net::event::result());
+
+      end_callback(fd, slow_callback::readable, start);
+
+      if (!ok) {
+        // Socket failed.
+        fail_socket(sock);
+      }
+    }
+  }
+}
+
 #if defined(USE_SOCKET_TEMPLATE)
   template<typename T>
 #endif
@@ -129,18 +318,161 @@ void net::async::event::dispatcher::process_pipe()
 {
   T* sock;
   while (read(_M_pipe[0], &sock, sizeof(T*)) == sizeof(T*)) {
-    if (register_socket(sock, sock->_M_event)) {
+    // Wake-up (see migrate())?
+    if (!sock) {
+      continue;
+    }
+
+    counters::add(_M_counters.handoffs);
+
+    if (add_socket(sock, sock->_M_event)) {
       sock->_M_timestamp = _M_time;
-      sock->_M_expire = _M_time + sock->_M_timeout;
 
-      add_node(sock);
+      sock->start_deadlines(_M_time);
+      update_node(sock);
     } else {
+      counters::add(_M_counters.errors);
+
       // Clear socket.
       clear_socket(sock);
     }
   }
 }
 
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+void net::async::event::dispatcher::process_shared()
+{
+  // Take a small batch of events (see share()); the rest are left for the
+  // other dispatchers sharing the selector, which might have taken them
+  // already.
+  int ret = _M_shared.wait(0);
+
+  for (int i = 0; i < ret; i++) {
+    net::event::result ev;
+    T* sock;
+    _M_shared.get(i, ev, reinterpret_cast<void*&>(sock));
+
+    counters::add(_M_counters.shared);
+
+    int fd = sock->handle();
+    uint64_t start = begin_callback(fd);
+
+    // Process socket.
+    bool ok = ((!ev.error) && (process_shared_socket(sock, ev)));
+
+    end_callback(fd,
+                 (ev.readable ? slow_callback::readable : 0) |
+                 (ev.writable ? slow_callback::writable : 0),
+                 start);
+
+    if (!ok) {
+      // Socket failed (it is disarmed, so no other dispatcher can be
+      // processing it).
+      counters::add(_M_counters.errors);
+
+      // Unlink node (if run() has called fail(), the socket is in the list
+      // of failed sockets).
+      unlink_node(sock);
+
+      // Clear socket.
+      clear_socket(sock);
+    }
+  }
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+bool net::async::event::dispatcher::process_shared_socket(T* sock,
+                                                          net::event::result ev)
+{
+  // The socket belongs to this dispatcher until it is rearmed.
+  sock->_M_dispatcher = this;
+
+  sock->_M_readable |= ev.readable;
+  sock->_M_writable |= ev.writable;
+
+  // If there are coalesced writes pending and the socket is writable, flush
+  // them first to make room in the write buffer.
+  if ((ev.writable) && (sock->_M_wend > sock->_M_wbegin)) {
+    if (!sock->flush()) {
+      return false;
+    }
+  }
+
+  counters::add(_M_counters.callbacks);
+
+  // Set the read budget of the callback (if the socket is still readable
+  // after exhausting it, it is reported again when it is rearmed).
+  _M_budget = (_M_read_budget > 0) ? _M_read_budget : SIZE_MAX;
+  _M_in_run = true;
+
+  bool ret = sock->run();
+
+  _M_in_run = false;
+  _M_budget = SIZE_MAX;
+
+  // Flush the coalesced writes now (once the socket is rearmed, another
+  // dispatcher might process it).
+  if ((ret) && (sock->_M_flush_scheduled)) {
+    cancel_flush(sock);
+    ret = sock->flush();
+  }
+
+  return ((ret) && (!sock->_M_error) && (update_socket(_M_shared, sock)));
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+bool net::async::event::dispatcher::share_socket(T* sock)
+{
+  // If the dispatcher doesn't share a selector, the socket is already
+  // shared or has failed or it is not being called from the dispatcher's
+  // thread...
+  if ((_M_shared.handle() == -1) ||
+      (sock->_M_shared) ||
+      (sock->_M_error) ||
+      (current() != this)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  // Send the coalesced writes.
+  if (sock->_M_flush_scheduled) {
+    cancel_flush(sock);
+
+    if (!sock->flush()) {
+      return false;
+    }
+  }
+
+  if (sock->_M_ready_scheduled) {
+    cancel_run(sock);
+  }
+
+  // Remove socket from this dispatcher (shared sockets don't have idle
+  // timeout).
+  unlink_node(sock);
+  unlink_socket(sock);
+
+  _M_selector.remove(sock->handle(), sock->_M_armed);
+
+  counters::add(_M_counters.closed);
+
+  sock->_M_timeout = -1;
+  sock->_M_shared = true;
+
+  sock->_M_event = net::event::with_trigger(sock->_M_event,
+                                            net::event::trigger::oneshot);
+
+  sock->_M_armed = watched_events(sock);
+
+  return _M_shared.add(sock->handle(), sock->_M_armed, sock);
+}
+
 #if defined(USE_SOCKET_TEMPLATE)
   template<typename T>
 #endif
@@ -166,23 +498,223 @@ void net::async::event::dispatcher::add_node(T* sock)
 #endif
 void net::async::event::dispatcher::check_expired()
 {
+  // Move the expired sockets to a list of their own, so that the sockets
+  // whose timeout is rearmed are not processed again in this iteration.
+  util::node expired;
+  expired.prev = &expired;
+  expired.next = &expired;
+
   util::node* s = _M_header.next;
 
   while ((s != &_M_header) && (_M_time >= static_cast<T*>(s)->_M_expire)) {
-    util::node* next = s->next;
+    s = s->next;
+  }
+
+  if (s == _M_header.next) {
+    return;
+  }
+
+  expired.next = _M_header.next;
+  expired.prev = s->prev;
+
+  expired.next->prev = &expired;
+  expired.prev->next = &expired;
+
+  _M_header.next = s;
+  s->prev = &_M_header;
+
+  while (expired.next != &expired) {
+    T* sock = static_cast<T*>(expired.next);
+
+    // Unlink node.
+    unlink_node(sock);
+
+    counters::add(_M_counters.timeouts);
+
+    // Tell the socket which deadline has expired.
+    uint64_t expire;
+    sock->_M_expired = sock->next_deadline(_M_time, expire);
+
+    int fd = sock->handle();
+    uint64_t start = begin_callback(fd);
+
+    bool ok = ((sock->timeout()) &&
+               (!sock->_M_error) &&
+               (update_socket(_M_selector, sock)));
+
+    end_callback(fd, slow_callback::timeout, start);
+
+    if (ok) {
+      // Restart the deadline which has expired and rearm the timeout, if
+      // the socket still has one (timeout() might have changed its
+      // deadlines).
+      sock->restart_deadline(_M_time);
+      update_node(sock);
+    } else {
+      counters::add(_M_counters.closed);
+
+      // Unlink node (if timeout() has called fail(), the socket is in the
+      // list of failed sockets).
+      unlink_node(sock);
+
+      // Clear socket.
+      clear_socket(sock);
+    }
+  }
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+void net::async::event::dispatcher::flush()
+{
+  while (_M_flush) {
+    T* sock = static_cast<T*>(_M_flush);
+
+    _M_flush = sock->_M_next_flush;
+
+    sock->_M_next_flush = nullptr;
+    sock->_M_flush_scheduled = false;
+
+    // Skip sockets which have failed (they will be cleared).
+    if (!sock->_M_error) {
+      if ((sock->flush()) && (update_socket(_M_selector, sock))) {
+        // Rearm the timeout (if some data has been sent or the write
+        // deadline has been started).
+        update_node(sock);
+      } else {
+        counters::add(_M_counters.errors);
+        counters::add(_M_counters.closed);
+
+        // Unlink node.
+        unlink_node(sock);
+
+        // Clear socket.
+        clear_socket(sock);
+      }
+    }
+  }
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+void net::async::event::dispatcher::clear_failed_sockets()
+{
+  uint64_t nerrors = 0;
+
+  do {
+    T* sock = static_cast<T*>(_M_errors.next);
+
+    // Unlink node.
+    unlink_node(sock);
+
+    // Clear socket.
+    clear_socket(sock);
+
+    nerrors++;
+  } while (_M_errors.next != &_M_errors);
+
+  counters::add(_M_counters.errors, nerrors);
+  counters::add(_M_counters.closed, nerrors);
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+void net::async::event::dispatcher::process_drain()
+{
+  // If the drain has just been requested, stop accepting.
+  if (!_M_draining) {
+    _M_draining = true;
+    _M_drain_deadline = _M_time + _M_drain_timeout;
+
+    // Close the listening sockets.
+    T* next = static_cast<T*>(_M_sockets);
+    while (next) {
+      T* sock = next;
+      next = static_cast<T*>(sock->_M_next_socket);
+
+      if (sock->_M_listening) {
+        counters::add(_M_counters.closed);
+
+        // Unlink node.
+        unlink_node(sock);
+
+        // Clear socket.
+        clear_socket(sock);
+      }
+    }
+  }
+
+  // If the other sockets have been closed or the deadline has expired...
+  if ((!_M_sockets) || (_M_time >= _M_drain_deadline)) {
+    // Close the sockets left.
+    while (_M_sockets) {
+      T* sock = static_cast<T*>(_M_sockets);
+
+      counters::add(_M_counters.closed);
 
-    if (!static_cast<T*>(s)->timeout()) {
       // Unlink node.
-      unlink_node(static_cast<T*>(s));
+      unlink_node(sock);
 
       // Clear socket.
-      clear_socket(static_cast<T*>(s));
+      clear_socket(sock);
+    }
 
-      s = next;
-    } else {
-      s = s->next;
+    _M_running.store(false, std::memory_order_release);
+  }
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+void net::async::event::dispatcher::migrate_sockets()
+{
+  // The timers can't be migrated (they might be cancelled from the thread
+  // of the dispatcher of a socket migrated somewhere else): a dispatcher
+  // with pending timers is not migrated.
+  if (!_M_timers.empty()) {
+    _M_migrated = false;
+    _M_migrate.store(false, std::memory_order_release);
+
+    return;
+  }
+
+  // Forget the sockets to be run again (the targets will report them as
+  // readable).
+  while (_M_ready) {
+    cancel_run(_M_ready);
+  }
+
+  size_t i = 0;
+
+  while (_M_sockets) {
+    T* sock = static_cast<T*>(_M_sockets);
+
+    // Remove socket from this dispatcher.
+    unlink_socket(sock);
+    unlink_node(sock);
+
+    _M_selector.remove(sock->handle(), sock->_M_armed);
+
+    counters::add(_M_counters.migrated);
+
+    // Hand the socket off to the next target (when the socket is added
+    // to the target's selector, the pending events are reported again).
+    dispatcher* target = _M_targets[i++ % _M_ntargets];
+    sock->_M_dispatcher = target;
+
+    if (!target->register_socket(sock)) {
+      counters::add(_M_counters.errors);
+
+      // Clear socket.
+      clear_socket(sock);
     }
   }
+
+  _M_migrated = true;
+  _M_migrate.store(false, std::memory_order_release);
 }
 
 #if !defined(USE_SOCKET_TEMPLATE)
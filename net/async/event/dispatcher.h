@@ -2,11 +2,19 @@
 #define NET_ASYNC_EVENT_DISPATCHER_H
 
 #include <stdint.h>
+#include <limits.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/time.h>
 #include "net/internal/selector.h"
 #include "net/event/event.h"
+#include "net/async/event/metrics.h"
+#include "net/async/event/watchdog.h"
+#include "net/async/event/timer.h"
 #include "util/node.h"
 
 #if !defined(USE_SOCKET_TEMPLATE)
@@ -16,21 +24,59 @@
 namespace net {
   namespace async {
     namespace event {
-#if !defined(USE_SOCKET_TEMPLATE)
       // Forward declaration.
       class socket;
-#endif // !defined(USE_SOCKET_TEMPLATE)
 
       class dispatcher {
+        friend class socket;
+
         public:
+          // Configuration of the dispatcher's thread.
+          struct thread_config {
+            // Name of the thread (nullptr: don't set it).
+            // Linux truncates it to 15 characters.
+            const char* name;
+
+            // CPUs the thread is pinned to (Linux; nullptr: no affinity).
+            // The memory first touched by the dispatcher's thread (stack,
+            // selector events) is allocated on the NUMA node of these CPUs.
+            const int* cpus;
+            size_t ncpus;
+
+            // If the thread is pinned to a single CPU, set SO_INCOMING_CPU
+            // to that CPU on the sockets bound / listening through this
+            // dispatcher, so that the kernel prefers the socket of the
+            // dispatcher running on the CPU which received the packet
+            // (SO_REUSEPORT).
+            bool incoming_cpu;
+
+            // Constructor.
+            thread_config();
+          };
+
           // Constructor.
           dispatcher();
 
           // Destructor.
           ~dispatcher();
 
+          // Default maximum number of events returned by a single wait.
+          static const size_t default_max_events =
+            net::internal::selector::default_max_events;
+
+          // Default limit of the number of events returned by a single wait.
+          static const size_t default_max_events_limit = 4096;
+
+          // Default maximum number of events taken from the shared selector
+          // per wake-up (see share()).
+          static const size_t default_shared_batch = 1;
+
           // Create.
-          bool create();
+          // A single wait returns up to 'max_events' events. Each time a
+          // wait returns 'max_events' events, 'max_events' is doubled, up to
+          // 'max_events_limit'.
+          bool create(size_t max_events = default_max_events,
+                      size_t max_events_limit = default_max_events_limit);
 
           // Get time.
           uint64_t time() const;
@@ -41,9 +87,40 @@ namespace net {
 #endif
           bool start();
 
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          bool start(const thread_config& config);
+
+          // Get the CPU to be set as SO_INCOMING_CPU (-1 if none).
+          int incoming_cpu() const;
+
+          // Configure the current thread (CPU affinity and name).
+          static bool configure_thread(const thread_config& config);
+
           // Stop.
+          // It can be called from any thread: the dispatcher is woken up
+          // and stops at the end of the current loop iteration. If the
+          // dispatcher is draining (see drain()), wait until it has
+          // finished.
           void stop();
 
+          // Stop gracefully: drain() and wait until the dispatcher has
+          // stopped.
+          void stop(unsigned timeout);
+
+          // Drain: close the listening sockets, wait up to 'timeout'
+          // milliseconds for the other sockets to be closed by their
+          // handlers, close the sockets left and stop.
+          // It can be called from any thread and returns immediately (see
+          // stop()).
+          void drain(unsigned timeout);
+
+          // Is the dispatcher draining?
+          // The sockets can check it from their handlers to finish their
+          // work (e.g. not to keep connections alive).
+          bool draining() const;
+
           // Run.
 #if defined(USE_SOCKET_TEMPLATE)
           template<typename T>
@@ -51,6 +128,8 @@ namespace net {
           void run();
 
           // Register socket without timeout.
+          // If it is not called from the thread running dispatcher::run(),
+          // the socket is handed off through the pipe.
 #if defined(USE_SOCKET_TEMPLATE)
           template<typename T>
 #endif
@@ -59,8 +138,10 @@ namespace net {
           // Register socket with timeout.
           // After 'timeout' milliseconds of inactivity in the socket, the
           // method socket::timeout() will be called.
-          // This method is called from socket::accept(), which is running in
-          // the thread context of dispatcher::run().
+          // When it is called from the thread running dispatcher::run()
+          // (e.g. socket::accept() or a connect() made from a socket's
+          // handler), the socket is added to the selector right away;
+          // otherwise, it is handed off through the pipe.
 #if defined(USE_SOCKET_TEMPLATE)
           template<typename T>
 #endif
@@ -73,28 +154,189 @@ namespace net {
           // This method is called from a thread not running the
           // dispatcher::run() method.
           // The address of the socket is written to a pipe which is read from
-          // the thread running the dispatcher::run() method.
+          // the thread running the dispatcher::run() method (if the pipe is
+          // full, it waits for the dispatcher to read from it).
 #if defined(USE_SOCKET_TEMPLATE)
           template<typename T>
 #endif
           bool register_socket(T* sock);
 
-        private:
-          static const int timeout = 500; // Milliseconds.
+          // Schedule timer.
+          // The callback of the timer is called from the dispatcher's thread
+          // after 'delay' nanoseconds and then every 'period' nanoseconds
+          // (0: only once). If the timer is pending, it is rescheduled.
+          // Timers never expire early and have a resolution of
+          // 2^timer_wheel::tick_shift nanoseconds (~16 microseconds).
+          // It has to be called from the dispatcher's thread (e.g. from a
+          // socket or a timer callback) or before the dispatcher is started.
+          // The timers are not migrated (see migrate()): a dispatcher with
+          // pending timers can't be migrated nor removed from its
+          // dispatchers until they have been cancelled or have expired.
+          void schedule(timer& t, uint64_t delay, uint64_t period = 0);
+
+          // Cancel timer (if it is pending).
+          // It has to be called from the dispatcher's thread.
+          void cancel(timer& t);
+
+          // Get number of pending timers.
+          size_t timers() const;
+
+          // Get snapshot of the metrics.
+          // It can be called from any thread; the counters are read one by
+          // one, so the snapshot is not taken atomically.
+          void get_metrics(metrics& m) const;
+
+          // Set read budget.
+          // A call to socket::run() can receive up to 'bytes' bytes (0:
+          // unlimited); then socket::readable() returns false and, if the
+          // socket is still readable, it is run again in the next loop
+          // iteration without waiting for another event, so that a busy
+          // socket cannot starve the others. The data received outside
+          // socket::run() (e.g. from a timer or socket::timeout()) is not
+          // charged.
+          // It has to be called before the dispatcher is started.
+          void set_read_budget(size_t bytes);
+
+          // Set trigger.
+          // The sockets registered with an edge-triggered watch (the socket
+          // methods use edge-triggered watches) are registered with the
+          // trigger 't' instead. Level-triggered and one-shot sockets are
+          // watched for writability only while they cannot write, and
+          // one-shot sockets are rearmed after each callback.
+          // It has to be called before the dispatcher is started.
+          void set_trigger(net::event::trigger t);
+
+          // Share a selector with other dispatchers.
+          // If 'other' is nullptr, a new shared selector is created;
+          // otherwise, the dispatcher joins the shared selector of 'other'.
+          // The sockets passed to socket::share() are watched by all the
+          // dispatchers sharing the selector and each event is processed
+          // by only one of them (the sockets are one-shot), so that the
+          // dispatchers which are not busy take the work.
+          // Each time the shared selector is reported, the dispatcher takes
+          // up to 'batch' events from it; the rest are left for the other
+          // dispatchers (all of them are woken up).
+          // It has to be called after create() and before the dispatcher
+          // is started.
+          bool share(const dispatcher* other = nullptr,
+                     size_t batch = default_shared_batch);
+
+          // Enable / disable the histogram of the latency of the socket
+          // callbacks (it adds two clock reads per callback).
+          void enable_callback_latency(bool enable);
+
+          // Enable watchdog.
+          // The callbacks (socket::run() and socket::timeout()) which take
+          // 'threshold' nanoseconds or more are recorded in a ring buffer,
+          // which can be read from another thread with
+          // read_slow_callbacks(). It adds two clock reads per callback.
+          void enable_watchdog(uint64_t threshold);
 
+          // Disable watchdog.
+          void disable_watchdog();
+
+          // Read slow callbacks (see watchdog::read()).
+          // It can be called from any thread.
+          size_t read_slow_callbacks(uint64_t& cursor,
+                                     slow_callback* entries,
+                                     size_t n,
+                                     uint64_t& lost) const;
+
+          // Has the dispatcher been running the same callback for
+          // 'threshold' nanoseconds or more?
+          // It can be called from any thread (the watchdog has to be
+          // enabled).
+          bool stalled(uint64_t threshold, int& fd, uint64_t& duration) const;
+
+          // Migrate all the sockets to the dispatchers 'targets' (round-robin)
+          // and wait until it is done.
+          // It has to be called from another thread while the dispatcher is
+          // running. The idle timers of the sockets are restarted.
+          // Returns false (and nothing is migrated) if the dispatcher has
+          // pending timers (see schedule()).
+          bool migrate(dispatcher** targets, size_t ntargets);
+
+          // Get the dispatcher running in the current thread (nullptr if
+          // none).
+          static dispatcher* current();
+
+        private:
           net::internal::selector _M_selector;
 
+          // Selector shared with other dispatchers (see share()).
+          net::internal::selector _M_shared;
+
           int _M_pipe[2];
 
           util::node _M_header;
 
+          // Sockets which have failed in the current loop iteration (they
+          // are cleared at the end of the iteration, as there might be more
+          // events for them in the current batch).
+          util::node _M_errors;
+
+          // Limit of the number of events returned by a single wait.
+          size_t _M_max_events_limit;
+
           struct timeval _M_start;
 
           // Milliseconds since start.
           uint64_t _M_time;
 
           pthread_t _M_thread;
-          bool _M_running;
+
+          // Has the thread been started (see start())?
+          bool _M_started;
+
+          std::atomic<bool> _M_running;
+
+          // Drain requested by drain().
+          std::atomic<bool> _M_drain;
+          unsigned _M_drain_timeout;
+
+          // Is the dispatcher draining and until when?
+          bool _M_draining;
+          uint64_t _M_drain_deadline;
+
+          int _M_incoming_cpu;
+
+          // Sockets with coalesced writes pending to be flushed.
+          socket* _M_flush;
+
+          // Registered sockets.
+          socket* _M_sockets;
+
+          // Sockets to be run again in the next loop iteration.
+          socket* _M_ready;
+          socket** _M_ready_tail;
+
+          // Read budget of each call to socket::run() and what is left of
+          // it in the current call (SIZE_MAX outside socket::run()).
+          size_t _M_read_budget;
+          size_t _M_budget;
+
+          // Is a socket being run? The read budget is only consumed from
+          // socket::run() (not from the timers, socket::timeout() or
+          // socket::clear()).
+          bool _M_in_run;
+
+          // Trigger of the sockets registered with an edge-triggered watch.
+          net::event::trigger _M_trigger;
+
+          // Migration requested by migrate().
+          std::atomic<bool> _M_migrate;
+          dispatcher** _M_targets;
+          size_t _M_ntargets;
+          bool _M_migrated;
+
+          // Metrics.
+          counters _M_counters;
+
+          // Slow-callback detector.
+          watchdog _M_watchdog;
+
+          // Timers.
+          timer_wheel _M_timers;
 
           // Run.
 #if defined(USE_SOCKET_TEMPLATE)
@@ -114,6 +356,68 @@ namespace net {
 #endif
           void process_pipe();
 
+          // Process the events of the shared selector.
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          void process_shared();
+
+          // Process shared socket.
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          bool process_shared_socket(T* sock, net::event::result ev);
+
+          // Move socket to the shared selector (see socket::share()).
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          bool share_socket(T* sock);
+
+          // Get the events to be watched for a socket.
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          static net::event::watch watched_events(const T* sock);
+
+          // Update the events watched for a socket (and rearm it, if it is
+          // one-shot). The selector is only modified if the events change.
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          bool update_socket(net::internal::selector& selector, T* sock);
+
+          // Add socket to the selector and to the list of registered sockets
+          // (called from the thread running dispatcher::run()).
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          bool add_socket(T* sock, net::event::watch ev);
+
+          // Add socket to the list of registered sockets.
+          void link_socket(socket* sock);
+
+          // Remove socket from the list of registered sockets.
+          void unlink_socket(socket* sock);
+
+          // Drain the sockets (see drain()).
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          void process_drain();
+
+          // Wake up the dispatcher (through the pipe).
+          void wake_up();
+
+          // Migrate sockets to the dispatchers passed to migrate().
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          void migrate_sockets();
+
+          // Get the dispatcher running in the current thread.
+          static dispatcher*& current_dispatcher();
+
           // Clear socket.
 #if defined(USE_SOCKET_TEMPLATE)
           template<typename T>
@@ -132,12 +436,69 @@ namespace net {
 #endif
           void unlink_node(T* sock);
 
+          // Link the socket in the list of sockets with timeout according to
+          // its earliest deadline (unlink it if it has none).
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          void update_node(T* sock);
+
+          // Move socket to the list of failed sockets.
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          void fail_socket(T* sock);
+
+          // Clear failed sockets.
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          void clear_failed_sockets();
+
           // Check expired sockets.
 #if defined(USE_SOCKET_TEMPLATE)
           template<typename T>
 #endif
           void check_expired();
 
+          // Consume read budget.
+          void consume_budget(size_t bytes);
+
+          // Add socket to the list of sockets to be run again in the next
+          // loop iteration.
+          void defer_run(socket* sock);
+
+          // Remove socket from the list of sockets to be run again.
+          void cancel_run(socket* sock);
+
+          // Run the sockets which exhausted their read budget in the
+          // previous loop iteration.
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          void run_ready();
+
+          // Add socket to the list of sockets to be flushed at the end of the
+          // current loop iteration.
+          void defer_flush(socket* sock);
+
+          // Remove socket from the list of sockets to be flushed.
+          void cancel_flush(socket* sock);
+
+          // Flush coalesced writes.
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          void flush();
+
+          // Wait for events ('timeout' in milliseconds, -1: no timeout).
+          // If a timer expires before the timeout, wait until then with
+          // sub-millisecond precision.
+          int wait(int timeout);
+
+          // Run the expired timers.
+          void run_timers();
+
           // Compute timeout.
 #if defined(USE_SOCKET_TEMPLATE)
           template<typename T>
@@ -146,16 +507,64 @@ namespace net {
 
           // Update time.
           void update_time();
+
+          // Begin callback.
+          // Returns the current time if the callbacks are being timed; 0
+          // otherwise.
+          uint64_t begin_callback(int fd);
+
+          // End callback.
+          void end_callback(int fd, uint32_t events, uint64_t start);
+
+#if defined(__linux__)
+          // Build CPU set.
+          static bool build_cpu_set(const int* cpus,
+                                    size_t ncpus,
+                                    cpu_set_t& set);
+#endif
+
+          // Set thread name.
+          static void set_thread_name(pthread_t thread, const char* name);
       };
 
+      inline dispatcher::thread_config::thread_config()
+        : name(nullptr),
+          cpus(nullptr),
+          ncpus(0),
+          incoming_cpu(false)
+      {
+      }
+
       inline dispatcher::dispatcher()
-        : _M_running(false)
+        : _M_started(false),
+          _M_running(false),
+          _M_drain(false),
+          _M_drain_timeout(0),
+          _M_draining(false),
+          _M_drain_deadline(0),
+          _M_incoming_cpu(-1),
+          _M_flush(nullptr),
+          _M_sockets(nullptr),
+          _M_ready(nullptr),
+          _M_ready_tail(&_M_ready),
+          _M_read_budget(0),
+          _M_budget(SIZE_MAX),
+          _M_in_run(false),
+          _M_trigger(net::event::trigger::edge),
+          _M_migrate(false),
+          _M_targets(nullptr),
+          _M_ntargets(0),
+          _M_migrated(false),
+          _M_timers(counters::now())
       {
         _M_pipe[0] = -1;
         _M_pipe[1] = -1;
 
         _M_header.prev = &_M_header;
         _M_header.next = &_M_header;
+
+        _M_errors.prev = &_M_errors;
+        _M_errors.next = &_M_errors;
       }
 
       inline dispatcher::~dispatcher()
@@ -171,9 +580,16 @@ namespace net {
         }
       }
 
-      inline bool dispatcher::create()
+      inline bool dispatcher::create(size_t max_events,
+                                     size_t max_events_limit)
       {
-        return ((_M_selector.create()) &&
+        _M_max_events_limit = (max_events_limit > max_events) ?
+                                max_events_limit :
+                                max_events;
+
+        counters::set(_M_counters.event_capacity, max_events);
+
+        return ((_M_selector.create(max_events)) &&
                 (pipe2(_M_pipe, O_NONBLOCK) == 0) &&
                 (_M_selector.add(_M_pipe[0],
                                  net::event::watch::read,
@@ -190,27 +606,147 @@ namespace net {
 #endif
       inline bool dispatcher::start()
       {
-        _M_running = true;
+#if defined(USE_SOCKET_TEMPLATE)
+        return start<T>(thread_config());
+#else
+        return start(thread_config());
+#endif
+      }
+
+#if defined(USE_SOCKET_TEMPLATE)
+      template<typename T>
+#endif
+      inline bool dispatcher::start(const thread_config& config)
+      {
+        pthread_attr_t attr;
+        if (pthread_attr_init(&attr) != 0) {
+          return false;
+        }
+
+        // Set CPU affinity (the thread starts running on one of the CPUs,
+        // so that the memory it touches is allocated on the local NUMA
+        // node).
+        if (config.ncpus > 0) {
+#if defined(__linux__)
+          cpu_set_t set;
+          if ((!build_cpu_set(config.cpus, config.ncpus, set)) ||
+              (pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set) !=
+               0)) {
+            pthread_attr_destroy(&attr);
+            return false;
+          }
+#else
+          pthread_attr_destroy(&attr);
+
+          errno = ENOTSUP;
+          return false;
+#endif
+        }
+
+        _M_incoming_cpu = ((config.incoming_cpu) && (config.ncpus == 1)) ?
+                            config.cpus[0] :
+                            -1;
+
+        _M_running.store(true, std::memory_order_release);
 
         // Create thread.
 #if defined(USE_SOCKET_TEMPLATE)
-        if (pthread_create(&_M_thread, nullptr, run<T>, this) == 0) {
+        int ret = pthread_create(&_M_thread, &attr, run<T>, this);
 #else
-        if (pthread_create(&_M_thread, nullptr, run, this) == 0) {
+        int ret = pthread_create(&_M_thread, &attr, run, this);
 #endif
+
+        pthread_attr_destroy(&attr);
+
+        if (ret == 0) {
+          _M_started = true;
+
+          if (config.name) {
+            set_thread_name(_M_thread, config.name);
+          }
+
           return true;
         }
 
-        _M_running = false;
+        _M_running.store(false, std::memory_order_release);
+        _M_incoming_cpu = -1;
 
         return false;
       }
 
+      inline int dispatcher::incoming_cpu() const
+      {
+        return _M_incoming_cpu;
+      }
+
+      inline bool dispatcher::configure_thread(const thread_config& config)
+      {
+        if (config.ncpus > 0) {
+#if defined(__linux__)
+          cpu_set_t set;
+          if ((!build_cpu_set(config.cpus, config.ncpus, set)) ||
+              (pthread_setaffinity_np(pthread_self(),
+                                      sizeof(cpu_set_t),
+                                      &set) != 0)) {
+            return false;
+          }
+#else
+          errno = ENOTSUP;
+          return false;
+#endif
+        }
+
+        if (config.name) {
+          set_thread_name(pthread_self(), config.name);
+        }
+
+        return true;
+      }
+
       inline void dispatcher::stop()
       {
-        if (_M_running) {
-          _M_running = false;
+        if (_M_started) {
+          // Unless the dispatcher is draining, stop it now.
+          if (!_M_drain.load(std::memory_order_acquire)) {
+            _M_running.store(false, std::memory_order_release);
+            wake_up();
+          }
+
           pthread_join(_M_thread, nullptr);
+
+          _M_started = false;
+          _M_drain.store(false, std::memory_order_relaxed);
+          _M_draining = false;
+        }
+      }
+
+      inline void dispatcher::stop(unsigned timeout)
+      {
+        drain(timeout);
+        stop();
+      }
+
+      inline void dispatcher::drain(unsigned timeout)
+      {
+        if ((_M_running.load(std::memory_order_acquire)) &&
+            (!_M_drain.load(std::memory_order_acquire))) {
+          _M_drain_timeout = timeout;
+          _M_drain.store(true, std::memory_order_release);
+
+          wake_up();
+        }
+      }
+
+      inline bool dispatcher::draining() const
+      {
+        return _M_draining;
+      }
+
+      inline void dispatcher::wake_up()
+      {
+        void* wakeup = nullptr;
+        if (write(_M_pipe[1], &wakeup, sizeof(void*)) < 0) {
+          // The pipe is full, the dispatcher is about to wake up anyway.
         }
       }
 
@@ -219,8 +755,20 @@ namespace net {
 #endif
       inline bool dispatcher::register_socket(T* sock)
       {
-        return (write(_M_pipe[1], &sock, sizeof(T*)) ==
-                static_cast<ssize_t>(sizeof(T*)));
+        do {
+          if (write(_M_pipe[1], &sock, sizeof(T*)) ==
+              static_cast<ssize_t>(sizeof(T*))) {
+            return true;
+          }
+
+          // If the pipe is full and the dispatcher is running in another
+          // thread, wait for it to empty the pipe.
+        } while ((errno == EAGAIN) &&
+                 (_M_running.load(std::memory_order_relaxed)) &&
+                 (current() != this) &&
+                 (sched_yield() == 0));
+
+        return false;
       }
 
 #if defined(USE_SOCKET_TEMPLATE)
@@ -237,6 +785,192 @@ namespace net {
         return nullptr;
       }
 
+      inline bool dispatcher::migrate(dispatcher** targets, size_t ntargets)
+      {
+        if ((!_M_running.load(std::memory_order_acquire)) ||
+            (ntargets == 0)) {
+          return false;
+        }
+
+        _M_targets = targets;
+        _M_ntargets = ntargets;
+
+        _M_migrate.store(true, std::memory_order_release);
+
+        // Wake up the dispatcher.
+        wake_up();
+
+        // Wait for the dispatcher to migrate the sockets.
+        while (_M_migrate.load(std::memory_order_acquire)) {
+          usleep(1000);
+        }
+
+        return _M_migrated;
+      }
+
+      inline dispatcher* dispatcher::current()
+      {
+        return current_dispatcher();
+      }
+
+      inline dispatcher*& dispatcher::current_dispatcher()
+      {
+        static thread_local dispatcher* d = nullptr;
+        return d;
+      }
+
+      inline void dispatcher::schedule(timer& t,
+                                       uint64_t delay,
+                                       uint64_t period)
+      {
+        if (t._M_wheel) {
+          t._M_wheel->remove(&t);
+        }
+
+        t._M_expire = counters::now() + delay;
+        t._M_period = period;
+
+        _M_timers.add(&t);
+      }
+
+      inline void dispatcher::cancel(timer& t)
+      {
+        if (t._M_wheel) {
+          t._M_wheel->remove(&t);
+        }
+      }
+
+      inline size_t dispatcher::timers() const
+      {
+        return _M_timers.size();
+      }
+
+      inline void dispatcher::get_metrics(metrics& m) const
+      {
+        _M_counters.get(m);
+      }
+
+      inline void dispatcher::set_read_budget(size_t bytes)
+      {
+        _M_read_budget = bytes;
+      }
+
+      inline void dispatcher::set_trigger(net::event::trigger t)
+      {
+        _M_trigger = t;
+      }
+
+      inline bool dispatcher::share(const dispatcher* other, size_t batch)
+      {
+        // A wait of the shared selector returns up to 'batch' events.
+        if (other ? _M_shared.create(other->_M_shared, batch) :
+                    _M_shared.create(batch)) {
+          // Watch the shared selector (level-triggered: it is reported
+          // while it has events).
+          return _M_selector.add(_M_shared.handle(),
+                                 net::event::watch::read_level,
+                                 reinterpret_cast<void*>(_M_shared.handle()));
+        }
+
+        return false;
+      }
+
+      inline void dispatcher::enable_callback_latency(bool enable)
+      {
+        _M_counters.latency_enabled.store(enable, std::memory_order_relaxed);
+      }
+
+      inline void dispatcher::enable_watchdog(uint64_t threshold)
+      {
+        _M_watchdog.threshold((threshold > 0) ? threshold : 1);
+      }
+
+      inline void dispatcher::disable_watchdog()
+      {
+        _M_watchdog.threshold(0);
+      }
+
+      inline size_t dispatcher::read_slow_callbacks(uint64_t& cursor,
+                                                    slow_callback* entries,
+                                                    size_t n,
+                                                    uint64_t& lost) const
+      {
+        return _M_watchdog.read(cursor, entries, n, lost);
+      }
+
+      inline bool dispatcher::stalled(uint64_t threshold,
+                                      int& fd,
+                                      uint64_t& duration) const
+      {
+        return _M_watchdog.stalled(counters::now(), threshold, fd, duration);
+      }
+
+      inline void dispatcher::consume_budget(size_t bytes)
+      {
+        if (_M_in_run) {
+          _M_budget = (bytes < _M_budget) ? _M_budget - bytes : 0;
+        }
+      }
+
+      inline int dispatcher::wait(int timeout)
+      {
+        if ((timeout != 0) && (!_M_timers.empty())) {
+          uint64_t next = _M_timers.next_expiration();
+          uint64_t now = counters::now();
+
+          uint64_t ns = (next > now) ? next - now : 0;
+          if ((timeout < 0) ||
+              (ns < static_cast<uint64_t>(timeout) * 1000000ull)) {
+            struct timespec ts;
+            ts.tv_sec = ns / 1000000000ull;
+            ts.tv_nsec = ns % 1000000000ull;
+
+            return _M_selector.wait(ts);
+          }
+        }
+
+        return _M_selector.wait(timeout);
+      }
+
+      inline void dispatcher::run_timers()
+      {
+        uint64_t now = counters::now();
+
+        // Move the expired timers to a list of their own, so that the timers
+        // rescheduled from the callbacks are not run again in this
+        // iteration.
+        util::node expired;
+        expired.prev = &expired;
+        expired.next = &expired;
+
+        _M_timers.expire(now, expired);
+
+        while (expired.next != &expired) {
+          timer* t = static_cast<timer*>(expired.next);
+
+          _M_timers.remove(t);
+
+          // Rearm periodic timers before the callback (which might cancel
+          // or reschedule them). If the timer is late, skip the periods
+          // missed.
+          if (t->_M_period > 0) {
+            if ((t->_M_expire += t->_M_period) <= now) {
+              t->_M_expire = now + t->_M_period;
+            }
+
+            _M_timers.add(t);
+          }
+
+          counters::add(_M_counters.timers);
+
+          uint64_t start = begin_callback(-1);
+
+          t->_M_callback(*t, t->_M_arg);
+
+          end_callback(-1, slow_callback::timer, start);
+        }
+      }
+
       inline void dispatcher::update_time()
       {
         struct timeval now;
@@ -247,6 +981,67 @@ namespace net {
 
         _M_time = (res.tv_sec * 1000) + (res.tv_usec / 1000);
       }
+
+      inline uint64_t dispatcher::begin_callback(int fd)
+      {
+        if ((!_M_counters.latency_enabled.load(std::memory_order_relaxed)) &&
+            (_M_watchdog.threshold() == 0)) {
+          return 0;
+        }
+
+        uint64_t start = counters::now();
+        _M_watchdog.enter(fd, start);
+
+        return start;
+      }
+
+      inline void dispatcher::end_callback(int fd,
+                                           uint32_t events,
+                                           uint64_t start)
+      {
+        if (start != 0) {
+          uint64_t end = counters::now();
+
+          if (_M_counters.latency_enabled.load(std::memory_order_relaxed)) {
+            _M_counters.record_latency(end - start);
+          }
+
+          _M_watchdog.exit(fd, events, start, end);
+        }
+      }
+
+#if defined(__linux__)
+      inline bool dispatcher::build_cpu_set(const int* cpus,
+                                            size_t ncpus,
+                                            cpu_set_t& set)
+      {
+        CPU_ZERO(&set);
+
+        for (size_t i = 0; i < ncpus; i++) {
+          if ((cpus[i] < 0) || (cpus[i] >= CPU_SETSIZE)) {
+            errno = EINVAL;
+            return false;
+          }
+
+          CPU_SET(cpus[i], &set);
+        }
+
+        return true;
+      }
+#endif // defined(__linux__)
+
+      inline void dispatcher::set_thread_name(pthread_t thread,
+                                              const char* name)
+      {
+#if defined(__linux__)
+        // The name can have 16 characters at most (including the
+        // terminating null byte).
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%s", name);
+
+        pthread_setname_np(thread, buf);
+#endif
+      }
     }
   }
 }
@@ -13,7 +13,23 @@
   bool net::async::event::dispatcher::register_socket(T* sock,
                                                       net::event::watch ev)
   {
-    return _M_selector.add(sock->handle(), ev, sock);
+    // If running in the dispatcher's thread...
+    if (current() == this) {
+      if (add_socket(sock, ev)) {
+        sock->start_deadlines(_M_time);
+        update_node(sock);
+
+        return true;
+      }
+
+      return false;
+    }
+
+    // Hand the socket off to the dispatcher's thread.
+    sock->_M_event = ev;
+    sock->_M_timeout = -1;
+
+    return register_socket(sock);
   }
 #endif // defined(USE_SOCKET_TEMPLATE)
 
@@ -24,12 +40,48 @@ inline bool net::async::event::dispatcher::register_socket(T* sock,
                                                            net::event::watch ev,
                                                            unsigned timeout)
 {
-  if (register_socket(sock, ev)) {
-    sock->_M_timestamp = _M_time;
-    sock->_M_timeout = timeout;
-    sock->_M_expire = _M_time + timeout;
+  // If running in the dispatcher's thread...
+  if (current() == this) {
+    if (add_socket(sock, ev)) {
+      sock->_M_timestamp = _M_time;
+      sock->_M_timeout = timeout;
+
+      sock->start_deadlines(_M_time);
+      update_node(sock);
+
+      return true;
+    }
+
+    return false;
+  }
+
+  // Hand the socket off to the dispatcher's thread.
+  sock->_M_event = ev;
+  sock->_M_timeout = timeout;
+
+  return register_socket(sock);
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+inline bool net::async::event::dispatcher::add_socket(T* sock,
+                                                      net::event::watch ev)
+{
+  // Apply the dispatcher's trigger to edge-triggered watches.
+  if (net::event::trigger_of(ev) == net::event::trigger::edge) {
+    ev = net::event::with_trigger(ev, _M_trigger);
+  }
+
+  sock->_M_event = ev;
+
+  net::event::watch armed = watched_events(sock);
+  if (_M_selector.add(sock->handle(), armed, sock)) {
+    sock->_M_armed = armed;
 
-    add_node(sock);
+    link_socket(sock);
+
+    counters::add(_M_counters.registered);
 
     return true;
   }
@@ -42,6 +94,21 @@ inline bool net::async::event::dispatcher::register_socket(T* sock,
 #endif
 inline void net::async::event::dispatcher::clear_socket(T* sock)
 {
+  // Remove socket from the list of sockets to be flushed.
+  if (sock->_M_flush_scheduled) {
+    cancel_flush(sock);
+  }
+
+  // Remove socket from the list of sockets to be run again.
+  if (sock->_M_ready_scheduled) {
+    cancel_run(sock);
+  }
+
+  // Remove socket from the list of registered sockets.
+  if (!sock->_M_shared) {
+    unlink_socket(sock);
+  }
+
   // Close socket.
   sock->_M_socket.close();
 
@@ -52,6 +119,54 @@ inline void net::async::event::dispatcher::clear_socket(T* sock)
   sock->clear();
 }
 
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+inline net::event::watch
+net::async::event::dispatcher::watched_events(const T* sock)
+{
+  // Watch for writability while the socket wants write events or there is
+  // coalesced data pending to be sent (if the socket is going to be flushed,
+  // it is updated after the flush).
+  bool write = ((net::event::writes(sock->_M_event)) &&
+                ((sock->_M_write_events) ||
+                 ((sock->_M_wend > sock->_M_wbegin) &&
+                  (!sock->_M_flush_scheduled))));
+
+  // Level-triggered and one-shot sockets only while they cannot write
+  // (otherwise they would be reported all the time).
+  if ((write) &&
+      (net::event::trigger_of(sock->_M_event) != net::event::trigger::edge)) {
+    write = !sock->_M_writable;
+  }
+
+  return write ? sock->_M_event : net::event::without_write(sock->_M_event);
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+inline bool
+net::async::event::dispatcher::update_socket(net::internal::selector& selector,
+                                             T* sock)
+{
+  net::event::watch ev = watched_events(sock);
+
+  // One-shot sockets have to be rearmed even if the events don't change.
+  if ((ev != sock->_M_armed) ||
+      (net::event::trigger_of(ev) == net::event::trigger::oneshot)) {
+    if (!selector.modify(sock->handle(), sock->_M_armed, ev, sock)) {
+      return false;
+    }
+
+    sock->_M_armed = ev;
+
+    counters::add(_M_counters.modified);
+  }
+
+  return true;
+}
+
 #if defined(USE_SOCKET_TEMPLATE)
   template<typename T>
 #endif
@@ -67,21 +182,86 @@ inline void net::async::event::dispatcher::unlink_node(T* sock)
   }
 }
 
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+inline void net::async::event::dispatcher::update_node(T* sock)
+{
+  uint64_t expire;
+  sock->next_deadline(_M_time, expire);
+
+  if (expire != UINT64_MAX) {
+    // If the socket is not in the list or its timeout has changed...
+    if ((!sock->prev) || (expire != sock->_M_expire)) {
+      unlink_node(sock);
+
+      sock->_M_expire = expire;
+
+      add_node(sock);
+    }
+  } else {
+    // Unlink node.
+    unlink_node(sock);
+  }
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+inline void net::async::event::dispatcher::fail_socket(T* sock)
+{
+  sock->_M_error = true;
+
+  // Move the socket from the list of sockets with timeout (if it is there)
+  // to the list of failed sockets.
+  unlink_node(sock);
+
+  sock->prev = _M_errors.prev;
+  sock->next = &_M_errors;
+
+  _M_errors.prev->next = sock;
+  _M_errors.prev = sock;
+}
+
 #if defined(USE_SOCKET_TEMPLATE)
   template<typename T>
 #endif
 inline int net::async::event::dispatcher::compute_timeout()
 {
-  // If there is at least one socket...
+  // If sockets have failed since the failed sockets were cleared (e.g. from
+  // a timer), clear them without waiting.
+  if (_M_errors.next != &_M_errors) {
+    return 0;
+  }
+
+  uint64_t expire = UINT64_MAX;
+
+  // If there is at least one socket with timeout...
   if (_M_header.next != &_M_header) {
-    uint64_t left =
-      static_cast<T*>(_M_header.next)->_M_expire - _M_time;
+    expire = static_cast<T*>(_M_header.next)->_M_expire;
+  }
 
-    return (static_cast<int>(left) < timeout) ? static_cast<int>(left) :
-                                                timeout;
-  } else {
-    return timeout;
+  // If the dispatcher is draining, wake up at the deadline.
+  if ((_M_draining) && (_M_drain_deadline < expire)) {
+    expire = _M_drain_deadline;
+  }
+
+  // If there is nothing to wait for, wait until there are events (stop(),
+  // drain() and migrate() wake the dispatcher up through the pipe).
+  if (expire == UINT64_MAX) {
+    return -1;
   }
+
+  // A deadline might have expired already (e.g. a read deadline rearmed
+  // after the socket has been sending for a while).
+  if (expire <= _M_time) {
+    return 0;
+  }
+
+  uint64_t left = expire - _M_time;
+
+  return (left < static_cast<uint64_t>(INT_MAX)) ? static_cast<int>(left) :
+                                                   INT_MAX;
 }
 
 #if !defined(USE_SOCKET_TEMPLATE)
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include "net/async/event/dispatchers.h"
 
 #if defined(USE_SOCKET_TEMPLATE)
@@ -9,37 +10,149 @@
 #endif
 bool net::async::event::dispatchers::start(size_t ndispatchers)
 {
-  if (ndispatchers <= max_dispatchers) {
-    if (ndispatchers == 0) {
-      // Create dispatcher.
-      if (_M_dispatchers[0].create()) {
 #if defined(USE_SOCKET_TEMPLATE)
-        _M_dispatchers[0].run<T>();
+  return start<T>(ndispatchers, config());
 #else
-        _M_dispatchers[0].run();
+  return start(ndispatchers, config());
 #endif
-      }
-    } else {
-      for (_M_ndispatchers = 0;
-           _M_ndispatchers < ndispatchers;
-           _M_ndispatchers++) {
-        // Create and start dispatcher.
-        if ((!_M_dispatchers[_M_ndispatchers].create()) ||
-#if defined(USE_SOCKET_TEMPLATE)
-            (!_M_dispatchers[_M_ndispatchers].start<T>())) {
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+bool net::async::event::dispatchers::start(size_t ndispatchers,
+                                           const config& cfg)
+{
+  // If the dispatchers have already been started or the configuration is
+  // not valid...
+  if ((_M_dispatchers) ||
+      (cfg.max_events == 0) ||
+      ((cfg.ncpus > 0) &&
+       ((!cfg.cpus) ||
+        (cfg.cpus_per_dispatcher == 0) ||
+        (cfg.cpus_per_dispatcher > cfg.ncpus)))) {
+    return false;
+  }
+
+  _M_config = cfg;
+
+  if (ndispatchers == 0) {
+    // Run a single dispatcher in the current thread.
+    if (allocate(1)) {
+#if defined(USE_SOCKET_TEMPLATE)
+      start_dispatcher<T>(0, false);
+#else
+      start_dispatcher(0, false);
+#endif
+    }
+  } else {
+    size_t max_dispatchers = (cfg.max_dispatchers > ndispatchers) ?
+                               cfg.max_dispatchers :
+                               ndispatchers;
+
+    if (!allocate(max_dispatchers)) {
+      return false;
+    }
+
+    while (_M_ndispatchers < ndispatchers) {
+      // Create and start dispatcher.
+#if defined(USE_SOCKET_TEMPLATE)
+      if (!start_dispatcher<T>(_M_ndispatchers, true)) {
 #else
-            (!_M_dispatchers[_M_ndispatchers].start())) {
+      if (!start_dispatcher(_M_ndispatchers, true)) {
 #endif
-          // Stop dispatchers.
-          stop();
+        // Stop dispatchers.
+        stop();
 
-          return false;
-        }
+        return false;
       }
     }
+  }
+
+  return true;
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+net::async::event::dispatcher* net::async::event::dispatchers::add()
+{
+  if ((_M_ndispatchers > 0) && (_M_ndispatchers < _M_max_dispatchers)) {
+#if defined(USE_SOCKET_TEMPLATE)
+    if (start_dispatcher<T>(_M_ndispatchers, true)) {
+#else
+    if (start_dispatcher(_M_ndispatchers, true)) {
+#endif
+      return at(_M_ndispatchers - 1);
+    }
+  }
+
+  return nullptr;
+}
+
+#if defined(USE_SOCKET_TEMPLATE)
+  template<typename T>
+#endif
+bool net::async::event::dispatchers::start_dispatcher(size_t i, bool thread)
+{
+  // CPUs of the dispatcher.
+  static const size_t max_cpus = 256;
+  int cpus[max_cpus];
+  size_t ncpus = (_M_config.cpus_per_dispatcher < max_cpus) ?
+                   _M_config.cpus_per_dispatcher :
+                   max_cpus;
+
+  char name[16];
+
+  dispatcher::thread_config tc;
+  tc.name = _M_config.name ? name : nullptr;
+  tc.cpus = cpus;
+  tc.ncpus = (_M_config.ncpus > 0) ? ncpus : 0;
+  tc.incoming_cpu = _M_config.incoming_cpu;
+
+  if (_M_config.name) {
+    // Truncate the prefix (if needed) to keep the index.
+    char index[16];
+    int len = snprintf(index, sizeof(index), "-%zu", i);
+
+    snprintf(name,
+             sizeof(name),
+             "%.*s%s",
+             static_cast<int>(sizeof(name)) - 1 - len,
+             _M_config.name,
+             index);
+  }
+
+  size_t first = i * ncpus;
+  for (size_t j = 0; j < tc.ncpus; j++) {
+    cpus[j] = _M_config.cpus[(first + j) % _M_config.ncpus];
+  }
+
+  dispatcher* d = new (at(i)) dispatcher();
+  _M_ndispatchers++;
+
+  if (thread) {
+    // Create and start dispatcher.
+#if defined(USE_SOCKET_TEMPLATE)
+    if ((create_dispatcher(i)) && (d->start<T>(tc))) {
+#else
+    if ((create_dispatcher(i)) && (d->start(tc))) {
+#endif
+      return true;
+    }
+  } else if ((dispatcher::configure_thread(tc)) && (create_dispatcher(i))) {
+    // Run dispatcher.
+#if defined(USE_SOCKET_TEMPLATE)
+    d->run<T>();
+#else
+    d->run();
+#endif
 
     return true;
-  } else {
-    return false;
   }
+
+  d->~dispatcher();
+  _M_ndispatchers--;
+
+  return false;
 }
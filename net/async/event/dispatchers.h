@@ -1,6 +1,8 @@
 #ifndef NET_ASYNC_EVENT_DISPATCHERS_H
 #define NET_ASYNC_EVENT_DISPATCHERS_H
 
+#include <stdlib.h>
+#include <new>
 #include "net/async/event/dispatcher.h"
 
 namespace net {
@@ -8,6 +10,52 @@ namespace net {
     namespace event {
       class dispatchers {
         public:
+          // Configuration of the dispatchers' threads.
+          struct config {
+            // Prefix of the names of the threads ("<name>-<index>",
+            // nullptr: don't set them).
+            const char* name;
+
+            // CPUs the threads are pinned to (nullptr: no affinity).
+            // Dispatcher i is pinned to the 'cpus_per_dispatcher' CPUs
+            // starting at cpus[(i * cpus_per_dispatcher) % ncpus].
+            // The list has to remain valid while dispatchers can be added.
+            const int* cpus;
+            size_t ncpus;
+            size_t cpus_per_dispatcher;
+
+            // Set SO_INCOMING_CPU on the sockets of the dispatchers pinned
+            // to a single CPU (see dispatcher::thread_config).
+            bool incoming_cpu;
+
+            // Maximum number of dispatchers (0: the number of dispatchers
+            // passed to start()).
+            size_t max_dispatchers;
+
+            // Maximum number of events returned by a single wait and its
+            // limit (see dispatcher::create()).
+            size_t max_events;
+            size_t max_events_limit;
+
+            // Read budget of each call to socket::run() (0: unlimited, see
+            // dispatcher::set_read_budget()).
+            size_t read_budget;
+
+            // Trigger of the sockets (see dispatcher::set_trigger()).
+            net::event::trigger trigger;
+
+            // Share a selector among the dispatchers (see
+            // dispatcher::share() and socket::share()).
+            bool shared;
+
+            // Maximum number of events a dispatcher takes from the shared
+            // selector per wake-up (see dispatcher::share()).
+            size_t shared_batch;
+
+            // Constructor.
+            config();
+          };
+
           // Constructor.
           dispatchers();
 
@@ -20,40 +68,200 @@ namespace net {
 #endif
           bool start(size_t ndispatchers = 0);
 
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          bool start(size_t ndispatchers, const config& cfg);
+
           // Stop.
           void stop();
 
+          // Stop gracefully: the dispatchers drain their sockets in parallel
+          // (see dispatcher::drain()).
+          void stop(unsigned timeout);
+
+          // Add dispatcher.
+          // Returns the new dispatcher or nullptr if the maximum number of
+          // dispatchers has been reached or the dispatcher couldn't be
+          // started.
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          dispatcher* add();
+
+          // Remove the last dispatcher.
+          // Its sockets are migrated to the other dispatchers (round-robin)
+          // before it is stopped. No sockets should be registered in it
+          // meanwhile. It fails if the dispatcher has pending timers (see
+          // dispatcher::schedule()).
+          bool remove();
+
           // Get dispatcher.
           dispatcher* get(size_t i);
 
+          // Get number of dispatchers.
+          size_t count() const;
+
+          // add(), remove(), get() and count() have to be called from the
+          // same thread.
+
         private:
-          static const size_t max_dispatchers = 32;
+          static const size_t cache_line_size = 64;
 
-          dispatcher _M_dispatchers[max_dispatchers];
+          // Each dispatcher starts in its own cache line.
+          static const size_t slot_size = (sizeof(dispatcher) +
+                                           cache_line_size - 1) &
+                                          ~(cache_line_size - 1);
+
+          uint8_t* _M_dispatchers;
+          size_t _M_max_dispatchers;
           size_t _M_ndispatchers;
+
+          config _M_config;
+
+          // Allocate slots.
+          bool allocate(size_t max_dispatchers);
+
+          // Start dispatcher in slot 'i' (in a new thread, or in the current
+          // thread if 'thread' is false).
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          bool start_dispatcher(size_t i, bool thread);
+
+          // Create dispatcher in slot 'i'.
+          bool create_dispatcher(size_t i);
+
+          // Get dispatcher in slot 'i'.
+          dispatcher* at(size_t i);
       };
 
+      inline dispatchers::config::config()
+        : name(nullptr),
+          cpus(nullptr),
+          ncpus(0),
+          cpus_per_dispatcher(1),
+          incoming_cpu(false),
+          max_dispatchers(0),
+          max_events(dispatcher::default_max_events),
+          max_events_limit(dispatcher::default_max_events_limit),
+          read_budget(0),
+          trigger(net::event::trigger::edge),
+          shared(false),
+          shared_batch(dispatcher::default_shared_batch)
+      {
+      }
+
       inline dispatchers::dispatchers()
-        : _M_ndispatchers(0)
+        : _M_dispatchers(nullptr),
+          _M_max_dispatchers(0),
+          _M_ndispatchers(0)
       {
       }
 
       inline dispatchers::~dispatchers()
       {
         stop();
+
+        for (size_t i = 0; i < _M_ndispatchers; i++) {
+          at(i)->~dispatcher();
+        }
+
+        free(_M_dispatchers);
       }
 
       inline void dispatchers::stop()
       {
         // Stop dispatchers.
         for (size_t i = 0; i < _M_ndispatchers; i++) {
-          _M_dispatchers[i].stop();
+          at(i)->stop();
+        }
+      }
+
+      inline void dispatchers::stop(unsigned timeout)
+      {
+        // Drain dispatchers.
+        for (size_t i = 0; i < _M_ndispatchers; i++) {
+          at(i)->drain(timeout);
+        }
+
+        stop();
+      }
+
+      inline bool dispatchers::remove()
+      {
+        // If there are other dispatchers to migrate the sockets to...
+        if (_M_ndispatchers > 1) {
+          dispatcher** targets;
+          if ((targets = new (std::nothrow)
+                         dispatcher*[_M_ndispatchers - 1]) != nullptr) {
+            for (size_t i = 0; i < _M_ndispatchers - 1; i++) {
+              targets[i] = at(i);
+            }
+
+            dispatcher* d = at(_M_ndispatchers - 1);
+
+            // Migrate sockets.
+            bool ret = d->migrate(targets, _M_ndispatchers - 1);
+
+            delete [] targets;
+
+            if (ret) {
+              d->stop();
+              d->~dispatcher();
+
+              _M_ndispatchers--;
+
+              return true;
+            }
+          }
         }
+
+        return false;
       }
 
       inline dispatcher* dispatchers::get(size_t i)
       {
-        return (i < _M_ndispatchers) ? &_M_dispatchers[i] : nullptr;
+        return (i < _M_ndispatchers) ? at(i) : nullptr;
+      }
+
+      inline size_t dispatchers::count() const
+      {
+        return _M_ndispatchers;
+      }
+
+      inline bool dispatchers::allocate(size_t max_dispatchers)
+      {
+        void* mem;
+        if (posix_memalign(&mem,
+                           cache_line_size,
+                           max_dispatchers * slot_size) == 0) {
+          _M_dispatchers = static_cast<uint8_t*>(mem);
+          _M_max_dispatchers = max_dispatchers;
+
+          return true;
+        }
+
+        return false;
+      }
+
+      inline bool dispatchers::create_dispatcher(size_t i)
+      {
+        dispatcher* d = at(i);
+
+        d->set_read_budget(_M_config.read_budget);
+        d->set_trigger(_M_config.trigger);
+
+        // The dispatchers join the shared selector of the first one.
+        return ((d->create(_M_config.max_events, _M_config.max_events_limit)) &&
+                ((!_M_config.shared) ||
+                 (d->share((i > 0) ? at(0) : nullptr,
+                           _M_config.shared_batch))));
+      }
+
+      inline dispatcher* dispatchers::at(size_t i)
+      {
+        return reinterpret_cast<dispatcher*>(_M_dispatchers + i * slot_size);
       }
     }
   }
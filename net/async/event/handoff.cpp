@@ -0,0 +1,268 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "net/async/event/handoff.h"
+
+bool net::async::event::handoff::listen(
+  const net::socket::address::local& addr
+)
+{
+  _M_listener.close();
+
+  // Remove the file of the previous process (if any).
+  const struct sockaddr_un* sun =
+    reinterpret_cast<const struct sockaddr_un*>(
+      static_cast<const struct sockaddr*>(addr)
+    );
+
+  if ((sun->sun_path[0] != 0) &&
+      (unlink(sun->sun_path) < 0) &&
+      (errno != ENOENT)) {
+    return false;
+  }
+
+  if ((_M_listener.create(net::socket::domain::local,
+                          net::socket::type::seqpacket)) &&
+      (_M_listener.bind(addr)) &&
+      (_M_listener.listen())) {
+    return true;
+  }
+
+  _M_listener.close();
+
+  return false;
+}
+
+bool net::async::event::handoff::send(int timeout)
+{
+  _M_peer.close();
+
+  // Wait for the new process.
+  if (!_M_listener.accept(_M_peer, timeout)) {
+    return false;
+  }
+
+  // The header and the tags are sent in the same message as the handles.
+  header hdr;
+  hdr.magic = magic;
+  hdr.count = static_cast<uint32_t>(_M_nhandles);
+
+  struct iovec iov[2];
+  iov[0].iov_base = &hdr;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = _M_tags;
+  iov[1].iov_len = _M_nhandles * sizeof(uint32_t);
+
+  union {
+    struct cmsghdr align;
+    uint8_t buf[CMSG_SPACE(max_handles * sizeof(net::socket::handle_t))];
+  } control;
+
+  struct msghdr msg;
+  msg.msg_name = nullptr;
+  msg.msg_namelen = 0;
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  msg.msg_flags = 0;
+
+  if (_M_nhandles > 0) {
+    size_t len = _M_nhandles * sizeof(net::socket::handle_t);
+
+    memset(&control, 0, sizeof(control));
+
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(len);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(len);
+
+    memcpy(CMSG_DATA(cmsg), _M_handles, len);
+  } else {
+    msg.msg_control = nullptr;
+    msg.msg_controllen = 0;
+  }
+
+  // Send the sockets and wait for the acknowledgement.
+  uint32_t ack;
+  ssize_t ret = -1;
+  if ((_M_peer.sendmsg(&msg, timeout)) &&
+      ((ret = _M_peer.recv(&ack, sizeof(uint32_t), timeout)) ==
+       static_cast<ssize_t>(sizeof(uint32_t))) &&
+      (ack == acknowledgement)) {
+    _M_peer.close();
+    return true;
+  }
+
+  if (ret == 0) {
+    // The new process closed the connection.
+    errno = ECONNRESET;
+  }
+
+  _M_peer.close();
+
+  return false;
+}
+
+bool net::async::event::handoff::receive(
+  const net::socket::address::local& addr,
+  int timeout
+)
+{
+  close();
+
+  if ((!_M_peer.create(net::socket::domain::local,
+                       net::socket::type::seqpacket)) ||
+      (!_M_peer.connect(addr, timeout))) {
+    _M_peer.close();
+    return false;
+  }
+
+  header hdr;
+
+  struct iovec iov[2];
+  iov[0].iov_base = &hdr;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = _M_tags;
+  iov[1].iov_len = sizeof(_M_tags);
+
+  union {
+    struct cmsghdr align;
+    uint8_t buf[CMSG_SPACE(max_handles * sizeof(net::socket::handle_t))];
+  } control;
+
+  struct msghdr msg;
+  msg.msg_name = nullptr;
+  msg.msg_namelen = 0;
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control);
+  msg.msg_flags = 0;
+
+#if defined(MSG_CMSG_CLOEXEC)
+  static const int flags = MSG_CMSG_CLOEXEC;
+#else
+  static const int flags = 0;
+#endif
+
+  ssize_t ret;
+  if ((ret = net::internal::socket::recvmsg(_M_peer.handle(),
+                                            &msg,
+                                            flags,
+                                            timeout)) < 0) {
+    _M_peer.close();
+    return false;
+  }
+
+  // Collect the handles received.
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+       cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+      size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) /
+                 sizeof(net::socket::handle_t);
+
+      if (n > max_handles - _M_nhandles) {
+        n = max_handles - _M_nhandles;
+      }
+
+      memcpy(_M_handles + _M_nhandles,
+             CMSG_DATA(cmsg),
+             n * sizeof(net::socket::handle_t));
+
+      _M_nhandles += n;
+    }
+  }
+
+  _M_owned = _M_nhandles;
+
+  // Check the message.
+  if ((ret == 0) ||
+      (static_cast<size_t>(ret) < sizeof(header)) ||
+      (hdr.magic != magic) ||
+      (hdr.count != _M_nhandles) ||
+      (static_cast<size_t>(ret) !=
+       sizeof(header) + _M_nhandles * sizeof(uint32_t)) ||
+      ((msg.msg_flags & MSG_CTRUNC) != 0)) {
+    close();
+
+    errno = (ret == 0) ? ECONNRESET : EPROTO;
+    return false;
+  }
+
+  return true;
+}
+
+net::socket::handle_t
+net::async::event::handoff::take(const net::socket::address& addr)
+{
+  for (size_t i = 0; i < _M_nhandles; i++) {
+    if ((_M_handles[i] != net::socket::invalid_handle) &&
+        (_M_tags[i] == listener)) {
+      net::socket::address a;
+      socklen_t addrlen = sizeof(struct sockaddr_storage);
+      if ((getsockname(_M_handles[i], a, &addrlen) == 0) &&
+          (a.equal(addr))) {
+        return take_handle(i);
+      }
+    }
+  }
+
+  return net::socket::invalid_handle;
+}
+
+net::socket::handle_t net::async::event::handoff::take(uint32_t tag)
+{
+  for (size_t i = 0; i < _M_nhandles; i++) {
+    if ((_M_handles[i] != net::socket::invalid_handle) &&
+        (_M_tags[i] == tag)) {
+      return take_handle(i);
+    }
+  }
+
+  return net::socket::invalid_handle;
+}
+
+bool net::async::event::handoff::acknowledge(int timeout)
+{
+  uint32_t ack = acknowledgement;
+  if (_M_peer.send(&ack, sizeof(uint32_t), timeout)) {
+    _M_peer.close();
+    return true;
+  }
+
+  _M_peer.close();
+
+  return false;
+}
+
+void net::async::event::handoff::close()
+{
+  // Close the handles received which haven't been taken.
+  if (_M_owned > 0) {
+    for (size_t i = 0; i < _M_nhandles; i++) {
+      if (_M_handles[i] != net::socket::invalid_handle) {
+        net::internal::socket::close(_M_handles[i]);
+      }
+    }
+  }
+
+  _M_nhandles = 0;
+  _M_owned = 0;
+
+  _M_listener.close();
+  _M_peer.close();
+}
+
+net::socket::handle_t net::async::event::handoff::take_handle(size_t i)
+{
+  net::socket::handle_t handle = _M_handles[i];
+  _M_handles[i] = net::socket::invalid_handle;
+
+  _M_owned--;
+
+  return handle;
+}
@@ -0,0 +1,134 @@
+#ifndef NET_ASYNC_EVENT_HANDOFF_H
+#define NET_ASYNC_EVENT_HANDOFF_H
+
+#include <stdint.h>
+#include <errno.h>
+#include "net/socket.h"
+
+namespace net {
+  namespace async {
+    namespace event {
+      // Hand-off of sockets to a new process (hot restart).
+      // The running process listens on a local address; the new process
+      // connects to it, receives the listening sockets (and, optionally,
+      // idle connections) with SCM_RIGHTS, attaches them to its dispatchers
+      // (socket::attach()) and acknowledges the hand-off. Then the old
+      // process stops accepting and drains its connections, while the new
+      // process keeps accepting from the same sockets: no connection is
+      // refused and the accept queues are not lost.
+      // The methods block (up to 'timeout' milliseconds, -1: no timeout),
+      // so they are not called from a dispatcher's thread.
+      class handoff {
+        public:
+          // Maximum number of sockets handed off.
+          static const size_t max_handles = 64;
+
+          // Tag of the listening sockets.
+          static const uint32_t listener = 0;
+
+          // Constructor.
+          handoff();
+
+          // Destructor.
+          ~handoff();
+
+          // Old process: listen on 'addr' for the new process (an existing
+          // file is replaced).
+          bool listen(const net::socket::address::local& addr);
+
+          // Old process: add socket to be handed off ('tag' tells the new
+          // process what the socket is used for).
+          bool add(net::socket::handle_t handle, uint32_t tag = listener);
+
+          // Old process: wait for the new process, send the sockets and wait
+          // until the new process acknowledges the hand-off.
+          // Returns false if the new process didn't take over (the old
+          // process keeps serving).
+          bool send(int timeout = -1);
+
+          // New process: receive the sockets from the old process listening
+          // on 'addr'.
+          bool receive(const net::socket::address::local& addr, int timeout);
+
+          // New process: take the next listening socket bound to 'addr'
+          // (there might be several, e.g. one per dispatcher with
+          // SO_REUSEPORT). Returns invalid_handle if there are none left.
+          net::socket::handle_t take(const net::socket::address& addr);
+
+          // New process: take the next socket with tag 'tag'.
+          net::socket::handle_t take(uint32_t tag);
+
+          // New process: acknowledge the hand-off once the sockets have been
+          // attached (the old process stops accepting then).
+          bool acknowledge(int timeout);
+
+          // Get number of sockets which haven't been taken.
+          size_t count() const;
+
+          // Close the sockets which haven't been taken and the connection
+          // to the other process.
+          void close();
+
+        private:
+          // Message header.
+          struct header {
+            uint32_t magic;
+            uint32_t count;
+          };
+
+          static const uint32_t magic = 0x48444f46;         // "HDOF".
+          static const uint32_t acknowledgement = 0x41434b21; // "ACK!".
+
+          // Local socket: listening (old process) and connection to the
+          // other process.
+          net::socket _M_listener;
+          net::socket _M_peer;
+
+          net::socket::handle_t _M_handles[max_handles];
+          uint32_t _M_tags[max_handles];
+          size_t _M_nhandles;
+
+          // Number of handles owned (received and not taken).
+          size_t _M_owned;
+
+          // Take handle 'i'.
+          net::socket::handle_t take_handle(size_t i);
+
+          // Disable copy constructor and assignment operator.
+          handoff(const handoff&) = delete;
+          handoff& operator=(const handoff&) = delete;
+      };
+
+      inline handoff::handoff()
+        : _M_nhandles(0),
+          _M_owned(0)
+      {
+      }
+
+      inline handoff::~handoff()
+      {
+        close();
+      }
+
+      inline bool handoff::add(net::socket::handle_t handle, uint32_t tag)
+      {
+        if (_M_nhandles < max_handles) {
+          _M_handles[_M_nhandles] = handle;
+          _M_tags[_M_nhandles++] = tag;
+
+          return true;
+        }
+
+        errno = ENOSPC;
+        return false;
+      }
+
+      inline size_t handoff::count() const
+      {
+        return _M_owned;
+      }
+    }
+  }
+}
+
+#endif // NET_ASYNC_EVENT_HANDOFF_H
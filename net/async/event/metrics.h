@@ -0,0 +1,259 @@
+#ifndef NET_ASYNC_EVENT_METRICS_H
+#define NET_ASYNC_EVENT_METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <atomic>
+
+namespace net {
+  namespace async {
+    namespace event {
+      // Snapshot of the metrics of a dispatcher.
+      // All the counters are cumulative since the dispatcher was created,
+      // except 'sockets'. Times are in nanoseconds.
+      struct metrics {
+        // Number of buckets of the callback latency histogram.
+        // Bucket 0 counts the callbacks which took less than 2^min_shift
+        // nanoseconds, bucket i (i > 0) the callbacks which took
+        // [2^(min_shift + i - 1), 2^(min_shift + i)) nanoseconds and the
+        // last bucket also counts the slower ones.
+        static const unsigned latency_buckets = 24;
+        static const unsigned min_shift = 7;
+
+        // Iterations of the event loop.
+        uint64_t iterations;
+
+        // Events returned by the selector.
+        uint64_t events;
+
+        // Maximum number of events returned by a single wait.
+        uint64_t max_events;
+
+        // Waits which returned the maximum number of events the selector
+        // can return (the events didn't fit in a single wait).
+        uint64_t full_waits;
+
+        // Maximum number of events the selector can currently return.
+        uint64_t event_capacity;
+
+        // Time spent waiting for events.
+        uint64_t wait_time;
+
+        // Time spent processing events, timeouts and deferred writes.
+        uint64_t busy_time;
+
+        // Calls to socket::run().
+        uint64_t callbacks;
+
+        // Calls to socket::run() which exhausted the read budget (the
+        // socket was run again in the next loop iteration).
+        uint64_t requeued;
+
+        // Events of shared sockets processed by this dispatcher (see
+        // dispatcher::share()).
+        uint64_t shared;
+
+        // Calls to selector::modify() (the events watched for a socket
+        // changed or a one-shot socket was rearmed).
+        uint64_t modified;
+
+        // Connections accepted.
+        uint64_t accepted;
+
+        // Calls to socket::timeout().
+        uint64_t timeouts;
+
+        // Timer callbacks (see dispatcher::schedule()).
+        uint64_t timers;
+
+        // Sockets which have failed (error event, socket::run() or a
+        // deferred write failed, or the registration failed).
+        uint64_t errors;
+
+        // Sockets received through the pipe (registered from another
+        // thread).
+        uint64_t handoffs;
+
+        // Sockets migrated to other dispatchers.
+        uint64_t migrated;
+
+        // Sockets currently registered.
+        uint64_t sockets;
+
+        // Latency of the socket callbacks (socket::run() and
+        // socket::timeout(), only if enabled).
+        uint64_t callback_latency[latency_buckets];
+      };
+
+      // Counters updated by the dispatcher's thread.
+      // The counters are written by a single thread, so they are updated
+      // with relaxed loads and stores (no atomic read-modify-write) and can be
+      // read from any thread.
+      // The counters are kept in their own cache lines, so that reading them
+      // from another thread doesn't slow down the rest of the dispatcher.
+      class counters {
+        public:
+          static const size_t cache_line_size = 64;
+
+          typedef std::atomic<uint64_t> counter;
+
+          // Constructor.
+          counters();
+
+          // Add to counter.
+          static void add(counter& c, uint64_t n = 1);
+
+          // Set counter to the maximum of its current value and 'n'.
+          static void max(counter& c, uint64_t n);
+
+          // Set counter.
+          static void set(counter& c, uint64_t n);
+
+          // Record callback latency.
+          void record_latency(uint64_t ns);
+
+          // Copy counters to a snapshot.
+          void get(metrics& m) const;
+
+          // Get monotonic time (nanoseconds).
+          static uint64_t now();
+
+        private:
+          uint8_t _M_pad0[cache_line_size];
+
+        public:
+          counter iterations;
+          counter events;
+          counter max_events;
+          counter full_waits;
+          counter event_capacity;
+          counter wait_time;
+          counter busy_time;
+          counter callbacks;
+          counter requeued;
+          counter shared;
+          counter modified;
+          counter accepted;
+          counter timeouts;
+          counter timers;
+          counter errors;
+          counter handoffs;
+          counter registered;
+          counter closed;
+          counter migrated;
+
+          counter callback_latency[metrics::latency_buckets];
+
+          // Record callback latencies?
+          std::atomic<bool> latency_enabled;
+
+        private:
+          uint8_t _M_pad1[cache_line_size];
+      };
+
+      inline counters::counters()
+        : iterations(0),
+          events(0),
+          max_events(0),
+          full_waits(0),
+          event_capacity(0),
+          wait_time(0),
+          busy_time(0),
+          callbacks(0),
+          requeued(0),
+          shared(0),
+          modified(0),
+          accepted(0),
+          timeouts(0),
+          timers(0),
+          errors(0),
+          handoffs(0),
+          registered(0),
+          closed(0),
+          migrated(0),
+          latency_enabled(false)
+      {
+        for (unsigned i = 0; i < metrics::latency_buckets; i++) {
+          callback_latency[i].store(0, std::memory_order_relaxed);
+        }
+      }
+
+      inline void counters::add(counter& c, uint64_t n)
+      {
+        c.store(c.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+      }
+
+      inline void counters::max(counter& c, uint64_t n)
+      {
+        if (n > c.load(std::memory_order_relaxed)) {
+          c.store(n, std::memory_order_relaxed);
+        }
+      }
+
+      inline void counters::set(counter& c, uint64_t n)
+      {
+        c.store(n, std::memory_order_relaxed);
+      }
+
+      inline void counters::record_latency(uint64_t ns)
+      {
+        unsigned bucket = 0;
+
+        if ((ns >>= metrics::min_shift) > 0) {
+          bucket = 64 - __builtin_clzll(ns);
+
+          if (bucket >= metrics::latency_buckets) {
+            bucket = metrics::latency_buckets - 1;
+          }
+        }
+
+        add(callback_latency[bucket]);
+      }
+
+      inline void counters::get(metrics& m) const
+      {
+        m.iterations = iterations.load(std::memory_order_relaxed);
+        m.events = events.load(std::memory_order_relaxed);
+        m.max_events = max_events.load(std::memory_order_relaxed);
+        m.full_waits = full_waits.load(std::memory_order_relaxed);
+        m.event_capacity = event_capacity.load(std::memory_order_relaxed);
+        m.wait_time = wait_time.load(std::memory_order_relaxed);
+        m.busy_time = busy_time.load(std::memory_order_relaxed);
+        m.callbacks = callbacks.load(std::memory_order_relaxed);
+        m.requeued = requeued.load(std::memory_order_relaxed);
+        m.shared = shared.load(std::memory_order_relaxed);
+        m.modified = modified.load(std::memory_order_relaxed);
+        m.accepted = accepted.load(std::memory_order_relaxed);
+        m.timeouts = timeouts.load(std::memory_order_relaxed);
+        m.timers = timers.load(std::memory_order_relaxed);
+        m.errors = errors.load(std::memory_order_relaxed);
+        m.handoffs = handoffs.load(std::memory_order_relaxed);
+
+        m.migrated = migrated.load(std::memory_order_relaxed);
+
+        uint64_t nclosed = closed.load(std::memory_order_relaxed) +
+                           m.migrated;
+
+        uint64_t nregistered = registered.load(std::memory_order_relaxed);
+        m.sockets = (nregistered > nclosed) ? nregistered - nclosed : 0;
+
+        for (unsigned i = 0; i < metrics::latency_buckets; i++) {
+          m.callback_latency[i] =
+            callback_latency[i].load(std::memory_order_relaxed);
+        }
+      }
+
+      inline uint64_t counters::now()
+      {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return (static_cast<uint64_t>(ts.tv_sec) * 1000000000ull) + ts.tv_nsec;
+      }
+    }
+  }
+}
+
+#endif // NET_ASYNC_EVENT_METRICS_H
@@ -1,3 +1,4 @@
+#include <string.h>
 #include "net/async/event/socket.h"
 
 #if defined(USE_SOCKET_TEMPLATE)
@@ -22,9 +23,13 @@ ssize_t net::async::event::socket::readv(const struct iovec* iov,
   ssize_t ret;
   if ((ret = _M_socket.readv(iov, iovcnt)) == static_cast<ssize_t>(len)) {
     _M_timestamp = _M_dispatcher->time();
+    _M_read_timestamp = _M_timestamp;
+    _M_dispatcher->consume_budget(ret);
   } else if (ret >= 0) {
     _M_readable = false;
     _M_timestamp = _M_dispatcher->time();
+    _M_read_timestamp = _M_timestamp;
+    _M_dispatcher->consume_budget(ret);
   } else if (errno == EAGAIN) {
     _M_readable = false;
   } else {
@@ -37,6 +42,11 @@ ssize_t net::async::event::socket::readv(const struct iovec* iov,
 ssize_t net::async::event::socket::writev(const struct iovec* iov,
                                           unsigned iovcnt)
 {
+  // Send the coalesced writes first.
+  if (!flush_pending()) {
+    return -1;
+  }
+
   // Compute how many bytes should be sent.
   size_t len = 0;
   for (unsigned i = 0; i < iovcnt; i++) {
@@ -46,11 +56,19 @@ ssize_t net::async::event::socket::writev(const struct iovec* iov,
   ssize_t ret;
   if ((ret = _M_socket.writev(iov, iovcnt)) == static_cast<ssize_t>(len)) {
     _M_timestamp = _M_dispatcher->time();
+    _M_write_stalled = false;
   } else if (ret >= 0) {
     _M_writable = false;
     _M_timestamp = _M_dispatcher->time();
+    _M_write_timestamp = _M_timestamp;
+    _M_write_stalled = true;
   } else if (errno == EAGAIN) {
     _M_writable = false;
+
+    if (!_M_write_stalled) {
+      _M_write_timestamp = _M_dispatcher->time();
+      _M_write_stalled = true;
+    }
   } else {
     _M_error = true;
   }
@@ -58,8 +76,28 @@ ssize_t net::async::event::socket::writev(const struct iovec* iov,
   return ret;
 }
 
+ssize_t net::async::event::socket::writev(util::iovec_cursor& cursor)
+{
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(struct msghdr));
+
+  cursor.get(msg);
+
+  ssize_t ret;
+  if ((ret = sendmsg(&msg)) > 0) {
+    cursor.advance(ret);
+  }
+
+  return ret;
+}
+
 ssize_t net::async::event::socket::sendmsg(const struct msghdr* msg)
 {
+  // Send the coalesced writes first.
+  if (!flush_pending()) {
+    return -1;
+  }
+
   // Compute how many bytes should be sent.
   size_t len = 0;
   for (size_t i = 0; i < static_cast<size_t>(msg->msg_iovlen); i++) {
@@ -69,11 +107,19 @@ ssize_t net::async::event::socket::sendmsg(const struct msghdr* msg)
   ssize_t ret;
   if ((ret = _M_socket.sendmsg(msg)) == static_cast<ssize_t>(len)) {
     _M_timestamp = _M_dispatcher->time();
+    _M_write_stalled = false;
   } else if (ret >= 0) {
     _M_writable = false;
     _M_timestamp = _M_dispatcher->time();
+    _M_write_timestamp = _M_timestamp;
+    _M_write_stalled = true;
   } else if (errno == EAGAIN) {
     _M_writable = false;
+
+    if (!_M_write_stalled) {
+      _M_write_timestamp = _M_dispatcher->time();
+      _M_write_stalled = true;
+    }
   } else {
     _M_error = true;
   }
@@ -81,6 +127,128 @@ ssize_t net::async::event::socket::sendmsg(const struct msghdr* msg)
   return ret;
 }
 
+bool net::async::event::socket::flush()
+{
+  size_t len = _M_wend - _M_wbegin;
+
+  // If there is pending data...
+  if (len > 0) {
+    ssize_t ret;
+    if ((ret = _M_socket.send(_M_wbuf + _M_wbegin, len)) ==
+        static_cast<ssize_t>(len)) {
+      _M_wbegin = 0;
+      _M_wend = 0;
+
+      _M_timestamp = _M_dispatcher->time();
+      _M_write_stalled = false;
+    } else if (ret >= 0) {
+      _M_wbegin += ret;
+
+      _M_writable = false;
+      _M_timestamp = _M_dispatcher->time();
+      _M_write_timestamp = _M_timestamp;
+      _M_write_stalled = true;
+    } else if (errno == EAGAIN) {
+      _M_writable = false;
+
+      if (!_M_write_stalled) {
+        _M_write_timestamp = _M_dispatcher->time();
+        _M_write_stalled = true;
+      }
+    } else {
+      _M_error = true;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+ssize_t net::async::event::socket::send_coalesced(const void* buf, size_t len)
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+  size_t pending = _M_wend - _M_wbegin;
+
+  // If the data doesn't fit in the write buffer...
+  if (pending + len > _M_wbufsize) {
+    // Send the pending data and the new data with a single system call.
+    struct iovec iov[2];
+    iov[0].iov_base = _M_wbuf + _M_wbegin;
+    iov[0].iov_len = pending;
+    iov[1].iov_base = const_cast<uint8_t*>(b);
+    iov[1].iov_len = len;
+
+    ssize_t ret;
+    if ((ret = _M_socket.writev(iov, 2)) >= 0) {
+      _M_timestamp = _M_dispatcher->time();
+      _M_write_timestamp = _M_timestamp;
+
+      if (static_cast<size_t>(ret) < pending) {
+        _M_wbegin += ret;
+        _M_writable = false;
+      } else {
+        ret -= pending;
+
+        _M_wbegin = 0;
+        _M_wend = 0;
+
+        // If all the data has been sent...
+        if (static_cast<size_t>(ret) == len) {
+          _M_write_stalled = false;
+          return ret;
+        }
+
+        _M_writable = false;
+
+        b += ret;
+        len -= ret;
+      }
+    } else if (errno == EAGAIN) {
+      _M_writable = false;
+
+      if (!_M_write_stalled) {
+        _M_write_timestamp = _M_dispatcher->time();
+      }
+    } else {
+      _M_error = true;
+      return -1;
+    }
+
+    // The data which couldn't be sent is buffered or rejected.
+    _M_write_stalled = true;
+  }
+
+  // If the data doesn't fit at the end of the write buffer, move the pending
+  // data to the beginning.
+  if ((_M_wbegin > 0) && (_M_wend + len > _M_wbufsize)) {
+    memmove(_M_wbuf, _M_wbuf + _M_wbegin, _M_wend - _M_wbegin);
+
+    _M_wend -= _M_wbegin;
+    _M_wbegin = 0;
+  }
+
+  // Copy as much data as possible to the write buffer.
+  size_t count = _M_wbufsize - _M_wend;
+  if (len < count) {
+    count = len;
+  }
+
+  memcpy(_M_wbuf + _M_wend, b, count);
+  _M_wend += count;
+
+  if (_M_wend > _M_wbegin) {
+    _M_dispatcher->defer_flush(this);
+  }
+
+  size_t consumed = (b + count) - static_cast<const uint8_t*>(buf);
+  if (consumed > 0) {
+    return consumed;
+  }
+
+  errno = EAGAIN;
+  return -1;
+}
+
 #if !defined(USE_SOCKET_TEMPLATE)
   #undef T
 #endif
@@ -1,9 +1,12 @@
 #ifndef NET_ASYNC_EVENT_SOCKET_H
 #define NET_ASYNC_EVENT_SOCKET_H
 
+#include <stdint.h>
+#include <stdlib.h>
 #include <errno.h>
 #include "net/async/socket.h"
 #include "net/async/event/dispatcher.h"
+#include "util/iovec_cursor.h"
 
 #if !defined(USE_SOCKET_TEMPLATE)
   #define T socket
@@ -12,18 +15,45 @@
 namespace net {
   namespace async {
     namespace event {
+      class coroutine_socket;
+
+#if defined(USE_SOCKET_TEMPLATE)
+      template<typename... Types>
+      class socket_types;
+#endif
+
+      // Deadline of a socket (see socket::expired()).
+      enum class deadline : uint8_t {
+        none,
+        idle,     // No data transferred (set_timeout()).
+        read,     // No data received (set_read_timeout()).
+        write,    // Data pending to be sent is stalled (set_write_timeout()).
+        connect,  // Connection not established (set_connect_timeout()).
+        lifetime  // Lifetime of the socket (set_lifetime()).
+      };
+
       class socket : private util::node {
         friend class dispatcher;
+        friend class coroutine_socket;
+
+#if defined(USE_SOCKET_TEMPLATE)
+        template<typename... Types>
+        friend class socket_types;
+#endif
 
         public:
+          static const size_t default_write_buffer_size = 16 * 1024;
+
           // Constructor.
           socket(dispatcher* dispatcher);
           socket();
 
-#if !defined(USE_SOCKET_TEMPLATE)
           // Destructor.
-          virtual ~socket() = default;
-#endif // !defined(USE_SOCKET_TEMPLATE)
+#if !defined(USE_SOCKET_TEMPLATE)
+          virtual ~socket();
+#else
+          ~socket();
+#endif
 
           // Connect.
           bool connect(const net::socket::address& addr);
@@ -40,6 +70,37 @@ namespace net {
           bool connect(const net::socket::address::local& addr,
                        unsigned timeout);
 
+          // Connect sending 'buf' with TCP Fast Open: the data is sent in the
+          // SYN if there is a cookie for the server. Return the number of
+          // bytes sent (the rest has to be sent once the socket is writable)
+          // or -1 on error.
+          ssize_t connect(const net::socket::address& addr,
+                          const void* buf,
+                          size_t len);
+
+          ssize_t connect(const net::socket::address::ipv4& addr,
+                          const void* buf,
+                          size_t len);
+
+          ssize_t connect(const net::socket::address::ipv6& addr,
+                          const void* buf,
+                          size_t len);
+
+          ssize_t connect(const net::socket::address& addr,
+                          const void* buf,
+                          size_t len,
+                          unsigned timeout);
+
+          ssize_t connect(const net::socket::address::ipv4& addr,
+                          const void* buf,
+                          size_t len,
+                          unsigned timeout);
+
+          ssize_t connect(const net::socket::address::ipv6& addr,
+                          const void* buf,
+                          size_t len,
+                          unsigned timeout);
+
           // Bind.
           bool bind(const net::socket::address& addr);
           bool bind(const net::socket::address::ipv4& addr);
@@ -61,12 +122,20 @@ namespace net {
           bool listen(const net::socket::address::local& addr,
                       unsigned timeout);
 
+          // Attach an open socket (e.g. a socket inherited from the previous
+          // process, see handoff). Listening sockets are watched for
+          // reading and the others for reading and writing. On success, the
+          // socket owns 'handle'.
+          bool attach(net::socket::handle_t handle);
+          bool attach(net::socket::handle_t handle, unsigned timeout);
+
 #if defined(USE_SOCKET_TEMPLATE)
           // Clear.
           void clear();
 
           // Timeout.
-          // Return false if the socket should be closed; true otherwise.
+          // Return false if the socket should be closed; true otherwise
+          // (the timeout is rearmed, if the socket still has one).
           bool timeout();
 
           // Run.
@@ -76,7 +145,8 @@ namespace net {
           virtual void clear();
 
           // Timeout.
-          // Return false if the socket should be closed; true otherwise.
+          // Return false if the socket should be closed; true otherwise
+          // (the timeout is rearmed, if the socket still has one).
           virtual bool timeout();
 
           // Run.
@@ -86,12 +156,93 @@ namespace net {
           // Get handle.
           net::socket::handle_t handle() const;
 
+          // Get number of connections in the accept queue of the listening
+          // socket and the backlog (Linux and FreeBSD).
+          bool get_accept_queue(size_t& length, size_t& backlog);
+
+          // Accept TCP Fast Open connections on the listening socket, with up
+          // to 'queue' connections pending to complete the handshake.
+          bool set_fast_open(unsigned queue);
+
+          // Only report the connections of the listening socket once they
+          // have received data (or after 'seconds'), so that the acceptor is
+          // not woken up for connections which have nothing to read yet.
+          bool set_defer_accept(unsigned seconds);
+
+          // Enable write coalescing.
+          // The data passed to send() is copied to a write buffer of 'size'
+          // bytes and all the writes made during the current loop iteration
+          // are sent with a single system call by the dispatcher at the end
+          // of the iteration.
+          // If the socket has already been created, TCP_NODELAY is set, as
+          // the coalescing is already done in user space.
+          // writev(), sendmsg(), sendto() and sendmmsg() don't use the write
+          // buffer: they send the pending data first and fail with EAGAIN
+          // if it can't be sent completely, so that the data is never
+          // reordered.
+          bool enable_write_coalescing(size_t size = default_write_buffer_size);
+
+          // Disable write coalescing.
+          // Returns false if there is pending data in the write buffer.
+          bool disable_write_coalescing();
+
+          // Get number of bytes in the write buffer pending to be sent.
+          size_t pending() const;
+
+          // Enable / disable write events.
+          // A socket which has nothing to send can disable write events, so
+          // that it is not woken up each time its send buffer drains
+          // (writability is still watched while there is coalesced data
+          // pending to be sent). The change takes effect when the current
+          // callback returns, and the selector is only modified if the
+          // events watched change. Enabled by default.
+          void enable_write_events();
+          void disable_write_events();
+
+          // Set timeout (milliseconds, -1: none) and restart it.
+          // Has to be called from the dispatcher's thread once the socket
+          // has been registered (shared sockets don't have timeout).
+          void set_timeout(int timeout);
+
+          // The following deadlines are independent of the idle timeout.
+          // They can be set before the socket is registered (e.g. before
+          // connect() or before passing the socket to accept()) or, from the
+          // dispatcher's thread, once it has been registered.
+
+          // Set read timeout (milliseconds, -1: none) and restart it: the
+          // socket times out if it doesn't receive data for 'timeout'
+          // milliseconds, even if it sends data.
+          void set_read_timeout(int timeout);
+
+          // Set write timeout (milliseconds, -1: none) and restart it: the
+          // socket times out if it has data which couldn't be sent and no
+          // data can be sent for 'timeout' milliseconds.
+          void set_write_timeout(int timeout);
+
+          // Set connect timeout (milliseconds, -1: none): the socket times
+          // out if the connection started by connect() is not established
+          // within 'timeout' milliseconds.
+          void set_connect_timeout(int timeout);
+
+          // Set lifetime (milliseconds, -1: none): the socket times out
+          // 'lifetime' milliseconds after it has been registered (or after
+          // calling set_lifetime()), whatever its activity.
+          void set_lifetime(int lifetime);
+
+          // Get the deadline which has expired (to be called from timeout()).
+          // If timeout() returns true, the idle, read and write deadlines are
+          // restarted and the connect and lifetime deadlines are disarmed.
+          deadline expired() const;
+
         protected:
           int _M_timeout; // Milliseconds.
 
           // Get socket error.
           bool get_socket_error(int& error);
 
+          // Get the CPU which processed the last packet received (Linux).
+          bool get_incoming_cpu(int& cpu);
+
           // Accept.
 #if defined(USE_SOCKET_TEMPLATE)
           template<typename T>
@@ -113,6 +264,34 @@ namespace net {
 #endif
           bool accept(T& sock, unsigned timeout);
 
+          // Accept up to 'n' connections (batched accept).
+          // The accept queue is drained into the sockets 'socks' (e.g. taken
+          // from a pool of free sockets) and then the connections are
+          // registered in a single pass. Returns the number of connections
+          // accepted: socks[0..ret - 1] have been registered and the others
+          // are left unused (in a different order).
+          // If 'n' connections have been accepted, the queue might not be
+          // empty: readable() returns false and the socket is run again in
+          // the next loop iteration, like when the read budget is exhausted
+          // (see dispatcher::set_read_budget()).
+          template<typename S>
+          size_t accept(S** socks, size_t n);
+
+          template<typename S>
+          size_t accept(S** socks, size_t n, unsigned timeout);
+
+          // Share socket.
+          // The socket 'sock' (e.g. a socket which has just been accepted)
+          // is moved to the selector shared by the dispatchers (see
+          // dispatcher::share()): its events are processed by any of them,
+          // one at a time, and it has no idle timeout. 'sock' can't be the
+          // socket being run. If it fails, 'sock' might be no longer
+          // registered and has to be closed.
+#if defined(USE_SOCKET_TEMPLATE)
+          template<typename T>
+#endif
+          bool share(T& sock);
+
           // Receive.
           ssize_t recv(void* buf, size_t len);
 
@@ -125,6 +304,10 @@ namespace net {
           // Write from multiple buffers.
           ssize_t writev(const struct iovec* iov, unsigned iovcnt);
 
+          // Write from the buffers left in 'cursor' and advance it (the
+          // socket can be run again until the cursor is done).
+          ssize_t writev(util::iovec_cursor& cursor);
+
           // Receive from.
           ssize_t recvfrom(void* buf, size_t len, net::socket::address& addr);
           ssize_t recvfrom(void* buf, size_t len);
@@ -171,23 +354,169 @@ namespace net {
           // Error?
           bool error() const;
 
+          // Flush write buffer.
+          // Returns false if the socket failed.
+          bool flush();
+
+          // Shut down the socket (e.g. the write side, once all the data has
+          // been sent, to close the connection gracefully). The data left in
+          // the write buffer is not sent.
+          bool shutdown(net::socket::shutdown_how how);
+
+          // Run the socket in the current loop iteration of its dispatcher
+          // (even if it has no events). Has to be called from the
+          // dispatcher's thread.
+          void schedule_run();
+
+          // Fail the socket: it is closed and cleared by the dispatcher in
+          // the current or the next loop iteration. Has to be called from
+          // the dispatcher's thread; if it is called from the socket's own
+          // run() or timeout(), the socket is handled as if the callback
+          // had returned false.
+          void fail();
+
+#if defined(USE_SOCKET_TEMPLATE)
+          // Set type tag (see socket_types): index of the socket's type in
+          // the list of socket types of the dispatcher. The tag is kept
+          // when the socket is cleared, so it is usually set once in the
+          // constructor (default: 0).
+          void set_tag(uint8_t tag);
+#endif
+
         private:
+          // The fields are laid out by how often they are used: the first
+          // 64 bytes (with the vtable pointer, the links of the list of
+          // timeouts and _M_timeout) hold what is used for every event, the
+          // next 64 bytes the deadlines and the write buffer, and the rest
+          // the links of the dispatcher's lists (the dispatcher prefetches
+          // the first 128 bytes of the next socket with events).
           async::socket _M_socket;
 
-          bool _M_readable;
-          bool _M_writable;
-          bool _M_error;
-
           net::event::watch _M_event;
 
-          uint64_t _M_timestamp;
+          // Events currently watched (level-triggered and one-shot sockets
+          // are not watched for writability while they can write).
+          net::event::watch _M_armed;
+
+          bool _M_readable:1;
+          bool _M_writable:1;
+          bool _M_error:1;
+
+          // Is the socket in the selector shared by the dispatchers?
+          bool _M_shared:1;
+
+          // Is it a listening socket (it is closed when the dispatcher
+          // starts draining)?
+          bool _M_listening:1;
+
+          // Watch for writability (see enable_write_events())?
+          bool _M_write_events:1;
+
+          // Is the data pending to be sent stalled (since
+          // _M_write_timestamp)?
+          bool _M_write_stalled:1;
+
+          // Is the connection being established (connect deadline armed)?
+          bool _M_connecting:1;
+
+          // Is the lifetime deadline armed?
+          bool _M_alive:1;
+
+          bool _M_flush_scheduled:1;
+          bool _M_ready_scheduled:1;
+
+          // Deadline which has expired (see expired()).
+          deadline _M_expired;
+
+#if defined(USE_SOCKET_TEMPLATE)
+          // Type tag.
+          uint8_t _M_tag;
+#endif
+
+          // Times are in milliseconds since the dispatcher was started,
+          // truncated to 32 bits (see since()).
+          uint32_t _M_timestamp;
+
           uint64_t _M_expire;
 
           dispatcher* _M_dispatcher;
 
+          // Time of the last data received.
+          uint32_t _M_read_timestamp;
+
+          // Time since the data pending to be sent is stalled (if
+          // _M_write_stalled is set).
+          uint32_t _M_write_timestamp;
+
+          // Time when the connect and lifetime deadlines were armed.
+          uint32_t _M_connect_timestamp;
+          uint32_t _M_lifetime_timestamp;
+
+          // Read, write, connect and lifetime deadlines (milliseconds, -1:
+          // none).
+          int _M_read_timeout;
+          int _M_write_timeout;
+          int _M_connect_timeout;
+          int _M_lifetime;
+
+          // Write buffer (write coalescing).
+          size_t _M_wbegin;
+          size_t _M_wend;
+          uint8_t* _M_wbuf;
+          size_t _M_wbufsize;
+
+          // Next socket to be flushed.
+          socket* _M_next_flush;
+
+          // Previous and next sockets in the list of sockets registered in
+          // the dispatcher.
+          socket* _M_prev_socket;
+          socket* _M_next_socket;
+
+          // Next socket to be run again (read budget exhausted).
+          socket* _M_next_ready;
+
           // Initialize.
           void init();
 
+          // Start the read, write, connect and lifetime deadlines (the socket
+          // is being registered).
+          void start_deadlines(uint64_t now);
+
+          // Get the time of the dispatcher 'timestamp' stands for (the
+          // deadlines are less than 2^31 milliseconds, so a timestamp which
+          // is in use is never more than 2^31 milliseconds older than
+          // 'now').
+          static uint64_t since(uint32_t timestamp, uint64_t now);
+
+          // Get the earliest deadline and its expiration time (UINT64_MAX if
+          // the socket has no deadlines), 'now' being the dispatcher's time.
+          deadline next_deadline(uint64_t now, uint64_t& expire) const;
+
+          // Restart (or disarm) the deadline which has expired.
+          void restart_deadline(uint64_t now);
+
+          // Rearm the timeout of the socket.
+          void rearm();
+
+          // Send using the write buffer.
+          ssize_t send_coalesced(const void* buf, size_t len);
+
+          // Send the data pending in the write buffer before writing
+          // directly, so that it is not sent after the new data. Returns
+          // false if the socket failed or not all the data could be sent
+          // (errno is EAGAIN).
+          bool flush_pending();
+
+#if defined(HAVE_RECVMMSG)
+          // Get number of bytes received in 'n' messages.
+          static size_t length(const struct mmsghdr* msgvec, int n);
+#endif
+
+          // If the dispatcher is pinned to a single CPU and wants it, set
+          // SO_INCOMING_CPU to that CPU (best effort).
+          void align_incoming_cpu();
+
           // Connect.
           template<typename Address>
           bool connect_(const Address& addr);
@@ -195,6 +524,15 @@ namespace net {
           template<typename Address>
           bool connect_(const Address& addr, unsigned timeout);
 
+          template<typename Address>
+          ssize_t connect_(const Address& addr, const void* buf, size_t len);
+
+          template<typename Address>
+          ssize_t connect_(const Address& addr,
+                           const void* buf,
+                           size_t len,
+                           unsigned timeout);
+
           // Bind.
           template<typename Address>
           bool bind_(const Address& addr);
@@ -209,22 +547,58 @@ namespace net {
           template<typename Address>
           bool listen_(const Address& addr, unsigned timeout);
 
+          // Take ownership of 'handle' for attach().
+          bool adopt(net::socket::handle_t handle);
+
+          // Batched accept ('timeout' < 0: no timeout).
+          template<typename S>
+          size_t accept_(S** socks, size_t n, int timeout);
+
           // Send to.
           template<typename Address>
           ssize_t sendto_(const void* buf, size_t len, const Address& addr);
       };
 
       inline socket::socket(dispatcher* dispatcher)
-        : _M_dispatcher(dispatcher)
+        : _M_flush_scheduled(false),
+          _M_ready_scheduled(false),
+          _M_dispatcher(dispatcher),
+          _M_wbuf(nullptr),
+          _M_wbufsize(0),
+          _M_next_flush(nullptr),
+          _M_prev_socket(nullptr),
+          _M_next_socket(nullptr),
+          _M_next_ready(nullptr)
       {
+#if defined(USE_SOCKET_TEMPLATE)
+        _M_tag = 0;
+#endif
+
         init();
       }
 
       inline socket::socket()
+        : _M_flush_scheduled(false),
+          _M_ready_scheduled(false),
+          _M_wbuf(nullptr),
+          _M_wbufsize(0),
+          _M_next_flush(nullptr),
+          _M_prev_socket(nullptr),
+          _M_next_socket(nullptr),
+          _M_next_ready(nullptr)
       {
+#if defined(USE_SOCKET_TEMPLATE)
+        _M_tag = 0;
+#endif
+
         init();
       }
 
+      inline socket::~socket()
+      {
+        free(_M_wbuf);
+      }
+
       inline bool socket::connect(const net::socket::address& addr)
       {
         return connect_(addr);
@@ -269,6 +643,51 @@ namespace net {
         return connect_(addr, timeout);
       }
 
+      inline ssize_t socket::connect(const net::socket::address& addr,
+                                     const void* buf,
+                                     size_t len)
+      {
+        return connect_(addr, buf, len);
+      }
+
+      inline ssize_t socket::connect(const net::socket::address::ipv4& addr,
+                                     const void* buf,
+                                     size_t len)
+      {
+        return connect_(addr, buf, len);
+      }
+
+      inline ssize_t socket::connect(const net::socket::address::ipv6& addr,
+                                     const void* buf,
+                                     size_t len)
+      {
+        return connect_(addr, buf, len);
+      }
+
+      inline ssize_t socket::connect(const net::socket::address& addr,
+                                     const void* buf,
+                                     size_t len,
+                                     unsigned timeout)
+      {
+        return connect_(addr, buf, len, timeout);
+      }
+
+      inline ssize_t socket::connect(const net::socket::address::ipv4& addr,
+                                     const void* buf,
+                                     size_t len,
+                                     unsigned timeout)
+      {
+        return connect_(addr, buf, len, timeout);
+      }
+
+      inline ssize_t socket::connect(const net::socket::address::ipv6& addr,
+                                     const void* buf,
+                                     size_t len,
+                                     unsigned timeout)
+      {
+        return connect_(addr, buf, len, timeout);
+      }
+
       inline bool socket::bind(const net::socket::address& addr)
       {
         return bind_(addr);
@@ -357,6 +776,38 @@ namespace net {
         return listen_(addr, timeout);
       }
 
+      inline bool socket::attach(net::socket::handle_t handle)
+      {
+        if (adopt(handle)) {
+          // Save current time.
+          _M_timestamp = _M_dispatcher->time();
+
+          // Register socket.
+          if (_M_dispatcher->register_socket(this, _M_event)) {
+            return true;
+          }
+
+          _M_socket.handle(net::socket::invalid_handle);
+        }
+
+        return false;
+      }
+
+      inline bool socket::attach(net::socket::handle_t handle,
+                                 unsigned timeout)
+      {
+        if (adopt(handle)) {
+          // Register socket.
+          if (_M_dispatcher->register_socket(this, _M_event, timeout)) {
+            return true;
+          }
+
+          _M_socket.handle(net::socket::invalid_handle);
+        }
+
+        return false;
+      }
+
       inline void socket::clear()
       {
       }
@@ -379,11 +830,157 @@ namespace net {
         return _M_socket.handle();
       }
 
+      inline bool socket::enable_write_coalescing(size_t size)
+      {
+        // If the write buffer has to be (re)allocated...
+        if (size != _M_wbufsize) {
+          // If there is pending data...
+          if ((size == 0) || (_M_wend > _M_wbegin)) {
+            return false;
+          }
+
+          void* buf;
+          if ((buf = realloc(_M_wbuf, size)) == nullptr) {
+            return false;
+          }
+
+          _M_wbuf = static_cast<uint8_t*>(buf);
+          _M_wbufsize = size;
+        }
+
+        if (_M_socket.handle() != net::socket::invalid_handle) {
+          _M_socket.set_tcp_no_delay(true);
+        }
+
+        return true;
+      }
+
+      inline bool socket::disable_write_coalescing()
+      {
+        // If there is pending data...
+        if (_M_wend > _M_wbegin) {
+          return false;
+        }
+
+        free(_M_wbuf);
+
+        _M_wbuf = nullptr;
+        _M_wbufsize = 0;
+
+        return true;
+      }
+
+      inline size_t socket::pending() const
+      {
+        return _M_wend - _M_wbegin;
+      }
+
+      inline bool socket::flush_pending()
+      {
+        if (_M_wend > _M_wbegin) {
+          if (!flush()) {
+            return false;
+          }
+
+          if (_M_wend > _M_wbegin) {
+            errno = EAGAIN;
+            return false;
+          }
+        }
+
+        return true;
+      }
+
+      inline void socket::enable_write_events()
+      {
+        _M_write_events = true;
+      }
+
+      inline void socket::disable_write_events()
+      {
+        _M_write_events = false;
+      }
+
+      inline void socket::set_timeout(int timeout)
+      {
+        _M_timeout = timeout;
+        _M_timestamp = _M_dispatcher->time();
+
+        rearm();
+      }
+
+      inline void socket::set_read_timeout(int timeout)
+      {
+        _M_read_timeout = timeout;
+
+        // If the socket has been registered...
+        if (_M_socket.handle() != net::socket::invalid_handle) {
+          _M_read_timestamp = _M_dispatcher->time();
+
+          rearm();
+        }
+      }
+
+      inline void socket::set_write_timeout(int timeout)
+      {
+        _M_write_timeout = timeout;
+
+        // If the socket has been registered...
+        if (_M_socket.handle() != net::socket::invalid_handle) {
+          _M_write_timestamp = _M_dispatcher->time();
+
+          rearm();
+        }
+      }
+
+      inline void socket::set_connect_timeout(int timeout)
+      {
+        _M_connect_timeout = timeout;
+
+        // If the socket has been registered...
+        if (_M_socket.handle() != net::socket::invalid_handle) {
+          _M_connect_timestamp = _M_dispatcher->time();
+
+          rearm();
+        }
+      }
+
+      inline void socket::set_lifetime(int lifetime)
+      {
+        _M_lifetime = lifetime;
+
+        // If the socket has been registered...
+        if (_M_socket.handle() != net::socket::invalid_handle) {
+          _M_lifetime_timestamp = _M_dispatcher->time();
+          _M_alive = true;
+
+          rearm();
+        }
+      }
+
+      inline deadline socket::expired() const
+      {
+        return _M_expired;
+      }
+
+      inline void socket::align_incoming_cpu()
+      {
+        int cpu;
+        if ((cpu = _M_dispatcher->incoming_cpu()) >= 0) {
+          _M_socket.set_incoming_cpu(cpu);
+        }
+      }
+
       inline bool socket::get_socket_error(int& error)
       {
         return _M_socket.get_socket_error(error);
       }
 
+      inline bool socket::get_incoming_cpu(int& cpu)
+      {
+        return _M_socket.get_incoming_cpu(cpu);
+      }
+
 #if defined(USE_SOCKET_TEMPLATE)
       template<typename T>
 #endif
@@ -393,10 +990,13 @@ namespace net {
           if (_M_dispatcher->register_socket(&sock,
                                              net::event::watch::read_write)) {
             _M_timestamp = _M_dispatcher->time();
+            _M_read_timestamp = _M_timestamp;
 
             sock._M_timestamp = _M_timestamp;
             sock._M_dispatcher = _M_dispatcher;
 
+            counters::add(_M_dispatcher->_M_counters.accepted);
+
             return true;
           } else {
             sock._M_socket.close();
@@ -419,10 +1019,13 @@ namespace net {
           if (_M_dispatcher->register_socket(&sock,
                                              net::event::watch::read_write)) {
             _M_timestamp = _M_dispatcher->time();
+            _M_read_timestamp = _M_timestamp;
 
             sock._M_timestamp = _M_timestamp;
             sock._M_dispatcher = _M_dispatcher;
 
+            counters::add(_M_dispatcher->_M_counters.accepted);
+
             return true;
           } else {
             sock._M_socket.close();
@@ -448,8 +1051,11 @@ namespace net {
                                              net::event::watch::read_write,
                                              timeout)) {
             _M_timestamp = _M_dispatcher->time();
+            _M_read_timestamp = _M_timestamp;
             sock._M_dispatcher = _M_dispatcher;
 
+            counters::add(_M_dispatcher->_M_counters.accepted);
+
             return true;
           } else {
             sock._M_socket.close();
@@ -473,8 +1079,11 @@ namespace net {
                                              net::event::watch::read_write,
                                              timeout)) {
             _M_timestamp = _M_dispatcher->time();
+            _M_read_timestamp = _M_timestamp;
             sock._M_dispatcher = _M_dispatcher;
 
+            counters::add(_M_dispatcher->_M_counters.accepted);
+
             return true;
           } else {
             sock._M_socket.close();
@@ -488,14 +1097,38 @@ namespace net {
         return false;
       }
 
+      template<typename S>
+      inline size_t socket::accept(S** socks, size_t n)
+      {
+        return accept_(socks, n, -1);
+      }
+
+      template<typename S>
+      inline size_t socket::accept(S** socks, size_t n, unsigned timeout)
+      {
+        return accept_(socks, n, static_cast<int>(timeout));
+      }
+
+#if defined(USE_SOCKET_TEMPLATE)
+      template<typename T>
+#endif
+      inline bool socket::share(T& sock)
+      {
+        return _M_dispatcher->share_socket(&sock);
+      }
+
       inline ssize_t socket::recv(void* buf, size_t len)
       {
         ssize_t ret;
         if ((ret = _M_socket.recv(buf, len)) == static_cast<ssize_t>(len)) {
           _M_timestamp = _M_dispatcher->time();
+          _M_read_timestamp = _M_timestamp;
+          _M_dispatcher->consume_budget(ret);
         } else if (ret >= 0) {
           _M_readable = false;
           _M_timestamp = _M_dispatcher->time();
+          _M_read_timestamp = _M_timestamp;
+          _M_dispatcher->consume_budget(ret);
         } else if (errno == EAGAIN) {
           _M_readable = false;
         } else {
@@ -507,14 +1140,27 @@ namespace net {
 
       inline ssize_t socket::send(const void* buf, size_t len)
       {
+        // If write coalescing is enabled...
+        if (_M_wbuf) {
+          return send_coalesced(buf, len);
+        }
+
         ssize_t ret;
         if ((ret = _M_socket.send(buf, len)) == static_cast<ssize_t>(len)) {
           _M_timestamp = _M_dispatcher->time();
+          _M_write_stalled = false;
         } else if (ret >= 0) {
           _M_writable = false;
           _M_timestamp = _M_dispatcher->time();
+          _M_write_timestamp = _M_timestamp;
+          _M_write_stalled = true;
         } else if (errno == EAGAIN) {
           _M_writable = false;
+
+          if (!_M_write_stalled) {
+            _M_write_timestamp = _M_dispatcher->time();
+            _M_write_stalled = true;
+          }
         } else {
           _M_error = true;
         }
@@ -529,6 +1175,8 @@ namespace net {
         ssize_t ret;
         if ((ret = _M_socket.recvfrom(buf, len, addr)) != -1) {
           _M_timestamp = _M_dispatcher->time();
+          _M_read_timestamp = _M_timestamp;
+          _M_dispatcher->consume_budget(ret);
         } else if (errno == EAGAIN) {
           _M_readable = false;
         } else {
@@ -543,6 +1191,8 @@ namespace net {
         ssize_t ret;
         if ((ret = _M_socket.recvfrom(buf, len)) != -1) {
           _M_timestamp = _M_dispatcher->time();
+          _M_read_timestamp = _M_timestamp;
+          _M_dispatcher->consume_budget(ret);
         } else if (errno == EAGAIN) {
           _M_readable = false;
         } else {
@@ -585,6 +1235,8 @@ namespace net {
         ssize_t ret;
         if ((ret = _M_socket.recvmsg(msg)) != -1) {
           _M_timestamp = _M_dispatcher->time();
+          _M_read_timestamp = _M_timestamp;
+          _M_dispatcher->consume_budget(ret);
         } else if (errno == EAGAIN) {
           _M_readable = false;
         } else {
@@ -601,9 +1253,13 @@ namespace net {
         if ((ret = _M_socket.recvmmsg(msgvec, vlen)) ==
             static_cast<int>(vlen)) {
           _M_timestamp = _M_dispatcher->time();
+          _M_read_timestamp = _M_timestamp;
+          _M_dispatcher->consume_budget(length(msgvec, ret));
         } else if (ret >= 0) {
           _M_readable = false;
           _M_timestamp = _M_dispatcher->time();
+          _M_read_timestamp = _M_timestamp;
+          _M_dispatcher->consume_budget(length(msgvec, ret));
         } else if (errno == EAGAIN) {
           _M_readable = false;
         } else {
@@ -614,18 +1270,42 @@ namespace net {
       }
 #endif // defined(HAVE_RECVMMSG)
 
+#if defined(HAVE_RECVMMSG)
+      inline size_t socket::length(const struct mmsghdr* msgvec, int n)
+      {
+        size_t len = 0;
+        for (int i = 0; i < n; i++) {
+          len += msgvec[i].msg_len;
+        }
+
+        return len;
+      }
+#endif // defined(HAVE_RECVMMSG)
+
 #if defined(HAVE_SENDMMSG)
       inline int socket::sendmmsg(struct mmsghdr* msgvec, unsigned vlen)
       {
+        if (!flush_pending()) {
+          return -1;
+        }
+
         int ret;
         if ((ret = _M_socket.sendmmsg(msgvec, vlen)) ==
             static_cast<int>(vlen)) {
           _M_timestamp = _M_dispatcher->time();
+          _M_write_stalled = false;
         } else if (ret >= 0) {
           _M_writable = false;
           _M_timestamp = _M_dispatcher->time();
+          _M_write_timestamp = _M_timestamp;
+          _M_write_stalled = true;
         } else if (errno == EAGAIN) {
           _M_writable = false;
+
+          if (!_M_write_stalled) {
+            _M_write_timestamp = _M_dispatcher->time();
+            _M_write_stalled = true;
+          }
         } else {
           _M_error = true;
         }
@@ -636,7 +1316,7 @@ namespace net {
 
       inline bool socket::readable() const
       {
-        return _M_readable;
+        return ((_M_readable) && (_M_dispatcher->_M_budget > 0));
       }
 
       inline bool socket::writable() const
@@ -649,13 +1329,194 @@ namespace net {
         return _M_error;
       }
 
+      inline bool socket::get_accept_queue(size_t& length, size_t& backlog)
+      {
+        return _M_socket.get_accept_queue(length, backlog);
+      }
+
+      inline bool socket::set_fast_open(unsigned queue)
+      {
+        return _M_socket.set_fast_open(static_cast<int>(queue));
+      }
+
+      inline bool socket::set_defer_accept(unsigned seconds)
+      {
+        return _M_socket.set_defer_accept(static_cast<int>(seconds));
+      }
+
+      inline bool socket::shutdown(net::socket::shutdown_how how)
+      {
+        return _M_socket.shutdown(how);
+      }
+
+      inline void socket::schedule_run()
+      {
+        _M_dispatcher->defer_run(this);
+      }
+
+      inline void socket::fail()
+      {
+        if (!_M_error) {
+          _M_dispatcher->fail_socket(this);
+        }
+      }
+
+#if defined(USE_SOCKET_TEMPLATE)
+      inline void socket::set_tag(uint8_t tag)
+      {
+        _M_tag = tag;
+      }
+#endif // defined(USE_SOCKET_TEMPLATE)
+
       inline void socket::init()
       {
         _M_timeout = -1;
         _M_readable = false;
         _M_writable = false;
         _M_error = false;
+        _M_shared = false;
+        _M_listening = false;
+        _M_write_events = true;
         _M_timestamp = 0;
+        _M_read_timeout = -1;
+        _M_write_timeout = -1;
+        _M_connect_timeout = -1;
+        _M_lifetime = -1;
+        _M_read_timestamp = 0;
+        _M_write_timestamp = 0;
+        _M_connect_timestamp = 0;
+        _M_lifetime_timestamp = 0;
+        _M_write_stalled = false;
+        _M_connecting = false;
+        _M_alive = false;
+        _M_expired = deadline::none;
+        _M_wbegin = 0;
+        _M_wend = 0;
+      }
+
+      inline void socket::start_deadlines(uint64_t now)
+      {
+        _M_read_timestamp = now;
+        _M_write_timestamp = now;
+        _M_write_stalled = false;
+
+        // The connect deadline is armed by connect().
+        _M_connect_timestamp = now;
+
+        _M_lifetime_timestamp = now;
+        _M_alive = true;
+      }
+
+      inline uint64_t socket::since(uint32_t timestamp, uint64_t now)
+      {
+        uint32_t age = static_cast<uint32_t>(now) - timestamp;
+
+        // A timestamp ahead of 'now' (the clock has gone backwards) is
+        // taken as 'now'.
+        return (age <= INT32_MAX) ? now - age : now;
+      }
+
+      inline deadline socket::next_deadline(uint64_t now,
+                                            uint64_t& expire) const
+      {
+        deadline d = deadline::none;
+        expire = UINT64_MAX;
+
+        if (_M_timeout >= 0) {
+          expire = since(_M_timestamp, now) + _M_timeout;
+          d = deadline::idle;
+        }
+
+        if (_M_read_timeout >= 0) {
+          uint64_t t = since(_M_read_timestamp, now) + _M_read_timeout;
+          if (t < expire) {
+            expire = t;
+            d = deadline::read;
+          }
+        }
+
+        if ((_M_write_stalled) && (_M_write_timeout >= 0)) {
+          uint64_t t = since(_M_write_timestamp, now) + _M_write_timeout;
+          if (t < expire) {
+            expire = t;
+            d = deadline::write;
+          }
+        }
+
+        if ((_M_connecting) && (_M_connect_timeout >= 0)) {
+          uint64_t t = since(_M_connect_timestamp, now) + _M_connect_timeout;
+          if (t < expire) {
+            expire = t;
+            d = deadline::connect;
+          }
+        }
+
+        if ((_M_alive) && (_M_lifetime >= 0)) {
+          uint64_t t = since(_M_lifetime_timestamp, now) + _M_lifetime;
+          if (t < expire) {
+            expire = t;
+            d = deadline::lifetime;
+          }
+        }
+
+        return d;
+      }
+
+      inline void socket::restart_deadline(uint64_t now)
+      {
+        switch (_M_expired) {
+          case deadline::idle:
+            _M_timestamp = now;
+            break;
+          case deadline::read:
+            _M_read_timestamp = now;
+            break;
+          case deadline::write:
+            _M_write_timestamp = now;
+            break;
+          case deadline::connect:
+            _M_connecting = false;
+            break;
+          case deadline::lifetime:
+            _M_alive = false;
+            break;
+          default:
+            break;
+        }
+      }
+
+      inline void socket::rearm()
+      {
+        // Failed sockets are in the list of failed sockets and shared
+        // sockets don't have timeout.
+        if ((!_M_shared) && (!_M_error)) {
+          _M_dispatcher->update_node(this);
+        }
+      }
+
+      inline bool socket::adopt(net::socket::handle_t handle)
+      {
+        _M_socket.handle(handle);
+
+        bool listening;
+        if ((_M_socket.get_listening(listening)) &&
+            (net::internal::socket::set_non_blocking(handle))) {
+          if (listening) {
+            align_incoming_cpu();
+
+            _M_listening = true;
+
+            _M_event = net::event::watch::read;
+          } else {
+            _M_event = net::event::watch::read_write;
+          }
+
+          return true;
+        }
+
+        _M_socket.handle(net::socket::invalid_handle);
+
+        return false;
       }
 
       template<typename Address>
@@ -666,6 +1527,8 @@ namespace net {
                              net::socket::type::stream)) {
           // Connect.
           if (_M_socket.connect(addr)) {
+            _M_connecting = true;
+
             // Save current time.
             _M_timestamp = _M_dispatcher->time();
 
@@ -690,23 +1553,77 @@ namespace net {
                              net::socket::type::stream)) {
           // Connect.
           if (_M_socket.connect(addr)) {
-            _M_event = net::event::watch::read_write;
+            _M_connecting = true;
+
+            // Register socket.
+            if (_M_dispatcher->register_socket(this,
+                                               net::event::watch::read_write,
+                                               timeout)) {
+              return true;
+            }
+          }
+
+          _M_socket.close();
+        }
+
+        return false;
+      }
+
+      template<typename Address>
+      ssize_t socket::connect_(const Address& addr,
+                               const void* buf,
+                               size_t len)
+      {
+        // Create socket.
+        if (_M_socket.create(static_cast<net::socket::domain>(addr.family()),
+                             net::socket::type::stream)) {
+          // Connect.
+          ssize_t ret;
+          if ((ret = _M_socket.connect(addr, buf, len)) >= 0) {
+            _M_connecting = true;
 
             // Save current time.
             _M_timestamp = _M_dispatcher->time();
 
-            _M_timeout = timeout;
+            // Register socket.
+            if (_M_dispatcher->register_socket(this,
+                                               net::event::watch::read_write)) {
+              return ret;
+            }
+          }
+
+          _M_socket.close();
+        }
+
+        return -1;
+      }
+
+      template<typename Address>
+      ssize_t socket::connect_(const Address& addr,
+                               const void* buf,
+                               size_t len,
+                               unsigned timeout)
+      {
+        // Create socket.
+        if (_M_socket.create(static_cast<net::socket::domain>(addr.family()),
+                             net::socket::type::stream)) {
+          // Connect.
+          ssize_t ret;
+          if ((ret = _M_socket.connect(addr, buf, len)) >= 0) {
+            _M_connecting = true;
 
             // Register socket.
-            if (_M_dispatcher->register_socket(this)) {
-              return true;
+            if (_M_dispatcher->register_socket(this,
+                                               net::event::watch::read_write,
+                                               timeout)) {
+              return ret;
             }
           }
 
           _M_socket.close();
         }
 
-        return false;
+        return -1;
       }
 
       template<typename Address>
@@ -717,6 +1634,8 @@ namespace net {
                              net::socket::type::datagram)) {
           // Bind.
           if (_M_socket.bind(addr)) {
+            align_incoming_cpu();
+
             // Save current time.
             _M_timestamp = _M_dispatcher->time();
 
@@ -741,15 +1660,12 @@ namespace net {
                              net::socket::type::datagram)) {
           // Bind.
           if (_M_socket.bind(addr)) {
-            _M_event = net::event::watch::read_write;
-
-            // Save current time.
-            _M_timestamp = _M_dispatcher->time();
-
-            _M_timeout = timeout;
+            align_incoming_cpu();
 
             // Register socket.
-            if (_M_dispatcher->register_socket(this)) {
+            if (_M_dispatcher->register_socket(this,
+                                               net::event::watch::read_write,
+                                               timeout)) {
               return true;
             }
           }
@@ -768,6 +1684,10 @@ namespace net {
                              net::socket::type::stream)) {
           // Bind and listen.
           if ((_M_socket.bind(addr)) && (_M_socket.listen())) {
+            align_incoming_cpu();
+
+            _M_listening = true;
+
             // Save current time.
             _M_timestamp = _M_dispatcher->time();
 
@@ -791,15 +1711,14 @@ namespace net {
                              net::socket::type::stream)) {
           // Bind and listen.
           if ((_M_socket.bind(addr)) && (_M_socket.listen())) {
-            _M_event = net::event::watch::read;
-
-            // Save current time.
-            _M_timestamp = _M_dispatcher->time();
+            align_incoming_cpu();
 
-            _M_timeout = timeout;
+            _M_listening = true;
 
             // Register socket.
-            if (_M_dispatcher->register_socket(this)) {
+            if (_M_dispatcher->register_socket(this,
+                                               net::event::watch::read,
+                                               timeout)) {
               return true;
             }
           }
@@ -810,26 +1729,179 @@ namespace net {
         return false;
       }
 
+      template<typename S>
+      size_t socket::accept_(S** socks, size_t n, int timeout)
+      {
+        // Drain the accept queue.
+        size_t naccepted = 0;
+        while (naccepted < n) {
+          if (!_M_socket.accept(socks[naccepted]->_M_socket)) {
+            if (errno == EAGAIN) {
+              _M_readable = false;
+            } else {
+              _M_error = true;
+            }
+
+            break;
+          }
+
+          naccepted++;
+        }
+
+        if (naccepted == 0) {
+          return 0;
+        }
+
+        // If the batch is full, run the socket again in the next loop
+        // iteration.
+        if (naccepted == n) {
+          _M_dispatcher->consume_budget(SIZE_MAX);
+        }
+
+        _M_timestamp = _M_dispatcher->time();
+        _M_read_timestamp = _M_timestamp;
+
+        // Register the connections (the ones registered are kept at the
+        // beginning of the array).
+        size_t nregistered = 0;
+        for (size_t i = 0; i < naccepted; i++) {
+          S* sock = socks[i];
+
+          sock->_M_dispatcher = _M_dispatcher;
+
+          if ((timeout < 0) ?
+              _M_dispatcher->register_socket(sock,
+                                             net::event::watch::read_write) :
+              _M_dispatcher->register_socket(sock,
+                                             net::event::watch::read_write,
+                                             static_cast<unsigned>(timeout))) {
+            sock->_M_timestamp = _M_timestamp;
+
+            socks[i] = socks[nregistered];
+            socks[nregistered++] = sock;
+          } else {
+            sock->_M_socket.close();
+          }
+        }
+
+        counters::add(_M_dispatcher->_M_counters.accepted, nregistered);
+
+        return nregistered;
+      }
+
       template<typename Address>
       inline ssize_t socket::sendto_(const void* buf,
                                      size_t len,
                                      const Address& addr)
       {
+        if (!flush_pending()) {
+          return -1;
+        }
+
         ssize_t ret;
         if ((ret = _M_socket.sendto(buf, len, addr)) ==
             static_cast<ssize_t>(len)) {
           _M_timestamp = _M_dispatcher->time();
+          _M_write_stalled = false;
         } else if (ret >= 0) {
           _M_writable = false;
           _M_timestamp = _M_dispatcher->time();
+          _M_write_timestamp = _M_timestamp;
+          _M_write_stalled = true;
         } else if (errno == EAGAIN) {
           _M_writable = false;
+
+          if (!_M_write_stalled) {
+            _M_write_timestamp = _M_dispatcher->time();
+            _M_write_stalled = true;
+          }
         } else {
           _M_error = true;
         }
 
         return ret;
       }
+      inline void dispatcher::defer_flush(socket* sock)
+      {
+        if (!sock->_M_flush_scheduled) {
+          sock->_M_next_flush = _M_flush;
+          sock->_M_flush_scheduled = true;
+
+          _M_flush = sock;
+        }
+      }
+
+      inline void dispatcher::cancel_flush(socket* sock)
+      {
+        socket** s = &_M_flush;
+
+        while (*s != sock) {
+          s = &(*s)->_M_next_flush;
+        }
+
+        *s = sock->_M_next_flush;
+
+        sock->_M_next_flush = nullptr;
+        sock->_M_flush_scheduled = false;
+      }
+
+      inline void dispatcher::defer_run(socket* sock)
+      {
+        if (!sock->_M_ready_scheduled) {
+          sock->_M_next_ready = nullptr;
+          sock->_M_ready_scheduled = true;
+
+          *_M_ready_tail = sock;
+          _M_ready_tail = &sock->_M_next_ready;
+        }
+      }
+
+      inline void dispatcher::cancel_run(socket* sock)
+      {
+        socket** s = &_M_ready;
+
+        while (*s != sock) {
+          s = &(*s)->_M_next_ready;
+        }
+
+        if ((*s = sock->_M_next_ready) == nullptr) {
+          _M_ready_tail = s;
+        }
+
+        sock->_M_next_ready = nullptr;
+        sock->_M_ready_scheduled = false;
+      }
+
+      inline void dispatcher::link_socket(socket* sock)
+      {
+        sock->_M_prev_socket = nullptr;
+        sock->_M_next_socket = _M_sockets;
+
+        if (_M_sockets) {
+          _M_sockets->_M_prev_socket = sock;
+        }
+
+        _M_sockets = sock;
+      }
+
+      inline void dispatcher::unlink_socket(socket* sock)
+      {
+        if (sock->_M_prev_socket) {
+          sock->_M_prev_socket->_M_next_socket = sock->_M_next_socket;
+        } else if (_M_sockets == sock) {
+          _M_sockets = sock->_M_next_socket;
+        } else {
+          // Not registered.
+          return;
+        }
+
+        if (sock->_M_next_socket) {
+          sock->_M_next_socket->_M_prev_socket = sock->_M_prev_socket;
+        }
+
+        sock->_M_prev_socket = nullptr;
+        sock->_M_next_socket = nullptr;
+      }
     }
   }
 }
@@ -838,4 +1910,7 @@ namespace net {
   #undef T
 #endif
 
-#endif // NET_ASYNC_EVENT_SOCKET_H
+// Inline methods of the dispatcher called from the socket's inline methods.
+#include "net/async/event/dispatcher.inl"
+
+#endif // NET_ASYNC_EVENT_SOCKET_H
\ No newline at end of file
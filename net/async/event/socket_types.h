@@ -0,0 +1,177 @@
+#ifndef NET_ASYNC_EVENT_SOCKET_TYPES_H
+#define NET_ASYNC_EVENT_SOCKET_TYPES_H
+
+#if !defined(USE_SOCKET_TEMPLATE)
+  #error "net/async/event/socket_types.h requires USE_SOCKET_TEMPLATE."
+#endif
+
+#include <stdint.h>
+#include <type_traits>
+#include "net/async/event/socket.h"
+
+namespace net {
+  namespace async {
+    namespace event {
+      // Index of the type 'U' in the list 'Types' (helper of socket_types).
+      template<typename U, typename... Types>
+      struct socket_type_index;
+
+      template<typename U, typename... Rest>
+      struct socket_type_index<U, U, Rest...>
+        : std::integral_constant<unsigned, 0> {
+      };
+
+      template<typename U, typename First, typename... Rest>
+      struct socket_type_index<U, First, Rest...>
+        : std::integral_constant<unsigned,
+                                 1 + socket_type_index<U, Rest...>::value> {
+      };
+
+      template<typename U>
+      struct socket_type_index<U> {
+        static_assert(sizeof(U*) == 0, "Socket type not in the list.");
+      };
+
+      // Call the handlers of the socket's type (helper of socket_types).
+      template<typename First, typename... Rest>
+      struct socket_type_switch {
+        static void clear(socket* sock, unsigned tag);
+        static bool timeout(socket* sock, unsigned tag);
+        static bool run(socket* sock, unsigned tag);
+      };
+
+      template<typename Last>
+      struct socket_type_switch<Last> {
+        static void clear(socket* sock, unsigned tag);
+        static bool timeout(socket* sock, unsigned tag);
+        static bool run(socket* sock, unsigned tag);
+      };
+
+      // Closed set of socket types handled by a dispatcher (template
+      // build).
+      // The template build calls the handlers of the sockets without
+      // virtual methods, but a dispatcher started with a single socket type
+      // T (dispatcher::run<T>()) handles all its sockets as T. A dispatcher
+      // started with socket_types<A, B, ...> as T handles sockets of any of
+      // those types: each socket sets its tag (its index in the list) with
+      // socket::set_tag() and clear(), timeout() and run() are called on
+      // the socket's own type after comparing the tag (no virtual methods
+      // nor function pointers):
+      //
+      //   class acceptor;
+      //   class connection;
+      //
+      //   typedef net::async::event::socket_types<acceptor, connection>
+      //           types;
+      //
+      //   class connection : public net::async::event::socket {
+      //     public:
+      //       connection()
+      //       {
+      //         set_tag(types::tag<connection>());
+      //       }
+      //       ...
+      //   };
+      //
+      //   dispatchers.start<types>(ndispatchers, config);
+      //
+      // Objects of this class are never created.
+      template<typename... Types>
+      class socket_types : public socket {
+        public:
+          static_assert((sizeof...(Types) > 0) && (sizeof...(Types) <= 256),
+                        "Invalid number of socket types.");
+
+          // Get tag of the socket type 'U'.
+          template<typename U>
+          static constexpr uint8_t tag();
+
+          // Clear.
+          void clear();
+
+          // Timeout.
+          bool timeout();
+
+          // Run.
+          bool run();
+
+        private:
+          // Constructor.
+          socket_types() = delete;
+      };
+
+      template<typename First, typename... Rest>
+      inline void socket_type_switch<First, Rest...>::clear(socket* sock,
+                                                            unsigned tag)
+      {
+        if (tag == 0) {
+          static_cast<First*>(sock)->clear();
+        } else {
+          socket_type_switch<Rest...>::clear(sock, tag - 1);
+        }
+      }
+
+      template<typename First, typename... Rest>
+      inline bool socket_type_switch<First, Rest...>::timeout(socket* sock,
+                                                              unsigned tag)
+      {
+        return (tag == 0) ? static_cast<First*>(sock)->timeout() :
+                            socket_type_switch<Rest...>::timeout(sock,
+                                                                 tag - 1);
+      }
+
+      template<typename First, typename... Rest>
+      inline bool socket_type_switch<First, Rest...>::run(socket* sock,
+                                                          unsigned tag)
+      {
+        return (tag == 0) ? static_cast<First*>(sock)->run() :
+                            socket_type_switch<Rest...>::run(sock, tag - 1);
+      }
+
+      template<typename Last>
+      inline void socket_type_switch<Last>::clear(socket* sock, unsigned tag)
+      {
+        static_cast<Last*>(sock)->clear();
+      }
+
+      template<typename Last>
+      inline bool socket_type_switch<Last>::timeout(socket* sock, unsigned tag)
+      {
+        return static_cast<Last*>(sock)->timeout();
+      }
+
+      template<typename Last>
+      inline bool socket_type_switch<Last>::run(socket* sock, unsigned tag)
+      {
+        return static_cast<Last*>(sock)->run();
+      }
+
+      template<typename... Types>
+      template<typename U>
+      inline constexpr uint8_t socket_types<Types...>::tag()
+      {
+        return socket_type_index<U, Types...>::value;
+      }
+
+      template<typename... Types>
+      inline void socket_types<Types...>::clear()
+      {
+        socket_type_switch<Types...>::clear(this, _M_tag);
+      }
+
+      template<typename... Types>
+      inline bool socket_types<Types...>::timeout()
+      {
+        return socket_type_switch<Types...>::timeout(this, _M_tag);
+      }
+
+      template<typename... Types>
+      inline bool socket_types<Types...>::run()
+      {
+        return socket_type_switch<Types...>::run(this, _M_tag);
+      }
+    }
+  }
+}
+
+#endif // NET_ASYNC_EVENT_SOCKET_TYPES_H
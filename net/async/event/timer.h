@@ -0,0 +1,459 @@
+#ifndef NET_ASYNC_EVENT_TIMER_H
+#define NET_ASYNC_EVENT_TIMER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "util/node.h"
+
+namespace net {
+  namespace async {
+    namespace event {
+      class dispatcher;
+      class timer_wheel;
+
+      // Timer of a dispatcher (see dispatcher::schedule()).
+      // The timer is owned by the caller and is linked in the dispatcher's
+      // timer wheel while it is pending, so that scheduling a timer doesn't
+      // allocate memory.
+      class timer : private util::node {
+        friend class dispatcher;
+        friend class timer_wheel;
+
+        public:
+          // Callback (called from the dispatcher's thread).
+          typedef void (*callback)(timer& t, void* arg);
+
+          // Constructor.
+          timer();
+          timer(callback cb, void* arg);
+
+          // Destructor.
+          // A pending timer is cancelled (it has to be destroyed from the
+          // dispatcher's thread).
+          ~timer();
+
+          // Set callback.
+          void set_callback(callback cb, void* arg);
+
+          // Is the timer pending?
+          bool pending() const;
+
+          // Get expiration time (monotonic time, nanoseconds).
+          uint64_t expiration() const;
+
+          // Get period (nanoseconds, 0: one-shot).
+          uint64_t period() const;
+
+        private:
+          // Slot of the expired timers.
+          static const unsigned expired_slot = ~0u;
+
+          // Wheel the timer is linked in (nullptr if it is not pending).
+          timer_wheel* _M_wheel;
+
+          uint64_t _M_expire;
+          uint64_t _M_period;
+
+          callback _M_callback;
+          void* _M_arg;
+
+          unsigned _M_slot;
+      };
+
+      // Hierarchical timing wheel.
+      // Level 0 has a slot per tick (2^tick_shift nanoseconds) and each slot
+      // of level l spans 64^l ticks. A timer is linked in the level which
+      // covers its distance to the current tick and is moved down (cascaded)
+      // when the wheel reaches its slot, so adding and removing a timer take
+      // constant time. A bitmap per level keeps track of the slots in use,
+      // so that the empty slots are skipped and the next expiration is
+      // found without walking the lists.
+      class timer_wheel {
+        public:
+          // Tick (16.384 microseconds).
+          static const unsigned tick_shift = 14;
+
+          // Slots per level.
+          static const unsigned slot_bits = 6;
+          static const unsigned nslots = 1u << slot_bits;
+
+          // Levels (the last level spans 2^56 nanoseconds, ~2.3 years;
+          // timers further away are cascaded within the last level until
+          // they get closer).
+          static const unsigned nlevels = 7;
+
+          // Constructor.
+          timer_wheel(uint64_t now);
+
+          // Destructor.
+          ~timer_wheel();
+
+          // Empty?
+          bool empty() const;
+
+          // Get number of pending timers.
+          size_t size() const;
+
+          // Add timer (its expiration time has been set).
+          void add(timer* t);
+
+          // Remove timer.
+          void remove(timer* t);
+
+          // Get the time of the next tick which has to be processed, either
+          // because timers expire or have to be cascaded (UINT64_MAX if
+          // there are no timers).
+          uint64_t next_expiration() const;
+
+          // Move the timers which have expired at 'now' to the end of the
+          // list 'expired' (they are still pending until they are removed).
+          void expire(uint64_t now, util::node& expired);
+
+        private:
+          static const uint64_t slot_mask = nslots - 1;
+
+          util::node _M_slots[nlevels * nslots];
+
+          // Slots in use of each level.
+          uint64_t _M_bitmap[nlevels];
+
+          // Next tick to be processed.
+          uint64_t _M_tick;
+
+          // Timers in the slots.
+          size_t _M_linked;
+
+          // Pending timers (in the slots or expired).
+          size_t _M_size;
+
+          // Link timer in its slot.
+          void link(timer* t);
+
+          // Get next tick to be processed.
+          uint64_t next_tick() const;
+
+          // Move the timers of a slot to the lower levels.
+          void cascade(unsigned level, unsigned slot);
+
+          // Get index of the lowest bit set at position 'from' or above
+          // (-1 if none).
+          static int lowest_bit(uint64_t bitmap, unsigned from);
+      };
+
+      inline timer::timer()
+        : _M_wheel(nullptr),
+          _M_expire(0),
+          _M_period(0),
+          _M_callback(nullptr),
+          _M_arg(nullptr),
+          _M_slot(expired_slot)
+      {
+      }
+
+      inline timer::timer(callback cb, void* arg)
+        : _M_wheel(nullptr),
+          _M_expire(0),
+          _M_period(0),
+          _M_callback(cb),
+          _M_arg(arg),
+          _M_slot(expired_slot)
+      {
+      }
+
+      inline timer::~timer()
+      {
+        if (_M_wheel) {
+          _M_wheel->remove(this);
+        }
+      }
+
+      inline void timer::set_callback(callback cb, void* arg)
+      {
+        _M_callback = cb;
+        _M_arg = arg;
+      }
+
+      inline bool timer::pending() const
+      {
+        return (_M_wheel != nullptr);
+      }
+
+      inline uint64_t timer::expiration() const
+      {
+        return _M_expire;
+      }
+
+      inline uint64_t timer::period() const
+      {
+        return _M_period;
+      }
+
+      inline timer_wheel::timer_wheel(uint64_t now)
+        : _M_tick(now >> tick_shift),
+          _M_linked(0),
+          _M_size(0)
+      {
+        for (size_t i = 0; i < nlevels * nslots; i++) {
+          _M_slots[i].prev = &_M_slots[i];
+          _M_slots[i].next = &_M_slots[i];
+        }
+
+        for (size_t i = 0; i < nlevels; i++) {
+          _M_bitmap[i] = 0;
+        }
+      }
+
+      inline timer_wheel::~timer_wheel()
+      {
+        // Detach the timers still in the slots (expired timers are in the
+        // list of the caller).
+        for (size_t i = 0; i < nlevels * nslots; i++) {
+          util::node* n = _M_slots[i].next;
+
+          while (n != &_M_slots[i]) {
+            timer* t = static_cast<timer*>(n);
+            n = n->next;
+
+            t->_M_wheel = nullptr;
+            t->clear();
+          }
+        }
+      }
+
+      inline bool timer_wheel::empty() const
+      {
+        return (_M_size == 0);
+      }
+
+      inline size_t timer_wheel::size() const
+      {
+        return _M_size;
+      }
+
+      inline void timer_wheel::add(timer* t)
+      {
+        t->_M_wheel = this;
+
+        link(t);
+
+        _M_size++;
+      }
+
+      inline void timer_wheel::remove(timer* t)
+      {
+        t->prev->next = t->next;
+        t->next->prev = t->prev;
+
+        if (t->_M_slot != timer::expired_slot) {
+          // If the slot is now empty, clear its bit.
+          if (_M_slots[t->_M_slot].next == &_M_slots[t->_M_slot]) {
+            _M_bitmap[t->_M_slot / nslots] &=
+              ~(1ull << (t->_M_slot % nslots));
+          }
+
+          _M_linked--;
+        }
+
+        t->clear();
+        t->_M_wheel = nullptr;
+        t->_M_slot = timer::expired_slot;
+
+        _M_size--;
+      }
+
+      inline uint64_t timer_wheel::next_expiration() const
+      {
+        uint64_t tick = next_tick();
+        return (tick != UINT64_MAX) ? tick << tick_shift : UINT64_MAX;
+      }
+
+      inline void timer_wheel::expire(uint64_t now, util::node& expired)
+      {
+        uint64_t target = now >> tick_shift;
+
+        do {
+          uint64_t tick = next_tick();
+          if ((tick == UINT64_MAX) || (tick > target)) {
+            break;
+          }
+
+          _M_tick = tick;
+
+          // Cascade the slots which start at this tick (a slot of level
+          // l + 1 can only start where a slot of level l does).
+          for (unsigned level = 1;
+               (level < nlevels) &&
+               ((tick & ((1ull << (slot_bits * level)) - 1)) == 0);
+               level++) {
+            cascade(level, (tick >> (slot_bits * level)) & slot_mask);
+          }
+
+          // Move the timers of the slot of level 0 to the list of expired
+          // timers.
+          unsigned slot = tick & slot_mask;
+          util::node* head = &_M_slots[slot];
+
+          if (head->next != head) {
+            for (util::node* n = head->next; n != head; n = n->next) {
+              static_cast<timer*>(n)->_M_slot = timer::expired_slot;
+              _M_linked--;
+            }
+
+            head->next->prev = expired.prev;
+            head->prev->next = &expired;
+
+            expired.prev->next = head->next;
+            expired.prev = head->prev;
+
+            head->prev = head;
+            head->next = head;
+
+            _M_bitmap[0] &= ~(1ull << slot);
+          }
+
+          _M_tick = tick + 1;
+        } while (true);
+
+        // Nothing happens until the next tick to be processed.
+        if (_M_tick <= target) {
+          _M_tick = target + 1;
+        }
+      }
+
+      inline void timer_wheel::link(timer* t)
+      {
+        // Round up, so that the timer never expires early.
+        uint64_t tick = (t->_M_expire >> tick_shift) +
+                        ((t->_M_expire & ((1ull << tick_shift) - 1)) != 0);
+
+        if (tick < _M_tick) {
+          tick = _M_tick;
+        }
+
+        uint64_t delta = tick - _M_tick;
+
+        // Find the level which covers the distance to the current tick
+        // (timers further away go to the last level and are cascaded to
+        // the same level until they are close enough).
+        unsigned level = 0;
+        while ((level < nlevels - 1) &&
+               (delta >= (1ull << (slot_bits * (level + 1))))) {
+          level++;
+        }
+
+        if (delta >= (1ull << (slot_bits * nlevels))) {
+          tick = _M_tick + (1ull << (slot_bits * nlevels)) - 1;
+        }
+
+        unsigned slot = (tick >> (slot_bits * level)) & slot_mask;
+
+        t->_M_slot = (level * nslots) + slot;
+
+        util::node* head = &_M_slots[t->_M_slot];
+
+        t->prev = head->prev;
+        t->next = head;
+
+        head->prev->next = t;
+        head->prev = t;
+
+        _M_bitmap[level] |= (1ull << slot);
+
+        _M_linked++;
+      }
+
+      inline uint64_t timer_wheel::next_tick() const
+      {
+        if (_M_linked == 0) {
+          return UINT64_MAX;
+        }
+
+        uint64_t next = UINT64_MAX;
+
+        for (unsigned level = 0; level < nlevels; level++) {
+          uint64_t bitmap = _M_bitmap[level];
+          if (bitmap == 0) {
+            continue;
+          }
+
+          unsigned shift = slot_bits * level;
+
+          // Current slot of the level: it hasn't been processed yet if the
+          // next tick to be processed is where the slot starts.
+          unsigned current = (_M_tick >> shift) & slot_mask;
+          bool started = ((_M_tick & ((1ull << shift) - 1)) != 0);
+
+          // Start of the current round of the level.
+          uint64_t round = (_M_tick >> (shift + slot_bits)) <<
+                           (shift + slot_bits);
+
+          uint64_t tick;
+          int slot;
+          if ((slot = lowest_bit(bitmap, current + started)) != -1) {
+            tick = round + (static_cast<uint64_t>(slot) << shift);
+          } else {
+            // Next round.
+            tick = round +
+                   (1ull << (shift + slot_bits)) +
+                   (static_cast<uint64_t>(lowest_bit(bitmap, 0)) << shift);
+          }
+
+          if (tick < next) {
+            next = tick;
+          }
+        }
+
+        return next;
+      }
+
+      inline void timer_wheel::cascade(unsigned level, unsigned slot)
+      {
+        util::node* head = &_M_slots[(level * nslots) + slot];
+
+        if (head->next == head) {
+          return;
+        }
+
+        // Detach the list, so that the timers which go back to the same
+        // slot are not cascaded again.
+        util::node list;
+        list.next = head->next;
+        list.prev = head->prev;
+
+        list.next->prev = &list;
+        list.prev->next = &list;
+
+        head->prev = head;
+        head->next = head;
+
+        _M_bitmap[level] &= ~(1ull << slot);
+
+        while (list.next != &list) {
+          timer* t = static_cast<timer*>(list.next);
+
+          list.next = t->next;
+          t->next->prev = &list;
+
+          _M_linked--;
+
+          link(t);
+        }
+      }
+
+      inline int timer_wheel::lowest_bit(uint64_t bitmap, unsigned from)
+      {
+        if (from < 64) {
+          bitmap &= (~0ull << from);
+
+          if (bitmap != 0) {
+            return __builtin_ctzll(bitmap);
+          }
+        }
+
+        return -1;
+      }
+    }
+  }
+}
+
+#endif // NET_ASYNC_EVENT_TIMER_H
@@ -0,0 +1,236 @@
+#ifndef NET_ASYNC_EVENT_WATCHDOG_H
+#define NET_ASYNC_EVENT_WATCHDOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace net {
+  namespace async {
+    namespace event {
+      // Callback which took longer than the watchdog's threshold.
+      struct slow_callback {
+        // Event mask.
+        static const uint32_t readable = 1u << 0;
+        static const uint32_t writable = 1u << 1;
+        static const uint32_t timeout = 1u << 2;
+        static const uint32_t timer = 1u << 3;
+
+        // Socket descriptor (-1 for timer callbacks).
+        int fd;
+
+        // Events which triggered the callback.
+        uint32_t events;
+
+        // Start of the callback (monotonic time, nanoseconds).
+        uint64_t start;
+
+        // Duration (nanoseconds).
+        uint64_t duration;
+      };
+
+      // Slow-callback detector.
+      // The dispatcher's thread records the callbacks which exceed the
+      // threshold in a ring buffer, overwriting the oldest entries when it
+      // is full. Other threads can read the ring and check whether the
+      // dispatcher is stuck in a callback without taking any lock.
+      class watchdog {
+        public:
+          // Number of entries of the ring buffer (power of two).
+          static const size_t ring_size = 256;
+
+          // Constructor.
+          watchdog();
+
+          // Get threshold (nanoseconds, 0: disabled).
+          uint64_t threshold() const;
+
+          // Set threshold (nanoseconds, 0: disabled).
+          void threshold(uint64_t ns);
+
+          // Enter callback (called by the dispatcher's thread).
+          void enter(int fd, uint64_t start);
+
+          // Exit callback (called by the dispatcher's thread).
+          // The callback is recorded if it took 'threshold' nanoseconds or
+          // more.
+          void exit(int fd, uint32_t events, uint64_t start, uint64_t end);
+
+          // Read slow callbacks.
+          // 'cursor' is the position of the next entry to be read (0 the
+          // first time) and is updated. Entries which have been overwritten
+          // before they could be read are skipped and added to 'lost'.
+          // Returns the number of entries copied to 'entries'.
+          size_t read(uint64_t& cursor,
+                      slow_callback* entries,
+                      size_t n,
+                      uint64_t& lost) const;
+
+          // Is the dispatcher running a callback for longer than 'ns'
+          // nanoseconds?
+          // 'fd' is the descriptor of the socket of the current callback (it
+          // might belong to a newer callback, if the dispatcher has moved on
+          // meanwhile).
+          bool stalled(uint64_t now,
+                       uint64_t ns,
+                       int& fd,
+                       uint64_t& duration) const;
+
+        private:
+          static const size_t cache_line_size = 64;
+
+          // Slot of the ring buffer (seqlock: 'seq' is odd while the slot
+          // is being written).
+          struct slot {
+            std::atomic<uint64_t> seq;
+            std::atomic<uint64_t> start;
+            std::atomic<uint64_t> duration;
+            std::atomic<uint64_t> fd_events;
+          };
+
+          uint8_t _M_pad0[cache_line_size];
+
+          std::atomic<uint64_t> _M_threshold;
+
+          // Number of entries written.
+          std::atomic<uint64_t> _M_head;
+
+          // Start of the callback being run (0: none).
+          std::atomic<uint64_t> _M_busy_since;
+          std::atomic<int> _M_fd;
+
+          uint8_t _M_pad1[cache_line_size];
+
+          slot _M_ring[ring_size];
+      };
+
+      inline watchdog::watchdog()
+        : _M_threshold(0),
+          _M_head(0),
+          _M_busy_since(0),
+          _M_fd(-1)
+      {
+        for (size_t i = 0; i < ring_size; i++) {
+          _M_ring[i].seq.store(0, std::memory_order_relaxed);
+          _M_ring[i].start.store(0, std::memory_order_relaxed);
+          _M_ring[i].duration.store(0, std::memory_order_relaxed);
+          _M_ring[i].fd_events.store(0, std::memory_order_relaxed);
+        }
+      }
+
+      inline uint64_t watchdog::threshold() const
+      {
+        return _M_threshold.load(std::memory_order_relaxed);
+      }
+
+      inline void watchdog::threshold(uint64_t ns)
+      {
+        _M_threshold.store(ns, std::memory_order_relaxed);
+      }
+
+      inline void watchdog::enter(int fd, uint64_t start)
+      {
+        _M_fd.store(fd, std::memory_order_relaxed);
+        _M_busy_since.store(start, std::memory_order_release);
+      }
+
+      inline void watchdog::exit(int fd,
+                                 uint32_t events,
+                                 uint64_t start,
+                                 uint64_t end)
+      {
+        _M_busy_since.store(0, std::memory_order_relaxed);
+
+        // If the watchdog is disabled or the callback was fast enough...
+        uint64_t threshold = _M_threshold.load(std::memory_order_relaxed);
+        uint64_t duration = end - start;
+        if ((threshold == 0) || (duration < threshold)) {
+          return;
+        }
+
+        uint64_t pos = _M_head.load(std::memory_order_relaxed);
+        slot* s = &_M_ring[pos & (ring_size - 1)];
+
+        // Mark the slot as being written.
+        s->seq.store((pos << 1) | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        s->start.store(start, std::memory_order_relaxed);
+        s->duration.store(duration, std::memory_order_relaxed);
+
+        uint64_t fd_events = static_cast<uint32_t>(fd);
+        fd_events = (fd_events << 32) | events;
+
+        s->fd_events.store(fd_events, std::memory_order_relaxed);
+
+        // Publish the slot.
+        s->seq.store((pos + 1) << 1, std::memory_order_release);
+        _M_head.store(pos + 1, std::memory_order_release);
+      }
+
+      inline size_t watchdog::read(uint64_t& cursor,
+                                   slow_callback* entries,
+                                   size_t n,
+                                   uint64_t& lost) const
+      {
+        uint64_t head = _M_head.load(std::memory_order_acquire);
+
+        // Skip the entries which have already been overwritten.
+        if (head - cursor > ring_size) {
+          lost += (head - ring_size - cursor);
+          cursor = head - ring_size;
+        }
+
+        size_t count = 0;
+
+        while ((cursor < head) && (count < n)) {
+          const slot* s = &_M_ring[cursor & (ring_size - 1)];
+
+          uint64_t seq = s->seq.load(std::memory_order_acquire);
+
+          uint64_t start = s->start.load(std::memory_order_relaxed);
+          uint64_t duration = s->duration.load(std::memory_order_relaxed);
+          uint64_t fd_events = s->fd_events.load(std::memory_order_relaxed);
+
+          std::atomic_thread_fence(std::memory_order_acquire);
+
+          // If the slot hasn't been overwritten while reading it...
+          if ((seq == ((cursor + 1) << 1)) &&
+              (s->seq.load(std::memory_order_relaxed) == seq)) {
+            slow_callback* e = &entries[count++];
+
+            e->fd = static_cast<int>(fd_events >> 32);
+            e->events = static_cast<uint32_t>(fd_events);
+            e->start = start;
+            e->duration = duration;
+          } else {
+            lost++;
+          }
+
+          cursor++;
+        }
+
+        return count;
+      }
+
+      inline bool watchdog::stalled(uint64_t now,
+                                    uint64_t ns,
+                                    int& fd,
+                                    uint64_t& duration) const
+      {
+        uint64_t since = _M_busy_since.load(std::memory_order_acquire);
+
+        if ((since != 0) && (now > since) && (now - since >= ns)) {
+          fd = _M_fd.load(std::memory_order_relaxed);
+          duration = now - since;
+
+          return true;
+        }
+
+        return false;
+      }
+    }
+  }
+}
+
+#endif // NET_ASYNC_EVENT_WATCHDOG_H
@@ -13,6 +13,20 @@ namespace net {
         bool connect(const address::ipv4& addr, int timeout) = delete;
         bool connect(const address::ipv6& addr, int timeout) = delete;
         bool connect(const address::local& addr, int timeout) = delete;
+        bool connect(const address& addr,
+                     const void* buf,
+                     size_t len,
+                     int timeout) = delete;
+
+        bool connect(const address::ipv4& addr,
+                     const void* buf,
+                     size_t len,
+                     int timeout) = delete;
+
+        bool connect(const address::ipv6& addr,
+                     const void* buf,
+                     size_t len,
+                     int timeout) = delete;
 
         // Accept.
         using net::socket::accept;
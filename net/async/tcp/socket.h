@@ -18,6 +18,17 @@ namespace net {
           bool connect(const address::ipv6& addr);
           bool connect(const address::local& addr);
 
+          // Connect sending 'buf' with TCP Fast Open.
+          // Return the number of bytes sent (possibly 0) or -1 on error.
+          ssize_t connect(const address& addr, const void* buf, size_t len);
+          ssize_t connect(const address::ipv4& addr,
+                          const void* buf,
+                          size_t len);
+
+          ssize_t connect(const address::ipv6& addr,
+                          const void* buf,
+                          size_t len);
+
           // Bind.
           using net::async::socket::bind;
           bool bind(const address& addr) = delete;
@@ -87,6 +98,36 @@ namespace net {
                 (async::socket::connect(addr)));
       }
 
+      inline ssize_t socket::connect(const address& addr,
+                                     const void* buf,
+                                     size_t len)
+      {
+        return net::socket::create(static_cast<socket::domain>(addr.family()),
+                                   socket::type::stream) ?
+                 async::socket::connect(addr, buf, len) :
+                 -1;
+      }
+
+      inline ssize_t socket::connect(const address::ipv4& addr,
+                                     const void* buf,
+                                     size_t len)
+      {
+        return net::socket::create(static_cast<socket::domain>(addr.family()),
+                                   socket::type::stream) ?
+                 async::socket::connect(addr, buf, len) :
+                 -1;
+      }
+
+      inline ssize_t socket::connect(const address::ipv6& addr,
+                                     const void* buf,
+                                     size_t len)
+      {
+        return net::socket::create(static_cast<socket::domain>(addr.family()),
+                                   socket::type::stream) ?
+                 async::socket::connect(addr, buf, len) :
+                 -1;
+      }
+
       inline bool socket::listen(const address& addr)
       {
         return ((net::socket::create(static_cast<socket::domain>(addr.family()),
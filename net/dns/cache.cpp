@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <new>
+#include "net/dns/cache.h"
+
+net::dns::cache::~cache()
+{
+  if (_M_shards) {
+    for (size_t i = 0; i < _M_nshards; i++) {
+      shard& s = _M_shards[i];
+
+      entry* e = s.lru_head;
+      while (e) {
+        entry* next = e->next_lru;
+
+        delete e;
+        e = next;
+      }
+
+      free(s.buckets);
+
+      pthread_mutex_destroy(&s.mutex);
+    }
+
+    delete [] _M_shards;
+  }
+}
+
+bool net::dns::cache::create(const config& config)
+{
+  // If the number of shards is not a power of two...
+  if ((config.shards == 0) ||
+      ((config.shards & (config.shards - 1)) != 0) ||
+      (config.max_entries == 0) ||
+      (config.min_ttl > config.max_ttl) ||
+      (_M_shards)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  if ((_M_shards = new (std::nothrow) shard[config.shards]) == nullptr) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  // One bucket per entry (power of two).
+  size_t nbuckets = 1;
+  while (nbuckets < config.max_entries) {
+    nbuckets <<= 1;
+  }
+
+  for (size_t i = 0; i < config.shards; i++) {
+    shard& s = _M_shards[i];
+
+    if ((s.buckets = static_cast<entry**>(
+                       calloc(nbuckets, sizeof(entry*))
+                     )) == nullptr) {
+      for (size_t j = 0; j < i; j++) {
+        free(_M_shards[j].buckets);
+        pthread_mutex_destroy(&_M_shards[j].mutex);
+      }
+
+      delete [] _M_shards;
+      _M_shards = nullptr;
+
+      return false;
+    }
+
+    pthread_mutex_init(&s.mutex, nullptr);
+
+    s.nbuckets = nbuckets;
+    s.lru_head = nullptr;
+    s.lru_tail = nullptr;
+    s.nentries = 0;
+  }
+
+  _M_config = config;
+  _M_nshards = config.shards;
+
+  return true;
+}
+
+bool net::dns::cache::lookup(const char* name,
+                             uint16_t qtype,
+                             int& error,
+                             result& res)
+{
+  size_t len = name_length(name);
+  size_t h = hash(name, len, qtype);
+
+  shard& s = _M_shards[(h >> 20) & (_M_nshards - 1)];
+
+  pthread_mutex_lock(&s.mutex);
+
+  entry* e;
+  if ((e = find(s, name, len, qtype, h)) != nullptr) {
+    if (now() < e->expire) {
+      error = e->error;
+
+      for (size_t i = 0;
+           (i < e->naddresses) && (res.naddresses < max_addresses);
+           i++) {
+        res.addresses[res.naddresses++] = e->addresses[i];
+      }
+
+      // Move the entry to the head of the LRU list.
+      unlink_lru(s, e);
+      link_lru(s, e);
+
+      pthread_mutex_unlock(&s.mutex);
+
+      return true;
+    }
+
+    // The entry has expired.
+    remove(s, e);
+    delete e;
+  }
+
+  pthread_mutex_unlock(&s.mutex);
+
+  return false;
+}
+
+void net::dns::cache::add(const char* name,
+                          uint16_t qtype,
+                          int error,
+                          const ip_address* addresses,
+                          size_t naddresses,
+                          uint32_t ttl,
+                          bool has_ttl)
+{
+  if (!has_ttl) {
+    // Positive answers without TTL are not cached.
+    if (error == 0) {
+      return;
+    }
+
+    ttl = _M_config.negative_ttl;
+  }
+
+  if (ttl < _M_config.min_ttl) {
+    ttl = _M_config.min_ttl;
+  } else if (ttl > _M_config.max_ttl) {
+    ttl = _M_config.max_ttl;
+  }
+
+  size_t len = name_length(name);
+  if ((ttl == 0) || (len > max_name_length)) {
+    return;
+  }
+
+  size_t h = hash(name, len, qtype);
+
+  shard& s = _M_shards[(h >> 20) & (_M_nshards - 1)];
+
+  pthread_mutex_lock(&s.mutex);
+
+  entry* e;
+  if ((e = find(s, name, len, qtype, h)) != nullptr) {
+    remove(s, e);
+  } else if (s.nentries == _M_config.max_entries) {
+    // Replace the least recently used entry.
+    e = s.lru_tail;
+    remove(s, e);
+  } else if ((e = new (std::nothrow) entry) == nullptr) {
+    pthread_mutex_unlock(&s.mutex);
+    return;
+  }
+
+  memcpy(e->name, name, len);
+  e->name[len] = 0;
+
+  e->qtype = qtype;
+  e->hash = h;
+  e->error = error;
+
+  if (naddresses > max_addresses) {
+    naddresses = max_addresses;
+  }
+
+  memcpy(e->addresses, addresses, naddresses * sizeof(ip_address));
+  e->naddresses = naddresses;
+
+  e->expire = now() + (static_cast<uint64_t>(ttl) * 1000);
+
+  // Insert entry.
+  entry** bucket = &s.buckets[h & (s.nbuckets - 1)];
+  e->next = *bucket;
+  *bucket = e;
+
+  link_lru(s, e);
+
+  s.nentries++;
+
+  pthread_mutex_unlock(&s.mutex);
+}
+
+void net::dns::cache::clear()
+{
+  for (size_t i = 0; i < _M_nshards; i++) {
+    shard& s = _M_shards[i];
+
+    pthread_mutex_lock(&s.mutex);
+
+    while (s.lru_head) {
+      entry* e = s.lru_head;
+
+      remove(s, e);
+      delete e;
+    }
+
+    pthread_mutex_unlock(&s.mutex);
+  }
+}
+
+net::dns::cache::entry* net::dns::cache::find(shard& s,
+                                              const char* name,
+                                              size_t len,
+                                              uint16_t qtype,
+                                              size_t hash)
+{
+  for (entry* e = s.buckets[hash & (s.nbuckets - 1)]; e; e = e->next) {
+    if ((e->hash == hash) &&
+        (e->qtype == qtype) &&
+        (strncasecmp(e->name, name, len) == 0) &&
+        (e->name[len] == 0)) {
+      return e;
+    }
+  }
+
+  return nullptr;
+}
+
+void net::dns::cache::remove(shard& s, entry* e)
+{
+  // Remove from the bucket.
+  entry** prev = &s.buckets[e->hash & (s.nbuckets - 1)];
+  while (*prev != e) {
+    prev = &(*prev)->next;
+  }
+
+  *prev = e->next;
+
+  unlink_lru(s, e);
+
+  s.nentries--;
+}
+
+size_t net::dns::cache::hash(const char* name, size_t len, uint16_t qtype)
+{
+  // FNV-1a (64 bits) of the name in lower case and of the record type.
+  uint64_t h = 14695981039346656037ull;
+
+  for (size_t i = 0; i < len; i++) {
+    h ^= static_cast<uint8_t>(tolower(static_cast<uint8_t>(name[i])));
+    h *= 1099511628211ull;
+  }
+
+  h ^= qtype;
+  h *= 1099511628211ull;
+
+  return static_cast<size_t>(h ^ (h >> 29));
+}
@@ -0,0 +1,214 @@
+#ifndef NET_DNS_CACHE_H
+#define NET_DNS_CACHE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "net/dns/message.h"
+
+namespace net {
+  namespace dns {
+    // Cache of name resolutions, shared by the resolvers of several
+    // dispatchers.
+    // The entries expire by a process-wide monotonic clock (see now()), not
+    // by the clocks of the dispatchers, which count from the time each one
+    // was started.
+    // The entries (name and record type) are spread over shards, each one
+    // with its own lock, hash table and LRU list, so that the dispatchers
+    // rarely contend. An entry expires after the TTL of the answer (clamped
+    // to [min_ttl, max_ttl]); negative answers (the name doesn't exist or
+    // has no addresses of the type) are cached too. When a shard is full,
+    // its least recently used entry is replaced.
+    class cache {
+      public:
+        static const size_t default_shards = 16;
+        static const size_t default_max_entries = 256;
+        static const uint32_t default_min_ttl = 0;
+        static const uint32_t default_max_ttl = 24 * 60 * 60;
+        static const uint32_t default_negative_ttl = 30;
+
+        struct config {
+          // Number of shards (power of two).
+          size_t shards;
+
+          // Maximum number of entries per shard.
+          size_t max_entries;
+
+          // Minimum and maximum TTL (seconds).
+          uint32_t min_ttl;
+          uint32_t max_ttl;
+
+          // TTL of the negative answers without SOA record (seconds).
+          uint32_t negative_ttl;
+
+          // Constructor.
+          config();
+        };
+
+        // Constructor.
+        cache();
+
+        // Destructor.
+        ~cache();
+
+        // Create.
+        bool create();
+        bool create(const config& config);
+
+        // Look up 'name' (record type 'qtype').
+        // Returns false if the name is not cached or the entry has expired.
+        // Otherwise, 'error' is 0 or ENOENT (negative answer) and the
+        // addresses are appended to 'res'.
+        bool lookup(const char* name,
+                    uint16_t qtype,
+                    int& error,
+                    result& res);
+
+        // Add answer ('error': 0 or ENOENT, 'ttl' in seconds).
+        void add(const char* name,
+                 uint16_t qtype,
+                 int error,
+                 const ip_address* addresses,
+                 size_t naddresses,
+                 uint32_t ttl,
+                 bool has_ttl);
+
+        // Remove all the entries.
+        void clear();
+
+        // Get current time (milliseconds of CLOCK_MONOTONIC).
+        static uint64_t now();
+
+      private:
+        struct entry {
+          char name[max_name_length + 1];
+          uint16_t qtype;
+          size_t hash;
+
+          int error;
+
+          ip_address addresses[max_addresses];
+          size_t naddresses;
+
+          // Expiration time (milliseconds).
+          uint64_t expire;
+
+          // Next entry in the bucket.
+          entry* next;
+
+          // LRU list (most recently used first).
+          entry* prev_lru;
+          entry* next_lru;
+        };
+
+        struct shard {
+          pthread_mutex_t mutex;
+
+          entry** buckets;
+          size_t nbuckets;
+
+          entry* lru_head;
+          entry* lru_tail;
+
+          size_t nentries;
+        };
+
+        config _M_config;
+
+        shard* _M_shards;
+        size_t _M_nshards;
+
+        // Find entry.
+        static entry* find(shard& s,
+                           const char* name,
+                           size_t len,
+                           uint16_t qtype,
+                           size_t hash);
+
+        // Remove entry from the hash table and from the LRU list.
+        static void remove(shard& s, entry* e);
+
+        // Link entry at the head of the LRU list.
+        static void link_lru(shard& s, entry* e);
+
+        // Unlink entry from the LRU list.
+        static void unlink_lru(shard& s, entry* e);
+
+        // Get length of the name (without the trailing dot).
+        static size_t name_length(const char* name);
+
+        // Hash name (ignoring case) and record type.
+        static size_t hash(const char* name, size_t len, uint16_t qtype);
+
+        // Disable copy constructor and assignment operator.
+        cache(const cache&) = delete;
+        cache& operator=(const cache&) = delete;
+    };
+
+    inline cache::config::config()
+      : shards(default_shards),
+        max_entries(default_max_entries),
+        min_ttl(default_min_ttl),
+        max_ttl(default_max_ttl),
+        negative_ttl(default_negative_ttl)
+    {
+    }
+
+    inline cache::cache()
+      : _M_shards(nullptr),
+        _M_nshards(0)
+    {
+    }
+
+    inline bool cache::create()
+    {
+      return create(config());
+    }
+
+    inline void cache::link_lru(shard& s, entry* e)
+    {
+      e->prev_lru = nullptr;
+      e->next_lru = s.lru_head;
+
+      if (s.lru_head) {
+        s.lru_head->prev_lru = e;
+      } else {
+        s.lru_tail = e;
+      }
+
+      s.lru_head = e;
+    }
+
+    inline void cache::unlink_lru(shard& s, entry* e)
+    {
+      if (e->prev_lru) {
+        e->prev_lru->next_lru = e->next_lru;
+      } else {
+        s.lru_head = e->next_lru;
+      }
+
+      if (e->next_lru) {
+        e->next_lru->prev_lru = e->prev_lru;
+      } else {
+        s.lru_tail = e->prev_lru;
+      }
+    }
+
+    inline uint64_t cache::now()
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+
+      return (static_cast<uint64_t>(ts.tv_sec) * 1000) +
+             (ts.tv_nsec / 1000000);
+    }
+
+    inline size_t cache::name_length(const char* name)
+    {
+      size_t len = strlen(name);
+      return ((len > 0) && (name[len - 1] == '.')) ? len - 1 : len;
+    }
+  }
+}
+
+#endif // NET_DNS_CACHE_H
@@ -0,0 +1,320 @@
+#include <errno.h>
+#include "net/dns/happy_eyeballs.h"
+
+void net::dns::connection::clear()
+{
+  happy_eyeballs* race = _M_race;
+  bool delayed = _M_delayed;
+
+  if (race) {
+    race->unlink_attempt(this);
+  }
+
+  _M_established = false;
+  _M_delayed = false;
+
+  closed();
+
+  // If the connection was being attempted...
+  if (race) {
+    race->attempt_failed(delayed);
+  }
+}
+
+bool net::dns::connection::timeout()
+{
+  if (_M_established) {
+    return expired();
+  }
+
+  // Attempt which lost the race?
+  if (!_M_race) {
+    return false;
+  }
+
+  return _M_race->expired(this);
+}
+
+bool net::dns::connection::run()
+{
+  if (_M_established) {
+    return process();
+  }
+
+  // Attempt which lost the race?
+  if (!_M_race) {
+    return false;
+  }
+
+  // Wait until the connection has been established.
+  if (!writable()) {
+    return true;
+  }
+
+  int error;
+  if (!get_socket_error(error)) {
+    return false;
+  }
+
+  if (error != 0) {
+    _M_race->_M_error = error;
+    return false;
+  }
+
+  _M_established = true;
+
+  _M_race->won(this);
+
+  return true;
+}
+
+net::dns::happy_eyeballs::happy_eyeballs(resolver* resolver,
+                                         unsigned attempt_delay)
+  : _M_resolver(resolver),
+    _M_attempt_delay(attempt_delay),
+    _M_resolving(false),
+    _M_naddresses(0),
+    _M_next(0),
+    _M_attempts(nullptr),
+    _M_error(0)
+{
+}
+
+net::dns::happy_eyeballs::~happy_eyeballs()
+{
+  cancel();
+}
+
+bool net::dns::happy_eyeballs::connect(const char* name,
+                                       in_port_t port,
+                                       unsigned timeout)
+{
+  if (active()) {
+    errno = EALREADY;
+    return false;
+  }
+
+  _M_port = port;
+  _M_deadline = get_dispatcher()->time() + timeout;
+
+  _M_resolving = true;
+
+  if (!_M_resolver->resolve(name, resolver::family::any, resolved, this)) {
+    _M_resolving = false;
+    return false;
+  }
+
+  return true;
+}
+
+bool net::dns::happy_eyeballs::connect(const result& res,
+                                       in_port_t port,
+                                       unsigned timeout)
+{
+  if (active()) {
+    errno = EALREADY;
+    return false;
+  }
+
+  return start(res, port, timeout);
+}
+
+void net::dns::happy_eyeballs::cancel()
+{
+  if (_M_resolving) {
+    _M_resolver->cancel(this);
+    _M_resolving = false;
+  }
+
+  stop_attempts();
+
+  _M_next = _M_naddresses;
+}
+
+void net::dns::happy_eyeballs::resolved(const result& res, void* user)
+{
+  happy_eyeballs* race = static_cast<happy_eyeballs*>(user);
+
+  race->_M_resolving = false;
+
+  if (res.error != 0) {
+    race->failed(res.error);
+    return;
+  }
+
+  uint64_t now = race->get_dispatcher()->time();
+
+  if (now >= race->_M_deadline) {
+    race->failed(ETIMEDOUT);
+    return;
+  }
+
+  if (!race->start(res, race->_M_port, race->_M_deadline - now)) {
+    race->failed(errno);
+  }
+}
+
+bool net::dns::happy_eyeballs::start(const result& res,
+                                     in_port_t port,
+                                     unsigned timeout)
+{
+  if (res.naddresses == 0) {
+    errno = ENOENT;
+    return false;
+  }
+
+  _M_port = port;
+  _M_deadline = get_dispatcher()->time() + timeout;
+  _M_error = 0;
+
+  // Interleave the address families, starting with the family of the
+  // first address.
+  const ip_address* first[max_addresses];
+  const ip_address* second[max_addresses];
+  size_t nfirst = 0;
+  size_t nsecond = 0;
+
+  for (size_t i = 0; i < res.naddresses; i++) {
+    if (res.addresses[i].family == res.addresses[0].family) {
+      first[nfirst++] = &res.addresses[i];
+    } else {
+      second[nsecond++] = &res.addresses[i];
+    }
+  }
+
+  _M_naddresses = 0;
+
+  for (size_t i = 0; (i < nfirst) || (i < nsecond); i++) {
+    if (i < nfirst) {
+      _M_addresses[_M_naddresses++] = *first[i];
+    }
+
+    if (i < nsecond) {
+      _M_addresses[_M_naddresses++] = *second[i];
+    }
+  }
+
+  _M_next = 0;
+
+  return start_attempt();
+}
+
+bool net::dns::happy_eyeballs::start_attempt()
+{
+  while (_M_next < _M_naddresses) {
+    uint64_t now = get_dispatcher()->time();
+
+    if (now >= _M_deadline) {
+      _M_error = ETIMEDOUT;
+      break;
+    }
+
+    connection* conn;
+    if ((conn = create()) == nullptr) {
+      _M_error = ENOMEM;
+      break;
+    }
+
+    net::socket::address addr;
+    _M_addresses[_M_next++].to_address(_M_port, addr);
+
+    // The next attempt is started when the attempt delay expires.
+    uint64_t remaining = _M_deadline - now;
+    unsigned delay = (remaining < _M_attempt_delay) ?
+                       static_cast<unsigned>(remaining) :
+                       _M_attempt_delay;
+
+    link_attempt(conn);
+
+    conn->_M_delayed = true;
+
+    if (conn->connect(addr, delay)) {
+      return true;
+    }
+
+    // The connection couldn't be started (e.g. there is no route to the
+    // address family).
+    _M_error = errno;
+
+    unlink_attempt(conn);
+
+    conn->_M_delayed = false;
+    conn->closed();
+  }
+
+  if (_M_error == 0) {
+    _M_error = ECONNREFUSED;
+  }
+
+  errno = _M_error;
+
+  return false;
+}
+
+void net::dns::happy_eyeballs::won(connection* conn)
+{
+  unlink_attempt(conn);
+
+  conn->_M_delayed = false;
+
+  // The connection has no timeout until the caller sets one.
+  conn->set_timeout(-1);
+
+  stop_attempts();
+
+  _M_next = _M_naddresses;
+
+  connected(conn);
+}
+
+bool net::dns::happy_eyeballs::expired(connection* conn)
+{
+  // If the attempt delay has expired, start the next attempt (the current
+  // attempt keeps running).
+  if (conn->_M_delayed) {
+    conn->_M_delayed = false;
+
+    start_attempt();
+
+    uint64_t now = get_dispatcher()->time();
+
+    if (now < _M_deadline) {
+      conn->set_timeout(static_cast<int>(_M_deadline - now));
+      return true;
+    }
+  }
+
+  // The race has timed out.
+  _M_error = ETIMEDOUT;
+
+  return false;
+}
+
+void net::dns::happy_eyeballs::attempt_failed(bool delayed)
+{
+  // If the next attempt hadn't been started yet (or there are no attempts
+  // running), start it now.
+  if (((delayed) || (!_M_attempts)) && (start_attempt())) {
+    return;
+  }
+
+  // If there are no attempts left...
+  if (!_M_attempts) {
+    _M_next = _M_naddresses;
+
+    failed(_M_error);
+  }
+}
+
+void net::dns::happy_eyeballs::stop_attempts()
+{
+  // The attempts are closed by their dispatcher.
+  while (_M_attempts) {
+    connection* conn = _M_attempts;
+
+    unlink_attempt(conn);
+
+    conn->_M_delayed = false;
+    conn->fail();
+  }
+}
@@ -0,0 +1,233 @@
+#ifndef NET_DNS_HAPPY_EYEBALLS_H
+#define NET_DNS_HAPPY_EYEBALLS_H
+
+#if defined(USE_SOCKET_TEMPLATE)
+  #error "Happy eyeballs requires the virtual socket interface."
+#endif
+
+#include "net/async/event/socket.h"
+#include "net/dns/resolver.h"
+
+namespace net {
+  namespace dns {
+    // Forward declaration.
+    class happy_eyeballs;
+
+    // Connection established by happy_eyeballs.
+    // While the connection is being attempted, run(), timeout() and clear()
+    // are handled by the race; once it has been established, they call
+    // process(), expired() and closed().
+    class connection : public net::async::event::socket {
+      friend class happy_eyeballs;
+
+      public:
+        // Constructor.
+        connection(net::async::event::dispatcher* dispatcher);
+
+        // Clear.
+        void clear() final;
+
+        // Timeout.
+        bool timeout() final;
+
+        // Run.
+        bool run() final;
+
+        // Has the connection been established?
+        bool established() const;
+
+      protected:
+        // Process connection (run() once the connection has been
+        // established).
+        // Return false if the connection should be closed.
+        virtual bool process() = 0;
+
+        // Timeout once the connection has been established (by default,
+        // the connection is closed).
+        virtual bool expired();
+
+        // Connection closed (also called for the attempts which failed or
+        // lost the race; the connection might be deleted).
+        virtual void closed() = 0;
+
+      private:
+        happy_eyeballs* _M_race;
+
+        // Attempts of the race.
+        connection* _M_prev;
+        connection* _M_next;
+
+        bool _M_established;
+
+        // Has the next attempt not been started yet?
+        bool _M_delayed;
+    };
+
+    // Connection to a name racing its IPv6 and IPv4 addresses (happy
+    // eyeballs, RFC 8305).
+    // The addresses are interleaved by family (starting with IPv6) and a
+    // new connection attempt is started every 'attempt delay' milliseconds
+    // (or as soon as the last attempt fails) until one of them is
+    // established; the others are closed then.
+    class happy_eyeballs {
+      friend class connection;
+
+      public:
+        static const unsigned default_attempt_delay = 250; // Milliseconds.
+
+        // Constructor.
+        happy_eyeballs(resolver* resolver,
+                       unsigned attempt_delay = default_attempt_delay);
+
+        // Destructor.
+        virtual ~happy_eyeballs();
+
+        // Resolve 'name' and connect to 'port'.
+        // The race might finish (connected() or failed()) before connect()
+        // returns.
+        bool connect(const char* name,
+                     in_port_t port,
+                     unsigned timeout = net::socket::default_timeout);
+
+        // Connect to the addresses of 'res'.
+        bool connect(const result& res,
+                     in_port_t port,
+                     unsigned timeout = net::socket::default_timeout);
+
+        // Cancel race (the connections being attempted are closed).
+        void cancel();
+
+        // Is the race running?
+        bool active() const;
+
+        // Get dispatcher.
+        net::async::event::dispatcher* get_dispatcher() const;
+
+      protected:
+        // Create connection for a new attempt.
+        virtual connection* create() = 0;
+
+        // A connection has been established.
+        virtual void connected(connection* conn) = 0;
+
+        // The name couldn't be resolved or all the attempts failed.
+        virtual void failed(int error) = 0;
+
+      private:
+        resolver* _M_resolver;
+
+        unsigned _M_attempt_delay;
+
+        bool _M_resolving;
+
+        in_port_t _M_port;
+
+        // Deadline of the race (milliseconds).
+        uint64_t _M_deadline;
+
+        // Addresses (in the order in which they are attempted).
+        ip_address _M_addresses[max_addresses];
+        size_t _M_naddresses;
+        size_t _M_next;
+
+        // Connections being attempted.
+        connection* _M_attempts;
+
+        // Error of the last attempt.
+        int _M_error;
+
+        // Name resolved.
+        static void resolved(const result& res, void* user);
+
+        // Start race.
+        bool start(const result& res, in_port_t port, unsigned timeout);
+
+        // Start the next attempt.
+        bool start_attempt();
+
+        // Attempt established.
+        void won(connection* conn);
+
+        // Attempt timed out.
+        bool expired(connection* conn);
+
+        // Attempt failed.
+        void attempt_failed(bool delayed);
+
+        // Stop the attempts.
+        void stop_attempts();
+
+        // Link / unlink attempt.
+        void link_attempt(connection* conn);
+        void unlink_attempt(connection* conn);
+
+        // Disable copy constructor and assignment operator.
+        happy_eyeballs(const happy_eyeballs&) = delete;
+        happy_eyeballs& operator=(const happy_eyeballs&) = delete;
+    };
+
+    inline connection::connection(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher),
+        _M_race(nullptr),
+        _M_prev(nullptr),
+        _M_next(nullptr),
+        _M_established(false),
+        _M_delayed(false)
+    {
+    }
+
+    inline bool connection::established() const
+    {
+      return _M_established;
+    }
+
+    inline bool connection::expired()
+    {
+      // Close connection.
+      return false;
+    }
+
+    inline bool happy_eyeballs::active() const
+    {
+      return ((_M_resolving) || (_M_attempts));
+    }
+
+    inline net::async::event::dispatcher*
+    happy_eyeballs::get_dispatcher() const
+    {
+      return _M_resolver->get_dispatcher();
+    }
+
+    inline void happy_eyeballs::link_attempt(connection* conn)
+    {
+      conn->_M_race = this;
+      conn->_M_prev = nullptr;
+      conn->_M_next = _M_attempts;
+
+      if (_M_attempts) {
+        _M_attempts->_M_prev = conn;
+      }
+
+      _M_attempts = conn;
+    }
+
+    inline void happy_eyeballs::unlink_attempt(connection* conn)
+    {
+      if (conn->_M_prev) {
+        conn->_M_prev->_M_next = conn->_M_next;
+      } else {
+        _M_attempts = conn->_M_next;
+      }
+
+      if (conn->_M_next) {
+        conn->_M_next->_M_prev = conn->_M_prev;
+      }
+
+      conn->_M_race = nullptr;
+      conn->_M_prev = nullptr;
+      conn->_M_next = nullptr;
+    }
+  }
+}
+
+#endif // NET_DNS_HAPPY_EYEBALLS_H
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include "net/dns/hosts.h"
+
+bool net::dns::hosts::load(const char* path)
+{
+  FILE* file;
+  if ((file = fopen(path, "r")) == nullptr) {
+    return false;
+  }
+
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    // Remove comment.
+    char* comment;
+    if ((comment = strchr(line, '#')) != nullptr) {
+      *comment = 0;
+    }
+
+    static const char* const separators = " \t\r\n";
+
+    char* saveptr;
+    const char* token;
+    if ((token = strtok_r(line, separators, &saveptr)) == nullptr) {
+      continue;
+    }
+
+    // Address.
+    ip_address addr;
+    if (inet_pton(AF_INET, token, &addr.ipv4) == 1) {
+      addr.family = AF_INET;
+    } else if (inet_pton(AF_INET6, token, &addr.ipv6) == 1) {
+      addr.family = AF_INET6;
+    } else {
+      continue;
+    }
+
+    // Canonical name and aliases.
+    while ((token = strtok_r(nullptr, separators, &saveptr)) != nullptr) {
+      if (!add(token, addr)) {
+        fclose(file);
+        return false;
+      }
+    }
+  }
+
+  fclose(file);
+
+  return true;
+}
+
+bool net::dns::hosts::add(const char* name, const ip_address& addr)
+{
+  if (_M_used == _M_size) {
+    size_t size = (_M_size > 0) ? _M_size * 2 : 16;
+
+    entry* entries;
+    if ((entries = static_cast<entry*>(
+                     realloc(_M_entries, size * sizeof(entry))
+                   )) == nullptr) {
+      return false;
+    }
+
+    _M_entries = entries;
+    _M_size = size;
+  }
+
+  entry* e = &_M_entries[_M_used];
+
+  if ((e->name = strdup(name)) == nullptr) {
+    return false;
+  }
+
+  // Remove trailing dot.
+  size_t len = strlen(e->name);
+  if ((len > 1) && (e->name[len - 1] == '.')) {
+    e->name[len - 1] = 0;
+  }
+
+  e->addr = addr;
+
+  _M_used++;
+
+  return true;
+}
+
+bool net::dns::hosts::lookup(const char* name,
+                             sa_family_t family,
+                             result& res) const
+{
+  size_t len = strlen(name);
+  if ((len > 1) && (name[len - 1] == '.')) {
+    len--;
+  }
+
+  bool found = false;
+
+  for (size_t i = 0; i < _M_used; i++) {
+    const entry* e = &_M_entries[i];
+
+    if ((strncasecmp(e->name, name, len) == 0) && (e->name[len] == 0)) {
+      found = true;
+
+      if (((family == AF_UNSPEC) || (family == e->addr.family)) &&
+          (res.naddresses < max_addresses)) {
+        res.addresses[res.naddresses++] = e->addr;
+      }
+    }
+  }
+
+  return found;
+}
+
+void net::dns::hosts::clear()
+{
+  for (size_t i = 0; i < _M_used; i++) {
+    free(_M_entries[i].name);
+  }
+
+  free(_M_entries);
+
+  _M_entries = nullptr;
+  _M_size = 0;
+  _M_used = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef NET_DNS_HOSTS_H
+#define NET_DNS_HOSTS_H
+
+#include "net/dns/message.h"
+
+namespace net {
+  namespace dns {
+    // Static table of host names (/etc/hosts).
+    class hosts {
+      public:
+        static constexpr const char* const default_path = "/etc/hosts";
+
+        // Constructor.
+        hosts();
+
+        // Destructor.
+        ~hosts();
+
+        // Load file.
+        bool load(const char* path = default_path);
+
+        // Add host.
+        bool add(const char* name, const ip_address& addr);
+
+        // Look up 'name' (family AF_INET, AF_INET6 or AF_UNSPEC).
+        // The addresses found are appended to 'res'.
+        // Returns false if the name is not in the table.
+        bool lookup(const char* name, sa_family_t family, result& res) const;
+
+        // Remove all the hosts.
+        void clear();
+
+      private:
+        struct entry {
+          char* name;
+          ip_address addr;
+        };
+
+        entry* _M_entries;
+        size_t _M_size;
+        size_t _M_used;
+
+        // Disable copy constructor and assignment operator.
+        hosts(const hosts&) = delete;
+        hosts& operator=(const hosts&) = delete;
+    };
+
+    inline hosts::hosts()
+      : _M_entries(nullptr),
+        _M_size(0),
+        _M_used(0)
+    {
+    }
+
+    inline hosts::~hosts()
+    {
+      clear();
+    }
+  }
+}
+
+#endif // NET_DNS_HOSTS_H
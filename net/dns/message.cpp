@@ -0,0 +1,287 @@
+#include <string.h>
+#include <strings.h>
+#include "net/dns/message.h"
+
+namespace net {
+  namespace dns {
+    // Size of the header.
+    static const size_t header_size = 12;
+
+    // Class IN.
+    static const uint16_t class_in = 1;
+
+    // Maximum number of compression pointers followed in a name.
+    static const unsigned max_pointers = 16;
+
+    static inline uint16_t get16(const uint8_t* p)
+    {
+      return (static_cast<uint16_t>(p[0]) << 8) | p[1];
+    }
+
+    static inline uint32_t get32(const uint8_t* p)
+    {
+      return (static_cast<uint32_t>(p[0]) << 24) |
+             (static_cast<uint32_t>(p[1]) << 16) |
+             (static_cast<uint32_t>(p[2]) << 8) |
+             p[3];
+    }
+
+    static inline void put16(uint8_t* p, uint16_t n)
+    {
+      p[0] = static_cast<uint8_t>(n >> 8);
+      p[1] = static_cast<uint8_t>(n);
+    }
+
+    // Read name at 'off' (in dotted form, without the trailing dot) and
+    // advance 'off' past it.
+    static bool read_name(const uint8_t* msg,
+                          size_t len,
+                          size_t& off,
+                          char* name,
+                          size_t size)
+    {
+      size_t pos = off;
+      size_t n = 0;
+      unsigned pointers = 0;
+      bool jumped = false;
+
+      do {
+        if (pos >= len) {
+          return false;
+        }
+
+        uint8_t l = msg[pos];
+
+        // Compression pointer?
+        if ((l & 0xc0) == 0xc0) {
+          if ((pos + 1 >= len) || (++pointers > max_pointers)) {
+            return false;
+          }
+
+          if (!jumped) {
+            off = pos + 2;
+            jumped = true;
+          }
+
+          pos = ((l & 0x3f) << 8) | msg[pos + 1];
+        } else if ((l & 0xc0) != 0) {
+          return false;
+        } else if (l == 0) {
+          if (!jumped) {
+            off = pos + 1;
+          }
+
+          name[n] = 0;
+
+          return true;
+        } else {
+          if ((pos + 1 + l > len) || (n + l + 1 >= size)) {
+            return false;
+          }
+
+          if (n > 0) {
+            name[n++] = '.';
+          }
+
+          memcpy(name + n, msg + pos + 1, l);
+          n += l;
+
+          pos += 1 + l;
+        }
+      } while (true);
+    }
+
+    // Skip name at 'off'.
+    static bool skip_name(const uint8_t* msg, size_t len, size_t& off)
+    {
+      char name[max_name_length + 2];
+      return read_name(msg, len, off, name, sizeof(name));
+    }
+
+    // Compare names (ignoring case and the trailing dot).
+    static bool equal_names(const char* name1, const char* name2)
+    {
+      size_t len1 = strlen(name1);
+      if ((len1 > 0) && (name1[len1 - 1] == '.')) {
+        len1--;
+      }
+
+      size_t len2 = strlen(name2);
+      if ((len2 > 0) && (name2[len2 - 1] == '.')) {
+        len2--;
+      }
+
+      return ((len1 == len2) && (strncasecmp(name1, name2, len1) == 0));
+    }
+
+    size_t build_query(uint16_t id,
+                       const char* name,
+                       uint16_t qtype,
+                       uint8_t* buf,
+                       size_t size)
+    {
+      size_t len = strlen(name);
+
+      // Skip trailing dot.
+      if ((len > 0) && (name[len - 1] == '.')) {
+        len--;
+      }
+
+      if ((len == 0) ||
+          (len > max_name_length) ||
+          (header_size + len + 2 + 4 > size)) {
+        return 0;
+      }
+
+      // Header: recursion desired, one question.
+      memset(buf, 0, header_size);
+      put16(buf, id);
+      buf[2] = 0x01;
+      put16(buf + 4, 1);
+
+      uint8_t* p = buf + header_size;
+
+      // Question name.
+      const char* label = name;
+      const char* end = name + len;
+
+      do {
+        const char* dot;
+        if ((dot = static_cast<const char*>(
+                     memchr(label, '.', end - label)
+                   )) == nullptr) {
+          dot = end;
+        }
+
+        size_t l = dot - label;
+        if ((l == 0) || (l > 63)) {
+          return 0;
+        }
+
+        *p++ = static_cast<uint8_t>(l);
+        memcpy(p, label, l);
+        p += l;
+
+        label = dot + 1;
+      } while (label < end);
+
+      *p++ = 0;
+
+      // Question type and class.
+      put16(p, qtype);
+      put16(p + 2, class_in);
+
+      return p + 4 - buf;
+    }
+
+    bool parse_response(const uint8_t* msg,
+                        size_t len,
+                        uint16_t id,
+                        const char* name,
+                        uint16_t qtype,
+                        response& res)
+    {
+      // Check header: identifier, response, standard query and one
+      // question.
+      if ((len < header_size) ||
+          (get16(msg) != id) ||
+          ((msg[2] & 0x80) == 0) ||
+          ((msg[2] & 0x78) != 0) ||
+          (get16(msg + 4) != 1)) {
+        return false;
+      }
+
+      res.rcode = msg[3] & 0x0f;
+      res.truncated = ((msg[2] & 0x02) != 0);
+      res.naddresses = 0;
+      res.ttl = 0;
+      res.has_ttl = false;
+
+      unsigned ancount = get16(msg + 6);
+      unsigned nscount = get16(msg + 8);
+
+      // Check question.
+      size_t off = header_size;
+
+      char qname[max_name_length + 2];
+      if ((!read_name(msg, len, off, qname, sizeof(qname))) ||
+          (off + 4 > len) ||
+          (!equal_names(qname, name)) ||
+          (get16(msg + off) != qtype) ||
+          (get16(msg + off + 2) != class_in)) {
+        return false;
+      }
+
+      off += 4;
+
+      // Answers and authority records.
+      for (unsigned i = 0; i < ancount + nscount; i++) {
+        if ((!skip_name(msg, len, off)) || (off + 10 > len)) {
+          return false;
+        }
+
+        uint16_t type = get16(msg + off);
+        uint16_t klass = get16(msg + off + 2);
+        uint32_t ttl = get32(msg + off + 4);
+        uint16_t rdlength = get16(msg + off + 8);
+
+        off += 10;
+
+        if (off + rdlength > len) {
+          return false;
+        }
+
+        // TTLs with the most significant bit set are treated as 0
+        // (RFC 2181).
+        if (ttl & 0x80000000u) {
+          ttl = 0;
+        }
+
+        if (klass == class_in) {
+          if (i < ancount) {
+            if ((type == qtype) &&
+                (rdlength == ((qtype == type_a) ?
+                               sizeof(struct in_addr) :
+                               sizeof(struct in6_addr)))) {
+              if (res.naddresses < max_addresses) {
+                ip_address& addr = res.addresses[res.naddresses++];
+
+                if (qtype == type_a) {
+                  addr.family = AF_INET;
+                  memcpy(&addr.ipv4, msg + off, sizeof(struct in_addr));
+                } else {
+                  addr.family = AF_INET6;
+                  memcpy(&addr.ipv6, msg + off, sizeof(struct in6_addr));
+                }
+              }
+
+              if ((!res.has_ttl) || (ttl < res.ttl)) {
+                res.ttl = ttl;
+                res.has_ttl = true;
+              }
+            } else if (type == type_cname) {
+              // The TTL of the aliases limits the TTL of the answer.
+              if ((!res.has_ttl) || (ttl < res.ttl)) {
+                res.ttl = ttl;
+                res.has_ttl = true;
+              }
+            }
+          } else if ((type == type_soa) &&
+                     (res.naddresses == 0) &&
+                     (rdlength >= 22)) {
+            // Negative answer: the TTL is the minimum of the TTL of the
+            // SOA record and its MINIMUM field (RFC 2308).
+            uint32_t minimum = get32(msg + off + rdlength - 4);
+
+            res.ttl = (minimum < ttl) ? minimum : ttl;
+            res.has_ttl = true;
+          }
+        }
+
+        off += rdlength;
+      }
+
+      return true;
+    }
+  }
+}
@@ -0,0 +1,132 @@
+#ifndef NET_DNS_MESSAGE_H
+#define NET_DNS_MESSAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include "net/socket.h"
+
+namespace net {
+  namespace dns {
+    // Maximum size of a DNS message over UDP (without EDNS).
+    static const size_t max_message_size = 512;
+
+    // Maximum length of a domain name (without the trailing dot).
+    static const size_t max_name_length = 253;
+
+    // Maximum number of addresses of a name.
+    static const size_t max_addresses = 16;
+
+    // Record types.
+    static const uint16_t type_a = 1;
+    static const uint16_t type_cname = 5;
+    static const uint16_t type_soa = 6;
+    static const uint16_t type_aaaa = 28;
+
+    // Response codes.
+    static const uint8_t rcode_no_error = 0;
+    static const uint8_t rcode_format_error = 1;
+    static const uint8_t rcode_server_failure = 2;
+    static const uint8_t rcode_name_error = 3;
+    static const uint8_t rcode_refused = 5;
+
+    // IP address (of an A or AAAA record).
+    struct ip_address {
+      sa_family_t family;
+
+      union {
+        struct in_addr ipv4;
+        struct in6_addr ipv6;
+      };
+
+      // Build socket address.
+      void to_address(in_port_t port, net::socket::address& addr) const;
+    };
+
+    // Result of a name resolution.
+    struct result {
+      // 0: success, ENOENT: the name doesn't exist or has no addresses,
+      // ETIMEDOUT: the name servers didn't answer, EIO: the name servers
+      // failed, EINVAL: invalid name.
+      int error;
+
+      ip_address addresses[max_addresses];
+      size_t naddresses;
+    };
+
+    // Response to a query.
+    struct response {
+      uint8_t rcode;
+
+      // Truncated?
+      bool truncated;
+
+      ip_address addresses[max_addresses];
+      size_t naddresses;
+
+      // TTL (seconds): minimum TTL of the records of the answer or, if
+      // there are no addresses, TTL of the negative answer (from the SOA
+      // record, if present).
+      uint32_t ttl;
+      bool has_ttl;
+    };
+
+    // Build query (recursion desired).
+    // Returns the length of the query or 0 if the name is not valid.
+    size_t build_query(uint16_t id,
+                       const char* name,
+                       uint16_t qtype,
+                       uint8_t* buf,
+                       size_t size);
+
+    // Get the identifier of a message.
+    // Returns false if the message is too short.
+    bool message_id(const uint8_t* msg, size_t len, uint16_t& id);
+
+    // Parse response to the query ('id', 'name', 'qtype').
+    // Returns false if the message is malformed or is not a response to
+    // the query.
+    bool parse_response(const uint8_t* msg,
+                        size_t len,
+                        uint16_t id,
+                        const char* name,
+                        uint16_t qtype,
+                        response& res);
+
+    inline void ip_address::to_address(in_port_t port,
+                                       net::socket::address& addr) const
+    {
+      if (family == AF_INET) {
+        struct sockaddr_in sin;
+        memset(&sin, 0, sizeof(struct sockaddr_in));
+
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons(port);
+        sin.sin_addr = ipv4;
+
+        addr = reinterpret_cast<const struct sockaddr&>(sin);
+      } else {
+        struct sockaddr_in6 sin6;
+        memset(&sin6, 0, sizeof(struct sockaddr_in6));
+
+        sin6.sin6_family = AF_INET6;
+        sin6.sin6_port = htons(port);
+        sin6.sin6_addr = ipv6;
+
+        addr = reinterpret_cast<const struct sockaddr&>(sin6);
+      }
+    }
+
+    inline bool message_id(const uint8_t* msg, size_t len, uint16_t& id)
+    {
+      if (len >= 2) {
+        id = (static_cast<uint16_t>(msg[0]) << 8) | msg[1];
+        return true;
+      }
+
+      return false;
+    }
+  }
+}
+
+#endif // NET_DNS_MESSAGE_H
@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "net/dns/resolv_conf.h"
+
+bool net::dns::resolv_conf::load(const char* path)
+{
+  FILE* file;
+  bool loaded;
+  if ((loaded = ((file = fopen(path, "r")) != nullptr))) {
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+      static const char* const separators = " \t\r\n";
+
+      char* saveptr;
+      const char* token;
+      if (((token = strtok_r(line, separators, &saveptr)) == nullptr) ||
+          (*token == '#') ||
+          (*token == ';')) {
+        continue;
+      }
+
+      if (strcmp(token, "nameserver") == 0) {
+        net::socket::address addr;
+        if (((token = strtok_r(nullptr, separators, &saveptr)) != nullptr) &&
+            (addr.build(token, port))) {
+          add_nameserver(addr);
+        }
+      } else if (strcmp(token, "options") == 0) {
+        while ((token = strtok_r(nullptr, separators, &saveptr)) != nullptr) {
+          if (strncmp(token, "timeout:", 8) == 0) {
+            unsigned long n = strtoul(token + 8, nullptr, 10);
+            timeout = ((n > 0) && (n <= 30)) ? n * 1000 : default_timeout;
+          } else if (strncmp(token, "attempts:", 9) == 0) {
+            unsigned long n = strtoul(token + 9, nullptr, 10);
+            attempts = ((n > 0) && (n <= 5)) ? n : default_attempts;
+          } else if (strcmp(token, "rotate") == 0) {
+            rotate = true;
+          }
+        }
+      }
+    }
+
+    fclose(file);
+  }
+
+  // If there are no name servers, use the local name server.
+  if (nnameservers == 0) {
+    net::socket::address addr;
+    if (addr.build("127.0.0.1", port)) {
+      add_nameserver(addr);
+    }
+  }
+
+  return loaded;
+}
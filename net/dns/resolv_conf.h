@@ -0,0 +1,63 @@
+#ifndef NET_DNS_RESOLV_CONF_H
+#define NET_DNS_RESOLV_CONF_H
+
+#include "net/socket.h"
+
+namespace net {
+  namespace dns {
+    // Resolver configuration (/etc/resolv.conf).
+    // Only the name servers and the options "timeout", "attempts" and
+    // "rotate" are used.
+    struct resolv_conf {
+      static constexpr const char* const default_path = "/etc/resolv.conf";
+
+      static const size_t max_nameservers = 3;
+      static const unsigned default_timeout = 5 * 1000;
+      static const unsigned default_attempts = 2;
+      static const in_port_t port = 53;
+
+      // Name servers.
+      net::socket::address nameservers[max_nameservers];
+      size_t nnameservers;
+
+      // Timeout of each query to a name server (milliseconds).
+      unsigned timeout;
+
+      // Number of times each name server is queried.
+      unsigned attempts;
+
+      // Start with a different name server each time?
+      bool rotate;
+
+      // Constructor.
+      resolv_conf();
+
+      // Load file.
+      // If the file has no name servers, the local name server is used.
+      bool load(const char* path = default_path);
+
+      // Add name server.
+      bool add_nameserver(const net::socket::address& addr);
+    };
+
+    inline resolv_conf::resolv_conf()
+      : nnameservers(0),
+        timeout(default_timeout),
+        attempts(default_attempts),
+        rotate(false)
+    {
+    }
+
+    inline bool resolv_conf::add_nameserver(const net::socket::address& addr)
+    {
+      if (nnameservers < max_nameservers) {
+        nameservers[nnameservers++] = addr;
+        return true;
+      }
+
+      return false;
+    }
+  }
+}
+
+#endif // NET_DNS_RESOLV_CONF_H
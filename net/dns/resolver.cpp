@@ -0,0 +1,631 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <new>
+#include "net/dns/resolver.h"
+
+net::dns::resolver::resolver(net::async::event::dispatcher* dispatcher)
+  : _M_dispatcher(dispatcher),
+    _M_nameservers_added(false),
+    _M_cache(nullptr),
+    _M_transport4(dispatcher, this, AF_INET),
+    _M_transport6(dispatcher, this, AF_INET6),
+    _M_lookups(nullptr),
+    _M_free(nullptr),
+    _M_active(nullptr),
+    _M_next_server(0)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  // Seed of the query identifiers.
+  _M_random = (static_cast<uint64_t>(ts.tv_sec) * 1000000000ull) ^
+              static_cast<uint64_t>(ts.tv_nsec) ^
+              (static_cast<uint64_t>(getpid()) << 32) ^
+              reinterpret_cast<uintptr_t>(this);
+
+  if (_M_random == 0) {
+    _M_random = 1;
+  }
+}
+
+net::dns::resolver::~resolver()
+{
+  delete [] _M_lookups;
+}
+
+bool net::dns::resolver::create(const config& config)
+{
+  if ((config.max_lookups == 0) || (_M_lookups)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  if ((_M_lookups = new (std::nothrow) lookup[config.max_lookups]) ==
+      nullptr) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  for (size_t i = 0; i < config.max_lookups; i++) {
+    _M_lookups[i].next = (i + 1 < config.max_lookups) ? &_M_lookups[i + 1] :
+                                                        nullptr;
+  }
+
+  _M_free = _M_lookups;
+
+  if (config.resolv_conf) {
+    // If there were name servers added...
+    if (_M_nameservers_added) {
+      resolv_conf conf;
+      conf.load(config.resolv_conf);
+
+      _M_conf.timeout = conf.timeout;
+      _M_conf.attempts = conf.attempts;
+      _M_conf.rotate = conf.rotate;
+    } else {
+      _M_conf.load(config.resolv_conf);
+    }
+  }
+
+  if (config.timeout > 0) {
+    _M_conf.timeout = config.timeout;
+  }
+
+  if (config.attempts > 0) {
+    _M_conf.attempts = config.attempts;
+  }
+
+  if ((config.hosts) && (!_M_hosts.load(config.hosts)) && (errno != ENOENT)) {
+    return false;
+  }
+
+  _M_cache = config.cache;
+
+  return true;
+}
+
+bool net::dns::resolver::add_nameserver(const net::socket::address& addr)
+{
+  if ((addr.family() != AF_INET) && (addr.family() != AF_INET6)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  // The name servers added replace the ones of resolv.conf.
+  if (!_M_nameservers_added) {
+    _M_conf.nnameservers = 0;
+    _M_nameservers_added = true;
+  }
+
+  if (!_M_conf.add_nameserver(addr)) {
+    errno = ENOSPC;
+    return false;
+  }
+
+  return true;
+}
+
+bool net::dns::resolver::resolve(const char* name,
+                                 family f,
+                                 callback cb,
+                                 void* user)
+{
+  size_t len = strlen(name);
+  if ((len > 0) && (name[len - 1] == '.')) {
+    len--;
+  }
+
+  if ((len == 0) || (len > max_name_length) || (!cb)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  result res;
+  res.error = 0;
+  res.naddresses = 0;
+
+  sa_family_t family = (f == family::ipv4) ? AF_INET :
+                       (f == family::ipv6) ? AF_INET6 :
+                                             AF_UNSPEC;
+
+  char host[max_name_length + 1];
+  memcpy(host, name, len);
+  host[len] = 0;
+
+  // Numeric address?
+  ip_address addr;
+  if (inet_pton(AF_INET, host, &addr.ipv4) == 1) {
+    addr.family = AF_INET;
+  } else if (inet_pton(AF_INET6, host, &addr.ipv6) == 1) {
+    addr.family = AF_INET6;
+  } else {
+    addr.family = AF_UNSPEC;
+  }
+
+  if (addr.family != AF_UNSPEC) {
+    if ((family == AF_UNSPEC) || (family == addr.family)) {
+      res.addresses[res.naddresses++] = addr;
+    } else {
+      res.error = ENOENT;
+    }
+
+    cb(res, user);
+    return true;
+  }
+
+  // Hosts table.
+  if (_M_hosts.lookup(host, family, res)) {
+    if (res.naddresses == 0) {
+      res.error = ENOENT;
+    }
+
+    cb(res, user);
+    return true;
+  }
+
+  if (!_M_free) {
+    errno = EAGAIN;
+    return false;
+  }
+
+  lookup* l = _M_free;
+
+  memcpy(l->name, host, len + 1);
+  l->cb = cb;
+  l->user = user;
+
+  // IPv6 addresses first.
+  l->nqueries = 0;
+
+  if (family != AF_INET) {
+    l->queries[l->nqueries++].qtype = type_aaaa;
+  }
+
+  if (family != AF_INET6) {
+    l->queries[l->nqueries++].qtype = type_a;
+  }
+
+  // Look up the cache.
+  unsigned npending = 0;
+
+  for (unsigned i = 0; i < l->nqueries; i++) {
+    query* q = &l->queries[i];
+
+    q->pending = false;
+    q->tries = 0;
+    q->server_failure = false;
+    q->naddresses = 0;
+
+    if (_M_cache) {
+      result cached;
+      cached.naddresses = 0;
+
+      if (_M_cache->lookup(l->name,
+                           q->qtype,
+                           q->error,
+                           cached)) {
+        memcpy(q->addresses,
+               cached.addresses,
+               cached.naddresses * sizeof(ip_address));
+
+        q->naddresses = cached.naddresses;
+
+        continue;
+      }
+    }
+
+    q->pending = true;
+    npending++;
+  }
+
+  // If the answer is cached (the lookup is left in the list of free
+  // lookups)...
+  if (npending == 0) {
+    merge(l, res);
+
+    cb(res, user);
+    return true;
+  }
+
+  // Move the lookup to the list of active lookups.
+  _M_free = l->next;
+
+  l->prev = nullptr;
+  l->next = _M_active;
+
+  if (_M_active) {
+    _M_active->prev = l;
+  }
+
+  _M_active = l;
+
+  // Send the queries.
+  for (unsigned i = 0; i < l->nqueries; i++) {
+    query* q = &l->queries[i];
+
+    if (q->pending) {
+      // First name server.
+      q->first = ((_M_conf.rotate) && (_M_conf.nnameservers > 0)) ?
+                   _M_next_server++ % _M_conf.nnameservers :
+                   0;
+
+      send_query(l, q);
+    }
+  }
+
+  if (completed(l)) {
+    finish(l);
+  } else {
+    rearm();
+  }
+
+  return true;
+}
+
+void net::dns::resolver::cancel(void* user)
+{
+  // The lookups are completed without calling their callbacks.
+  for (lookup* l = _M_active; l; l = l->next) {
+    if (l->user == user) {
+      l->cb = nullptr;
+    }
+  }
+}
+
+void net::dns::resolver::send_query(lookup* l, query* q)
+{
+  size_t ntries = _M_conf.attempts * _M_conf.nnameservers;
+
+  while (q->tries < ntries) {
+    const net::socket::address& addr =
+      _M_conf.nameservers[(q->first + q->tries) % _M_conf.nnameservers];
+
+    q->tries++;
+
+    transport* t;
+    if (((t = get_transport(addr.family())) != nullptr) &&
+        ((t->opened()) || (t->open()))) {
+      uint8_t buf[max_message_size];
+
+      q->id = random_id();
+
+      size_t len;
+      if ((len = build_query(q->id, l->name, q->qtype, buf, sizeof(buf))) ==
+          0) {
+        complete_query(q, EINVAL);
+        return;
+      }
+
+      // If the datagram couldn't be sent because the socket buffer is
+      // full, the query is sent again when it times out.
+      if ((t->send_query(buf, len, addr)) || (errno == EAGAIN)) {
+        q->deadline = _M_dispatcher->time() + _M_conf.timeout;
+        return;
+      }
+    }
+
+    // Try the next name server.
+  }
+
+  // No name server answered (or there are no name servers).
+  complete_query(q, ((q->server_failure) || (ntries == 0)) ? EIO :
+                                                             ETIMEDOUT);
+}
+
+void net::dns::resolver::complete_query(query* q, int error)
+{
+  q->pending = false;
+  q->error = error;
+}
+
+bool net::dns::resolver::completed(const lookup* l)
+{
+  for (unsigned i = 0; i < l->nqueries; i++) {
+    if (l->queries[i].pending) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void net::dns::resolver::finish(lookup* l)
+{
+  result res;
+  merge(l, res);
+
+  callback cb = l->cb;
+  void* user = l->user;
+
+  // Unlink from the list of active lookups.
+  if (l->prev) {
+    l->prev->next = l->next;
+  } else {
+    _M_active = l->next;
+  }
+
+  if (l->next) {
+    l->next->prev = l->prev;
+  }
+
+  // Add to the list of free lookups (the callback might start a new
+  // lookup).
+  l->prev = nullptr;
+  l->next = _M_free;
+  _M_free = l;
+
+  if (cb) {
+    cb(res, user);
+  }
+}
+
+void net::dns::resolver::merge(const lookup* l, result& res)
+{
+  res.naddresses = 0;
+  res.error = 0;
+
+  // The lookup succeeds if there are addresses of any type; otherwise, the
+  // error of the first query which failed.
+  int error = 0;
+
+  for (unsigned i = 0; i < l->nqueries; i++) {
+    const query* q = &l->queries[i];
+
+    for (size_t j = 0;
+         (j < q->naddresses) && (res.naddresses < max_addresses);
+         j++) {
+      res.addresses[res.naddresses++] = q->addresses[j];
+    }
+
+    if ((error == 0) || ((error == ENOENT) && (q->error != 0))) {
+      error = q->error;
+    }
+  }
+
+  if (res.naddresses == 0) {
+    res.error = (error != 0) ? error : ENOENT;
+  }
+}
+
+bool net::dns::resolver::process_responses(transport* t)
+{
+  do {
+    uint8_t buf[max_message_size];
+    net::socket::address addr;
+
+    ssize_t ret;
+    if ((ret = t->receive(buf, sizeof(buf), addr)) < 0) {
+      // If there are no more datagrams...
+      if (!t->failed()) {
+        rearm();
+        return true;
+      }
+
+      return false;
+    }
+
+    uint16_t id;
+    if (!message_id(buf, ret, id)) {
+      continue;
+    }
+
+    // Find the query (the response has to come from the name server
+    // queried).
+    lookup* l;
+    query* q = nullptr;
+
+    for (l = _M_active; l; l = l->next) {
+      for (unsigned i = 0; i < l->nqueries; i++) {
+        if ((l->queries[i].pending) &&
+            (l->queries[i].id == id) &&
+            (nameserver(&l->queries[i]).equal(addr))) {
+          q = &l->queries[i];
+          break;
+        }
+      }
+
+      if (q) {
+        break;
+      }
+    }
+
+    response res;
+    if ((!q) || (!parse_response(buf, ret, id, l->name, q->qtype, res))) {
+      continue;
+    }
+
+    switch (res.rcode) {
+      case rcode_no_error:
+      case rcode_name_error:
+        {
+          int error = ((res.rcode == rcode_no_error) &&
+                       (res.naddresses > 0)) ? 0 : ENOENT;
+
+          memcpy(q->addresses,
+                 res.addresses,
+                 res.naddresses * sizeof(ip_address));
+
+          q->naddresses = res.naddresses;
+
+          // Truncated responses are not cached (there is no fallback to
+          // TCP, the addresses received are used).
+          if ((_M_cache) && (!res.truncated)) {
+            _M_cache->add(l->name,
+                          q->qtype,
+                          error,
+                          res.addresses,
+                          res.naddresses,
+                          res.ttl,
+                          res.has_ttl);
+          }
+
+          complete_query(q, error);
+        }
+
+        break;
+      default:
+        // Try the next name server.
+        q->server_failure = true;
+        send_query(l, q);
+    }
+
+    if (completed(l)) {
+      finish(l);
+    }
+  } while (true);
+}
+
+bool net::dns::resolver::process_timeouts()
+{
+  uint64_t now = _M_dispatcher->time();
+
+  lookup* l = _M_active;
+  while (l) {
+    // The callback can start new lookups (they are added to the head of
+    // the list).
+    lookup* next = l->next;
+
+    for (unsigned i = 0; i < l->nqueries; i++) {
+      query* q = &l->queries[i];
+
+      if ((q->pending) && (q->deadline <= now)) {
+        send_query(l, q);
+      }
+    }
+
+    if (completed(l)) {
+      finish(l);
+    }
+
+    l = next;
+  }
+
+  rearm();
+
+  return true;
+}
+
+void net::dns::resolver::closed(transport* t)
+{
+  // Send the queries to the next name server.
+  lookup* l = _M_active;
+  while (l) {
+    lookup* next = l->next;
+
+    for (unsigned i = 0; i < l->nqueries; i++) {
+      query* q = &l->queries[i];
+
+      if ((q->pending) &&
+          (get_transport(nameserver(q).family()) == t)) {
+        send_query(l, q);
+      }
+    }
+
+    if (completed(l)) {
+      finish(l);
+    }
+
+    l = next;
+  }
+
+  rearm();
+}
+
+void net::dns::resolver::rearm()
+{
+  transport* transports[] = {&_M_transport4, &_M_transport6};
+
+  uint64_t now = _M_dispatcher->time();
+
+  for (size_t i = 0; i < 2; i++) {
+    transport* t = transports[i];
+
+    if (t->opened()) {
+      // Earliest deadline of the queries sent through the transport.
+      uint64_t deadline = UINT64_MAX;
+
+      for (const lookup* l = _M_active; l; l = l->next) {
+        for (unsigned j = 0; j < l->nqueries; j++) {
+          const query* q = &l->queries[j];
+
+          if ((q->pending) &&
+              (q->deadline < deadline) &&
+              (get_transport(nameserver(q).family()) == t)) {
+            deadline = q->deadline;
+          }
+        }
+      }
+
+      if (deadline != UINT64_MAX) {
+        t->set_timeout((deadline > now) ? deadline - now : 0);
+      } else {
+        t->set_timeout(-1);
+      }
+    }
+  }
+}
+
+net::dns::resolver::transport*
+net::dns::resolver::get_transport(sa_family_t family)
+{
+  switch (family) {
+    case AF_INET:
+      return &_M_transport4;
+    case AF_INET6:
+      return &_M_transport6;
+    default:
+      return nullptr;
+  }
+}
+
+const net::socket::address&
+net::dns::resolver::nameserver(const query* q) const
+{
+  // Current try (the name servers are tried in turn).
+  size_t n = (q->tries > 0) ? q->tries - 1 : 0;
+
+  return _M_conf.nameservers[(q->first + n) % _M_conf.nnameservers];
+}
+
+uint16_t net::dns::resolver::random_id()
+{
+  do {
+    // xorshift64*.
+    _M_random ^= _M_random >> 12;
+    _M_random ^= _M_random << 25;
+    _M_random ^= _M_random >> 27;
+
+    uint16_t id = static_cast<uint16_t>((_M_random * 2685821657736338717ull) >>
+                                        48);
+
+    // The identifier has to be unique among the queries pending.
+    bool used = false;
+
+    for (const lookup* l = _M_active; (l) && (!used); l = l->next) {
+      for (unsigned i = 0; i < l->nqueries; i++) {
+        if ((l->queries[i].pending) && (l->queries[i].id == id)) {
+          used = true;
+          break;
+        }
+      }
+    }
+
+    if (!used) {
+      return id;
+    }
+  } while (true);
+}
+
+bool net::dns::resolver::transport::open()
+{
+  net::socket::address addr;
+  if (!addr.build((_M_family == AF_INET) ? "0.0.0.0" : "::", 0)) {
+    return false;
+  }
+
+  return (_M_open = bind(addr));
+}
@@ -0,0 +1,327 @@
+#ifndef NET_DNS_RESOLVER_H
+#define NET_DNS_RESOLVER_H
+
+#if defined(USE_SOCKET_TEMPLATE)
+  #error "The DNS resolver requires the virtual socket interface."
+#endif
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include "net/async/event/socket.h"
+#include "net/dns/message.h"
+#include "net/dns/cache.h"
+#include "net/dns/hosts.h"
+#include "net/dns/resolv_conf.h"
+
+namespace net {
+  namespace dns {
+    // Asynchronous stub resolver driven by a dispatcher.
+    // A name is looked up in the hosts table, in the cache (if any) and
+    // then the name servers are queried over UDP (one socket per address
+    // family, bound to a random port) with a random identifier per query.
+    // A name server which doesn't answer in time, fails or refuses the
+    // query is retried or the next one is tried (resolv.conf's "timeout",
+    // "attempts" and "rotate"). Answers are only accepted from the name
+    // server queried and must match the question.
+    // Each dispatcher has its own resolver; the cache can be shared by the
+    // resolvers of several dispatchers. The resolver is used from its
+    // dispatcher's thread and has to outlive it.
+    class resolver {
+      public:
+        static const size_t default_max_lookups = 256;
+
+        enum class family {
+          ipv4,
+          ipv6,
+          any
+        };
+
+        // Callback (called from the dispatcher's thread).
+        typedef void (*callback)(const result& res, void* user);
+
+        struct config {
+          // Resolver configuration file (nullptr: not loaded).
+          const char* resolv_conf;
+
+          // Hosts file (nullptr: not loaded).
+          const char* hosts;
+
+          // Timeout of each query (milliseconds) and number of times each
+          // name server is queried (0: resolv.conf's values).
+          unsigned timeout;
+          unsigned attempts;
+
+          // Maximum number of names being resolved.
+          size_t max_lookups;
+
+          // Cache (nullptr: no cache).
+          net::dns::cache* cache;
+
+          // Constructor.
+          config();
+        };
+
+        // Constructor.
+        resolver(net::async::event::dispatcher* dispatcher);
+
+        // Destructor.
+        ~resolver();
+
+        // Create.
+        bool create();
+        bool create(const config& config);
+
+        // Add name server (the name servers added replace the ones of
+        // resolv.conf).
+        bool add_nameserver(const net::socket::address& addr);
+
+        // Add host to the hosts table.
+        bool add_host(const char* name, const ip_address& addr);
+
+        // Resolve name.
+        // With family::any, the IPv6 addresses are returned before the IPv4
+        // addresses. If the result is already known (numeric address, hosts
+        // table or cache), the callback is called before resolve()
+        // returns.
+        // Returns false if the name is not valid (EINVAL) or there are too
+        // many names being resolved (EAGAIN).
+        bool resolve(const char* name, family f, callback cb, void* user);
+
+        // Cancel the resolutions started by 'user' (their callbacks are not
+        // called).
+        void cancel(void* user);
+
+        // Get dispatcher.
+        net::async::event::dispatcher* get_dispatcher() const;
+
+      private:
+        // UDP socket to the name servers of an address family.
+        class transport : public net::async::event::socket {
+          public:
+            // Constructor.
+            transport(net::async::event::dispatcher* dispatcher,
+                      resolver* resolver,
+                      sa_family_t family);
+
+            // Open (bind to a random port).
+            bool open();
+
+            // Is the socket open?
+            bool opened() const;
+
+            // Send query.
+            bool send_query(const void* buf,
+                            size_t len,
+                            const net::socket::address& addr);
+
+            // Receive response.
+            ssize_t receive(void* buf, size_t len, net::socket::address& addr);
+
+            // Has the socket failed?
+            bool failed() const;
+
+            // Clear.
+            void clear();
+
+            // Timeout.
+            bool timeout();
+
+            // Run.
+            bool run();
+
+          private:
+            resolver* _M_resolver;
+            sa_family_t _M_family;
+            bool _M_open;
+        };
+
+        // Query of one record type.
+        struct query {
+          uint16_t qtype;
+          uint16_t id;
+
+          bool pending;
+
+          // Number of queries sent.
+          unsigned tries;
+
+          // Name server of the first try.
+          size_t first;
+
+          // Deadline of the current try (milliseconds).
+          uint64_t deadline;
+
+          // Has a name server failed?
+          bool server_failure;
+
+          int error;
+
+          ip_address addresses[max_addresses];
+          size_t naddresses;
+        };
+
+        // Name being resolved.
+        struct lookup {
+          char name[max_name_length + 1];
+
+          callback cb;
+          void* user;
+
+          query queries[2];
+          unsigned nqueries;
+
+          lookup* prev;
+          lookup* next;
+        };
+
+        net::async::event::dispatcher* _M_dispatcher;
+
+        resolv_conf _M_conf;
+        bool _M_nameservers_added;
+
+        hosts _M_hosts;
+
+        net::dns::cache* _M_cache;
+
+        transport _M_transport4;
+        transport _M_transport6;
+
+        lookup* _M_lookups;
+        lookup* _M_free;
+        lookup* _M_active;
+
+        size_t _M_next_server;
+
+        uint64_t _M_random;
+
+        // Send the next try of the query (or complete it if there are no
+        // tries left).
+        void send_query(lookup* l, query* q);
+
+        // Complete query.
+        static void complete_query(query* q, int error);
+
+        // Has the lookup been completed?
+        static bool completed(const lookup* l);
+
+        // Finish lookup (call the callback).
+        void finish(lookup* l);
+
+        // Merge the answers of the queries of the lookup.
+        static void merge(const lookup* l, result& res);
+
+        // Process responses.
+        bool process_responses(transport* t);
+
+        // Process expired queries.
+        bool process_timeouts();
+
+        // Transport closed.
+        void closed(transport* t);
+
+        // Rearm the timeouts of the transports.
+        void rearm();
+
+        // Get transport of the address family.
+        transport* get_transport(sa_family_t family);
+
+        // Get name server of the current try.
+        const net::socket::address& nameserver(const query* q) const;
+
+        // Generate query identifier.
+        uint16_t random_id();
+
+        // Disable copy constructor and assignment operator.
+        resolver(const resolver&) = delete;
+        resolver& operator=(const resolver&) = delete;
+    };
+
+    inline resolver::config::config()
+      : resolv_conf(net::dns::resolv_conf::default_path),
+        hosts(net::dns::hosts::default_path),
+        timeout(0),
+        attempts(0),
+        max_lookups(default_max_lookups),
+        cache(nullptr)
+    {
+    }
+
+    inline bool resolver::create()
+    {
+      return create(config());
+    }
+
+    inline bool resolver::add_host(const char* name, const ip_address& addr)
+    {
+      return _M_hosts.add(name, addr);
+    }
+
+    inline net::async::event::dispatcher* resolver::get_dispatcher() const
+    {
+      return _M_dispatcher;
+    }
+
+    inline resolver::transport::transport(
+      net::async::event::dispatcher* dispatcher,
+      resolver* resolver,
+      sa_family_t family
+    )
+      : net::async::event::socket(dispatcher),
+        _M_resolver(resolver),
+        _M_family(family),
+        _M_open(false)
+    {
+    }
+
+    inline bool resolver::transport::opened() const
+    {
+      return _M_open;
+    }
+
+    inline bool resolver::transport::send_query(
+      const void* buf,
+      size_t len,
+      const net::socket::address& addr
+    )
+    {
+      // A datagram which can't be sent doesn't make the socket fail (the
+      // socket's sendto() would).
+      return (::sendto(handle(),
+                       buf,
+                       len,
+                       MSG_NOSIGNAL,
+                       static_cast<const struct sockaddr*>(addr),
+                       addr.size()) == static_cast<ssize_t>(len));
+    }
+
+    inline ssize_t resolver::transport::receive(void* buf,
+                                                size_t len,
+                                                net::socket::address& addr)
+    {
+      return recvfrom(buf, len, addr);
+    }
+
+    inline bool resolver::transport::failed() const
+    {
+      return error();
+    }
+
+    inline void resolver::transport::clear()
+    {
+      _M_open = false;
+      _M_resolver->closed(this);
+    }
+
+    inline bool resolver::transport::timeout()
+    {
+      return _M_resolver->process_timeouts();
+    }
+
+    inline bool resolver::transport::run()
+    {
+      return _M_resolver->process_responses(this);
+    }
+  }
+}
+
+#endif // NET_DNS_RESOLVER_H
@@ -14,6 +14,18 @@ namespace net {
   namespace event {
     typedef internal::event::watch watch;
 
+    // How the events of a watch are reported.
+    enum class trigger {
+      // When the descriptor becomes ready.
+      edge,
+
+      // While the descriptor is ready.
+      level,
+
+      // Once, until the descriptor is rearmed.
+      oneshot
+    };
+
     struct result {
       uint32_t readable:1;
       uint32_t writable:1;
@@ -23,12 +35,78 @@ namespace net {
       result();
     };
 
+    // Get the watch 'ev' with the trigger 't'.
+    watch with_trigger(watch ev, trigger t);
+
+    // Get the trigger of a watch.
+    trigger trigger_of(watch ev);
+
+    // Does the watch include readability / writability?
+    bool reads(watch ev);
+    bool writes(watch ev);
+
+    // Get the watch 'ev' without writability.
+    watch without_write(watch ev);
+
     inline result::result()
       : readable(0),
         writable(0),
         error(0)
     {
     }
+
+    inline watch with_trigger(watch ev, trigger t)
+    {
+      uint32_t bits = static_cast<uint32_t>(ev) &
+                      ~(internal::event::edge_bits |
+                        internal::event::level_bits |
+                        internal::event::oneshot_bits);
+
+      switch (t) {
+        case trigger::edge:
+          bits |= internal::event::edge_bits;
+          break;
+        case trigger::level:
+          bits |= internal::event::level_bits;
+          break;
+        case trigger::oneshot:
+          bits |= internal::event::oneshot_bits;
+          break;
+      }
+
+      return static_cast<watch>(bits);
+    }
+
+    inline trigger trigger_of(watch ev)
+    {
+      uint32_t bits = static_cast<uint32_t>(ev);
+
+      if (bits & internal::event::oneshot_bits) {
+        return trigger::oneshot;
+      } else if ((bits & (internal::event::edge_bits |
+                          internal::event::level_bits)) ==
+                 internal::event::edge_bits) {
+        return trigger::edge;
+      } else {
+        return trigger::level;
+      }
+    }
+
+    inline bool reads(watch ev)
+    {
+      return ((static_cast<uint32_t>(ev) & internal::event::read_bits) != 0);
+    }
+
+    inline bool writes(watch ev)
+    {
+      return ((static_cast<uint32_t>(ev) & internal::event::write_bits) != 0);
+    }
+
+    inline watch without_write(watch ev)
+    {
+      return static_cast<watch>(static_cast<uint32_t>(ev) &
+                                ~internal::event::write_bits);
+    }
   }
 }
 
@@ -0,0 +1,521 @@
+#include <string.h>
+#include <strings.h>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+#include "net/http/parser.h"
+
+namespace net {
+  namespace http {
+    // Token characters (RFC 7230, section 3.2.6).
+    static const uint8_t token[256] = {
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+      0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0
+    };
+
+    static inline bool is_token(char c)
+    {
+      return (token[static_cast<uint8_t>(c)] != 0);
+    }
+
+    static inline bool is_ctl(char c)
+    {
+      return ((static_cast<uint8_t>(c) < 0x20) || (c == 0x7f));
+    }
+
+    static inline int hex_value(char c)
+    {
+      if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+      } else if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+      } else if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+      } else {
+        return -1;
+      }
+    }
+
+    // Search the end of the headers ("\r\n\r\n").
+    static const char* find_headers_end(const char* p, const char* end)
+    {
+#if defined(__SSE2__)
+      const __m128i cr = _mm_set1_epi8('\r');
+
+      // Process 16 bytes at a time (a match at the last position of the
+      // block requires 3 more bytes).
+      while (end - p >= 19) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, cr));
+
+        while (mask != 0) {
+          const char* s = p + __builtin_ctz(mask);
+
+          if ((s[1] == '\n') && (s[2] == '\r') && (s[3] == '\n')) {
+            return s;
+          }
+
+          mask &= (mask - 1);
+        }
+
+        p += 16;
+      }
+#endif // defined(__SSE2__)
+
+      while (end - p >= 4) {
+        const char* s;
+        if ((s = static_cast<const char*>(memchr(p, '\r', end - p - 3))) !=
+            nullptr) {
+          if ((s[1] == '\n') && (s[2] == '\r') && (s[3] == '\n')) {
+            return s;
+          }
+
+          p = s + 1;
+        } else {
+          return nullptr;
+        }
+      }
+
+      return nullptr;
+    }
+
+    // Search the first control character (including HTAB).
+    // The search always stops inside the headers block, as it ends with
+    // "\r\n\r\n".
+    static const char* find_ctl(const char* p)
+    {
+#if defined(__SSE2__)
+      const __m128i space = _mm_set1_epi8(0x1f);
+      const __m128i del = _mm_set1_epi8(0x7f);
+
+      // Process byte by byte until the pointer is aligned.
+      while ((reinterpret_cast<uintptr_t>(p) & 15) != 0) {
+        if (is_ctl(*p)) {
+          return p;
+        }
+
+        p++;
+      }
+
+      // Aligned loads never cross a page boundary, reading some bytes past
+      // the end of the headers block is safe.
+      do {
+        __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(p));
+
+        unsigned mask = _mm_movemask_epi8(
+                          _mm_or_si128(
+                            _mm_cmpeq_epi8(_mm_min_epu8(v, space), v),
+                            _mm_cmpeq_epi8(v, del)
+                          )
+                        );
+
+        if (mask != 0) {
+          return p + __builtin_ctz(mask);
+        }
+
+        p += 16;
+      } while (true);
+#else
+      while (!is_ctl(*p)) {
+        p++;
+      }
+
+      return p;
+#endif // defined(__SSE2__)
+    }
+
+    static bool equal(const char* s1, size_t len1, const char* s2, size_t len2)
+    {
+      return ((len1 == len2) && (strncasecmp(s1, s2, len1) == 0));
+    }
+
+    const char* request::header(const char* name, size_t& len) const
+    {
+      size_t namelen = strlen(name);
+
+      for (size_t i = 0; i < _M_nheaders; i++) {
+        const field* f = &_M_headers[i];
+
+        if (equal(_M_base + f->name.off, f->name.len, name, namelen)) {
+          len = f->value.len;
+          return _M_base + f->value.off;
+        }
+      }
+
+      return nullptr;
+    }
+
+    parser::result parser::parse(char* buf, size_t len, request& req)
+    {
+      req._M_base = buf;
+
+      switch (_M_state) {
+        case state::headers:
+          {
+            // Search the end of the headers (starting from the last bytes
+            // processed, in case "\r\n\r\n" was split).
+            const char* end;
+            if ((end = find_headers_end(buf + ((_M_off > 3) ? _M_off - 3 : 0),
+                                        buf + len)) == nullptr) {
+              _M_off = len;
+              return result::incomplete;
+            }
+
+            _M_off = (end + 4) - buf;
+
+            // Parse headers.
+            if (!parse_headers(buf, _M_off, req)) {
+              return result::error;
+            }
+
+            req._M_body.off = static_cast<uint32_t>(_M_off);
+            req._M_body.len = 0;
+
+            if (_M_state == state::complete) {
+              return result::complete;
+            }
+          }
+
+          if (_M_state != state::body) {
+            return parse_chunked(buf, len, req);
+          }
+
+          // Fall through.
+        case state::body:
+          if (len - _M_off >= _M_length) {
+            req._M_body.len = static_cast<uint32_t>(_M_length);
+
+            _M_off += _M_length;
+
+            _M_state = state::complete;
+            return result::complete;
+          }
+
+          return result::incomplete;
+        case state::complete:
+          return result::complete;
+        default:
+          return parse_chunked(buf, len, req);
+      }
+    }
+
+    bool parser::parse_headers(const char* buf, size_t len, request& req)
+    {
+      const char* p = buf;
+      const char* end = buf + len;
+
+      // Method.
+      const char* q = p;
+      while (is_token(*q)) {
+        q++;
+      }
+
+      if ((q == p) || (*q != ' ')) {
+        return false;
+      }
+
+      req._M_method.off = 0;
+      req._M_method.len = static_cast<uint32_t>(q - p);
+
+      // Request target.
+      p = ++q;
+      while ((!is_ctl(*q)) && (*q != ' ')) {
+        q++;
+      }
+
+      if ((q == p) || (*q != ' ')) {
+        return false;
+      }
+
+      req._M_target.off = static_cast<uint32_t>(p - buf);
+      req._M_target.len = static_cast<uint32_t>(q - p);
+
+      // HTTP version.
+      p = ++q;
+      if ((end - p < 10) ||
+          (memcmp(p, "HTTP/1.", 7) != 0) ||
+          (p[7] < '0') ||
+          (p[7] > '9') ||
+          (p[8] != '\r') ||
+          (p[9] != '\n')) {
+        return false;
+      }
+
+      req._M_minor_version = p[7] - '0';
+      req._M_keep_alive = (req._M_minor_version > 0);
+      req._M_nheaders = 0;
+
+      bool content_length = false;
+      bool chunked = false;
+      uint64_t length = 0;
+
+      p += 10;
+
+      // Headers.
+      while (*p != '\r') {
+        // Header name.
+        q = p;
+        while (is_token(*q)) {
+          q++;
+        }
+
+        if ((q == p) ||
+            (*q != ':') ||
+            (req._M_nheaders == request::max_headers)) {
+          return false;
+        }
+
+        request::field* f = &req._M_headers[req._M_nheaders++];
+
+        f->name.off = static_cast<uint32_t>(p - buf);
+        f->name.len = static_cast<uint32_t>(q - p);
+
+        // Skip whitespace.
+        p = q + 1;
+        while ((*p == ' ') || (*p == '\t')) {
+          p++;
+        }
+
+        // Header value.
+        q = p;
+        while (*(q = find_ctl(q)) == '\t') {
+          q++;
+        }
+
+        if ((*q != '\r') || (q[1] != '\n')) {
+          return false;
+        }
+
+        const char* value = p;
+        p = q + 2;
+
+        // Remove trailing whitespace.
+        while ((q > value) && ((q[-1] == ' ') || (q[-1] == '\t'))) {
+          q--;
+        }
+
+        f->value.off = static_cast<uint32_t>(value - buf);
+        f->value.len = static_cast<uint32_t>(q - value);
+
+        const char* name = buf + f->name.off;
+
+        if (equal(name, f->name.len, "Content-Length", 14)) {
+          if ((q == value) || (q - value > 15)) {
+            return false;
+          }
+
+          uint64_t n = 0;
+          for (const char* s = value; s < q; s++) {
+            if ((*s >= '0') && (*s <= '9')) {
+              n = (n * 10) + (*s - '0');
+            } else {
+              return false;
+            }
+          }
+
+          // Several Content-Length headers with different values?
+          if ((content_length) && (n != length)) {
+            return false;
+          }
+
+          content_length = true;
+          length = n;
+        } else if (equal(name, f->name.len, "Transfer-Encoding", 17)) {
+          // Only the chunked transfer coding is supported.
+          if (!equal(value, q - value, "chunked", 7)) {
+            return false;
+          }
+
+          chunked = true;
+        } else if (equal(name, f->name.len, "Connection", 10)) {
+          // Check connection options.
+          const char* s = value;
+          while (s < q) {
+            const char* option = s;
+            while ((s < q) && (*s != ',')) {
+              s++;
+            }
+
+            const char* optionend = s++;
+
+            while ((option < optionend) &&
+                   ((*option == ' ') || (*option == '\t'))) {
+              option++;
+            }
+
+            while ((optionend > option) &&
+                   ((optionend[-1] == ' ') || (optionend[-1] == '\t'))) {
+              optionend--;
+            }
+
+            if (equal(option, optionend - option, "close", 5)) {
+              req._M_keep_alive = false;
+            } else if (equal(option, optionend - option, "keep-alive", 10)) {
+              req._M_keep_alive = true;
+            }
+          }
+        }
+      }
+
+      // Both Content-Length and Transfer-Encoding? (request smuggling).
+      if ((content_length) && (chunked)) {
+        return false;
+      }
+
+      if (chunked) {
+        _M_state = state::chunk_size;
+        _M_length = 0;
+        _M_ndigits = 0;
+      } else if (length > 0) {
+        _M_state = state::body;
+        _M_length = length;
+      } else {
+        _M_state = state::complete;
+      }
+
+      return true;
+    }
+
+    parser::result parser::parse_chunked(char* buf, size_t len, request& req)
+    {
+      while (_M_off < len) {
+        char c = buf[_M_off];
+
+        switch (_M_state) {
+          case state::chunk_size:
+            {
+              int n;
+              if ((n = hex_value(c)) >= 0) {
+                // Chunk too big?
+                if (++_M_ndigits > 15) {
+                  return result::error;
+                }
+
+                _M_length = (_M_length << 4) | n;
+              } else if (_M_ndigits == 0) {
+                return result::error;
+              } else if ((c == ';') || (c == ' ') || (c == '\t')) {
+                _M_state = state::chunk_extension;
+              } else if (c == '\r') {
+                _M_state = state::chunk_size_lf;
+              } else {
+                return result::error;
+              }
+
+              _M_off++;
+            }
+
+            break;
+          case state::chunk_extension:
+            // Ignore chunk extensions.
+            if (c == '\r') {
+              _M_state = state::chunk_size_lf;
+            } else if (c == '\n') {
+              return result::error;
+            }
+
+            _M_off++;
+            break;
+          case state::chunk_size_lf:
+            if (c != '\n') {
+              return result::error;
+            }
+
+            _M_off++;
+
+            _M_state = (_M_length > 0) ? state::chunk_data : state::trailer;
+            break;
+          case state::chunk_data:
+            {
+              size_t count = len - _M_off;
+              if (_M_length < count) {
+                count = static_cast<size_t>(_M_length);
+              }
+
+              // Decode in place.
+              memmove(buf + req._M_body.off + req._M_body.len,
+                      buf + _M_off,
+                      count);
+
+              req._M_body.len += static_cast<uint32_t>(count);
+
+              _M_off += count;
+
+              if ((_M_length -= count) == 0) {
+                _M_state = state::chunk_data_cr;
+              }
+            }
+
+            break;
+          case state::chunk_data_cr:
+            if (c != '\r') {
+              return result::error;
+            }
+
+            _M_off++;
+
+            _M_state = state::chunk_data_lf;
+            break;
+          case state::chunk_data_lf:
+            if (c != '\n') {
+              return result::error;
+            }
+
+            _M_off++;
+
+            _M_length = 0;
+            _M_ndigits = 0;
+
+            _M_state = state::chunk_size;
+            break;
+          case state::trailer:
+            // Empty line?
+            _M_state = (c == '\r') ? state::trailer_lf : state::trailer_line;
+
+            _M_off++;
+            break;
+          case state::trailer_line:
+            // Ignore trailer fields.
+            if (c == '\r') {
+              _M_state = state::trailer_line_lf;
+            } else if (c == '\n') {
+              return result::error;
+            }
+
+            _M_off++;
+            break;
+          case state::trailer_line_lf:
+            if (c != '\n') {
+              return result::error;
+            }
+
+            _M_off++;
+
+            _M_state = state::trailer;
+            break;
+          case state::trailer_lf:
+            if (c != '\n') {
+              return result::error;
+            }
+
+            _M_off++;
+
+            _M_state = state::complete;
+            return result::complete;
+          default:
+            return result::error;
+        }
+      }
+
+      return result::incomplete;
+    }
+  }
+}
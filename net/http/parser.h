@@ -0,0 +1,240 @@
+#ifndef NET_HTTP_PARSER_H
+#define NET_HTTP_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace net {
+  namespace http {
+    // Forward declaration.
+    class parser;
+
+    class request {
+      friend class parser;
+
+      public:
+        static const size_t max_headers = 32;
+
+        // Constructor.
+        request();
+
+        // Get method.
+        const char* method(size_t& len) const;
+
+        // Get request target.
+        const char* target(size_t& len) const;
+
+        // Get minor version (HTTP/1.<minor version>).
+        unsigned minor_version() const;
+
+        // Get number of headers.
+        size_t number_headers() const;
+
+        // Get header by index.
+        bool header(size_t idx,
+                    const char*& name,
+                    size_t& namelen,
+                    const char*& value,
+                    size_t& valuelen) const;
+
+        // Get header by name (case-insensitive).
+        const char* header(const char* name, size_t& len) const;
+
+        // Get body.
+        // If the request used the chunked transfer coding, the body has
+        // already been decoded.
+        const char* body(size_t& len) const;
+
+        // Keep-alive?
+        bool keep_alive() const;
+
+      private:
+        struct string {
+          uint32_t off;
+          uint32_t len;
+        };
+
+        struct field {
+          string name;
+          string value;
+        };
+
+        // Beginning of the request.
+        const char* _M_base;
+
+        string _M_method;
+        string _M_target;
+        unsigned _M_minor_version;
+
+        field _M_headers[max_headers];
+        size_t _M_nheaders;
+
+        string _M_body;
+
+        bool _M_keep_alive;
+
+        // Clear.
+        void clear();
+    };
+
+    class parser {
+      public:
+        enum class result {
+          incomplete,
+          complete,
+          error
+        };
+
+        // Constructor.
+        parser();
+
+        // Reset parser (to parse a new request).
+        void reset();
+
+        // Parse request.
+        // 'buf' points to the beginning of the request and 'len' is the
+        // number of bytes received so far. The parser doesn't copy any data,
+        // the request refers to 'buf'.
+        // The buffer might be moved between calls (the request stores
+        // offsets), but its content must be preserved.
+        // The data of chunked bodies is decoded in place.
+        result parse(char* buf, size_t len, request& req);
+
+        // Get size of the complete request (headers and body, as received).
+        size_t size() const;
+
+      private:
+        enum class state {
+          headers,
+          body,
+          chunk_size,
+          chunk_extension,
+          chunk_size_lf,
+          chunk_data,
+          chunk_data_cr,
+          chunk_data_lf,
+          trailer,
+          trailer_line,
+          trailer_line_lf,
+          trailer_lf,
+          complete
+        };
+
+        state _M_state;
+
+        // Number of bytes processed.
+        size_t _M_off;
+
+        // Content length / size of the current chunk.
+        uint64_t _M_length;
+
+        // Number of digits of the size of the current chunk.
+        unsigned _M_ndigits;
+
+        // Parse headers.
+        bool parse_headers(const char* buf, size_t len, request& req);
+
+        // Parse chunked body.
+        result parse_chunked(char* buf, size_t len, request& req);
+    };
+
+    inline request::request()
+    {
+      clear();
+    }
+
+    inline const char* request::method(size_t& len) const
+    {
+      len = _M_method.len;
+      return _M_base + _M_method.off;
+    }
+
+    inline const char* request::target(size_t& len) const
+    {
+      len = _M_target.len;
+      return _M_base + _M_target.off;
+    }
+
+    inline unsigned request::minor_version() const
+    {
+      return _M_minor_version;
+    }
+
+    inline size_t request::number_headers() const
+    {
+      return _M_nheaders;
+    }
+
+    inline bool request::header(size_t idx,
+                                const char*& name,
+                                size_t& namelen,
+                                const char*& value,
+                                size_t& valuelen) const
+    {
+      if (idx < _M_nheaders) {
+        const field* f = &_M_headers[idx];
+
+        name = _M_base + f->name.off;
+        namelen = f->name.len;
+
+        value = _M_base + f->value.off;
+        valuelen = f->value.len;
+
+        return true;
+      }
+
+      return false;
+    }
+
+    inline const char* request::body(size_t& len) const
+    {
+      len = _M_body.len;
+      return _M_base + _M_body.off;
+    }
+
+    inline bool request::keep_alive() const
+    {
+      return _M_keep_alive;
+    }
+
+    inline void request::clear()
+    {
+      _M_base = nullptr;
+
+      _M_method.off = 0;
+      _M_method.len = 0;
+
+      _M_target.off = 0;
+      _M_target.len = 0;
+
+      _M_minor_version = 1;
+
+      _M_nheaders = 0;
+
+      _M_body.off = 0;
+      _M_body.len = 0;
+
+      _M_keep_alive = true;
+    }
+
+    inline parser::parser()
+    {
+      reset();
+    }
+
+    inline void parser::reset()
+    {
+      _M_state = state::headers;
+      _M_off = 0;
+      _M_length = 0;
+      _M_ndigits = 0;
+    }
+
+    inline size_t parser::size() const
+    {
+      return _M_off;
+    }
+  }
+}
+
+#endif // NET_HTTP_PARSER_H
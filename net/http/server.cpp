@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include "net/http/server.h"
+
+namespace net {
+  namespace http {
+    // Get reason phrase.
+    static const char* reason_phrase(unsigned status)
+    {
+      switch (status) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 413: return "Payload Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default:  return "Unknown";
+      }
+    }
+
+    bool connection::run()
+    {
+      do {
+        // Process requests.
+        if ((!_M_close) && (!process())) {
+          return false;
+        }
+
+        // If the connection has to be closed...
+        if (_M_close) {
+          return close_gracefully();
+        }
+
+        // If there are too many responses pending to be sent...
+        if (pending() > write_buffer_size / 2) {
+          if (!flush()) {
+            return false;
+          }
+
+          // If not all the data could be sent, wait for the socket to be
+          // writable.
+          if (pending() > write_buffer_size / 2) {
+            return true;
+          }
+
+          // There might be more requests in the buffer.
+          continue;
+        }
+
+        if (!readable()) {
+          return true;
+        }
+
+        // Receive.
+        ssize_t ret;
+        if ((ret = recv(_M_buf + _M_end, buffer_size - _M_end)) > 0) {
+          _M_end += ret;
+        } else if (ret == 0) {
+          // Connection closed by peer.
+          return false;
+        } else {
+          return !error();
+        }
+      } while (true);
+    }
+
+    bool connection::close_gracefully()
+    {
+      if (!_M_shutdown) {
+        if (!flush()) {
+          return false;
+        }
+
+        // If not all the data could be sent, wait for the socket to be
+        // writable.
+        if (pending() > 0) {
+          return true;
+        }
+
+        // Closing a socket with unread data (e.g. pipelined requests or a
+        // request body) sends a RST, which might discard the responses the
+        // client hasn't read yet: shut down the write side and discard the
+        // input until the client closes the connection (or for up to
+        // 'linger_timeout' milliseconds).
+        if (!shutdown(net::socket::shutdown_how::write)) {
+          return false;
+        }
+
+        _M_shutdown = true;
+
+        set_lifetime(linger_timeout);
+      }
+
+      while (readable()) {
+        ssize_t ret;
+        if ((ret = recv(_M_buf, buffer_size)) == 0) {
+          // Connection closed by peer.
+          return false;
+        } else if (ret < 0) {
+          return !error();
+        }
+      }
+
+      return true;
+    }
+
+    bool connection::respond(unsigned status,
+                             const char* content_type,
+                             const void* body,
+                             size_t len)
+    {
+      char length[32];
+      snprintf(length, sizeof(length), "Content-Length: %zu\r\n", len);
+
+      return ((send_header(status, content_type, length)) &&
+              ((_M_head) || (len == 0) || (send_all(body, len))));
+    }
+
+    bool connection::begin_chunked_response(unsigned status,
+                                            const char* content_type)
+    {
+      // HTTP/1.0 clients don't support the chunked transfer coding, the end
+      // of the body is signaled by closing the connection.
+      if (_M_request.minor_version() == 0) {
+        _M_keep_alive = false;
+        _M_chunked = false;
+
+        return send_header(status, content_type, "");
+      }
+
+      _M_chunked = true;
+
+      return send_header(status,
+                         content_type,
+                         "Transfer-Encoding: chunked\r\n");
+    }
+
+    bool connection::send_chunk(const void* buf, size_t len)
+    {
+      if ((_M_head) || (len == 0)) {
+        return true;
+      }
+
+      if (!_M_chunked) {
+        return send_all(buf, len);
+      }
+
+      char size[32];
+      size_t sizelen = snprintf(size, sizeof(size), "%zx\r\n", len);
+
+      return ((sizelen + len + 2 <= write_buffer_size - pending()) &&
+              (send_all(size, sizelen)) &&
+              (send_all(buf, len)) &&
+              (send_all("\r\n", 2)));
+    }
+
+    bool connection::end_chunked_response()
+    {
+      if ((_M_head) || (!_M_chunked)) {
+        return true;
+      }
+
+      _M_chunked = false;
+
+      return send_all("0\r\n\r\n", 5);
+    }
+
+    bool connection::process()
+    {
+      while (_M_begin < _M_end) {
+        switch (_M_parser.parse(_M_buf + _M_begin,
+                                _M_end - _M_begin,
+                                _M_request)) {
+          case parser::result::complete:
+            {
+              size_t len;
+              const char* method = _M_request.method(len);
+
+              _M_keep_alive = _M_request.keep_alive();
+              _M_head = ((len == 4) && (memcmp(method, "HEAD", 4) == 0));
+              _M_chunked = false;
+
+              // Process request.
+              if (!_M_server->process(_M_request, *this)) {
+                return false;
+              }
+
+              // Skip request.
+              if ((_M_begin += _M_parser.size()) == _M_end) {
+                _M_begin = 0;
+                _M_end = 0;
+              }
+
+              _M_parser.reset();
+
+              if (!_M_keep_alive) {
+                _M_close = true;
+                return true;
+              }
+
+              // If there are too many responses pending to be sent...
+              if (pending() > write_buffer_size / 2) {
+                return true;
+              }
+            }
+
+            break;
+          case parser::result::incomplete:
+            // If the buffer is full...
+            if (_M_end == buffer_size) {
+              if (_M_begin > 0) {
+                // Move the request to the beginning of the buffer.
+                memmove(_M_buf, _M_buf + _M_begin, _M_end - _M_begin);
+
+                _M_end -= _M_begin;
+                _M_begin = 0;
+              } else {
+                // Request too large.
+                _M_keep_alive = false;
+                _M_head = false;
+                _M_close = true;
+
+                return respond(413, "text/plain", "Payload Too Large\n", 18);
+              }
+            }
+
+            return true;
+          case parser::result::error:
+            _M_keep_alive = false;
+            _M_head = false;
+            _M_close = true;
+
+            return respond(400, "text/plain", "Bad Request\n", 12);
+        }
+      }
+
+      return true;
+    }
+
+    bool connection::send_header(unsigned status,
+                                 const char* content_type,
+                                 const char* length)
+    {
+      char header[512];
+      int len = snprintf(header,
+                         sizeof(header),
+                         "HTTP/1.1 %u %s\r\n"
+                         "Date: %s\r\n"
+                         "Content-Type: %s\r\n"
+                         "%s"
+                         "%s"
+                         "\r\n",
+                         status,
+                         reason_phrase(status),
+                         _M_server->date(),
+                         content_type,
+                         length,
+                         _M_keep_alive ? "" : "Connection: close\r\n");
+
+      return ((len > 0) &&
+              (static_cast<size_t>(len) < sizeof(header)) &&
+              (send_all(header, len)));
+    }
+
+    server::~server()
+    {
+      // Delete connections in use.
+      connection* conn = _M_used_connections;
+
+      while (conn) {
+        connection* next = conn->_M_next;
+
+        delete conn;
+        conn = next;
+      }
+
+      // Delete free connections.
+      conn = _M_free_connections;
+
+      while (conn) {
+        connection* next = conn->_M_next;
+
+        delete conn;
+        conn = next;
+      }
+    }
+
+    bool server::run()
+    {
+      do {
+        // If there is a free connection...
+        connection* conn;
+        if (_M_free_connections) {
+          conn = _M_free_connections;
+          unlink_node(_M_free_connections, conn);
+        } else {
+          if ((conn = new (std::nothrow) connection(this)) == nullptr) {
+            return false;
+          }
+        }
+
+        // Accept connection (idle connections are closed after
+        // '_M_keep_alive_timeout' milliseconds).
+        if (!accept(*conn, _M_keep_alive_timeout)) {
+          // Add connection to the free list.
+          link_node(_M_free_connections, conn);
+
+          return !error();
+        }
+
+        link_node(_M_used_connections, conn);
+
+        // Enable write coalescing (pipelined responses are sent with a
+        // single system call).
+        conn->enable_write_coalescing(connection::write_buffer_size);
+      } while (true);
+    }
+
+    const char* server::date()
+    {
+      time_t now = ::time(nullptr);
+
+      if (now != _M_date_time) {
+        struct tm tm;
+        gmtime_r(&now, &tm);
+
+        strftime(_M_date,
+                 sizeof(_M_date),
+                 "%a, %d %b %Y %H:%M:%S GMT",
+                 &tm);
+
+        _M_date_time = now;
+      }
+
+      return _M_date;
+    }
+  }
+}
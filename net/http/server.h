@@ -0,0 +1,235 @@
+#ifndef NET_HTTP_SERVER_H
+#define NET_HTTP_SERVER_H
+
+#if defined(USE_SOCKET_TEMPLATE)
+  #error "The HTTP server requires the virtual socket interface."
+#endif
+
+#include <time.h>
+#include "net/async/event/socket.h"
+#include "net/http/parser.h"
+
+namespace net {
+  namespace http {
+    // Forward declaration.
+    class server;
+
+    class connection : public net::async::event::socket {
+      friend class server;
+
+      public:
+        // Size of the buffer for the requests (maximum request size).
+        static const size_t buffer_size = 8 * 1024;
+
+        // Size of the write buffer (maximum size of the responses pending to
+        // be sent).
+        static const size_t write_buffer_size = 64 * 1024;
+
+        // Maximum time to wait for the client to close the connection once
+        // the last response has been sent (milliseconds).
+        static const int linger_timeout = 2 * 1000;
+
+        // Constructor.
+        connection(server* server);
+
+        // Destructor.
+        ~connection() = default;
+
+        // Clear.
+        void clear();
+
+        // Timeout.
+        bool timeout();
+
+        // Run.
+        bool run();
+
+        // Send response.
+        bool respond(unsigned status,
+                     const char* content_type,
+                     const void* body,
+                     size_t len);
+
+        // Send response using the chunked transfer coding.
+        bool begin_chunked_response(unsigned status, const char* content_type);
+        bool send_chunk(const void* buf, size_t len);
+        bool end_chunked_response();
+
+      private:
+        server* _M_server;
+
+        char _M_buf[buffer_size];
+        size_t _M_begin;
+        size_t _M_end;
+
+        parser _M_parser;
+        request _M_request;
+
+        // Current request.
+        bool _M_keep_alive;
+        bool _M_head;
+        bool _M_chunked;
+
+        // Close connection once the pending data has been sent?
+        bool _M_close;
+
+        // Has the write side been shut down (the input is being discarded
+        // until the client closes the connection)?
+        bool _M_shutdown;
+
+        connection* _M_prev;
+        connection* _M_next;
+
+        // Process requests.
+        bool process();
+
+        // Close the connection gracefully once the pending data has been
+        // sent.
+        bool close_gracefully();
+
+        // Send response header.
+        bool send_header(unsigned status,
+                         const char* content_type,
+                         const char* length);
+
+        // Send data (all or nothing).
+        bool send_all(const void* buf, size_t len);
+
+        // Initialize.
+        void reset();
+    };
+
+    class server : public net::async::event::socket {
+      friend class connection;
+
+      public:
+        static const unsigned default_keep_alive_timeout = 30 * 1000;
+
+        // Constructor.
+        server(net::async::event::dispatcher* dispatcher,
+               unsigned keep_alive_timeout = default_keep_alive_timeout);
+
+        // Destructor.
+        virtual ~server();
+
+        // Process request.
+        // The response has to be sent using the methods of 'conn'.
+        // Return false if the connection should be closed.
+        virtual bool process(const request& req, connection& conn) = 0;
+
+        // Run.
+        bool run();
+
+      private:
+        unsigned _M_keep_alive_timeout;
+
+        connection* _M_used_connections;
+        connection* _M_free_connections;
+
+        // Cached "Date" header value.
+        char _M_date[32];
+        time_t _M_date_time;
+
+        // Get value of the "Date" header.
+        const char* date();
+
+        // Free connection.
+        void free_connection(connection* conn);
+
+        static void unlink_node(connection*& list, connection* conn);
+        static void link_node(connection*& list, connection* conn);
+    };
+
+    inline connection::connection(server* server)
+      : _M_server(server),
+        _M_prev(nullptr),
+        _M_next(nullptr)
+    {
+      reset();
+    }
+
+    inline void connection::clear()
+    {
+      reset();
+
+      _M_server->free_connection(this);
+    }
+
+    inline bool connection::timeout()
+    {
+      // Close idle connection.
+      return false;
+    }
+
+    inline bool connection::send_all(const void* buf, size_t len)
+    {
+      // Check whether there is space in the write buffer.
+      if (len <= write_buffer_size - pending()) {
+        return (send(buf, len) == static_cast<ssize_t>(len));
+      }
+
+      return false;
+    }
+
+    inline void connection::reset()
+    {
+      _M_begin = 0;
+      _M_end = 0;
+
+      _M_parser.reset();
+
+      _M_keep_alive = true;
+      _M_head = false;
+      _M_chunked = false;
+      _M_close = false;
+      _M_shutdown = false;
+    }
+
+    inline server::server(net::async::event::dispatcher* dispatcher,
+                          unsigned keep_alive_timeout)
+      : net::async::event::socket(dispatcher),
+        _M_keep_alive_timeout(keep_alive_timeout),
+        _M_used_connections(nullptr),
+        _M_free_connections(nullptr),
+        _M_date_time(0)
+    {
+      *_M_date = 0;
+    }
+
+    inline void server::free_connection(connection* conn)
+    {
+      unlink_node(_M_used_connections, conn);
+      link_node(_M_free_connections, conn);
+    }
+
+    inline void server::unlink_node(connection*& list, connection* conn)
+    {
+      if (conn->_M_prev) {
+        conn->_M_prev->_M_next = conn->_M_next;
+      } else {
+        list = list->_M_next;
+      }
+
+      if (conn->_M_next) {
+        conn->_M_next->_M_prev = conn->_M_prev;
+        conn->_M_next = nullptr;
+      }
+
+      conn->_M_prev = nullptr;
+    }
+
+    inline void server::link_node(connection*& list, connection* conn)
+    {
+      if (list) {
+        list->_M_prev = conn;
+      }
+
+      conn->_M_prev = nullptr;
+      conn->_M_next = list;
+
+      list = conn;
+    }
+  }
+}
+
+#endif // NET_HTTP_SERVER_H
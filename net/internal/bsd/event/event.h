@@ -7,10 +7,32 @@
 namespace net {
   namespace internal {
     namespace event {
+      // Bits of a watch (the trigger bits are translated to kevent flags
+      // by the selector).
+      static const uint32_t read_bits = POLLIN;
+      static const uint32_t write_bits = POLLOUT;
+      static const uint32_t edge_bits = 0;
+      static const uint32_t level_bits = 1u << 16;
+      static const uint32_t oneshot_bits = 1u << 17;
+
       enum class watch : uint32_t {
-        read       = POLLIN,
-        write      = POLLOUT,
-        read_write = POLLIN | POLLOUT
+        // Edge-triggered (EV_CLEAR).
+        read       = read_bits,
+        write      = write_bits,
+        read_write = read_bits | write_bits,
+
+        // Level-triggered.
+        read_level       = read_bits | level_bits,
+        write_level      = write_bits | level_bits,
+        read_write_level = read_bits | write_bits | level_bits,
+
+        // One-shot (EV_DISPATCH): after an event has been reported the
+        // filter is disabled until it is rearmed with selector::modify()
+        // (then the event is reported again if the descriptor is still
+        // ready).
+        read_oneshot       = read_bits | oneshot_bits,
+        write_oneshot      = write_bits | oneshot_bits,
+        read_write_oneshot = read_bits | write_bits | oneshot_bits
       };
     }
   }
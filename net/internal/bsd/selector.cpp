@@ -1,68 +1,30 @@
 #include "net/internal/bsd/selector.h"
 
+static unsigned short trigger_flags(net::event::watch ev);
+
+static void set(struct kevent* event,
+                int fd,
+                short filter,
+                unsigned short flags,
+                void* data);
+
 bool net::internal::selector::add(int fd, event::watch ev, void* data)
 {
   struct kevent events[2];
   unsigned nevents = 0;
 
-  switch (ev) {
-    case event::watch::read:
-#if !defined(__NetBSD__)
-      EV_SET(&events[0], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, data);
-#else
-      EV_SET(&events[0],
-             fd,
-             EVFILT_READ,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             reinterpret_cast<intptr_t>(data));
-#endif
-
-      nevents = 1;
-      break;
-    case event::watch::write:
-#if !defined(__NetBSD__)
-      EV_SET(&events[0], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, data);
-#else
-      EV_SET(&events[0],
-             fd,
-             EVFILT_WRITE,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             reinterpret_cast<intptr_t>(data));
-#endif
+  unsigned short flags = EV_ADD | trigger_flags(ev);
 
-      nevents = 1;
-      break;
-    case event::watch::read_write:
-#if !defined(__NetBSD__)
-      EV_SET(&events[0], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, data);
-      EV_SET(&events[1], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, data);
-#else
-      EV_SET(&events[0],
-             fd,
-             EVFILT_READ,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             reinterpret_cast<intptr_t>(data));
-
-      EV_SET(&events[1],
-             fd,
-             EVFILT_WRITE,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             reinterpret_cast<intptr_t>(data));
-#endif
+  if (net::event::reads(ev)) {
+    set(&events[nevents++], fd, EVFILT_READ, flags, data);
+  }
 
-      nevents = 2;
-      break;
+  if (net::event::writes(ev)) {
+    set(&events[nevents++], fd, EVFILT_WRITE, flags, data);
   }
 
-  return (kevent(_M_fd, events, nevents, nullptr, 0, nullptr) == 0);
+  return ((nevents == 0) ||
+          (kevent(_M_fd, events, nevents, nullptr, 0, nullptr) == 0));
 }
 
 bool net::internal::selector::remove(int fd, event::watch ev)
@@ -70,39 +32,16 @@ bool net::internal::selector::remove(int fd, event::watch ev)
   struct kevent events[2];
   unsigned nevents = 0;
 
-  switch (ev) {
-    case event::watch::read:
-#if !defined(__NetBSD__)
-      EV_SET(&events[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
-#else
-      EV_SET(&events[0], fd, EVFILT_READ, EV_DELETE, 0, 0, 0);
-#endif
-
-      nevents = 1;
-      break;
-    case event::watch::write:
-#if !defined(__NetBSD__)
-      EV_SET(&events[0], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
-#else
-      EV_SET(&events[0], fd, EVFILT_WRITE, EV_DELETE, 0, 0, 0);
-#endif
-
-      nevents = 1;
-      break;
-    case event::watch::read_write:
-#if !defined(__NetBSD__)
-      EV_SET(&events[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
-      EV_SET(&events[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
-#else
-      EV_SET(&events[0], fd, EVFILT_READ, EV_DELETE, 0, 0, 0);
-      EV_SET(&events[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, 0);
-#endif
+  if (net::event::reads(ev)) {
+    set(&events[nevents++], fd, EVFILT_READ, EV_DELETE, nullptr);
+  }
 
-      nevents = 2;
-      break;
+  if (net::event::writes(ev)) {
+    set(&events[nevents++], fd, EVFILT_WRITE, EV_DELETE, nullptr);
   }
 
-  return (kevent(_M_fd, events, nevents, nullptr, 0, nullptr) == 0);
+  return ((nevents == 0) ||
+          (kevent(_M_fd, events, nevents, nullptr, 0, nullptr) == 0));
 }
 
 bool net::internal::selector::modify(int fd,
@@ -110,123 +49,50 @@ bool net::internal::selector::modify(int fd,
                                      event::watch newev,
                                      void* data)
 {
-  if (oldev == newev) {
-    return add(fd, newev, data);
-  }
-
-  struct kevent events[4];
+  struct kevent events[2];
   unsigned nevents = 0;
 
-  switch (oldev) {
-    case event::watch::read:
-#if !defined(__NetBSD__)
-      EV_SET(&events[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
-#else
-      EV_SET(&events[0], fd, EVFILT_READ, EV_DELETE, 0, 0, 0);
-#endif
+  // Adding a filter which already exists updates it and enables it again
+  // (one-shot).
+  unsigned short flags = EV_ADD | trigger_flags(newev);
 
-      nevents = 1;
-      break;
-    case event::watch::write:
-#if !defined(__NetBSD__)
-      EV_SET(&events[0], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
-#else
-      EV_SET(&events[0], fd, EVFILT_WRITE, EV_DELETE, 0, 0, 0);
-#endif
-
-      nevents = 1;
-      break;
-    case event::watch::read_write:
-#if !defined(__NetBSD__)
-      EV_SET(&events[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
-      EV_SET(&events[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
-#else
-      EV_SET(&events[0], fd, EVFILT_READ, EV_DELETE, 0, 0, 0);
-      EV_SET(&events[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, 0);
-#endif
+  if (net::event::reads(newev)) {
+    set(&events[nevents++], fd, EVFILT_READ, flags, data);
+  } else if (net::event::reads(oldev)) {
+    set(&events[nevents++], fd, EVFILT_READ, EV_DELETE, nullptr);
+  }
 
-      nevents = 2;
-      break;
+  if (net::event::writes(newev)) {
+    set(&events[nevents++], fd, EVFILT_WRITE, flags, data);
+  } else if (net::event::writes(oldev)) {
+    set(&events[nevents++], fd, EVFILT_WRITE, EV_DELETE, nullptr);
   }
 
-  switch (newev) {
-    case event::watch::read:
-#if !defined(__NetBSD__)
-      EV_SET(&events[nevents++],
-             fd,
-             EVFILT_READ,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             data);
-#else
-      EV_SET(&events[nevents++],
-             fd,
-             EVFILT_READ,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             reinterpret_cast<intptr_t>(data));
-#endif
+  return ((nevents == 0) ||
+          (kevent(_M_fd, events, nevents, nullptr, 0, nullptr) == 0));
+}
 
-      break;
-    case event::watch::write:
-#if !defined(__NetBSD__)
-      EV_SET(&events[nevents++],
-             fd,
-             EVFILT_WRITE,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             data);
-#else
-      EV_SET(&events[nevents++],
-             fd,
-             EVFILT_WRITE,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             reinterpret_cast<intptr_t>(data));
-#endif
+unsigned short trigger_flags(net::event::watch ev)
+{
+  switch (net::event::trigger_of(ev)) {
+    case net::event::trigger::edge:
+      return EV_CLEAR;
+    case net::event::trigger::oneshot:
+      return EV_DISPATCH;
+    default:
+      return 0;
+  }
+}
 
-      break;
-    case event::watch::read_write:
+void set(struct kevent* event,
+         int fd,
+         short filter,
+         unsigned short flags,
+         void* data)
+{
 #if !defined(__NetBSD__)
-      EV_SET(&events[nevents++],
-             fd,
-             EVFILT_READ,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             data);
-
-      EV_SET(&events[nevents++],
-             fd,
-             EVFILT_WRITE,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             data);
+  EV_SET(event, fd, filter, flags, 0, 0, data);
 #else
-      EV_SET(&events[nevents++],
-             fd,
-             EVFILT_READ,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             reinterpret_cast<intptr_t>(data));
-
-      EV_SET(&events[nevents++],
-             fd,
-             EVFILT_WRITE,
-             EV_ADD | EV_CLEAR,
-             0,
-             0,
-             reinterpret_cast<intptr_t>(data));
+  EV_SET(event, fd, filter, flags, 0, 0, reinterpret_cast<intptr_t>(data));
 #endif
-
-      break;
-  }
-
-  return (kevent(_M_fd, events, nevents, nullptr, 0, nullptr) == 0);
 }
@@ -2,6 +2,7 @@
 #define NET_INTERNAL_BSD_SELECTOR_H
 
 #include <unistd.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <sys/event.h>
 #include "net/event/event.h"
@@ -10,7 +11,8 @@ namespace net {
   namespace internal {
     class selector {
       public:
-        static const size_t max_events = 1024;
+        // Default number of events returned by a single wait.
+        static const size_t default_max_events = 256;
 
         // Constructor.
         selector();
@@ -19,7 +21,25 @@ namespace net {
         ~selector();
 
         // Create.
-        bool create();
+        // 'max_events' is the maximum number of events returned by a single
+        // wait.
+        bool create(size_t max_events = default_max_events);
+
+        // Create a selector which shares the kernel object of 'other' (the
+        // descriptors added to one of them are watched by both), with its
+        // own events.
+        bool create(const selector& other,
+                    size_t max_events = default_max_events);
+
+        // Get handle.
+        int handle() const;
+
+        // Get the maximum number of events returned by a single wait.
+        size_t max_events() const;
+
+        // Set the maximum number of events returned by a single wait.
+        // The results of the last wait are lost.
+        bool resize(size_t max_events);
 
         // Add.
         bool add(int fd, event::watch ev, void* data);
@@ -30,20 +50,33 @@ namespace net {
         // Modify.
         bool modify(int fd, event::watch oldev, event::watch newev, void* data);
 
-        // Wait.
+        // Wait ('timeout' in milliseconds, -1: no timeout).
         int wait(int timeout);
 
+        // Wait with a timeout of nanosecond resolution.
+        int wait(const struct timespec& timeout);
+
         // Get result event.
         void get(size_t i, net::event::result& ev, void*& data) const;
 
+        // Get the data of a result event.
+        void* data(size_t i) const;
+
       private:
         int _M_fd;
 
-        struct kevent _M_events[max_events];
+        // Events returned by wait().
+        struct kevent* _M_events;
+        size_t _M_max_events;
+
+        // Allocate events.
+        static struct kevent* allocate(size_t max_events);
     };
 
     inline selector::selector()
-      : _M_fd(-1)
+      : _M_fd(-1),
+        _M_events(nullptr),
+        _M_max_events(0)
     {
     }
 
@@ -52,18 +85,90 @@ namespace net {
       if (_M_fd != -1) {
         close(_M_fd);
       }
+
+      if (_M_events) {
+        munmap(_M_events, _M_max_events * sizeof(struct kevent));
+      }
+    }
+
+    inline bool selector::create(size_t max_events)
+    {
+      // Allocate events.
+      if ((max_events > 0) &&
+          ((_M_events = allocate(max_events)) != nullptr)) {
+        _M_max_events = max_events;
+
+        // Create event queue.
+        if ((_M_fd = kqueue()) != -1) {
+          return true;
+        }
+
+        munmap(_M_events, _M_max_events * sizeof(struct kevent));
+        _M_events = nullptr;
+        _M_max_events = 0;
+      }
+
+      return false;
+    }
+
+    inline bool selector::create(const selector& other, size_t max_events)
+    {
+      // Allocate events.
+      if ((max_events > 0) &&
+          ((_M_events = allocate(max_events)) != nullptr)) {
+        _M_max_events = max_events;
+
+        // Duplicate the descriptor of the other selector.
+        if ((_M_fd = dup(other._M_fd)) != -1) {
+          return true;
+        }
+
+        munmap(_M_events, _M_max_events * sizeof(struct kevent));
+        _M_events = nullptr;
+        _M_max_events = 0;
+      }
+
+      return false;
+    }
+
+    inline int selector::handle() const
+    {
+      return _M_fd;
     }
 
-    inline bool selector::create()
+    inline size_t selector::max_events() const
     {
-      // Create event queue.
-      return ((_M_fd = kqueue()) != -1);
+      return _M_max_events;
+    }
+
+    inline bool selector::resize(size_t max_events)
+    {
+      struct kevent* events;
+      if ((max_events > 0) && ((events = allocate(max_events)) != nullptr)) {
+        munmap(_M_events, _M_max_events * sizeof(struct kevent));
+
+        _M_events = events;
+        _M_max_events = max_events;
+
+        return true;
+      }
+
+      return false;
     }
 
     inline int selector::wait(int timeout)
     {
+      if (timeout < 0) {
+        return kevent(_M_fd, nullptr, 0, _M_events, _M_max_events, nullptr);
+      }
+
       struct timespec ts = {timeout / 1000, (timeout % 1000) * 1000000};
-      return kevent(_M_fd, nullptr, 0, _M_events, max_events, &ts);
+      return kevent(_M_fd, nullptr, 0, _M_events, _M_max_events, &ts);
+    }
+
+    inline int selector::wait(const struct timespec& timeout)
+    {
+      return kevent(_M_fd, nullptr, 0, _M_events, _M_max_events, &timeout);
     }
 
     inline void selector::get(size_t i,
@@ -85,6 +190,27 @@ namespace net {
 
       data = reinterpret_cast<void*>(_M_events[i].udata);
     }
+
+    inline void* selector::data(size_t i) const
+    {
+      return reinterpret_cast<void*>(_M_events[i].udata);
+    }
+
+    inline struct kevent* selector::allocate(size_t max_events)
+    {
+      // The events are allocated with mmap(), so that the pages are
+      // allocated when the dispatcher's thread touches them for the first
+      // time, on its NUMA node.
+      void* events = mmap(nullptr,
+                          max_events * sizeof(struct kevent),
+                          PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS,
+                          -1,
+                          0);
+
+      return (events != MAP_FAILED) ? static_cast<struct kevent*>(events) :
+                                      nullptr;
+    }
   }
 }
 
@@ -8,10 +8,30 @@ namespace net {
   namespace internal {
     namespace event {
       enum class watch : uint32_t {
+        // Edge-triggered.
         read       = EPOLLIN | EPOLLRDHUP | EPOLLET,
         write      = EPOLLOUT | EPOLLET,
-        read_write = EPOLLIN | EPOLLRDHUP | EPOLLOUT | EPOLLET
+        read_write = EPOLLIN | EPOLLRDHUP | EPOLLOUT | EPOLLET,
+
+        // Level-triggered.
+        read_level       = EPOLLIN | EPOLLRDHUP,
+        write_level      = EPOLLOUT,
+        read_write_level = EPOLLIN | EPOLLRDHUP | EPOLLOUT,
+
+        // One-shot: after an event has been reported the descriptor is
+        // disabled until it is rearmed with selector::modify() (then the
+        // event is reported again if the descriptor is still ready).
+        read_oneshot       = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT,
+        write_oneshot      = EPOLLOUT | EPOLLONESHOT,
+        read_write_oneshot = EPOLLIN | EPOLLRDHUP | EPOLLOUT | EPOLLONESHOT
       };
+
+      // Bits of a watch.
+      static const uint32_t read_bits = EPOLLIN | EPOLLRDHUP;
+      static const uint32_t write_bits = EPOLLOUT;
+      static const uint32_t edge_bits = EPOLLET;
+      static const uint32_t level_bits = 0;
+      static const uint32_t oneshot_bits = EPOLLONESHOT;
     }
   }
 }
@@ -2,13 +2,19 @@
 #define NET_INTERNAL_LINUX_SELECTOR_H
 
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <atomic>
 #include "net/event/event.h"
 
 namespace net {
   namespace internal {
     class selector {
       public:
-        static const size_t max_events = 1024;
+        // Default number of events returned by a single wait.
+        static const size_t default_max_events = 256;
 
         // Constructor.
         selector();
@@ -17,7 +23,25 @@ namespace net {
         ~selector();
 
         // Create.
-        bool create();
+        // 'max_events' is the maximum number of events returned by a single
+        // wait.
+        bool create(size_t max_events = default_max_events);
+
+        // Create a selector which shares the kernel object of 'other' (the
+        // descriptors added to one of them are watched by both), with its
+        // own events.
+        bool create(const selector& other,
+                    size_t max_events = default_max_events);
+
+        // Get handle.
+        int handle() const;
+
+        // Get the maximum number of events returned by a single wait.
+        size_t max_events() const;
+
+        // Set the maximum number of events returned by a single wait.
+        // The results of the last wait are lost.
+        bool resize(size_t max_events);
 
         // Add.
         bool add(int fd, event::watch ev, void* data);
@@ -31,17 +55,31 @@ namespace net {
         // Wait.
         int wait(int timeout);
 
+        // Wait with a timeout of nanosecond resolution (epoll_pwait2(),
+        // Linux 5.11; older kernels round it up to milliseconds).
+        int wait(const struct timespec& timeout);
+
         // Get result event.
         void get(size_t i, net::event::result& ev, void*& data) const;
 
+        // Get the data of a result event.
+        void* data(size_t i) const;
+
       private:
         int _M_fd;
 
-        struct epoll_event _M_events[max_events];
+        // Events returned by wait().
+        struct epoll_event* _M_events;
+        size_t _M_max_events;
+
+        // Allocate events.
+        static struct epoll_event* allocate(size_t max_events);
     };
 
     inline selector::selector()
-      : _M_fd(-1)
+      : _M_fd(-1),
+        _M_events(nullptr),
+        _M_max_events(0)
     {
     }
 
@@ -50,12 +88,75 @@ namespace net {
       if (_M_fd != -1) {
         close(_M_fd);
       }
+
+      if (_M_events) {
+        munmap(_M_events, _M_max_events * sizeof(struct epoll_event));
+      }
+    }
+
+    inline bool selector::create(size_t max_events)
+    {
+      // Allocate events.
+      if ((max_events > 0) &&
+          ((_M_events = allocate(max_events)) != nullptr)) {
+        _M_max_events = max_events;
+
+        // Create epoll file descriptor.
+        if ((_M_fd = epoll_create1(0)) != -1) {
+          return true;
+        }
+
+        munmap(_M_events, _M_max_events * sizeof(struct epoll_event));
+        _M_events = nullptr;
+        _M_max_events = 0;
+      }
+
+      return false;
     }
 
-    inline bool selector::create()
+    inline bool selector::create(const selector& other, size_t max_events)
     {
-      // Create epoll file descriptor.
-      return ((_M_fd = epoll_create1(0)) != -1);
+      // Allocate events.
+      if ((max_events > 0) &&
+          ((_M_events = allocate(max_events)) != nullptr)) {
+        _M_max_events = max_events;
+
+        // Duplicate the descriptor of the other selector.
+        if ((_M_fd = dup(other._M_fd)) != -1) {
+          return true;
+        }
+
+        munmap(_M_events, _M_max_events * sizeof(struct epoll_event));
+        _M_events = nullptr;
+        _M_max_events = 0;
+      }
+
+      return false;
+    }
+
+    inline int selector::handle() const
+    {
+      return _M_fd;
+    }
+
+    inline size_t selector::max_events() const
+    {
+      return _M_max_events;
+    }
+
+    inline bool selector::resize(size_t max_events)
+    {
+      struct epoll_event* events;
+      if ((max_events > 0) && ((events = allocate(max_events)) != nullptr)) {
+        munmap(_M_events, _M_max_events * sizeof(struct epoll_event));
+
+        _M_events = events;
+        _M_max_events = max_events;
+
+        return true;
+      }
+
+      return false;
     }
 
     inline bool selector::add(int fd, event::watch ev, void* data)
@@ -90,7 +191,36 @@ namespace net {
 
     inline int selector::wait(int timeout)
     {
-      return epoll_wait(_M_fd, _M_events, max_events, timeout);
+      return epoll_wait(_M_fd, _M_events, _M_max_events, timeout);
+    }
+
+    inline int selector::wait(const struct timespec& timeout)
+    {
+#if defined(SYS_epoll_pwait2) && defined(__LP64__)
+      static std::atomic<bool> supported(true);
+
+      if (supported.load(std::memory_order_relaxed)) {
+        int ret = syscall(SYS_epoll_pwait2,
+                          _M_fd,
+                          _M_events,
+                          _M_max_events,
+                          &timeout,
+                          nullptr,
+                          0);
+
+        if ((ret >= 0) || (errno != ENOSYS)) {
+          return ret;
+        }
+
+        supported.store(false, std::memory_order_relaxed);
+      }
+#endif // defined(SYS_epoll_pwait2) && defined(__LP64__)
+
+      return epoll_wait(_M_fd,
+                        _M_events,
+                        _M_max_events,
+                        (timeout.tv_sec * 1000) +
+                        ((timeout.tv_nsec + 999999) / 1000000));
     }
 
     inline void selector::get(size_t i,
@@ -111,6 +241,27 @@ namespace net {
 
       data = _M_events[i].data.ptr;
     }
+
+    inline void* selector::data(size_t i) const
+    {
+      return _M_events[i].data.ptr;
+    }
+
+    inline struct epoll_event* selector::allocate(size_t max_events)
+    {
+      // The events are allocated with mmap(), so that the pages are
+      // allocated when the dispatcher's thread touches them for the first
+      // time, on its NUMA node.
+      void* events = mmap(nullptr,
+                          max_events * sizeof(struct epoll_event),
+                          PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS,
+                          -1,
+                          0);
+
+      return (events != MAP_FAILED) ? static_cast<struct epoll_event*>(events) :
+                                      nullptr;
+    }
   }
 }
 
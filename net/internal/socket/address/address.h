@@ -1,6 +1,7 @@
 #ifndef NET_INTERNAL_SOCKET_ADDRESS_H
 #define NET_INTERNAL_SOCKET_ADDRESS_H
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -69,6 +70,84 @@ namespace net {
                                               sizeof(addr1->sun_path)) == 0);
         }
 
+        static inline bool equal(const struct sockaddr* addr1,
+                                 const struct sockaddr* addr2)
+        {
+          if (addr1->sa_family != addr2->sa_family) {
+            return false;
+          }
+
+          switch (addr1->sa_family) {
+            case AF_INET:
+              return equal(reinterpret_cast<const struct sockaddr_in*>(addr1),
+                           reinterpret_cast<const struct sockaddr_in*>(addr2));
+            case AF_INET6:
+              return equal(
+                       reinterpret_cast<const struct sockaddr_in6*>(addr1),
+                       reinterpret_cast<const struct sockaddr_in6*>(addr2)
+                     );
+            case AF_UNIX:
+              return equal(reinterpret_cast<const struct sockaddr_un*>(addr1),
+                           reinterpret_cast<const struct sockaddr_un*>(addr2));
+            default:
+              return false;
+          }
+        }
+
+        // Hash (equal addresses have the same hash).
+        static inline size_t hash(uint64_t n)
+        {
+          // Mixer of splitmix64.
+          n = (n ^ (n >> 30)) * 0xbf58476d1ce4e5b9ull;
+          n = (n ^ (n >> 27)) * 0x94d049bb133111ebull;
+
+          return static_cast<size_t>(n ^ (n >> 31));
+        }
+
+        static inline size_t hash(const struct sockaddr_in* addr)
+        {
+          return hash((static_cast<uint64_t>(addr->sin_addr.s_addr) << 16) |
+                      addr->sin_port);
+        }
+
+        static inline size_t hash(const struct sockaddr_in6* addr)
+        {
+          uint64_t n[2];
+          memcpy(n, &addr->sin6_addr, sizeof(n));
+
+          return hash(n[0] ^ hash(n[1] ^ addr->sin6_port));
+        }
+
+        static inline size_t hash(const struct sockaddr_un* addr)
+        {
+          // FNV-1a (abstract addresses are compared in full, see equal()).
+          size_t len = addr->sun_path[0] ? strnlen(addr->sun_path,
+                                                   sizeof(addr->sun_path)) :
+                                           sizeof(addr->sun_path);
+
+          uint64_t n = 0xcbf29ce484222325ull;
+          for (size_t i = 0; i < len; i++) {
+            n = (n ^ static_cast<uint8_t>(addr->sun_path[i])) *
+                0x100000001b3ull;
+          }
+
+          return static_cast<size_t>(n);
+        }
+
+        static inline size_t hash(const struct sockaddr* addr)
+        {
+          switch (addr->sa_family) {
+            case AF_INET:
+              return hash(reinterpret_cast<const struct sockaddr_in*>(addr));
+            case AF_INET6:
+              return hash(reinterpret_cast<const struct sockaddr_in6*>(addr));
+            case AF_UNIX:
+              return hash(reinterpret_cast<const struct sockaddr_un*>(addr));
+            default:
+              return 0;
+          }
+        }
+
         // Extract IP and port.
         // 'ip' has to be, at least, INET6_ADDRSTRLEN bytes long.
         bool extract_ip_port(const char* address, char* ip, in_port_t& port);
@@ -1,7 +1,9 @@
 #include <stdint.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <poll.h>
+#include <sys/time.h>
 #include <netinet/tcp.h>
 #include <errno.h>
 #include <limits.h>
@@ -11,6 +13,7 @@
 #endif
 
 #include "net/internal/socket/socket.h"
+#include "util/iovec_cursor.h"
 
 #if !defined(POLLRDHUP)
   #define POLLRDHUP 0
@@ -24,44 +27,21 @@ namespace net {
                           int flags,
                           int timeout)
       {
-        size_t iovcnt;
-        if ((iovcnt = msg->msg_iovlen) <= IOV_MAX) {
-          struct iovec vec[IOV_MAX];
-          size_t total = 0;
-
-          for (size_t i = 0; i < iovcnt; i++) {
-            vec[i] = msg->msg_iov[i];
-
-            total += vec[i].iov_len;
-          }
-
-          msg->msg_iov = vec;
-
-          size_t sent = 0;
+        if (static_cast<size_t>(msg->msg_iovlen) <= IOV_MAX) {
+          util::iovec_cursor cursor(msg->msg_iov, msg->msg_iovlen);
 
           do {
+            cursor.get(*msg);
+
             ssize_t ret;
             if ((ret = socket::sendmsg(sock, msg, flags)) >= 0) {
-              if ((sent += ret) == total) {
+              cursor.advance(ret);
+
+              if (cursor.done()) {
                 return true;
               }
 
-              if (wait_writable(sock, timeout)) {
-                while (static_cast<size_t>(ret) >= msg->msg_iov->iov_len) {
-                  ret -= msg->msg_iov->iov_len;
-
-                  msg->msg_iov++;
-                  msg->msg_iovlen--;
-                }
-
-                if (ret > 0) {
-                  msg->msg_iov->iov_base = reinterpret_cast<uint8_t*>(
-                                             msg->msg_iov->iov_base
-                                           ) + ret;
-
-                  msg->msg_iov->iov_len -= ret;
-                }
-              } else {
+              if (!wait_writable(sock, timeout)) {
                 return false;
               }
             } else {
@@ -115,10 +95,86 @@ namespace net {
         if ((ret == 0) ||
             ((errno == EINPROGRESS) && (wait_writable(sock, timeout)))) {
           int error;
-          return ((get_socket_error(sock, error)) && (error == 0));
-        } else {
+          if (get_socket_error(sock, error)) {
+            if (error == 0) {
+              return true;
+            }
+
+            errno = error;
+          }
+        }
+
+        return false;
+      }
+
+      ssize_t connect(handle_t sock,
+                      const struct sockaddr* addr,
+                      socklen_t addrlen,
+                      const void* buf,
+                      size_t len)
+      {
+#if defined(MSG_FASTOPEN)
+        ssize_t ret;
+        while (((ret = ::sendto(sock,
+                                buf,
+                                len,
+                                MSG_FASTOPEN | MSG_NOSIGNAL,
+                                addr,
+                                addrlen)) < 0) &&
+               (errno == EINTR));
+
+        if (ret >= 0) {
+          return ret;
+        }
+
+        // If there is no cookie yet, the SYN is sent without data.
+        if (errno == EINPROGRESS) {
+          return 0;
+        }
+
+        // If TCP Fast Open is disabled, connect as usual.
+        if (errno != EOPNOTSUPP) {
+          return -1;
+        }
+#endif // defined(MSG_FASTOPEN)
+
+        return socket::connect(sock, addr, addrlen) ? 0 : -1;
+      }
+
+      bool connect(handle_t sock,
+                   const struct sockaddr* addr,
+                   socklen_t addrlen,
+                   const void* buf,
+                   size_t len,
+                   int timeout)
+      {
+        ssize_t ret;
+        if ((ret = socket::connect(sock, addr, addrlen, buf, len)) < 0) {
           return false;
         }
+
+        // If all the data has been sent in the SYN, don't wait for the
+        // connection to be established.
+        if (static_cast<size_t>(ret) == len) {
+          return true;
+        }
+
+        if (wait_writable(sock, timeout)) {
+          int error;
+          if (get_socket_error(sock, error)) {
+            if (error == 0) {
+              return socket::send(sock,
+                                  static_cast<const uint8_t*>(buf) + ret,
+                                  len - ret,
+                                  0,
+                                  timeout);
+            }
+
+            errno = error;
+          }
+        }
+
+        return false;
       }
 
       handle_t connect(const struct sockaddr* addr, socklen_t addrlen)
@@ -157,6 +213,154 @@ namespace net {
         return (::getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &optlen) == 0);
       }
 
+      bool get_listening(handle_t sock, bool& on)
+      {
+        int optval;
+        socklen_t optlen = sizeof(int);
+
+        if (::getsockopt(sock,
+                         SOL_SOCKET,
+                         SO_ACCEPTCONN,
+                         &optval,
+                         &optlen) == 0) {
+          on = (optval != 0);
+
+          return true;
+        }
+
+        return false;
+      }
+
+      bool set_non_blocking(handle_t sock)
+      {
+        int flags;
+        return (((flags = fcntl(sock, F_GETFL)) != -1) &&
+                (((flags & O_NONBLOCK) != 0) ||
+                 (fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0)));
+      }
+
+      bool set_blocking(handle_t sock)
+      {
+        int flags;
+        return (((flags = fcntl(sock, F_GETFL)) != -1) &&
+                (((flags & O_NONBLOCK) == 0) ||
+                 (fcntl(sock, F_SETFL, flags & ~O_NONBLOCK) == 0)));
+      }
+
+      bool set_recv_timeout(handle_t sock, int timeout)
+      {
+        // A zero timeval means no timeout.
+        struct timeval tv;
+        tv.tv_sec = (timeout > 0) ? timeout / 1000 : 0;
+        tv.tv_usec = (timeout > 0) ? (timeout % 1000) * 1000 : 0;
+
+        return (::setsockopt(sock,
+                             SOL_SOCKET,
+                             SO_RCVTIMEO,
+                             &tv,
+                             sizeof(struct timeval)) == 0);
+      }
+
+      bool set_send_timeout(handle_t sock, int timeout)
+      {
+        // A zero timeval means no timeout.
+        struct timeval tv;
+        tv.tv_sec = (timeout > 0) ? timeout / 1000 : 0;
+        tv.tv_usec = (timeout > 0) ? (timeout % 1000) * 1000 : 0;
+
+        return (::setsockopt(sock,
+                             SOL_SOCKET,
+                             SO_SNDTIMEO,
+                             &tv,
+                             sizeof(struct timeval)) == 0);
+      }
+
+      bool get_accept_queue(handle_t sock, size_t& length, size_t& backlog)
+      {
+#if defined(__linux__)
+        // For listening sockets, tcpi_unacked is the number of connections
+        // in the accept queue and tcpi_sacked the backlog.
+        struct tcp_info info;
+        socklen_t optlen = sizeof(struct tcp_info);
+
+        if (::getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &optlen) == 0) {
+          if (info.tcpi_state == TCP_LISTEN) {
+            length = info.tcpi_unacked;
+            backlog = info.tcpi_sacked;
+
+            return true;
+          }
+
+          errno = EINVAL;
+        }
+
+        return false;
+#elif defined(SO_LISTENQLEN) && defined(SO_LISTENQLIMIT)
+        int len;
+        int limit;
+        socklen_t optlen = sizeof(int);
+
+        if ((::getsockopt(sock,
+                          SOL_SOCKET,
+                          SO_LISTENQLEN,
+                          &len,
+                          &optlen) == 0) &&
+            (::getsockopt(sock,
+                          SOL_SOCKET,
+                          SO_LISTENQLIMIT,
+                          &limit,
+                          &optlen) == 0)) {
+          length = static_cast<size_t>(len);
+          backlog = static_cast<size_t>(limit);
+
+          return true;
+        }
+
+        return false;
+#else
+        errno = ENOTSUP;
+        return false;
+#endif
+      }
+
+      bool set_fast_open(handle_t sock, int queue)
+      {
+#if defined(TCP_FASTOPEN)
+        return (::setsockopt(sock,
+                             IPPROTO_TCP,
+                             TCP_FASTOPEN,
+                             &queue,
+                             sizeof(int)) == 0);
+#else
+        errno = ENOTSUP;
+        return false;
+#endif
+      }
+
+      bool set_defer_accept(handle_t sock, int seconds)
+      {
+#if defined(TCP_DEFER_ACCEPT)
+        return (::setsockopt(sock,
+                             IPPROTO_TCP,
+                             TCP_DEFER_ACCEPT,
+                             &seconds,
+                             sizeof(int)) == 0);
+#elif defined(SO_ACCEPTFILTER)
+        struct accept_filter_arg arg;
+        memset(&arg, 0, sizeof(struct accept_filter_arg));
+        strcpy(arg.af_name, "dataready");
+
+        return (::setsockopt(sock,
+                             SOL_SOCKET,
+                             SO_ACCEPTFILTER,
+                             &arg,
+                             sizeof(struct accept_filter_arg)) == 0);
+#else
+        errno = ENOTSUP;
+        return false;
+#endif
+      }
+
       bool get_recvbuf_size(handle_t sock, int& size)
       {
         socklen_t optlen = sizeof(int);
@@ -249,6 +453,33 @@ namespace net {
 #endif
       }
 
+      bool get_incoming_cpu(handle_t sock, int& cpu)
+      {
+#if defined(SO_INCOMING_CPU)
+        socklen_t optlen = sizeof(int);
+        return (::getsockopt(sock,
+                             SOL_SOCKET,
+                             SO_INCOMING_CPU,
+                             &cpu,
+                             &optlen) == 0);
+#else
+        return false;
+#endif
+      }
+
+      bool set_incoming_cpu(handle_t sock, int cpu)
+      {
+#if defined(SO_INCOMING_CPU)
+        return (::setsockopt(sock,
+                             SOL_SOCKET,
+                             SO_INCOMING_CPU,
+                             &cpu,
+                             sizeof(int)) == 0);
+#else
+        return false;
+#endif
+      }
+
       bool cork(handle_t sock)
       {
 #if defined(TCP_CORK)
@@ -293,18 +524,20 @@ namespace net {
 
       bool bind(handle_t sock, const struct sockaddr* addr, socklen_t addrlen)
       {
-        // Reuse address and port.
+        // Reuse address and port (SO_REUSEPORT only applies to internet
+        // sockets; Linux rejects it for local sockets).
         int optval = 1;
         return ((::setsockopt(sock,
                               SOL_SOCKET,
                               SO_REUSEADDR,
                               &optval,
                               sizeof(int)) == 0) &&
-                (::setsockopt(sock,
-                              SOL_SOCKET,
-                              SO_REUSEPORT,
-                              &optval,
-                              sizeof(int)) == 0) &&
+                ((addr->sa_family == AF_UNIX) ||
+                 (::setsockopt(sock,
+                               SOL_SOCKET,
+                               SO_REUSEPORT,
+                               &optval,
+                               sizeof(int)) == 0)) &&
                 (::bind(sock, addr, addrlen) == 0));
       }
 
@@ -682,100 +915,52 @@ namespace net {
 
         while (vlen > 0) {
           struct mmsghdr msgs[uio_maxiov];
-          struct iovec vec[uio_maxiov][IOV_MAX];
-          size_t lengths[uio_maxiov];
+          util::iovec_cursor cursors[uio_maxiov];
 
           unsigned nmsgs = (vlen < uio_maxiov) ? vlen : uio_maxiov;
 
           for (unsigned i = 0; i < nmsgs; i++) {
             const struct msghdr* src = &msgvec[i].msg_hdr;
-            size_t msg_iovlen = src->msg_iovlen;
-
             struct msghdr* dest = &msgs[i].msg_hdr;
 
-            dest->msg_name = src->msg_name;
-            dest->msg_namelen = src->msg_namelen;
-            dest->msg_iov = vec[i];
-            dest->msg_iovlen = msg_iovlen;
-            dest->msg_control = src->msg_control;
-            dest->msg_controllen = src->msg_controllen;
-            dest->msg_flags = src->msg_flags;
-
-            size_t len = 0;
-            for (size_t j = 0; j < msg_iovlen; j++) {
-              vec[i][j] = src->msg_iov[j];
+            *dest = *src;
 
-              len += vec[i][j].iov_len;
-            }
-
-            lengths[i] = len;
+            cursors[i].set(src->msg_iov, src->msg_iovlen);
           }
 
           msgvec += nmsgs;
           vlen -= nmsgs;
 
           struct mmsghdr* m = msgs;
-          size_t* l = lengths;
+          util::iovec_cursor* c = cursors;
 
           do {
+            // If only the rest of a buffer of the first message is sent,
+            // the following messages are sent once it has been completed.
             int ret;
             if ((ret = socket::sendmmsg(sock,
                                         m,
-                                        nmsgs,
+                                        c->partial() ? 1 : nmsgs,
                                         flags)) >= 0) {
+              // Advance the cursors of the messages which have been sent.
+              for (int i = 0; i < ret; i++) {
+                c[i].advance(m[i].msg_len);
+                c[i].get(m[i].msg_hdr);
+              }
+
               // Skip messages which have been completely sent.
               int i;
-
-#if !defined(__FreeBSD__)
-              for (i = 0; (i < ret) && (m[i].msg_len == l[i]); i++);
-#else
-              for (i = 0;
-                   (i < ret) && (m[i].msg_len == static_cast<ssize_t>(l[i]));
-                   i++);
-#endif
+              for (i = 0; (i < ret) && (c[i].done()); i++);
 
               // If all the messages have been sent...
-              if ((static_cast<unsigned>(ret) == nmsgs) && (i == ret)) {
+              if (static_cast<unsigned>(i) == nmsgs) {
                 break;
               }
 
               nmsgs -= i;
 
               m += i;
-              l += i;
-              ret -= i;
-
-              // Check rest of the messages.
-              for (i = 0; i < ret; i++) {
-                struct mmsghdr* msg = m + i;
-
-                // If not all the data has been sent...
-                if ((l[i] -= msg->msg_len) > 0) {
-                  struct msghdr* hdr = &msg->msg_hdr;
-
-#if !defined(__FreeBSD__)
-                  while (msg->msg_len >= hdr->msg_iov->iov_len) {
-#else
-                  while (msg->msg_len >=
-                         static_cast<ssize_t>(hdr->msg_iov->iov_len)) {
-#endif
-                    msg->msg_len -= hdr->msg_iov->iov_len;
-
-                    hdr->msg_iov++;
-                    hdr->msg_iovlen--;
-                  }
-
-                  if (msg->msg_len > 0) {
-                    hdr->msg_iov->iov_base = reinterpret_cast<uint8_t*>(
-                                               hdr->msg_iov->iov_base
-                                             ) + msg->msg_len;
-
-                    hdr->msg_iov->iov_len -= msg->msg_len;
-                  }
-                } else {
-                  msg->msg_hdr.msg_iovlen = 0;
-                }
-              }
+              c += i;
 
               if (!wait_writable(sock, timeout)) {
                 return false;
@@ -31,6 +31,24 @@ namespace net {
                    socklen_t addrlen,
                    int timeout);
 
+      // Connect sending 'buf' with TCP Fast Open (Linux): the data is sent
+      // in the SYN if there is a cookie for the server; otherwise, it is
+      // sent after the connection has been established.
+      // Return the number of bytes sent (possibly 0) or -1 on error.
+      ssize_t connect(handle_t sock,
+                      const struct sockaddr* addr,
+                      socklen_t addrlen,
+                      const void* buf,
+                      size_t len);
+
+      // Connect and send 'buf' using TCP Fast Open.
+      bool connect(handle_t sock,
+                   const struct sockaddr* addr,
+                   socklen_t addrlen,
+                   const void* buf,
+                   size_t len,
+                   int timeout);
+
       handle_t connect(const struct sockaddr* addr, socklen_t addrlen);
       handle_t connect(const struct sockaddr* addr,
                        socklen_t addrlen,
@@ -39,6 +57,37 @@ namespace net {
       // Get socket error.
       bool get_socket_error(handle_t sock, int& error);
 
+      // Is the socket listening?
+      bool get_listening(handle_t sock, bool& on);
+
+      // Make socket non-blocking.
+      bool set_non_blocking(handle_t sock);
+
+      // Make socket blocking.
+      bool set_blocking(handle_t sock);
+
+      // Set the timeout of the blocking receive operations (SO_RCVTIMEO,
+      // milliseconds, -1: no timeout).
+      bool set_recv_timeout(handle_t sock, int timeout);
+
+      // Set the timeout of the blocking send operations (SO_SNDTIMEO,
+      // milliseconds, -1: no timeout).
+      bool set_send_timeout(handle_t sock, int timeout);
+
+      // Get number of connections in the accept queue of a listening socket
+      // and the maximum number (backlog).
+      bool get_accept_queue(handle_t sock, size_t& length, size_t& backlog);
+
+      // Accept TCP Fast Open connections on a listening socket, with up to
+      // 'queue' pending connections which haven't completed the handshake
+      // (Linux, FreeBSD and macOS).
+      bool set_fast_open(handle_t sock, int queue);
+
+      // Defer accept: only report connections of a listening socket once
+      // they have received data or after 'seconds' (Linux; FreeBSD uses
+      // the "dataready" accept filter, which has no timeout).
+      bool set_defer_accept(handle_t sock, int seconds);
+
       // Get receive buffer size.
       bool get_recvbuf_size(handle_t sock, int& size);
 
@@ -63,6 +112,14 @@ namespace net {
       // Set TCP no delay.
       bool set_tcp_no_delay(handle_t sock, bool on);
 
+      // Get the CPU which processed the last packet received (Linux).
+      bool get_incoming_cpu(handle_t sock, int& cpu);
+
+      // Set incoming CPU (Linux).
+      // For sockets bound with SO_REUSEPORT, the kernel prefers the socket
+      // whose incoming CPU is the CPU processing the packet.
+      bool set_incoming_cpu(handle_t sock, int cpu);
+
       // Cork.
       bool cork(handle_t sock);
 
@@ -164,6 +164,12 @@ namespace net {
           bool operator==(const address& addr) const;
           bool operator==(const struct sockaddr& addr) const;
 
+          // Equal (compares only the family, address and port / path)?
+          bool equal(const address& addr) const;
+
+          // Get hash (equal addresses have the same hash).
+          size_t hash() const;
+
           // Assignment operator.
           address& operator=(const address& addr);
           address& operator=(const struct sockaddr& addr);
@@ -242,6 +248,28 @@ namespace net {
       bool connect(const address::ipv6& addr, int timeout);
       bool connect(const address::local& addr, int timeout);
 
+      // Connect sending 'buf' with TCP Fast Open.
+      // Return the number of bytes sent (possibly 0) or -1 on error.
+      ssize_t connect(const address& addr, const void* buf, size_t len);
+      ssize_t connect(const address::ipv4& addr, const void* buf, size_t len);
+      ssize_t connect(const address::ipv6& addr, const void* buf, size_t len);
+
+      // Connect and send 'buf' using TCP Fast Open.
+      bool connect(const address& addr,
+                   const void* buf,
+                   size_t len,
+                   int timeout);
+
+      bool connect(const address::ipv4& addr,
+                   const void* buf,
+                   size_t len,
+                   int timeout);
+
+      bool connect(const address::ipv6& addr,
+                   const void* buf,
+                   size_t len,
+                   int timeout);
+
       // Get socket error.
       bool get_socket_error(int& error);
 
@@ -257,6 +285,18 @@ namespace net {
       // Set send buffer size.
       bool set_sendbuf_size(int size);
 
+      // Is the socket listening?
+      bool get_listening(bool& on);
+
+      // Get number of connections in the accept queue and the backlog.
+      bool get_accept_queue(size_t& length, size_t& backlog);
+
+      // Accept TCP Fast Open connections (listening socket).
+      bool set_fast_open(int queue);
+
+      // Defer accept until data has been received (listening socket).
+      bool set_defer_accept(int seconds);
+
       // Get keep-alive.
       bool get_keep_alive(bool& on);
 
@@ -269,6 +309,12 @@ namespace net {
       // Set TCP no delay.
       bool set_tcp_no_delay(bool on);
 
+      // Get the CPU which processed the last packet received (Linux).
+      bool get_incoming_cpu(int& cpu);
+
+      // Set incoming CPU (Linux).
+      bool set_incoming_cpu(int cpu);
+
       // Cork.
       bool cork();
 
@@ -805,6 +851,21 @@ namespace net {
             (memcmp(&_M_addr, &addr._M_addr, _M_addrlen) == 0));
   }
 
+  inline bool socket::address::equal(const address& addr) const
+  {
+    return internal::socket::address::equal(
+             reinterpret_cast<const struct sockaddr*>(&_M_addr),
+             reinterpret_cast<const struct sockaddr*>(&addr._M_addr)
+           );
+  }
+
+  inline size_t socket::address::hash() const
+  {
+    return internal::socket::address::hash(
+             reinterpret_cast<const struct sockaddr*>(&_M_addr)
+           );
+  }
+
   inline socket::address& socket::address::operator=(const address& addr)
   {
     memcpy(&_M_addr, &addr._M_addr, addr._M_addrlen);
@@ -955,6 +1016,78 @@ namespace net {
                                      timeout);
   }
 
+  inline ssize_t socket::connect(const address& addr,
+                                 const void* buf,
+                                 size_t len)
+  {
+    return internal::socket::connect(_M_handle,
+                                     static_cast<const struct sockaddr*>(addr),
+                                     addr.size(),
+                                     buf,
+                                     len);
+  }
+
+  inline ssize_t socket::connect(const address::ipv4& addr,
+                                 const void* buf,
+                                 size_t len)
+  {
+    return internal::socket::connect(_M_handle,
+                                     static_cast<const struct sockaddr*>(addr),
+                                     addr.size(),
+                                     buf,
+                                     len);
+  }
+
+  inline ssize_t socket::connect(const address::ipv6& addr,
+                                 const void* buf,
+                                 size_t len)
+  {
+    return internal::socket::connect(_M_handle,
+                                     static_cast<const struct sockaddr*>(addr),
+                                     addr.size(),
+                                     buf,
+                                     len);
+  }
+
+  inline bool socket::connect(const address& addr,
+                              const void* buf,
+                              size_t len,
+                              int timeout)
+  {
+    return internal::socket::connect(_M_handle,
+                                     static_cast<const struct sockaddr*>(addr),
+                                     addr.size(),
+                                     buf,
+                                     len,
+                                     timeout);
+  }
+
+  inline bool socket::connect(const address::ipv4& addr,
+                              const void* buf,
+                              size_t len,
+                              int timeout)
+  {
+    return internal::socket::connect(_M_handle,
+                                     static_cast<const struct sockaddr*>(addr),
+                                     addr.size(),
+                                     buf,
+                                     len,
+                                     timeout);
+  }
+
+  inline bool socket::connect(const address::ipv6& addr,
+                              const void* buf,
+                              size_t len,
+                              int timeout)
+  {
+    return internal::socket::connect(_M_handle,
+                                     static_cast<const struct sockaddr*>(addr),
+                                     addr.size(),
+                                     buf,
+                                     len,
+                                     timeout);
+  }
+
   inline bool socket::get_socket_error(int& error)
   {
     return internal::socket::get_socket_error(_M_handle, error);
@@ -980,6 +1113,26 @@ namespace net {
     return internal::socket::set_sendbuf_size(_M_handle, size);
   }
 
+  inline bool socket::get_listening(bool& on)
+  {
+    return internal::socket::get_listening(_M_handle, on);
+  }
+
+  inline bool socket::get_accept_queue(size_t& length, size_t& backlog)
+  {
+    return internal::socket::get_accept_queue(_M_handle, length, backlog);
+  }
+
+  inline bool socket::set_fast_open(int queue)
+  {
+    return internal::socket::set_fast_open(_M_handle, queue);
+  }
+
+  inline bool socket::set_defer_accept(int seconds)
+  {
+    return internal::socket::set_defer_accept(_M_handle, seconds);
+  }
+
   inline bool socket::get_keep_alive(bool& on)
   {
     return internal::socket::get_keep_alive(_M_handle, on);
@@ -1000,6 +1153,16 @@ namespace net {
     return internal::socket::set_tcp_no_delay(_M_handle, on);
   }
 
+  inline bool socket::get_incoming_cpu(int& cpu)
+  {
+    return internal::socket::get_incoming_cpu(_M_handle, cpu);
+  }
+
+  inline bool socket::set_incoming_cpu(int cpu)
+  {
+    return internal::socket::set_incoming_cpu(_M_handle, cpu);
+  }
+
   inline bool socket::cork()
   {
     return internal::socket::cork(_M_handle);
@@ -13,6 +13,17 @@ namespace net {
         bool connect(const address::ipv4& addr) = delete;
         bool connect(const address::ipv6& addr) = delete;
         bool connect(const address::local& addr) = delete;
+        ssize_t connect(const address& addr,
+                        const void* buf,
+                        size_t len) = delete;
+
+        ssize_t connect(const address::ipv4& addr,
+                        const void* buf,
+                        size_t len) = delete;
+
+        ssize_t connect(const address::ipv6& addr,
+                        const void* buf,
+                        size_t len) = delete;
 
         // Accept.
         using net::socket::accept;
@@ -1,13 +1,21 @@
 #ifndef NET_SYNC_TCP_SOCKET_H
 #define NET_SYNC_TCP_SOCKET_H
 
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
 #include "net/sync/socket.h"
+#include "util/iovec_cursor.h"
 
 namespace net {
   namespace sync {
     namespace tcp {
       class socket : public net::sync::socket {
         public:
+          // Constructor.
+          socket();
+
           // Create socket.
           using net::sync::socket::create;
           bool create(domain d, type t) = delete;
@@ -18,6 +26,73 @@ namespace net {
           bool connect(const address::ipv6& addr, int timeout);
           bool connect(const address::local& addr, int timeout);
 
+          // Connect and send 'buf' using TCP Fast Open.
+          bool connect(const address& addr,
+                       const void* buf,
+                       size_t len,
+                       int timeout);
+
+          bool connect(const address::ipv4& addr,
+                       const void* buf,
+                       size_t len,
+                       int timeout);
+
+          bool connect(const address::ipv6& addr,
+                       const void* buf,
+                       size_t len,
+                       int timeout);
+
+          // Close socket.
+          void close();
+
+          // Blocking mode.
+          // The sockets are non-blocking: an operation which can't complete
+          // immediately waits with poll() and is retried. In blocking mode
+          // the operation blocks in the kernel, with the timeout set with
+          // SO_RCVTIMEO / SO_SNDTIMEO (only when it changes), so that each
+          // operation takes a single system call.
+          // It has to be set once the socket is connected, accepted or
+          // listening; it is reset when the socket is closed or created.
+          bool set_blocking(bool on);
+
+          // Is the socket in blocking mode?
+          bool blocking() const;
+
+          // Accept.
+          using net::sync::socket::accept;
+          bool accept(socket& sock, address& addr, int timeout);
+          bool accept(socket& sock, int timeout);
+
+          // Receive.
+          using net::sync::socket::recv;
+          ssize_t recv(void* buf, size_t len, int timeout);
+
+          // Send.
+          using net::sync::socket::send;
+          bool send(const void* buf, size_t len, int timeout);
+
+          // Read into multiple buffers.
+          using net::sync::socket::readv;
+          ssize_t readv(const struct iovec* iov, unsigned iovcnt, int timeout);
+
+          // Write from multiple buffers.
+          using net::sync::socket::writev;
+          bool writev(const struct iovec* iov, unsigned iovcnt, int timeout);
+
+          // Receive message.
+          using net::sync::socket::recvmsg;
+          ssize_t recvmsg(struct msghdr* msg, int timeout);
+
+          // Send message.
+          using net::sync::socket::sendmsg;
+          bool sendmsg(const struct msghdr* msg, int timeout);
+
+#if defined(HAVE_SENDFILE)
+          // Send file.
+          using net::sync::socket::sendfile;
+          bool sendfile(int in_fd, off_t& offset, size_t count, int timeout);
+#endif // defined(HAVE_SENDFILE)
+
           // Bind.
           using net::sync::socket::bind;
           bool bind(const address& addr) = delete;
@@ -65,67 +140,416 @@ namespace net {
                       int timeout) = delete;
 
           bool sendto(const void* buf, size_t len, int timeout) = delete;
+
+        private:
+          // Timeout not set.
+          static const int no_timeout = INT_MIN;
+
+          bool _M_blocking;
+
+          // Timeouts set with SO_RCVTIMEO and SO_SNDTIMEO.
+          int _M_recv_timeout;
+          int _M_send_timeout;
+
+          // Create socket (non-blocking mode).
+          template<typename Address>
+          bool create_socket(const Address& addr);
+
+          // Reset mode.
+          void reset();
+
+          // Prepare a blocking receive / send: a timeout of 0 is checked
+          // with poll(), otherwise the timeout of the socket is set (if it
+          // has changed).
+          bool prepare_recv(int timeout);
+          bool prepare_send(int timeout);
+
+          // Send message (blocking mode).
+          bool send_message(struct msghdr* msg);
+
+          // The blocking operations which time out fail with EAGAIN.
+          static void check_timeout();
       };
 
+      inline socket::socket()
+        : _M_blocking(false),
+          _M_recv_timeout(no_timeout),
+          _M_send_timeout(no_timeout)
+      {
+      }
+
       inline bool socket::connect(const address& addr, int timeout)
       {
-        return ((net::socket::create(static_cast<socket::domain>(addr.family()),
-                                     socket::type::stream)) &&
+        return ((create_socket(addr)) &&
                 (sync::socket::connect(addr, timeout)));
       }
 
       inline bool socket::connect(const address::ipv4& addr, int timeout)
       {
-        return ((net::socket::create(static_cast<socket::domain>(addr.family()),
-                                     socket::type::stream)) &&
+        return ((create_socket(addr)) &&
                 (sync::socket::connect(addr, timeout)));
       }
 
       inline bool socket::connect(const address::ipv6& addr, int timeout)
       {
-        return ((net::socket::create(static_cast<socket::domain>(addr.family()),
-                                     socket::type::stream)) &&
+        return ((create_socket(addr)) &&
                 (sync::socket::connect(addr, timeout)));
       }
 
       inline bool socket::connect(const address::local& addr, int timeout)
       {
-        return ((net::socket::create(static_cast<socket::domain>(addr.family()),
-                                     socket::type::stream)) &&
+        return ((create_socket(addr)) &&
                 (sync::socket::connect(addr, timeout)));
       }
 
+      inline bool socket::connect(const address& addr,
+                                  const void* buf,
+                                  size_t len,
+                                  int timeout)
+      {
+        return ((create_socket(addr)) &&
+                (sync::socket::connect(addr, buf, len, timeout)));
+      }
+
+      inline bool socket::connect(const address::ipv4& addr,
+                                  const void* buf,
+                                  size_t len,
+                                  int timeout)
+      {
+        return ((create_socket(addr)) &&
+                (sync::socket::connect(addr, buf, len, timeout)));
+      }
+
+      inline bool socket::connect(const address::ipv6& addr,
+                                  const void* buf,
+                                  size_t len,
+                                  int timeout)
+      {
+        return ((create_socket(addr)) &&
+                (sync::socket::connect(addr, buf, len, timeout)));
+      }
+
       inline bool socket::listen(const address& addr)
       {
-        return ((net::socket::create(static_cast<socket::domain>(addr.family()),
-                                     socket::type::stream)) &&
+        return ((create_socket(addr)) &&
                 (net::socket::bind(addr)) &&
                 (net::socket::listen()));
       }
 
       inline bool socket::listen(const address::ipv4& addr)
       {
-        return ((net::socket::create(static_cast<socket::domain>(addr.family()),
-                                     socket::type::stream)) &&
+        return ((create_socket(addr)) &&
                 (net::socket::bind(addr)) &&
                 (net::socket::listen()));
       }
 
       inline bool socket::listen(const address::ipv6& addr)
       {
-        return ((net::socket::create(static_cast<socket::domain>(addr.family()),
-                                     socket::type::stream)) &&
+        return ((create_socket(addr)) &&
                 (net::socket::bind(addr)) &&
                 (net::socket::listen()));
       }
 
       inline bool socket::listen(const address::local& addr)
       {
-        return ((net::socket::create(static_cast<socket::domain>(addr.family()),
-                                     socket::type::stream)) &&
+        return ((create_socket(addr)) &&
                 (net::socket::bind(addr)) &&
                 (net::socket::listen()));
       }
+
+      inline void socket::close()
+      {
+        net::sync::socket::close();
+        reset();
+      }
+
+      inline bool socket::set_blocking(bool on)
+      {
+        if (on ?
+              net::internal::socket::set_blocking(handle()) :
+              net::internal::socket::set_non_blocking(handle())) {
+          _M_blocking = on;
+          return true;
+        }
+
+        return false;
+      }
+
+      inline bool socket::blocking() const
+      {
+        return _M_blocking;
+      }
+
+      inline bool socket::accept(socket& sock, address& addr, int timeout)
+      {
+        if (!_M_blocking) {
+          if (net::sync::socket::accept(sock, addr, timeout)) {
+            sock.reset();
+            return true;
+          }
+        } else if (prepare_recv(timeout)) {
+          if (net::socket::accept(sock, addr)) {
+            sock.reset();
+            return true;
+          }
+
+          check_timeout();
+        }
+
+        return false;
+      }
+
+      inline bool socket::accept(socket& sock, int timeout)
+      {
+        if (!_M_blocking) {
+          if (net::sync::socket::accept(sock, timeout)) {
+            sock.reset();
+            return true;
+          }
+        } else if (prepare_recv(timeout)) {
+          if (net::socket::accept(sock)) {
+            sock.reset();
+            return true;
+          }
+
+          check_timeout();
+        }
+
+        return false;
+      }
+
+      inline ssize_t socket::recv(void* buf, size_t len, int timeout)
+      {
+        if (!_M_blocking) {
+          return net::sync::socket::recv(buf, len, timeout);
+        }
+
+        if (prepare_recv(timeout)) {
+          ssize_t ret;
+          if ((ret = net::socket::recv(buf, len)) < 0) {
+            check_timeout();
+          }
+
+          return ret;
+        }
+
+        return -1;
+      }
+
+      inline bool socket::send(const void* buf, size_t len, int timeout)
+      {
+        if (!_M_blocking) {
+          return net::sync::socket::send(buf, len, timeout);
+        }
+
+        if (prepare_send(timeout)) {
+          const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+          do {
+            ssize_t ret;
+            if ((ret = net::socket::send(b, len)) < 0) {
+              check_timeout();
+              return false;
+            }
+
+            if ((len -= ret) == 0) {
+              return true;
+            }
+
+            // Partial send (interrupted by a signal or timed out).
+            b += ret;
+          } while (true);
+        }
+
+        return false;
+      }
+
+      inline ssize_t socket::readv(const struct iovec* iov,
+                                   unsigned iovcnt,
+                                   int timeout)
+      {
+        if (!_M_blocking) {
+          return net::sync::socket::readv(iov, iovcnt, timeout);
+        }
+
+        if (prepare_recv(timeout)) {
+          ssize_t ret;
+          if ((ret = net::socket::readv(iov, iovcnt)) < 0) {
+            check_timeout();
+          }
+
+          return ret;
+        }
+
+        return -1;
+      }
+
+      inline bool socket::writev(const struct iovec* iov,
+                                 unsigned iovcnt,
+                                 int timeout)
+      {
+        if (!_M_blocking) {
+          return net::sync::socket::writev(iov, iovcnt, timeout);
+        }
+
+        if (prepare_send(timeout)) {
+          struct msghdr msg;
+          memset(&msg, 0, sizeof(struct msghdr));
+
+          msg.msg_iov = const_cast<struct iovec*>(iov);
+          msg.msg_iovlen = iovcnt;
+
+          return send_message(&msg);
+        }
+
+        return false;
+      }
+
+      inline ssize_t socket::recvmsg(struct msghdr* msg, int timeout)
+      {
+        if (!_M_blocking) {
+          return net::sync::socket::recvmsg(msg, timeout);
+        }
+
+        if (prepare_recv(timeout)) {
+          ssize_t ret;
+          if ((ret = net::socket::recvmsg(msg)) < 0) {
+            check_timeout();
+          }
+
+          return ret;
+        }
+
+        return -1;
+      }
+
+      inline bool socket::sendmsg(const struct msghdr* msg, int timeout)
+      {
+        if (!_M_blocking) {
+          return net::sync::socket::sendmsg(msg, timeout);
+        }
+
+        if (prepare_send(timeout)) {
+          struct msghdr m = *msg;
+          return send_message(&m);
+        }
+
+        return false;
+      }
+
+#if defined(HAVE_SENDFILE)
+      inline bool socket::sendfile(int in_fd,
+                                   off_t& offset,
+                                   size_t count,
+                                   int timeout)
+      {
+        if (!_M_blocking) {
+          return net::sync::socket::sendfile(in_fd, offset, count, timeout);
+        }
+
+        if (prepare_send(timeout)) {
+          do {
+            ssize_t ret;
+            if ((ret = net::socket::sendfile(in_fd, offset, count)) <= 0) {
+              if (ret < 0) {
+                check_timeout();
+              }
+
+              return false;
+            }
+
+            if ((count -= ret) == 0) {
+              return true;
+            }
+          } while (true);
+        }
+
+        return false;
+      }
+#endif // defined(HAVE_SENDFILE)
+
+      template<typename Address>
+      inline bool socket::create_socket(const Address& addr)
+      {
+        reset();
+
+        return net::socket::create(static_cast<socket::domain>(addr.family()),
+                                   socket::type::stream);
+      }
+
+      inline void socket::reset()
+      {
+        _M_blocking = false;
+        _M_recv_timeout = no_timeout;
+        _M_send_timeout = no_timeout;
+      }
+
+      inline bool socket::prepare_recv(int timeout)
+      {
+        if (timeout == 0) {
+          return net::internal::socket::wait_readable(handle(), 0);
+        }
+
+        if (timeout != _M_recv_timeout) {
+          if (!net::internal::socket::set_recv_timeout(handle(), timeout)) {
+            return false;
+          }
+
+          _M_recv_timeout = timeout;
+        }
+
+        return true;
+      }
+
+      inline bool socket::prepare_send(int timeout)
+      {
+        if (timeout == 0) {
+          return net::internal::socket::wait_writable(handle(), 0);
+        }
+
+        if (timeout != _M_send_timeout) {
+          if (!net::internal::socket::set_send_timeout(handle(), timeout)) {
+            return false;
+          }
+
+          _M_send_timeout = timeout;
+        }
+
+        return true;
+      }
+
+      inline bool socket::send_message(struct msghdr* msg)
+      {
+        if (static_cast<size_t>(msg->msg_iovlen) > IOV_MAX) {
+          errno = EINVAL;
+          return false;
+        }
+
+        util::iovec_cursor cursor(msg->msg_iov, msg->msg_iovlen);
+
+        do {
+          cursor.get(*msg);
+
+          ssize_t ret;
+          if ((ret = net::socket::sendmsg(msg)) < 0) {
+            check_timeout();
+            return false;
+          }
+
+          cursor.advance(ret);
+
+          // Partial send (interrupted by a signal or timed out)?
+        } while (!cursor.done());
+
+        return true;
+      }
+
+      inline void socket::check_timeout()
+      {
+        if (errno == EAGAIN) {
+          errno = ETIMEDOUT;
+        }
+      }
     }
   }
 }
@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#include "net/async/event/socket.h"
+#include "net/sync/tcp/socket.h"
+
+// A connection fails its own socket (socket::fail()) from run() or from
+// timeout() and returns true or false. In every case the dispatcher has to
+// close the connection and clear the socket exactly once.
+
+static const char* const address = "127.0.0.1:5303";
+
+static const int idle_timeout = 100; // Milliseconds.
+static const int client_timeout = 2000; // Milliseconds.
+
+// Where and how the connection fails.
+enum class mode {
+  run_true,      // fail() from run(), which returns true.
+  run_false,     // fail() from run(), which returns false.
+  timeout_true,  // fail() from timeout(), which returns true.
+  timeout_false  // fail() from timeout(), which returns false.
+};
+
+static std::atomic<mode> current(mode::run_true);
+static std::atomic<unsigned> ncleared(0);
+
+// Connection.
+class connection : public net::async::event::socket {
+  public:
+    // Constructor.
+    connection()
+      : _M_mode(current.load())
+    {
+    }
+
+    // Clear.
+    void clear()
+    {
+      ncleared++;
+      delete this;
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      switch (_M_mode) {
+        case mode::timeout_true:
+          fail();
+          return true;
+        case mode::timeout_false:
+          fail();
+          return false;
+        default:
+          return false;
+      }
+    }
+
+    // Run.
+    bool run()
+    {
+      // Read the data sent by the client (so that the connection is not
+      // reset when it is closed).
+      uint8_t buf[16];
+      if (recv(buf, sizeof(buf)) <= 0) {
+        return !error();
+      }
+
+      switch (_M_mode) {
+        case mode::run_true:
+          fail();
+          return true;
+        case mode::run_false:
+          fail();
+          return false;
+        default:
+          // Wait for the timeout (the client doesn't send anything).
+          return true;
+      }
+    }
+
+  private:
+    mode _M_mode;
+};
+
+// Acceptor.
+class acceptor : public net::async::event::socket {
+  public:
+    // Constructor.
+    acceptor(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher)
+    {
+    }
+
+    // Clear.
+    void clear()
+    {
+    }
+
+    // Run.
+    bool run()
+    {
+      do {
+        connection* sock;
+        if ((sock = new (std::nothrow) connection()) == nullptr) {
+          return false;
+        }
+
+        if (!accept(*sock, idle_timeout)) {
+          delete sock;
+          return !error();
+        }
+      } while (true);
+    }
+};
+
+static bool test(const net::socket::address& addr,
+                 mode m,
+                 const char* description);
+
+int main()
+{
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  net::async::event::dispatchers dispatchers;
+  if (!dispatchers.start(1)) {
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  acceptor a(dispatchers.get(0));
+  if (!a.listen(addr)) {
+    fprintf(stderr, "Error listening on '%s'.\n", address);
+    return -1;
+  }
+
+  bool ok = test(addr, mode::run_true, "fail() from run(), returns true");
+
+  ok &= test(addr, mode::run_false, "fail() from run(), returns false");
+
+  ok &= test(addr,
+             mode::timeout_true,
+             "fail() from timeout(), returns true");
+
+  ok &= test(addr,
+             mode::timeout_false,
+             "fail() from timeout(), returns false");
+
+  dispatchers.stop();
+
+  return ok ? 0 : -1;
+}
+
+bool test(const net::socket::address& addr, mode m, const char* description)
+{
+  current.store(m);
+
+  unsigned cleared = ncleared.load();
+
+  bool ok = false;
+
+  net::sync::tcp::socket sock;
+  if (sock.connect(addr, client_timeout)) {
+    // Make the connection readable.
+    if (((m == mode::timeout_true) || (m == mode::timeout_false)) ||
+        (sock.send("x", 1, client_timeout))) {
+      // The server has to close the connection.
+      uint8_t buf[16];
+      if (sock.recv(buf, sizeof(buf), client_timeout) == 0) {
+        // Give the dispatcher some time to clear the socket more than once
+        // (it mustn't).
+        usleep(2 * idle_timeout * 1000);
+
+        ok = (ncleared.load() == cleared + 1);
+      }
+    }
+  }
+
+  printf("%s: %s\n", ok ? "OK" : "FAILED", description);
+
+  return ok;
+}
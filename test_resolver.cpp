@@ -0,0 +1,673 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include "net/async/event/dispatchers.h"
+#include "net/dns/resolver.h"
+#include "net/dns/happy_eyeballs.h"
+#include "net/sync/udp/socket.h"
+
+// Resolves names against a stub DNS server running in its own thread and
+// connects to one of them with happy eyeballs. Then a second dispatcher is
+// added and both resolvers share the cache.
+//
+// Stub DNS server (zone "test"):
+//   www.test:      AAAA ::1, A 127.0.0.1 (TTL 60).
+//   v4.test:       A 127.0.0.1, no AAAA records.
+//   brief.test:    A 127.0.0.1 (TTL 1).
+//   servfail.test: server failure.
+//   silent.test:   no response.
+//   Other names:   the name doesn't exist.
+
+static const char* const dns_address = "127.0.0.1:5300";
+static const char* const tcp_address = "127.0.0.1:5301";
+static const in_port_t tcp_port = 5301;
+
+// Minimum age of the first dispatcher when the second one is added
+// (milliseconds).
+static const uint64_t dispatcher_age = 1500;
+
+static std::atomic<unsigned> nqueries(0);
+static std::atomic<bool> running(true);
+
+static void* run_dns_server(void* arg);
+
+class test;
+
+// Connection established by the race.
+class test_connection : public net::dns::connection {
+  public:
+    // Constructor.
+    test_connection(net::async::event::dispatcher* dispatcher)
+      : net::dns::connection(dispatcher)
+    {
+    }
+
+  protected:
+    // Process connection.
+    bool process()
+    {
+      return true;
+    }
+
+    // Connection closed.
+    void closed()
+    {
+      delete this;
+    }
+};
+
+// Race.
+class race : public net::dns::happy_eyeballs {
+  public:
+    // Constructor.
+    race(net::dns::resolver* resolver, test* t)
+      : net::dns::happy_eyeballs(resolver),
+        _M_test(t)
+    {
+    }
+
+  protected:
+    // Create connection.
+    net::dns::connection* create()
+    {
+      return new (std::nothrow) test_connection(get_dispatcher());
+    }
+
+    // Connection established.
+    void connected(net::dns::connection* conn);
+
+    // Race failed.
+    void failed(int error);
+
+  private:
+    test* _M_test;
+};
+
+// Runs the tests from the dispatcher's thread (one per timeout).
+class test : public net::async::event::socket {
+  public:
+    // Constructor.
+    test(net::async::event::dispatcher* dispatcher,
+         net::dns::resolver* resolver)
+      : net::async::event::socket(dispatcher),
+        _M_resolver(resolver),
+        _M_race(resolver, this),
+        _M_step(0),
+        _M_failed(0),
+        _M_done(false)
+    {
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      next();
+      return true;
+    }
+
+    // Run.
+    bool run()
+    {
+      return true;
+    }
+
+    // Done?
+    bool done() const
+    {
+      return _M_done;
+    }
+
+    // Get number of tests which failed.
+    unsigned failed() const
+    {
+      return _M_failed;
+    }
+
+    // Check result.
+    void check(bool ok, const char* description)
+    {
+      printf("%s: %s\n", ok ? "OK" : "FAILED", description);
+
+      if (!ok) {
+        _M_failed++;
+      }
+
+      // Run the next test in the next loop iteration.
+      set_timeout(0);
+    }
+
+  private:
+    net::dns::resolver* _M_resolver;
+    race _M_race;
+
+    unsigned _M_step;
+    unsigned _M_failed;
+    unsigned _M_queries;
+
+    std::atomic<bool> _M_done;
+
+    // Run the next test.
+    void next()
+    {
+      // Wait for the result of the current test.
+      set_timeout(-1);
+
+      switch (_M_step++) {
+        case 0:
+          _M_queries = nqueries;
+          resolve("www.test", net::dns::resolver::family::any, www);
+          break;
+        case 1:
+          _M_queries = nqueries;
+          resolve("WWW.test.", net::dns::resolver::family::any, cached);
+          break;
+        case 2:
+          resolve("v4.test", net::dns::resolver::family::ipv6, no_address);
+          break;
+        case 3:
+          resolve("v4.test", net::dns::resolver::family::any, v4);
+          break;
+        case 4:
+          resolve("missing.test",
+                  net::dns::resolver::family::any,
+                  no_address);
+
+          break;
+        case 5:
+          resolve("servfail.test",
+                  net::dns::resolver::family::ipv4,
+                  server_failure);
+
+          break;
+        case 6:
+          resolve("silent.test",
+                  net::dns::resolver::family::ipv4,
+                  timed_out);
+
+          break;
+        case 7:
+          resolve("static.test", net::dns::resolver::family::any, host);
+          break;
+        case 8:
+          resolve("127.0.0.2", net::dns::resolver::family::any, numeric);
+          break;
+        case 9:
+          // Only IPv4 is listening: the race falls back to 127.0.0.1.
+          if (!_M_race.connect("www.test", tcp_port, 5000)) {
+            check(false, "happy eyeballs (connect)");
+          }
+
+          break;
+        default:
+          _M_done = true;
+      }
+    }
+
+    void resolve(const char* name,
+                 net::dns::resolver::family f,
+                 net::dns::resolver::callback cb)
+    {
+      if (!_M_resolver->resolve(name, f, cb, this)) {
+        check(false, name);
+      }
+    }
+
+    static bool has_address(const net::dns::result& res, const char* addr)
+    {
+      for (size_t i = 0; i < res.naddresses; i++) {
+        char s[INET6_ADDRSTRLEN];
+        if ((inet_ntop(res.addresses[i].family,
+                       &res.addresses[i].ipv4,
+                       s,
+                       sizeof(s))) &&
+            (strcmp(s, addr) == 0)) {
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    static void www(const net::dns::result& res, void* user)
+    {
+      test* t = static_cast<test*>(user);
+
+      t->check((res.error == 0) &&
+               (res.naddresses == 2) &&
+               (res.addresses[0].family == AF_INET6) &&
+               (has_address(res, "::1")) &&
+               (has_address(res, "127.0.0.1")) &&
+               (nqueries == t->_M_queries + 2),
+               "www.test: AAAA and A records");
+    }
+
+    static void cached(const net::dns::result& res, void* user)
+    {
+      test* t = static_cast<test*>(user);
+
+      t->check((res.error == 0) &&
+               (res.naddresses == 2) &&
+               (nqueries == t->_M_queries),
+               "www.test: answer cached");
+    }
+
+    static void no_address(const net::dns::result& res, void* user)
+    {
+      static_cast<test*>(user)->check((res.error == ENOENT) &&
+                                      (res.naddresses == 0),
+                                      "no addresses");
+    }
+
+    static void v4(const net::dns::result& res, void* user)
+    {
+      static_cast<test*>(user)->check((res.error == 0) &&
+                                      (res.naddresses == 1) &&
+                                      (has_address(res, "127.0.0.1")),
+                                      "v4.test: only A records");
+    }
+
+    static void server_failure(const net::dns::result& res, void* user)
+    {
+      static_cast<test*>(user)->check(res.error == EIO,
+                                      "servfail.test: server failure");
+    }
+
+    static void timed_out(const net::dns::result& res, void* user)
+    {
+      static_cast<test*>(user)->check(res.error == ETIMEDOUT,
+                                      "silent.test: timeout");
+    }
+
+    static void host(const net::dns::result& res, void* user)
+    {
+      static_cast<test*>(user)->check((res.error == 0) &&
+                                      (res.naddresses == 1) &&
+                                      (has_address(res, "10.0.0.1")),
+                                      "static.test: hosts table");
+    }
+
+    static void numeric(const net::dns::result& res, void* user)
+    {
+      static_cast<test*>(user)->check((res.error == 0) &&
+                                      (res.naddresses == 1) &&
+                                      (has_address(res, "127.0.0.2")),
+                                      "127.0.0.2: numeric address");
+    }
+};
+
+// Resolves a name (IPv4) from the dispatcher's thread (in the timeout).
+class lookup : public net::async::event::socket {
+  public:
+    // Constructor.
+    lookup(net::async::event::dispatcher* dispatcher,
+           net::dns::resolver* resolver,
+           const char* name)
+      : net::async::event::socket(dispatcher),
+        _M_resolver(resolver),
+        _M_name(name),
+        _M_status(-1),
+        _M_done(false)
+    {
+    }
+
+    // Timeout.
+    bool timeout()
+    {
+      // Wait for the result.
+      set_timeout(-1);
+
+      if (!_M_resolver->resolve(_M_name,
+                                net::dns::resolver::family::ipv4,
+                                resolved,
+                                this)) {
+        _M_done = true;
+      }
+
+      return true;
+    }
+
+    // Run.
+    bool run()
+    {
+      return true;
+    }
+
+    // Done?
+    bool done() const
+    {
+      return _M_done;
+    }
+
+    // Get error of the resolution (-1 if it couldn't be started).
+    int status() const
+    {
+      return _M_status;
+    }
+
+  private:
+    net::dns::resolver* _M_resolver;
+    const char* _M_name;
+
+    int _M_status;
+    std::atomic<bool> _M_done;
+
+    static void resolved(const net::dns::result& res, void* user)
+    {
+      lookup* l = static_cast<lookup*>(user);
+
+      l->_M_status = res.error;
+      l->_M_done = true;
+    }
+};
+
+static bool resolve(lookup& l, unsigned expected_queries, const char* desc);
+
+void race::connected(net::dns::connection* conn)
+{
+  net::socket::address addr;
+  socklen_t addrlen = sizeof(struct sockaddr_storage);
+  bool ipv4 = ((getpeername(conn->handle(), addr, &addrlen) == 0) &&
+               (addr.family() == AF_INET));
+
+  _M_test->check(ipv4, "happy eyeballs: connected over IPv4");
+
+  // Close the connection.
+  conn->set_timeout(0);
+}
+
+void race::failed(int error)
+{
+  errno = error;
+  perror("happy eyeballs");
+
+  _M_test->check(false, "happy eyeballs: connected over IPv4");
+}
+
+int main()
+{
+  net::socket::address dnsaddr;
+  net::socket::address tcpaddr;
+  if ((!dnsaddr.build(dns_address)) || (!tcpaddr.build(tcp_address))) {
+    return -1;
+  }
+
+  // Start the stub DNS server.
+  net::sync::udp::socket dns;
+  if ((!dns.create(net::socket::domain::ipv4)) || (!dns.bind(dnsaddr))) {
+    fprintf(stderr, "Error binding to '%s'.\n", dns_address);
+    return -1;
+  }
+
+  pthread_t thread;
+  if (pthread_create(&thread, nullptr, run_dns_server, &dns) != 0) {
+    return -1;
+  }
+
+  // TCP server (only IPv4) for happy eyeballs.
+  net::socket listener;
+  if ((!listener.create(net::socket::domain::ipv4,
+                        net::socket::type::stream)) ||
+      (!listener.bind(tcpaddr)) ||
+      (!listener.listen())) {
+    fprintf(stderr, "Error listening on '%s'.\n", tcp_address);
+    return -1;
+  }
+
+  net::async::event::dispatchers::config dispatchers_config;
+  dispatchers_config.max_dispatchers = 2;
+
+  net::async::event::dispatchers dispatchers;
+  if (!dispatchers.start(1, dispatchers_config)) {
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  uint64_t started = net::dns::cache::now();
+
+  net::dns::cache cache;
+  if (!cache.create()) {
+    return -1;
+  }
+
+  // Resolver using only the stub DNS server.
+  net::dns::resolver resolver(dispatchers.get(0));
+
+  net::dns::resolver::config config;
+  config.resolv_conf = nullptr;
+  config.hosts = nullptr;
+  config.timeout = 200;
+  config.attempts = 2;
+  config.cache = &cache;
+
+  net::dns::ip_address host;
+  host.family = AF_INET;
+  inet_pton(AF_INET, "10.0.0.1", &host.ipv4);
+
+  if ((!resolver.add_nameserver(dnsaddr)) ||
+      (!resolver.create(config)) ||
+      (!resolver.add_host("static.test", host))) {
+    fprintf(stderr, "Error creating resolver.\n");
+    return -1;
+  }
+
+  // The tests are run from the socket's timeout.
+  net::socket::address addr;
+  addr.build("127.0.0.1", 0);
+
+  test t(dispatchers.get(0), &resolver);
+  if (!t.bind(addr, 0)) {
+    return -1;
+  }
+
+  for (unsigned i = 0; (i < 100) && (!t.done()); i++) {
+    usleep(100 * 1000);
+  }
+
+  bool ok = t.done();
+  if (!ok) {
+    printf("FAILED: tests didn't finish\n");
+  }
+
+  // The clock of a dispatcher counts from the time it was started: add a
+  // second dispatcher (with its own resolver) later, so that both clocks
+  // differ by more than the TTL of brief.test.
+  uint64_t now = net::dns::cache::now();
+  if (now < started + dispatcher_age) {
+    usleep((started + dispatcher_age - now) * 1000);
+  }
+
+  net::async::event::dispatcher* dispatcher;
+  if ((ok) && ((dispatcher = dispatchers.add()) != nullptr)) {
+    net::dns::resolver resolver2(dispatcher);
+    if ((resolver2.add_nameserver(dnsaddr)) && (resolver2.create(config))) {
+      // Cached by the new dispatcher, found by the old one.
+      lookup l1(dispatcher, &resolver2, "brief.test");
+      lookup l2(dispatchers.get(0), &resolver, "brief.test");
+
+      ok &= resolve(l1, 1, "brief.test: resolved by the second dispatcher");
+
+      ok &= resolve(l2,
+                    0,
+                    "brief.test: cached answer shared with the first "
+                    "dispatcher");
+
+      // Expired for the new dispatcher too.
+      usleep(1200 * 1000);
+
+      lookup l3(dispatcher, &resolver2, "brief.test");
+      ok &= resolve(l3, 1, "brief.test: cached answer expired (TTL)");
+
+      dispatchers.stop();
+    } else {
+      fprintf(stderr, "Error creating resolver.\n");
+      ok = false;
+    }
+  } else {
+    ok = false;
+  }
+
+  dispatchers.stop();
+
+  running = false;
+  pthread_join(thread, nullptr);
+
+  return ((ok) && (t.failed() == 0)) ? 0 : -1;
+}
+
+bool resolve(lookup& l, unsigned expected_queries, const char* desc)
+{
+  unsigned queries = nqueries;
+
+  net::socket::address addr;
+  addr.build("127.0.0.1", 0);
+
+  bool ok = false;
+  if (l.bind(addr, 0)) {
+    for (unsigned i = 0; (i < 50) && (!l.done()); i++) {
+      usleep(20 * 1000);
+    }
+
+    ok = ((l.done()) &&
+          (l.status() == 0) &&
+          (nqueries == queries + expected_queries));
+  }
+
+  printf("%s: %s\n", ok ? "OK" : "FAILED", desc);
+
+  return ok;
+}
+
+// Append 16-bit value.
+static uint8_t* put16(uint8_t* p, uint16_t n)
+{
+  *p++ = static_cast<uint8_t>(n >> 8);
+  *p++ = static_cast<uint8_t>(n);
+
+  return p;
+}
+
+// Append record (the name is a pointer to the question).
+static uint8_t* put_record(uint8_t* p,
+                           uint16_t type,
+                           uint32_t ttl,
+                           const void* data,
+                           uint16_t len)
+{
+  p = put16(p, 0xc00c);
+  p = put16(p, type);
+  p = put16(p, 1);
+  p = put16(p, static_cast<uint16_t>(ttl >> 16));
+  p = put16(p, static_cast<uint16_t>(ttl));
+  p = put16(p, len);
+
+  memcpy(p, data, len);
+
+  return p + len;
+}
+
+void* run_dns_server(void* arg)
+{
+  net::sync::udp::socket* sock = static_cast<net::sync::udp::socket*>(arg);
+
+  while (running) {
+    uint8_t buf[net::dns::max_message_size];
+    net::socket::address addr;
+
+    ssize_t ret;
+    if ((ret = sock->recvfrom(buf, sizeof(buf), addr, 100)) < 12) {
+      continue;
+    }
+
+    nqueries++;
+
+    // Question name.
+    char name[256];
+    size_t n = 0;
+    size_t off = 12;
+    while ((off < static_cast<size_t>(ret)) && (buf[off] != 0)) {
+      uint8_t l = buf[off];
+      if ((off + 1 + l >= static_cast<size_t>(ret)) || (n + l + 1 >= 256)) {
+        break;
+      }
+
+      if (n > 0) {
+        name[n++] = '.';
+      }
+
+      memcpy(name + n, buf + off + 1, l);
+      n += l;
+      off += 1 + l;
+    }
+
+    name[n] = 0;
+
+    if (off + 5 > static_cast<size_t>(ret)) {
+      continue;
+    }
+
+    uint16_t qtype = (buf[off + 1] << 8) | buf[off + 2];
+    off += 5;
+
+    if (strcasecmp(name, "silent.test") == 0) {
+      continue;
+    }
+
+    // Response: header and question.
+    uint8_t* p = buf + off;
+    unsigned ancount = 0;
+    unsigned nscount = 0;
+    uint8_t rcode = 0;
+
+    if (strcasecmp(name, "servfail.test") == 0) {
+      rcode = net::dns::rcode_server_failure;
+    } else if ((strcasecmp(name, "www.test") == 0) ||
+               (strcasecmp(name, "v4.test") == 0) ||
+               (strcasecmp(name, "brief.test") == 0)) {
+      struct in_addr ipv4;
+      struct in6_addr ipv6;
+      inet_pton(AF_INET, "127.0.0.1", &ipv4);
+      inet_pton(AF_INET6, "::1", &ipv6);
+
+      if (qtype == net::dns::type_a) {
+        uint32_t ttl = (strcasecmp(name, "brief.test") == 0) ? 1 : 60;
+        p = put_record(p, net::dns::type_a, ttl, &ipv4, sizeof(ipv4));
+        ancount++;
+      } else if ((qtype == net::dns::type_aaaa) &&
+                 (strcasecmp(name, "www.test") == 0)) {
+        p = put_record(p, net::dns::type_aaaa, 60, &ipv6, sizeof(ipv6));
+        ancount++;
+      }
+    } else {
+      rcode = net::dns::rcode_name_error;
+    }
+
+    // Negative answer: SOA record (TTL 30).
+    if (ancount == 0) {
+      uint8_t soa[] = {
+        0, 0,                   // MNAME, RNAME (root).
+        0, 0, 0, 1,             // SERIAL.
+        0, 0, 0x0e, 0x10,       // REFRESH.
+        0, 0, 0x0e, 0x10,       // RETRY.
+        0, 0, 0x0e, 0x10,       // EXPIRE.
+        0, 0, 0, 30             // MINIMUM.
+      };
+
+      p = put_record(p, net::dns::type_soa, 30, soa, sizeof(soa));
+      nscount++;
+    }
+
+    buf[2] = 0x81;
+    buf[3] = 0x80 | rcode;
+    put16(buf + 6, ancount);
+    put16(buf + 8, nscount);
+    put16(buf + 10, 0);
+
+    sock->sendto(buf, p - buf, addr, 1000);
+  }
+
+  return nullptr;
+}
@@ -0,0 +1,365 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#include "net/async/event/socket.h"
+#include "net/async/event/handoff.h"
+
+// Restarts an echo server while a client opens a connection after another
+// and counts the connections which are refused or fail.
+// With "--mode handoff" (default), the new server process receives the
+// listening socket from the old one (net::async::event::handoff) and the old
+// one drains its connections; with "--mode cold", the old server is stopped
+// and the new one listens on a new socket.
+
+static const char* const address = "127.0.0.1";
+static const in_port_t port = 5302;
+static const char* const control = "/tmp/test_restart.sock";
+
+static const int connection_timeout = 30 * 1000; // Milliseconds.
+static const unsigned drain_timeout = 5000; // Milliseconds.
+
+// Echo connection.
+class echo_connection : public net::async::event::socket {
+  public:
+    // Constructor.
+    echo_connection()
+      : _M_begin(0),
+        _M_end(0)
+    {
+    }
+
+    // Clear.
+    void clear()
+    {
+      delete this;
+    }
+
+    // Run.
+    bool run()
+    {
+      do {
+        // Send pending data.
+        if (_M_begin < _M_end) {
+          ssize_t ret;
+          if ((ret = send(_M_buf + _M_begin, _M_end - _M_begin)) > 0) {
+            if ((_M_begin += ret) < _M_end) {
+              return true;
+            }
+
+            _M_begin = 0;
+            _M_end = 0;
+          } else {
+            return !error();
+          }
+        }
+
+        if (!readable()) {
+          return true;
+        }
+
+        // Receive.
+        ssize_t ret;
+        if ((ret = recv(_M_buf, sizeof(_M_buf))) > 0) {
+          _M_end = ret;
+        } else if (ret == 0) {
+          // Connection closed by peer.
+          return false;
+        } else {
+          return !error();
+        }
+      } while (true);
+    }
+
+  private:
+    uint8_t _M_buf[1024];
+    size_t _M_begin;
+    size_t _M_end;
+};
+
+// Echo server.
+// Once the listening socket has been handed off, the dispatcher is drained:
+// the acceptor is closed and the connections are given some time to finish.
+class acceptor : public net::async::event::socket {
+  public:
+    // Constructor.
+    acceptor(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher)
+    {
+    }
+
+    // Clear.
+    void clear()
+    {
+    }
+
+    // Run.
+    bool run()
+    {
+      do {
+        echo_connection* sock;
+        if ((sock = new (std::nothrow) echo_connection()) == nullptr) {
+          return false;
+        }
+
+        if (!accept(*sock, connection_timeout)) {
+          delete sock;
+          return !error();
+        }
+      } while (true);
+    }
+};
+
+// Client counters.
+struct counters {
+  uint64_t ok;
+  uint64_t refused;
+  uint64_t failed;
+};
+
+static std::atomic<bool> running(true);
+
+static int server(bool old, bool cold);
+static void* run_client(void* arg);
+static pid_t spawn(const char* program, const char* role, bool cold);
+static bool wait_listening(const net::socket::address& addr);
+static uint64_t now();
+
+int main(int argc, const char** argv)
+{
+  bool cold = false;
+  unsigned duration = 500; // Milliseconds before and after the restart.
+
+  int i = 1;
+  while (i < argc) {
+    if (strcmp(argv[i], "--server") == 0) {
+      // Server process.
+      if (i + 1 < argc) {
+        return server(strcmp(argv[i + 1], "old") == 0,
+                      (i + 2 < argc) && (strcmp(argv[i + 2], "cold") == 0));
+      }
+
+      return -1;
+    } else if ((strcmp(argv[i], "--mode") == 0) && (i + 1 < argc)) {
+      if (strcmp(argv[i + 1], "cold") == 0) {
+        cold = true;
+      } else if (strcmp(argv[i + 1], "handoff") != 0) {
+        fprintf(stderr, "Usage: %s [--mode handoff|cold] [--duration ms]\n",
+                argv[0]);
+
+        return -1;
+      }
+
+      i += 2;
+    } else if ((strcmp(argv[i], "--duration") == 0) && (i + 1 < argc)) {
+      duration = static_cast<unsigned>(atoi(argv[i + 1]));
+      i += 2;
+    } else {
+      fprintf(stderr, "Usage: %s [--mode handoff|cold] [--duration ms]\n",
+              argv[0]);
+
+      return -1;
+    }
+  }
+
+  net::socket::address addr;
+  if (!addr.build(address, port)) {
+    return -1;
+  }
+
+  // Start the old server.
+  pid_t old;
+  if (((old = spawn(argv[0], "old", cold)) == -1) ||
+      (!wait_listening(addr))) {
+    fprintf(stderr, "Error starting the old server.\n");
+    return -1;
+  }
+
+  // Start the client.
+  counters c = {0, 0, 0};
+
+  pthread_t thread;
+  if (pthread_create(&thread, nullptr, run_client, &c) != 0) {
+    kill(old, SIGKILL);
+    return -1;
+  }
+
+  usleep(duration * 1000);
+
+  // Restart.
+  uint64_t start = now();
+
+  if (cold) {
+    kill(old, SIGTERM);
+    waitpid(old, nullptr, 0);
+  }
+
+  pid_t young = spawn(argv[0], "new", cold);
+
+  if (!cold) {
+    waitpid(old, nullptr, 0);
+  }
+
+  printf("Old server exited after %llu ms.\n",
+         static_cast<unsigned long long>((now() - start) / 1000000ull));
+
+  usleep(duration * 1000);
+
+  running = false;
+  pthread_join(thread, nullptr);
+
+  if (young != -1) {
+    kill(young, SIGTERM);
+    waitpid(young, nullptr, 0);
+  }
+
+  printf("Mode: %s\n", cold ? "cold" : "handoff");
+  printf("Connections: %llu\n",
+         static_cast<unsigned long long>(c.ok + c.refused + c.failed));
+
+  printf("Refused: %llu\n", static_cast<unsigned long long>(c.refused));
+  printf("Failed: %llu\n", static_cast<unsigned long long>(c.failed));
+
+  return ((young != -1) && ((cold) || (c.refused + c.failed == 0))) ? 0 : -1;
+}
+
+int server(bool old, bool cold)
+{
+  net::socket::address addr;
+  net::socket::address::local ctrl;
+  if ((!addr.build(address, port)) || (!ctrl.build(control))) {
+    return -1;
+  }
+
+  net::async::event::dispatchers dispatchers;
+  if (!dispatchers.start(1)) {
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  acceptor listener(dispatchers.get(0));
+  net::async::event::handoff handoff;
+
+  if ((old) || (cold)) {
+    if (!listener.listen(addr)) {
+      fprintf(stderr, "Error listening on %s:%u.\n", address, port);
+      return -1;
+    }
+
+    if (cold) {
+      pause();
+      return 0;
+    }
+
+    // Wait for the new server.
+    if ((!handoff.listen(ctrl)) ||
+        (!handoff.add(listener.handle())) ||
+        (!handoff.send())) {
+      perror("handoff");
+      return -1;
+    }
+
+    // Stop accepting and drain the connections.
+    dispatchers.stop(drain_timeout);
+
+    return 0;
+  }
+
+  // Take over the listening socket of the old server.
+  net::socket::handle_t handle;
+  if ((!handoff.receive(ctrl, 5000)) ||
+      ((handle = handoff.take(addr)) == net::socket::invalid_handle) ||
+      (!listener.attach(handle)) ||
+      (!handoff.acknowledge(5000))) {
+    perror("handoff");
+    return -1;
+  }
+
+  pause();
+
+  return 0;
+}
+
+void* run_client(void* arg)
+{
+  counters* c = static_cast<counters*>(arg);
+
+  net::socket::address addr;
+  addr.build(address, port);
+
+  while (running) {
+    net::socket sock;
+    if (!sock.create(net::socket::domain::ipv4, net::socket::type::stream)) {
+      c->failed++;
+      continue;
+    }
+
+    uint8_t buf[8] = {'p', 'i', 'n', 'g', 0, 0, 0, 0};
+    if (sock.connect(addr, 1000)) {
+      if ((sock.send(buf, 4, 1000)) && (sock.recv(buf + 4, 4, 1000) == 4)) {
+        c->ok++;
+      } else {
+        c->failed++;
+      }
+    } else if (errno == ECONNREFUSED) {
+      c->refused++;
+    } else {
+      c->failed++;
+    }
+  }
+
+  return nullptr;
+}
+
+pid_t spawn(const char* program, const char* role, bool cold)
+{
+  pid_t pid;
+  if ((pid = fork()) == 0) {
+    // Don't inherit the sockets of the client.
+    for (int fd = sysconf(_SC_OPEN_MAX) - 1; fd > STDERR_FILENO; fd--) {
+      close(fd);
+    }
+
+    execl(program,
+          program,
+          "--server",
+          role,
+          cold ? "cold" : "handoff",
+          static_cast<const char*>(nullptr));
+
+    _exit(127);
+  }
+
+  return pid;
+}
+
+bool wait_listening(const net::socket::address& addr)
+{
+  for (unsigned i = 0; i < 500; i++) {
+    net::socket sock;
+    if ((sock.create(net::socket::domain::ipv4, net::socket::type::stream)) &&
+        (sock.connect(addr, 1000))) {
+      return true;
+    }
+
+    usleep(10 * 1000);
+  }
+
+  return false;
+}
+
+uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
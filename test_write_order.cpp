@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <new>
+#include "net/async/event/dispatchers.h"
+#include "net/async/event/socket.h"
+#include "net/sync/tcp/socket.h"
+#include "util/iovec_cursor.h"
+
+// A connection with write coalescing enabled sends numbered records with
+// send() (through the write buffer) mixed with writev(), sendmsg() and
+// writev(cursor) (directly). The client waits before reading, so that the
+// send buffer fills up and the writes fail with EAGAIN or are partial. The
+// records have to arrive in order.
+
+static const char* const address = "127.0.0.1:5304";
+
+static const unsigned nrecords = 500000;
+static const size_t record_size = 8;
+
+static const int timeout = 10 * 1000; // Milliseconds.
+
+// Connection.
+class connection : public net::async::event::socket {
+  public:
+    // Constructor.
+    connection()
+      : _M_record(0),
+        _M_offset(0)
+    {
+    }
+
+    // Clear.
+    void clear()
+    {
+      delete this;
+    }
+
+    // Run.
+    bool run()
+    {
+      while (_M_record < nrecords) {
+        char record[record_size + 1];
+        snprintf(record, sizeof(record), "%07u\n", _M_record);
+
+        const char* b = record + _M_offset;
+        size_t len = record_size - _M_offset;
+
+        // Split the record in two buffers.
+        struct iovec iov[2];
+        iov[0].iov_base = const_cast<char*>(b);
+        iov[0].iov_len = len / 2;
+        iov[1].iov_base = const_cast<char*>(b) + (len / 2);
+        iov[1].iov_len = len - (len / 2);
+
+        ssize_t ret;
+        switch (_M_record % 4) {
+          case 0:
+            ret = send(b, len);
+            break;
+          case 1:
+            ret = writev(iov, 2);
+            break;
+          case 2:
+            {
+              struct msghdr msg;
+              memset(&msg, 0, sizeof(struct msghdr));
+
+              msg.msg_iov = iov;
+              msg.msg_iovlen = 2;
+
+              ret = sendmsg(&msg);
+            }
+
+            break;
+          default:
+            {
+              util::iovec_cursor cursor(iov, 2);
+              ret = writev(cursor);
+            }
+        }
+
+        if (ret > 0) {
+          if ((_M_offset += ret) == record_size) {
+            _M_record++;
+            _M_offset = 0;
+          }
+        } else {
+          // Wait until the socket is writable.
+          return !error();
+        }
+      }
+
+      return true;
+    }
+
+  private:
+    unsigned _M_record;
+    size_t _M_offset;
+};
+
+// Acceptor.
+class acceptor : public net::async::event::socket {
+  public:
+    // Constructor.
+    acceptor(net::async::event::dispatcher* dispatcher)
+      : net::async::event::socket(dispatcher)
+    {
+    }
+
+    // Clear.
+    void clear()
+    {
+    }
+
+    // Run.
+    bool run()
+    {
+      do {
+        connection* sock;
+        if ((sock = new (std::nothrow) connection()) == nullptr) {
+          return false;
+        }
+
+        if ((!sock->enable_write_coalescing()) || (!accept(*sock))) {
+          delete sock;
+          return !error();
+        }
+      } while (true);
+    }
+};
+
+int main()
+{
+  net::socket::address addr;
+  if (!addr.build(address)) {
+    fprintf(stderr, "Invalid address '%s'.\n", address);
+    return -1;
+  }
+
+  net::async::event::dispatchers dispatchers;
+  if (!dispatchers.start(1)) {
+    fprintf(stderr, "Error starting dispatchers.\n");
+    return -1;
+  }
+
+  acceptor a(dispatchers.get(0));
+  if (!a.listen(addr)) {
+    fprintf(stderr, "Error listening on '%s'.\n", address);
+    return -1;
+  }
+
+  static char buf[nrecords * record_size];
+  size_t received = 0;
+
+  net::sync::tcp::socket sock;
+  if (sock.connect(addr, timeout)) {
+    // Let the send buffer fill up.
+    usleep(100 * 1000);
+
+    while (received < sizeof(buf)) {
+      ssize_t ret;
+      if ((ret = sock.recv(buf + received,
+                           sizeof(buf) - received,
+                           timeout)) <= 0) {
+        break;
+      }
+
+      received += ret;
+    }
+  }
+
+  dispatchers.stop();
+
+  bool ok = (received == sizeof(buf));
+
+  for (unsigned i = 0; (ok) && (i < nrecords); i++) {
+    char record[record_size + 1];
+    snprintf(record, sizeof(record), "%07u\n", i);
+
+    ok = (memcmp(buf + (i * record_size), record, record_size) == 0);
+  }
+
+  printf("%s: send() mixed with writev() and sendmsg() keeps the order\n",
+         ok ? "OK" : "FAILED");
+
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,126 @@
+#ifndef UTIL_IOVEC_CURSOR_H
+#define UTIL_IOVEC_CURSOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+namespace util {
+  // Cursor over a vector of buffers which is sent with partial writes.
+  // The vector of the caller is not copied nor modified: the cursor skips
+  // the buffers which have been sent and, if the first buffer left has been
+  // sent partially, only the rest of that buffer is sent next (the
+  // following buffers are sent from the caller's vector afterwards).
+  class iovec_cursor {
+    public:
+      // Constructor.
+      iovec_cursor();
+      iovec_cursor(const struct iovec* iov, size_t iovcnt);
+
+      // Set vector.
+      void set(const struct iovec* iov, size_t iovcnt);
+
+      // Get number of bytes left.
+      size_t left() const;
+
+      // Has everything been sent?
+      bool done() const;
+
+      // Has the first buffer left been sent partially? If so, get() only
+      // returns the rest of that buffer.
+      bool partial() const;
+
+      // Set the buffers to be sent next in 'msg' (msg_iov and msg_iovlen).
+      void get(struct msghdr& msg);
+
+      // Advance 'n' bytes (sent).
+      void advance(size_t n);
+
+    private:
+      const struct iovec* _M_iov;
+      size_t _M_iovcnt;
+
+      // Bytes of the first buffer already sent.
+      size_t _M_offset;
+
+      size_t _M_left;
+
+      // Rest of the first buffer.
+      struct iovec _M_rest;
+  };
+
+  inline iovec_cursor::iovec_cursor()
+    : _M_iov(nullptr),
+      _M_iovcnt(0),
+      _M_offset(0),
+      _M_left(0)
+  {
+  }
+
+  inline iovec_cursor::iovec_cursor(const struct iovec* iov, size_t iovcnt)
+  {
+    set(iov, iovcnt);
+  }
+
+  inline void iovec_cursor::set(const struct iovec* iov, size_t iovcnt)
+  {
+    _M_iov = iov;
+    _M_iovcnt = iovcnt;
+    _M_offset = 0;
+
+    _M_left = 0;
+    for (size_t i = 0; i < iovcnt; i++) {
+      _M_left += iov[i].iov_len;
+    }
+  }
+
+  inline size_t iovec_cursor::left() const
+  {
+    return _M_left;
+  }
+
+  inline bool iovec_cursor::done() const
+  {
+    return (_M_left == 0);
+  }
+
+  inline bool iovec_cursor::partial() const
+  {
+    return (_M_offset != 0);
+  }
+
+  inline void iovec_cursor::get(struct msghdr& msg)
+  {
+    if (_M_offset == 0) {
+      msg.msg_iov = const_cast<struct iovec*>(_M_iov);
+      msg.msg_iovlen = _M_iovcnt;
+    } else {
+      _M_rest.iov_base = static_cast<uint8_t*>(_M_iov->iov_base) + _M_offset;
+      _M_rest.iov_len = _M_iov->iov_len - _M_offset;
+
+      msg.msg_iov = &_M_rest;
+      msg.msg_iovlen = 1;
+    }
+  }
+
+  inline void iovec_cursor::advance(size_t n)
+  {
+    _M_left -= n;
+
+    n += _M_offset;
+
+    // Skip the buffers which have been sent completely.
+    while ((_M_iovcnt > 0) && (n >= _M_iov->iov_len)) {
+      n -= _M_iov->iov_len;
+
+      _M_iov++;
+      _M_iovcnt--;
+    }
+
+    _M_offset = n;
+  }
+}
+
+#endif // UTIL_IOVEC_CURSOR_H